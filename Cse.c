@@ -0,0 +1,400 @@
+#include "Cse.h"
+
+/** @struct Cse_value
+ * A value number: how a value on the stack was made.
+ */
+typedef struct {
+	char op[MACHINE_NAME_LEN]; ///< The instruction that made it, or "?" for a value that matches nothing.
+	char *arg; ///< The operand of a pushi or addi.
+	int a; ///< Value number of the first operand.
+	int b; ///< Value number of the second operand.
+} Cse_value;
+
+/** @struct Cse_slot
+ * One entry of the simulated stack.
+ */
+typedef struct {
+	int vn; ///< The value number of the entry.
+	int start; ///< The first line of the side effect free code that computes it, or -1 if there is none.
+} Cse_slot;
+
+/** @struct Cse_event
+ * A point where side effect free code finished computing a value.
+ */
+typedef struct {
+	int start; ///< First line of the code.
+	int end; ///< Last line of the code.
+	int vn; ///< The value it computed.
+	int cycles; ///< What the code costs.
+	int holder; ///< Interned name of a variable already holding the value, or -1.
+	int temp; ///< Interned name of the temporary it is loaded from instead, once chosen, or -1.
+	int save; ///< 1 if the value is stored to a temporary after the code.
+} Cse_event;
+
+/** @struct Cse_block
+ * The state of local value numbering within one basic block.
+ */
+typedef struct {
+	Cse_value *values; ///< Every value number handed out in the block.
+	int value_ct; ///< Number of value numbers.
+	Cse_slot *stack; ///< The simulated stack.
+	int depth; ///< Number of entries on the simulated stack.
+	Symbol_table memory; ///< Maps each variable to the value number it holds, when known.
+	Cse_event *events; ///< The values computed in the block.
+	int event_ct; ///< Number of events.
+	int last_impure; ///< The last line in the block with a side effect.
+} Cse_block;
+
+/**
+ * Finds or hands out the value number of an operation.
+ *
+ * @param block The block being numbered.
+ * @param op The instruction, or "?" for a fresh number that matches nothing.
+ * @param arg The instruction's operand, or NULL.
+ * @param a Value number of the first operand, or -1.
+ * @param b Value number of the second operand, or -1.
+ * @return The value number.
+ */
+static int value_number(Cse_block *block, char *op, char *arg, int a, int b) {
+	if(strcmp(op, "add") == 0 && a > b) { //a + b and b + a are the same value
+		int swap = a;
+
+		a = b;
+		b = swap;
+	}
+
+	if(strcmp(op, "?") != 0)
+		for(int i = 0; i < block->value_ct; i++) {
+			Cse_value *value = &block->values[i];
+
+			if(strcmp(value->op, op) == 0 && value->a == a && value->b == b
+					&& (arg == NULL ? value->arg == NULL : value->arg != NULL && strcmp(value->arg, arg) == 0))
+				return i;
+		}
+
+	block->values = (Cse_value *)realloc(block->values, (block->value_ct + 1) * sizeof(Cse_value));
+	Cse_value *value = &block->values[block->value_ct];
+
+	strncpy(value->op, op, MACHINE_NAME_LEN - 1);
+	value->op[MACHINE_NAME_LEN - 1] = '\0';
+	value->arg = arg;
+	value->a = a;
+	value->b = b;
+
+	return block->value_ct++;
+}
+
+/**
+ * Returns the variable whose address a value is, or NULL if it is a constant or computed.
+ */
+static char * value_address(Cse_block *block, int vn) {
+	Cse_value *value = &block->values[vn];
+
+	if(strcmp(value->op, "pushi") != 0 || value->arg == NULL || machine_is_constant(value->arg))
+		return NULL;
+
+	return value->arg;
+}
+
+/**
+ * Takes the top entry off the simulated stack. Below the start of the block, entries are unknown.
+ */
+static Cse_slot stack_pop(Cse_block *block) {
+	if(block->depth == 0)
+		return (Cse_slot){value_number(block, "?", NULL, -1, -1), -1};
+
+	return block->stack[--block->depth];
+}
+
+/**
+ * Puts an entry on the simulated stack.
+ */
+static void stack_push(Cse_block *block, int vn, int start) {
+	block->stack = (Cse_slot *)realloc(block->stack, (block->depth + 1) * sizeof(Cse_slot));
+	block->stack[block->depth++] = (Cse_slot){vn, start};
+}
+
+/**
+ * Returns the interned name of a variable that holds a value, or -1 if none is known to.
+ */
+static int find_holder(Cse_block *block, int vn) {
+	for(int i = 0; i < block->memory.capacity; i++)
+		if(block->memory.slots[i].hash != 0 && block->memory.slots[i].addr == vn)
+			return block->memory.slots[i].key;
+
+	return -1;
+}
+
+/**
+ * Returns 1 if the lines from start to end overlap any event already chosen to be replaced or
+ * any point a temporary is saved at, 0 otherwise.
+ */
+static int overlaps_chosen(Cse_block *block, int start, int end) {
+	for(int i = 0; i < block->event_ct; i++) {
+		Cse_event *event = &block->events[i];
+
+		if((event->holder >= 0 || event->temp >= 0) && !event->save && start <= event->end && event->start <= end)
+			return 1;
+		if(event->save && start <= event->end && event->end <= end)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Orders events from the longest code to the shortest, so bigger savings are chosen first.
+ */
+static int compare_events(const void *a, const void *b) {
+	const Cse_event *x = (const Cse_event *)a;
+	const Cse_event *y = (const Cse_event *)b;
+
+	if(x->end - x->start != y->end - y->start)
+		return (y->end - y->start) - (x->end - x->start);
+
+	return x->start - y->start;
+}
+
+/**
+ * Numbers the values of one basic block and notes each value computed by side effect free code.
+ *
+ * @param block The block's state, empty.
+ * @param prog The program.
+ * @param machine The machine description, for the cost of each instruction.
+ * @param first The first line of the block.
+ * @param last The last line of the block.
+ */
+static void number_block(Cse_block *block, Program *prog, Machine *machine, int first, int last) {
+	block->last_impure = first - 1;
+
+	for(int i = first; i <= last; i++) {
+		Asm_line *line = &prog->lines[i];
+
+		if(line->kind != ASM_INST)
+			continue;
+
+		Machine_inst *inst = machine_inst(machine, line->op);
+		Cse_slot result = {-1, -1};
+
+		if(program_is(line, "pushi")) {
+			result = (Cse_slot){value_number(block, "pushi", line->arg, -1, -1), i};
+		} else if(program_is(line, "push")) {
+			Cse_slot addr = stack_pop(block);
+			char *var = value_address(block, addr.vn);
+			int held = var == NULL ? -1 : symbol_table_contains(&block->memory, var);
+
+			if(held < 0) { //Unknown until now, so it gets a fresh number
+				held = value_number(block, "?", NULL, -1, -1);
+				if(var != NULL)
+					symbol_table_add(&block->memory, var, held);
+			}
+
+			result = (Cse_slot){held, addr.start};
+		} else if(program_is(line, "pop")) {
+			Cse_slot addr = stack_pop(block);
+			Cse_slot value = stack_pop(block);
+			char *var = value_address(block, addr.vn);
+
+			if(var != NULL) {
+				symbol_table_add(&block->memory, var, value.vn);
+			} else { //Stored through a computed address, so nothing in memory is known any more
+				symbol_table_free(&block->memory);
+				symbol_table_init(&block->memory);
+			}
+			block->last_impure = i;
+		} else if(inst != NULL && inst->pops == 2 && inst->pushes == 1 && inst->operand == OPERAND_NONE) { //add, sub, slt
+			Cse_slot b = stack_pop(block);
+			Cse_slot a = stack_pop(block);
+			int pure = a.start >= 0 && b.start >= 0 && a.start > block->last_impure;
+
+			result = (Cse_slot){value_number(block, line->op, NULL, a.vn, b.vn), pure ? a.start : -1};
+		} else if(inst != NULL && inst->pops == 1 && inst->pushes == 1 && inst->operand == OPERAND_IMM) { //addi
+			Cse_slot a = stack_pop(block);
+
+			result = (Cse_slot){value_number(block, line->op, line->arg, a.vn, -1), a.start};
+		} else { //Branches, jumps and anything unknown
+			for(int j = 0; inst != NULL && j < inst->pops; j++)
+				stack_pop(block);
+			for(int j = 0; inst != NULL && j < inst->pushes; j++)
+				stack_push(block, value_number(block, "?", NULL, -1, -1), -1);
+			if(program_is(line, "jpush") || inst == NULL) {
+				symbol_table_free(&block->memory);
+				symbol_table_init(&block->memory);
+			}
+			block->last_impure = i;
+		}
+
+		if(result.vn < 0)
+			continue;
+
+		stack_push(block, result.vn, result.start);
+
+		if(result.start < 0 || result.start == i)
+			continue;
+
+		Cse_event event = {result.start, i, result.vn, 0, find_holder(block, result.vn), -1, 0};
+
+		for(int j = result.start; j <= i; j++) {
+			inst = prog->lines[j].kind == ASM_INST ? machine_inst(machine, prog->lines[j].op) : NULL;
+			if(inst != NULL)
+				event.cycles += inst->cycles;
+		}
+
+		block->events = (Cse_event *)realloc(block->events, (block->event_ct + 1) * sizeof(Cse_event));
+		block->events[block->event_ct++] = event;
+	}
+}
+
+/**
+ * Picks which values of a block are loaded from memory instead of computed again.
+ * A value already held by a variable is loaded from it. A value computed more than once that no
+ * variable holds is stored to a temporary the first time, when that pays for itself.
+ *
+ * @param block The numbered block.
+ * @param machine The machine description, for costs.
+ * @param func The function's name, to name temporaries after.
+ * @param decls_file Where temporaries are declared.
+ * @param stats Counts the temporaries declared.
+ */
+static void choose_block(Cse_block *block, Machine *machine, char *func, FILE *decls_file, Cse_stats *stats) {
+	int load = machine_cycles(machine, "pushi push");
+	int save = machine_cycles(machine, "pushi pop pushi push");
+
+	if(block->event_ct > 0) //No events leaves the array NULL
+		qsort(block->events, block->event_ct, sizeof(Cse_event), compare_events);
+
+	int *holders = (int *)malloc((block->event_ct + 1) * sizeof(int));
+
+	for(int i = 0; i < block->event_ct; i++) {
+		holders[i] = block->events[i].holder;
+		block->events[i].holder = -1;
+	}
+
+	for(int i = 0; i < block->event_ct; i++) //Values a variable already holds
+		if(holders[i] >= 0 && block->events[i].cycles > load && !overlaps_chosen(block, block->events[i].start, block->events[i].end))
+			block->events[i].holder = holders[i];
+	free(holders);
+
+	for(int i = 0; i < block->event_ct; i++) { //Values computed more than once
+		Cse_event *source = NULL;
+		int vn = block->events[i].vn;
+		int gain = -save;
+		int ct = 0;
+
+		if(block->events[i].holder >= 0 || block->events[i].temp >= 0)
+			continue;
+
+		for(int j = 0; j < block->event_ct; j++) { //The first time it is computed, if that is still there
+			Cse_event *event = &block->events[j];
+
+			if(event->vn == vn && event->holder < 0 && event->temp < 0 && !overlaps_chosen(block, event->start, event->end)
+					&& (source == NULL || event->start < source->start))
+				source = event;
+		}
+
+		for(int j = 0; source != NULL && j < block->event_ct; j++) {
+			Cse_event *event = &block->events[j];
+
+			if(event->vn == vn && event->start > source->end && event->cycles > load && !overlaps_chosen(block, event->start, event->end)) {
+				gain += event->cycles - load;
+				ct++;
+			}
+		}
+
+		if(ct == 0 || gain <= 0)
+			continue;
+
+		char temp[STR_LEN];
+
+		snprintf(temp, STR_LEN, "cse_%s_%d", func, stats->temps++);
+		fprintf(decls_file, "\t.globl %s\n", temp);
+
+		int key = symbol_intern(temp, symbol_hash(temp));
+
+		for(int j = 0; j < block->event_ct; j++) {
+			Cse_event *event = &block->events[j];
+
+			if(event->vn == vn && event->start > source->end && event->cycles > load && !overlaps_chosen(block, event->start, event->end))
+				event->temp = key;
+		}
+		source->temp = key; //Stored to, not loaded from
+		source->save = 1;
+	}
+}
+
+/**
+ * Local value numbering. Within each basic block, code that computes a value already held in memory
+ * is replaced by a load of it, and a value computed more than once is kept in a temporary the first
+ * time when the machine's costs say that is cheaper. What is known about memory is forgotten after
+ * a store through a computed address and at calls, which also end the block.
+ *
+ * @param prog The function's code, rewritten in place.
+ * @param machine The machine description, for costs.
+ * @param func The function's name, to name temporaries after.
+ * @param decls_file Where temporaries are declared.
+ * @param stats Filled in with what was removed.
+ */
+void cse_run(Program *prog, Machine *machine, char *func, FILE *decls_file, Cse_stats *stats) {
+	Program out = {0};
+	int first = 0;
+
+	memset(stats, 0, sizeof(Cse_stats));
+
+	for(int last = 0; last < prog->line_ct; last++) {
+		if(last + 1 < prog->line_ct && !program_ends_block(&prog->lines[last]) && prog->lines[last + 1].kind != ASM_TAG)
+			continue;
+
+		Cse_block block = {0};
+
+		symbol_table_init(&block.memory);
+		number_block(&block, prog, machine, first, last);
+		choose_block(&block, machine, func, decls_file, stats);
+
+		for(int i = first; i <= last; i++) {
+			Cse_event *replace = NULL;
+			Cse_event *saved = NULL;
+
+			for(int j = 0; j < block.event_ct; j++) {
+				Cse_event *event = &block.events[j];
+
+				if(event->start == i && !event->save && (event->holder >= 0 || event->temp >= 0))
+					replace = event;
+				if(event->end == i && event->save)
+					saved = event;
+			}
+
+			if(replace != NULL) { //Load the value instead of computing it
+				for(int j = replace->start; j <= replace->end; j++) {
+					Asm_line *line = &prog->lines[j];
+					Machine_inst *inst = line->kind == ASM_INST ? machine_inst(machine, line->op) : NULL;
+
+					stats->loads += program_is(line, "push");
+					stats->ops += inst != NULL && inst->pops > 0 && inst->pushes == 1 && !program_is(line, "push");
+				}
+				program_append(&out, ASM_INST, "pushi", symbol_key_str(replace->holder >= 0 ? replace->holder : replace->temp));
+				program_append(&out, ASM_INST, "push", NULL);
+				stats->loads--;
+				i = replace->end;
+			} else {
+				program_copy_line(&out, &prog->lines[i]);
+			}
+
+			if(saved != NULL) { //Keep the value in its temporary as well as on the stack
+				program_append(&out, ASM_INST, "pushi", symbol_key_str(saved->temp));
+				program_append(&out, ASM_INST, "pop", NULL);
+				program_append(&out, ASM_INST, "pushi", symbol_key_str(saved->temp));
+				program_append(&out, ASM_INST, "push", NULL);
+				stats->loads--;
+			}
+		}
+
+		symbol_table_free(&block.memory);
+		free(block.values);
+		free(block.stack);
+		free(block.events);
+		first = last + 1;
+	}
+
+	program_free(prog);
+	*prog = out;
+}
@@ -0,0 +1,18 @@
+#ifndef CSE_H
+#define CSE_H
+
+#include "Program.h"
+#include "SymbolTable.h"
+
+/** @struct Cse_stats
+ * What local value numbering did to one function.
+ */
+typedef struct {
+	int loads; ///< Memory loads removed, after counting the ones it added.
+	int ops; ///< Arithmetic instructions removed.
+	int temps; ///< Compiler temporaries it declared.
+} Cse_stats;
+
+void cse_run(Program *prog, Machine *machine, char *func, FILE *decls_file, Cse_stats *stats);
+
+#endif
@@ -0,0 +1,382 @@
+#include "DataLayout.h"
+#include "StringOps.h"
+
+/** @struct Layout_func
+ * One function of the program, as the layout sees it.
+ */
+typedef struct {
+	char *name; ///< The function's name.
+	Program prog; ///< The function's code.
+	Program_cfg cfg; ///< Its control flow graph.
+	char *live_in; ///< The variables live at the start of each block, var_ct to a block.
+} Layout_func;
+
+/**
+ * Returns the number of the variable that a line pushes the address of to load or store it, or -1.
+ */
+static int line_var(Data_layout *layout, Program *prog, int i) {
+	if(i < 0 || i + 1 >= prog->line_ct || !program_is(&prog->lines[i], "pushi"))
+		return -1;
+	if(!program_is(&prog->lines[i + 1], "push") && !program_is(&prog->lines[i + 1], "pop"))
+		return -1;
+
+	return symbol_table_contains(&layout->var_index, prog->lines[i].arg);
+}
+
+/**
+ * Reads the variables declared by .globl lines, in order.
+ */
+static void read_decls(Data_layout *layout, char *decls) {
+	for(char *start = decls; *start != '\0';) {
+		char *end = strchr(start, '\n') != NULL ? strchr(start, '\n') + 1 : start + strlen(start);
+		char name[STR_LEN];
+
+		if(sscanf(start, " .globl %99s", name) == 1 && symbol_table_contains(&layout->var_index, name) < 0) {
+			layout->vars = (char **)realloc(layout->vars, (layout->var_ct + 1) * sizeof(char *));
+			layout->vars[layout->var_ct] = strdup(name);
+			symbol_table_add(&layout->var_index, name, layout->var_ct++);
+		}
+		start = end;
+	}
+}
+
+/**
+ * Notes that two variables can not share a cell.
+ */
+static void interfere(Data_layout *layout, char *graph, int v, int w) {
+	graph[v * layout->var_ct + w] = 1;
+	graph[w * layout->var_ct + v] = 1;
+}
+
+/**
+ * Walks a block of a function backwards from what is live at its end. Each store makes the variable
+ * stored to interfere with every other variable of the function that is live after it.
+ *
+ * @param layout The layout being built.
+ * @param funcs Every function of the program.
+ * @param f The function.
+ * @param b The block.
+ * @param reach Which functions each function's calls may lead to, func_ct to a function.
+ * @param func_ct Number of functions.
+ * @param live The variables live at the end of the block, changed to those live at its start.
+ * @param graph The interference graph, var_ct to a variable.
+ */
+static void walk_block(Data_layout *layout, Layout_func *funcs, int f, int b, char *reach, int func_ct, char *live, char *graph) {
+	Program *prog = &funcs[f].prog;
+	Program_block *block = &funcs[f].cfg.blocks[b];
+
+	for(int i = block->last; i >= block->first;) {
+		Asm_line *line = &prog->lines[i];
+		int var = line_var(layout, prog, i - 1);
+
+		if(program_is(line, "pop") && var >= 0) {
+			for(int w = 0; w < layout->var_ct; w++)
+				if(live[w] && w != var && layout->func[w] == f)
+					interfere(layout, graph, var, w);
+			live[var] = 0;
+			i -= 2;
+		} else if(program_is(line, "push") && var >= 0) {
+			live[var] = 1;
+			i -= 2;
+		} else if(program_is(line, "jpush")) { //A call that may come back into this function reads anything
+			char *callee = i > 0 && program_is(&prog->lines[i - 1], "pushi") ? prog->lines[i - 1].arg : NULL;
+			int g = -1;
+
+			for(int h = 0; callee != NULL && h < func_ct; h++)
+				if(strcmp(funcs[h].name, callee) == 0)
+					g = h;
+			if(g < 0 || reach[g * func_ct + f])
+				for(int w = 0; w < layout->var_ct; w++)
+					live[w] |= layout->func[w] == f;
+			i--;
+		} else {
+			i--;
+		}
+	}
+}
+
+/**
+ * Works out which variables of a function are live where, and adds the pairs that are live at the
+ * same time to the interference graph. At a return nothing is live, since the callers save the
+ * variables of their own they still need; where the code stops without returning, as at the end of
+ * main, everything is. A variable that may be read before it is stored to could be reading a value
+ * left by an earlier call, so it keeps a cell of its own.
+ */
+static void find_interference(Data_layout *layout, Layout_func *funcs, int f, char *reach, int func_ct, char *graph) {
+	Layout_func *func = &funcs[f];
+	int var_ct = layout->var_ct;
+	char *live = (char *)malloc(var_ct + 1);
+	int changed = 1;
+
+	program_cfg(&func->prog, &func->cfg);
+	func->live_in = (char *)calloc(func->cfg.block_ct * var_ct + 1, 1);
+
+	while(changed) {
+		changed = 0;
+		for(int b = func->cfg.block_ct - 1; b >= 0; b--) {
+			Program_block *block = &func->cfg.blocks[b];
+
+			memset(live, block->succ_ct == 0 && !program_is(&func->prog.lines[block->last], "jr"), var_ct);
+			for(int s = 0; s < block->succ_ct; s++)
+				for(int v = 0; v < var_ct; v++)
+					live[v] |= func->live_in[block->succs[s] * var_ct + v];
+
+			walk_block(layout, funcs, f, b, reach, func_ct, live, graph);
+			if(memcmp(live, &func->live_in[b * var_ct], var_ct) != 0) {
+				memcpy(&func->live_in[b * var_ct], live, var_ct);
+				changed = 1;
+			}
+		}
+	}
+
+	for(int v = 0; func->cfg.block_ct > 0 && v < var_ct; v++)
+		if(func->live_in[v] && layout->func[v] == f)
+			for(int w = 0; w < var_ct; w++)
+				interfere(layout, graph, v, w);
+
+	free(live);
+}
+
+/**
+ * Gives each variable a cell, taking main's variables first so that the cells they share are named
+ * after them, and then the rest in the order they were declared. Each goes in the first cell holding
+ * nothing it interferes with. The cells are then numbered in the order of their first declaration.
+ */
+static void assign_cells(Data_layout *layout, char *graph, int main_func) {
+	int *order = (int *)malloc((layout->var_ct + 1) * sizeof(int));
+	int *number = (int *)malloc((layout->var_ct + 1) * sizeof(int));
+	char *taken = (char *)malloc(layout->var_ct + 1);
+	int n = 0;
+
+	for(int v = 0; v < layout->var_ct; v++)
+		if(main_func >= 0 && layout->func[v] == main_func)
+			order[n++] = v;
+	for(int v = 0; v < layout->var_ct; v++)
+		if(main_func < 0 || layout->func[v] != main_func)
+			order[n++] = v;
+
+	layout->cell_ct = 0;
+	for(int i = 0; i < n; i++) {
+		int v = order[i];
+		int c = 0;
+
+		memset(taken, 0, layout->cell_ct + 1);
+		for(int j = 0; j < i; j++)
+			if(graph[v * layout->var_ct + order[j]])
+				taken[layout->cell[order[j]]] = 1;
+		while(taken[c])
+			c++;
+
+		if(c == layout->cell_ct) {
+			layout->cell_var = (int *)realloc(layout->cell_var, (layout->cell_ct + 1) * sizeof(int));
+			layout->cell_var[layout->cell_ct++] = v;
+		}
+		layout->cell[v] = c;
+	}
+
+	int *cell_var = (int *)malloc((layout->cell_ct + 1) * sizeof(int));
+	int cell_ct = 0;
+
+	for(int c = 0; c < layout->cell_ct; c++)
+		number[c] = -1;
+	for(int v = 0; v < layout->var_ct; v++) {
+		int c = layout->cell[v];
+
+		if(number[c] < 0) {
+			number[c] = cell_ct;
+			cell_var[cell_ct++] = layout->cell_var[c];
+		}
+	}
+	for(int v = 0; v < layout->var_ct; v++)
+		layout->cell[v] = number[layout->cell[v]];
+
+	free(layout->cell_var);
+	layout->cell_var = cell_var;
+	free(order);
+	free(number);
+	free(taken);
+}
+
+/**
+ * Works out where each variable of the program is kept in data memory.
+ *
+ * Variables of different functions may share a cell when neither function's calls can lead to the
+ * other, so that they are never running at the same time. Variables of the same function may share
+ * one when there is no point in its code where both hold a value that is still to be read. Variables
+ * whose address is used for anything but loading and storing them, those used by more than one
+ * function, the counters of --instrument and the cells of the compiler's own, like res and the frame
+ * pointer of --frames, whose names have no _, keep a cell of their own.
+ *
+ * @param layout The layout to be filled in.
+ * @param code The code of the whole program.
+ * @param decls The .globl declarations of its variables.
+ * @param funcs The names of the functions, each of which starts at a tag of its name.
+ * @param func_ct Number of functions.
+ * @param share 1 to let variables share cells, 0 to give each its own.
+ */
+void data_layout_build(Data_layout *layout, char *code, char *decls, char **funcs, int func_ct, int share) {
+	memset(layout, 0, sizeof(Data_layout));
+	symbol_table_init(&layout->var_index);
+	read_decls(layout, decls);
+
+	int var_ct = layout->var_ct;
+	char *graph = (char *)calloc(var_ct * var_ct + 1, 1);
+
+	layout->func = (int *)malloc((var_ct + 1) * sizeof(int));
+	layout->cell = (int *)malloc((var_ct + 1) * sizeof(int));
+	for(int v = 0; v < var_ct; v++)
+		layout->func[v] = -1;
+
+	if(!share) {
+		layout->cell_var = (int *)malloc((var_ct + 1) * sizeof(int));
+		for(int v = 0; v < var_ct; v++)
+			layout->cell[v] = layout->cell_var[v] = v;
+		layout->cell_ct = var_ct;
+		free(graph);
+		return;
+	}
+
+	Layout_func *func = (Layout_func *)calloc(func_ct + 1, sizeof(Layout_func));
+	char *reach = (char *)calloc(func_ct * func_ct + 1, 1);
+	char *pinned = (char *)calloc(var_ct + 1, 1);
+	Program all;
+	int f = -1;
+	int main_func = -1;
+
+	program_parse(&all, code);
+	for(int i = 0; i < all.line_ct; i++) { //Split the program at the start of each function
+		Asm_line *line = &all.lines[i];
+
+		for(int g = 0; line->kind == ASM_TAG && g < func_ct; g++)
+			if(strcmp(funcs[g], line->arg) == 0)
+				f = g;
+
+		int var = program_is(line, "pushi") ? symbol_table_contains(&layout->var_index, line->arg) : -1;
+
+		if(var >= 0)
+			layout->func[var] = layout->func[var] == -1 || layout->func[var] == f ? f : -2;
+		if(f >= 0)
+			program_copy_line(&func[f].prog, line);
+	}
+	for(f = 0; f < func_ct; f++)
+		func[f].name = funcs[f];
+
+	for(f = 0; f < func_ct; f++) { //Which functions each one calls, and which variables have their address taken
+		Program *prog = &func[f].prog;
+
+		if(strcmp(funcs[f], "main") == 0)
+			main_func = f;
+		for(int i = 0; i < prog->line_ct; i++) {
+			Asm_line *line = &prog->lines[i];
+			int var = program_is(line, "pushi") ? symbol_table_contains(&layout->var_index, line->arg) : -1;
+
+			if(var >= 0 && line_var(layout, prog, i) < 0)
+				pinned[var] = 1;
+			for(int g = 0; program_is(line, "pushi") && i + 1 < prog->line_ct && program_is(&prog->lines[i + 1], "jpush") && g < func_ct; g++)
+				if(strcmp(funcs[g], line->arg) == 0)
+					reach[f * func_ct + g] = 1;
+		}
+	}
+
+	for(int k = 0; k < func_ct; k++) //Calls that lead on through other functions
+		for(int i = 0; i < func_ct; i++)
+			for(int j = 0; reach[i * func_ct + k] && j < func_ct; j++)
+				reach[i * func_ct + j] |= reach[k * func_ct + j];
+
+	for(f = 0; f < func_ct; f++)
+		find_interference(layout, func, f, reach, func_ct, graph);
+
+	for(int v = 0; v < var_ct; v++) {
+		int fv = layout->func[v];
+
+		if(fv == -2)
+			pinned[v] = 1;
+		if(strchr(layout->vars[v], '_') == NULL || strncmp(layout->vars[v], "count_", 6) == 0) //Like res and the frame pointer
+			pinned[v] = 1;
+
+		for(int w = 0; w < var_ct; w++) {
+			int fw = layout->func[w];
+
+			if(v != w && (pinned[v] || (fv >= 0 && fw >= 0 && fv != fw && (reach[fv * func_ct + fw] || reach[fw * func_ct + fv]))))
+				interfere(layout, graph, v, w);
+		}
+	}
+
+	assign_cells(layout, graph, main_func);
+
+	for(f = 0; f < func_ct; f++) {
+		program_free(&func[f].prog);
+		if(func[f].live_in != NULL)
+			program_cfg_free(&func[f].cfg);
+		free(func[f].live_in);
+	}
+	program_free(&all);
+	free(func);
+	free(reach);
+	free(pinned);
+	free(graph);
+}
+
+/**
+ * Renames each variable in the code to the cell it is kept in.
+ *
+ * @param layout The layout.
+ * @param code The code of the whole program.
+ * @return The renamed code, which must be freed.
+ */
+char * data_layout_apply(Data_layout *layout, char *code) {
+	Program prog;
+
+	program_parse(&prog, code);
+	for(int i = 0; i < prog.line_ct; i++) {
+		Asm_line *line = &prog.lines[i];
+		int var = program_is(line, "pushi") ? symbol_table_contains(&layout->var_index, line->arg) : -1;
+
+		if(var >= 0 && layout->cell_var[layout->cell[var]] != var) {
+			free(line->arg);
+			line->arg = strdup(layout->vars[layout->cell_var[layout->cell[var]]]);
+		}
+	}
+
+	char *text = program_text(&prog);
+
+	program_free(&prog);
+
+	return text;
+}
+
+/**
+ * Writes the declaration of each cell, in order.
+ */
+void data_layout_decls(Data_layout *layout, FILE *output_file) {
+	for(int c = 0; c < layout->cell_ct; c++)
+		fprintf(output_file, "\t.globl %s\n", layout->vars[layout->cell_var[c]]);
+}
+
+/**
+ * Lists each cell of data memory with the variables kept in it.
+ */
+void data_layout_write(Data_layout *layout, FILE *layout_file) {
+	fprintf(layout_file, "data memory: %d cells for %d variables\n", layout->cell_ct, layout->var_ct);
+	for(int c = 0; c < layout->cell_ct; c++) {
+		fprintf(layout_file, "%4d", c);
+		for(int v = 0; v < layout->var_ct; v++)
+			if(layout->cell[v] == c)
+				fprintf(layout_file, " %s", layout->vars[v]);
+		fprintf(layout_file, "\n");
+	}
+}
+
+/**
+ * Frees the memory held by a layout.
+ */
+void data_layout_free(Data_layout *layout) {
+	for(int v = 0; v < layout->var_ct; v++)
+		free(layout->vars[v]);
+	free(layout->vars);
+	free(layout->func);
+	free(layout->cell);
+	free(layout->cell_var);
+	symbol_table_free(&layout->var_index);
+	memset(layout, 0, sizeof(Data_layout));
+}
@@ -0,0 +1,27 @@
+#ifndef DATA_LAYOUT_H
+#define DATA_LAYOUT_H
+
+#include "Program.h"
+#include "SymbolTable.h"
+
+/** @struct Data_layout
+ * Where each variable of the program is kept in data memory. Variables that are never needed at the
+ * same time may share a cell.
+ */
+typedef struct {
+	char **vars; ///< The declared variables, in the order of their declarations.
+	int var_ct; ///< Number of variables.
+	Symbol_table var_index; ///< Maps each variable's name to its number.
+	int *func; ///< The function whose code uses each variable, -1 if none does, or -2 if several do.
+	int *cell; ///< The cell each variable is kept in.
+	int cell_ct; ///< Number of cells.
+	int *cell_var; ///< The variable each cell is named after.
+} Data_layout;
+
+void data_layout_build(Data_layout *layout, char *code, char *decls, char **funcs, int func_ct, int share);
+char * data_layout_apply(Data_layout *layout, char *code);
+void data_layout_decls(Data_layout *layout, FILE *output_file);
+void data_layout_write(Data_layout *layout, FILE *layout_file);
+void data_layout_free(Data_layout *layout);
+
+#endif
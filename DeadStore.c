@@ -0,0 +1,330 @@
+#include "DeadStore.h"
+
+/** @struct Dead_slot
+ * One entry of the simulated stack.
+ */
+typedef struct {
+	int start; ///< The first line of the side effect free code that computes it, or -1 if there is none.
+	int end; ///< The line that finishes computing it.
+} Dead_slot;
+
+/** @struct Dead_store
+ * The state of one round of dead store elimination over a function.
+ */
+typedef struct {
+	Program *prog; ///< The function's code.
+	char *func; ///< The function's name.
+	Machine *machine; ///< The machine description.
+	Symbol_table *param_cts; ///< How many parameters each known function takes, or NULL.
+	Program_cfg cfg; ///< The function's control flow graph.
+	Symbol_table vars; ///< Numbers each variable the function loads or stores.
+	int var_ct; ///< Number of variables.
+	char *escaped; ///< 1 for each variable whose address is used other than to load or store it.
+	char *own; ///< 1 for each variable of the function itself, as opposed to a global such as a counter of --instrument.
+	char *live_in; ///< The variables live at the start of each block, var_ct to a block.
+	int *value_start; ///< For each store, the first line of the code computing the value it stores, or -1.
+	int *value_end; ///< For each store, the last line of the code computing its value.
+	char *removed; ///< 1 for each line that is removed.
+} Dead_store;
+
+/**
+ * Returns the number of the variable that a line pushes the address of to load or store it, or -1.
+ */
+static int line_var(Dead_store *dead, int i) {
+	Program *prog = dead->prog;
+
+	if(i < 0 || i + 1 >= prog->line_ct || !program_is(&prog->lines[i], "pushi"))
+		return -1;
+	if(!program_is(&prog->lines[i + 1], "push") && !program_is(&prog->lines[i + 1], "pop"))
+		return -1;
+
+	return symbol_table_contains(&dead->vars, prog->lines[i].arg);
+}
+
+/**
+ * Numbers the variables of a function, and notes which are its own and which have their address pushed
+ * for anything else.
+ */
+static void find_vars(Dead_store *dead) {
+	Program *prog = dead->prog;
+
+	for(int i = 0; i + 1 < prog->line_ct; i++) {
+		Asm_line *line = &prog->lines[i];
+
+		if(program_is(line, "pushi") && line->arg != NULL && !machine_is_constant(line->arg) && program_cfg_tag(&dead->cfg, line->arg) < 0
+				&& (program_is(&prog->lines[i + 1], "push") || program_is(&prog->lines[i + 1], "pop"))
+				&& symbol_table_contains(&dead->vars, line->arg) < 0)
+			symbol_table_add(&dead->vars, line->arg, dead->var_ct++);
+	}
+
+	char own_prefix[STR_LEN], temp_prefix[STR_LEN];
+
+	snprintf(own_prefix, STR_LEN, "%s_", dead->func);
+	snprintf(temp_prefix, STR_LEN, "cse_%s_", dead->func);
+	dead->own = (char *)calloc(dead->var_ct + 1, 1);
+	dead->escaped = (char *)calloc(dead->var_ct + 1, 1);
+	for(int i = 0; i < prog->line_ct; i++) {
+		Asm_line *line = &prog->lines[i];
+		int var = program_is(line, "pushi") ? symbol_table_contains(&dead->vars, line->arg) : -1;
+
+		if(var >= 0 && line_var(dead, i) < 0)
+			dead->escaped[var] = 1;
+		if(var >= 0 && (strncmp(line->arg, own_prefix, strlen(own_prefix)) == 0 || strncmp(line->arg, temp_prefix, strlen(temp_prefix)) == 0))
+			dead->own[var] = 1;
+	}
+}
+
+/**
+ * Takes the top entry off the simulated stack. Below what is known, entries are unknown.
+ */
+static Dead_slot stack_pop(Dead_slot *stack, int *depth) {
+	if(*depth == 0)
+		return (Dead_slot){-1, -1};
+
+	return stack[--*depth];
+}
+
+/**
+ * Follows the stack through the function to find the code that computes the value of each store.
+ * Only side effect free code counts, which can be dropped with the store. The stack is followed
+ * across calls to functions whose number of parameters is known, so that values saved before a
+ * call are found for the stores that restore them after it.
+ */
+static void find_values(Dead_store *dead) {
+	Program *prog = dead->prog;
+	Dead_slot *stack = (Dead_slot *)malloc((prog->line_ct + 1) * sizeof(Dead_slot));
+	int depth = 0;
+	int last_impure = -1;
+
+	for(int b = 0; b < dead->cfg.block_ct; b++) {
+		Program_block *block = &dead->cfg.blocks[b];
+
+		if(!block->after_call || block->has_tag) { //Only straight after a call is the stack carried on
+			depth = 0;
+			last_impure = block->first - 1;
+		}
+
+		for(int i = block->first; i <= block->last; i++) {
+			Asm_line *line = &prog->lines[i];
+			Machine_inst *inst = line->kind == ASM_INST ? machine_inst(dead->machine, line->op) : NULL;
+
+			dead->value_start[i] = -1;
+			if(line->kind != ASM_INST) {
+				continue;
+			} else if(inst == NULL) {
+				depth = 0;
+				last_impure = i;
+			} else if(program_is(line, "pop")) {
+				Dead_slot addr = stack_pop(stack, &depth);
+				Dead_slot value = stack_pop(stack, &depth);
+
+				if(line_var(dead, i - 1) >= 0 && addr.start == i - 1) {
+					dead->value_start[i] = value.start;
+					dead->value_end[i] = value.end;
+				}
+				last_impure = i;
+			} else if(program_is(line, "jpush")) {
+				char *callee = i > 0 && program_is(&prog->lines[i - 1], "pushi") ? prog->lines[i - 1].arg : NULL;
+				int params = callee != NULL && dead->param_cts != NULL ? symbol_table_contains(dead->param_cts, callee) : -1;
+
+				stack_pop(stack, &depth);
+				if(params < 0 || params > depth) //What the call leaves below its result is unknown
+					depth = 0;
+				else
+					depth -= params;
+				stack[depth++] = (Dead_slot){-1, -1};
+				last_impure = i;
+			} else if(inst->pushes == 1 && inst->operand != OPERAND_LABEL && line->op[0] != 'j') { //pushi, push, add, sub, slt, addi
+				Dead_slot result = {i, i};
+
+				for(int j = 0; j < inst->pops; j++) {
+					Dead_slot operand = stack_pop(stack, &depth);
+
+					result.start = operand.start < 0 || operand.start <= last_impure ? -1 : operand.start;
+					if(result.start < 0)
+						break;
+				}
+				if(result.start < 0)
+					result.end = -1;
+				stack[depth++] = result;
+			} else { //Branches, jumps and anything unknown
+				for(int j = 0; j < inst->pops; j++)
+					stack_pop(stack, &depth);
+				for(int j = 0; j < inst->pushes; j++)
+					stack[depth++] = (Dead_slot){-1, -1};
+				last_impure = i;
+			}
+		}
+	}
+
+	free(stack);
+}
+
+/**
+ * Takes a line back through the variables live before it.
+ *
+ * @param dead The pass's state.
+ * @param i The line. When it loads or stores a variable, the line pushing the address is taken too.
+ * @param live The variables live after the line, changed to those live before it.
+ * @return The line before the ones taken.
+ */
+static int live_before(Dead_store *dead, int i, char *live) {
+	Asm_line *line = &dead->prog->lines[i];
+	int var = line_var(dead, i - 1);
+
+	if(program_is(line, "pop") && var >= 0) {
+		live[var] = 0;
+		return i - 2;
+	} else if(program_is(line, "push") && var >= 0) {
+		live[var] = 1;
+		return i - 2;
+	} else if(program_is(line, "push") || program_is(line, "jpush")) { //A computed address, or a call back into this function
+		memset(live, 1, dead->var_ct);
+	}
+
+	return i - 1;
+}
+
+/**
+ * Works out the variables live at the end of a block: those any block after it may read. At a
+ * return the function's own variables are not, since the caller saved any of them it still needs,
+ * but globals such as the counters of --instrument are. Where the code stops without returning, as
+ * at the end of main, everything is.
+ */
+static void live_out(Dead_store *dead, int b, char *live) {
+	Program_block *block = &dead->cfg.blocks[b];
+
+	memset(live, block->succ_ct == 0, dead->var_ct);
+	if(block->succ_ct == 0 && program_is(&dead->prog->lines[block->last], "jr"))
+		for(int v = 0; v < dead->var_ct; v++)
+			live[v] = !dead->own[v];
+	for(int i = 0; i < block->succ_ct; i++)
+		for(int v = 0; v < dead->var_ct; v++)
+			live[v] |= dead->live_in[block->succs[i] * dead->var_ct + v];
+}
+
+/**
+ * Walks a block backwards from what is live at its end, removing each store to a variable that is not
+ * live along with the code computing its value.
+ *
+ * @param dead The pass's state.
+ * @param b The block.
+ * @param live The variables live at the end of the block, changed to those live at its start.
+ * @param stats Counts what is removed, or NULL to only work out what is live.
+ */
+static void walk_block(Dead_store *dead, int b, char *live, Dead_store_stats *stats) {
+	Program_block *block = &dead->cfg.blocks[b];
+
+	for(int i = block->last; i >= block->first;) {
+		Asm_line *line = &dead->prog->lines[i];
+		int var = line_var(dead, i - 1);
+
+		if(line->kind != ASM_INST || dead->removed[i]) {
+			i--;
+			continue;
+		}
+
+		if(stats != NULL && program_is(line, "pop") && var >= 0 && !live[var] && !dead->escaped[var]) {
+			if(dead->value_start[i] >= 0) {
+				for(int j = dead->value_start[i]; j <= dead->value_end[i]; j++)
+					dead->removed[j] = 1;
+				dead->removed[i - 1] = dead->removed[i] = 1;
+				stats->removed++;
+			} else {
+				stats->kept++;
+			}
+		}
+
+		i = live_before(dead, i, live);
+	}
+
+	for(int v = 0; v < dead->var_ct; v++)
+		live[v] |= dead->escaped[v];
+}
+
+/**
+ * Removes the stores of one round. Dropping the code that computed a value may leave more stores
+ * that are never read, for the next round.
+ *
+ * @return 1 if anything was removed, 0 otherwise.
+ */
+static int run_round(Program *prog, char *func, Machine *machine, Symbol_table *param_cts, Dead_store_stats *stats) {
+	Dead_store dead = {prog, func, machine, param_cts};
+	int removed = stats->removed;
+	int changed = 1;
+
+	program_cfg(prog, &dead.cfg);
+	symbol_table_init(&dead.vars);
+	find_vars(&dead);
+
+	char *live = (char *)malloc(dead.var_ct + 1);
+
+	dead.live_in = (char *)calloc(dead.cfg.block_ct * dead.var_ct + 1, 1);
+	dead.value_start = (int *)malloc((prog->line_ct + 1) * sizeof(int));
+	dead.value_end = (int *)malloc((prog->line_ct + 1) * sizeof(int));
+	dead.removed = (char *)calloc(prog->line_ct + 1, 1);
+	find_values(&dead);
+
+	while(changed) { //Liveness, going backwards until nothing changes
+		changed = 0;
+		for(int b = dead.cfg.block_ct - 1; b >= 0; b--) {
+			live_out(&dead, b, live);
+			walk_block(&dead, b, live, NULL);
+			if(memcmp(live, &dead.live_in[b * dead.var_ct], dead.var_ct) != 0) {
+				memcpy(&dead.live_in[b * dead.var_ct], live, dead.var_ct);
+				changed = 1;
+			}
+		}
+	}
+
+	stats->kept = 0;
+	for(int b = dead.cfg.block_ct - 1; b >= 0; b--) {
+		live_out(&dead, b, live);
+		walk_block(&dead, b, live, stats);
+	}
+
+	if(stats->removed > removed) {
+		Program out = {0};
+
+		for(int i = 0; i < prog->line_ct; i++)
+			if(!dead.removed[i])
+				program_copy_line(&out, &prog->lines[i]);
+		program_free(prog);
+		*prog = out;
+	}
+
+	free(live);
+	free(dead.escaped);
+	free(dead.own);
+	free(dead.live_in);
+	free(dead.value_start);
+	free(dead.value_end);
+	free(dead.removed);
+	symbol_table_free(&dead.vars);
+	program_cfg_free(&dead.cfg);
+
+	return stats->removed > removed;
+}
+
+/**
+ * Dead store elimination. Works out which variables are live at each point of a function by going
+ * backwards through its control flow graph, and removes each store to a variable that is not live,
+ * along with the code computing the value when it has no call or other side effect. A call is
+ * taken to read every variable, in case it comes back into this function. A store whose value
+ * cannot be dropped stays, since there is no other way to take it off the stack: the parameters,
+ * whose values the caller pushed, are like this.
+ *
+ * @param prog The function's code, rewritten in place.
+ * @param func The function's name, to tell its own variables from globals.
+ * @param machine The machine description, for each instruction's effect on the stack.
+ * @param param_cts How many parameters each function takes, to follow the stack across calls. May be NULL.
+ * @param stats Filled in with what was removed.
+ */
+void dead_store_run(Program *prog, char *func, Machine *machine, Symbol_table *param_cts, Dead_store_stats *stats) {
+	memset(stats, 0, sizeof(Dead_store_stats));
+	stats->writes_before = program_count(prog, "pop");
+
+	while(run_round(prog, func, machine, param_cts, stats));
+
+	stats->writes_after = program_count(prog, "pop");
+}
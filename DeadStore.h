@@ -0,0 +1,19 @@
+#ifndef DEAD_STORE_H
+#define DEAD_STORE_H
+
+#include "Program.h"
+#include "SymbolTable.h"
+
+/** @struct Dead_store_stats
+ * What dead store elimination did to one function.
+ */
+typedef struct {
+	int removed; ///< Stores removed along with the code that computed their value.
+	int kept; ///< Stores never read that stay, since nothing else would take their value off the stack.
+	int writes_before; ///< Stores in the function's code before the pass.
+	int writes_after; ///< Stores in the function's code after the pass.
+} Dead_store_stats;
+
+void dead_store_run(Program *prog, char *func, Machine *machine, Symbol_table *param_cts, Dead_store_stats *stats);
+
+#endif
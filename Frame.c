@@ -0,0 +1,114 @@
+#include "Frame.h"
+#include "StringOps.h"
+
+/**
+ * Writes the code that allocates a frame of the given size on entry to a function. The first cell of
+ * the frame keeps the caller's frame pointer.
+ */
+static void emit_prologue(Program *out, int size) {
+	char size_str[STR_LEN];
+
+	snprintf(size_str, STR_LEN, "%d", size);
+
+	program_append(out, ASM_INST, "pushi", FRAME_POINTER); //Keep the caller's frame pointer in the new frame
+	program_append(out, ASM_INST, "push", NULL);
+	program_append(out, ASM_INST, "pushi", FRAME_TOP);
+	program_append(out, ASM_INST, "push", NULL);
+	program_append(out, ASM_INST, "pop", NULL);
+	program_append(out, ASM_INST, "pushi", FRAME_TOP); //The new frame starts where the frames end
+	program_append(out, ASM_INST, "push", NULL);
+	program_append(out, ASM_INST, "pushi", FRAME_POINTER);
+	program_append(out, ASM_INST, "pop", NULL);
+	program_append(out, ASM_INST, "pushi", FRAME_TOP); //And the frames now end after it
+	program_append(out, ASM_INST, "push", NULL);
+	program_append(out, ASM_INST, "pushi", size_str);
+	program_append(out, ASM_INST, "add", NULL);
+	program_append(out, ASM_INST, "pushi", FRAME_TOP);
+	program_append(out, ASM_INST, "pop", NULL);
+}
+
+/**
+ * Writes the code that releases the frame before a return, leaving the value returned on the stack.
+ */
+static void emit_epilogue(Program *out) {
+	program_append(out, ASM_INST, "pushi", FRAME_POINTER); //The frames end where this one started
+	program_append(out, ASM_INST, "push", NULL);
+	program_append(out, ASM_INST, "pushi", FRAME_TOP);
+	program_append(out, ASM_INST, "pop", NULL);
+	program_append(out, ASM_INST, "pushi", FRAME_POINTER); //Back to the caller's frame
+	program_append(out, ASM_INST, "push", NULL);
+	program_append(out, ASM_INST, "push", NULL);
+	program_append(out, ASM_INST, "pushi", FRAME_POINTER);
+	program_append(out, ASM_INST, "pop", NULL);
+}
+
+/**
+ * Moves a function's own variables from their global cells into a frame that is allocated when the
+ * function is called and released when it returns, so that each call has its own copy of them and a
+ * caller's variables are safe without being saved around the call. Each variable's address becomes
+ * an offset from the frame pointer. Functions without variables of their own get no frame.
+ *
+ * @param prog The function's code, changed in place.
+ * @param func The name of the function. Its own variables are named after it.
+ * @param stats Filled in with what was changed.
+ */
+void frame_lower(Program *prog, char *func, Frame_stats *stats) {
+	Symbol_table tags, vars;
+	size_t prefix_len = strlen(func) + 1;
+	int entry = -1;
+
+	memset(stats, 0, sizeof(Frame_stats));
+	symbol_table_init(&tags);
+	symbol_table_init(&vars);
+
+	for(int i = 0; i < prog->line_ct; i++)
+		if(prog->lines[i].kind == ASM_TAG && prog->lines[i].arg != NULL)
+			symbol_table_add(&tags, prog->lines[i].arg, i);
+
+	for(int i = 0; i < prog->line_ct; i++) { //Slot 0 of the frame keeps the caller's frame pointer
+		Asm_line *line = &prog->lines[i];
+
+		if(program_is(line, "pushi") && line->arg != NULL && strncmp(line->arg, func, prefix_len - 1) == 0 && line->arg[prefix_len - 1] == '_'
+				&& symbol_table_contains(&tags, line->arg) < 0 && symbol_table_contains(&vars, line->arg) < 0)
+			symbol_table_add(&vars, line->arg, ++stats->vars);
+	}
+	entry = symbol_table_contains(&tags, func);
+
+	if(stats->vars > 0) {
+		Program out = {0};
+
+		if(entry < 0)
+			emit_prologue(&out, stats->vars + 1);
+
+		for(int i = 0; i < prog->line_ct; i++) {
+			Asm_line *line = &prog->lines[i];
+			int slot = program_is(line, "pushi") ? symbol_table_contains(&vars, line->arg) : -1;
+
+			if(slot >= 0) {
+				char slot_str[STR_LEN];
+
+				snprintf(slot_str, STR_LEN, "%d", slot);
+				program_append(&out, ASM_INST, "pushi", FRAME_POINTER);
+				program_append(&out, ASM_INST, "push", NULL);
+				program_append(&out, ASM_INST, "pushi", slot_str);
+				program_append(&out, ASM_INST, "add", NULL);
+				stats->accesses++;
+				continue;
+			}
+
+			if(program_is(line, "jr")) {
+				emit_epilogue(&out);
+				stats->returns++;
+			}
+			program_copy_line(&out, line);
+			if(i == entry)
+				emit_prologue(&out, stats->vars + 1);
+		}
+
+		program_free(prog);
+		*prog = out;
+	}
+
+	symbol_table_free(&tags);
+	symbol_table_free(&vars);
+}
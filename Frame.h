@@ -0,0 +1,21 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "Program.h"
+
+#define FRAME_POINTER "fp" ///< The cell holding the address of the running function's frame.
+#define FRAME_TOP "sp" ///< The cell holding the address of the first cell above every frame.
+#define FRAME_AREA "frames" ///< Declared after every other cell, so the frames start at its address.
+
+/** @struct Frame_stats
+ * What moving a function's variables into its frame did.
+ */
+typedef struct {
+	int vars; ///< Variables moved into the frame.
+	int accesses; ///< Loads and stores made relative to the frame pointer.
+	int returns; ///< Returns that release the frame.
+} Frame_stats;
+
+void frame_lower(Program *prog, char *func, Frame_stats *stats);
+
+#endif
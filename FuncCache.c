@@ -0,0 +1,146 @@
+#include "FuncCache.h"
+
+/**
+ * Returns the hash of a cache key. Never 0, since 0 marks an empty slot.
+ */
+static unsigned long long key_hash(char *key) {
+	unsigned long long hash = str_hash(key, strlen(key), STR_HASH_SEED);
+
+	return hash == 0 ? 1 : hash;
+}
+
+/**
+ * Finds the slot that either holds the given key or is the empty slot where it belongs.
+ *
+ * @param slots The slots to be searched through.
+ * @param capacity The number of slots. Must be a power of two.
+ * @param hash The hash of the key.
+ * @param key The key, or NULL to stop at the first empty slot.
+ * @return The index of the slot.
+ */
+static int find_slot(Func_cache_entry *slots, int capacity, unsigned long long hash, char *key) {
+	int mask = capacity - 1;
+	int i = hash & mask;
+
+	while(slots[i].hash != 0 && (key == NULL || slots[i].hash != hash || strcmp(slots[i].key, key) != 0))
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+/**
+ * Frees the contents of one slot.
+ */
+static void free_entry(Func_cache_entry *entry) {
+	free(entry->key);
+	free(entry->code);
+	free(entry->decls);
+	free(entry->counts);
+	free(entry->messages);
+	free(entry->state);
+	memset(entry, 0, sizeof(Func_cache_entry));
+}
+
+/**
+ * Initializes an empty cache.
+ *
+ * @param cache The cache to be initialized.
+ */
+void func_cache_init(Func_cache *cache) {
+	cache->slots = (Func_cache_entry *)calloc(FUNC_CACHE_MIN, sizeof(Func_cache_entry));
+	cache->capacity = FUNC_CACHE_MIN;
+	cache->length = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+}
+
+/**
+ * Frees the memory held by a cache.
+ *
+ * @param cache The cache to be freed.
+ */
+void func_cache_free(Func_cache *cache) {
+	for(int i = 0; i < cache->capacity; i++)
+		if(cache->slots[i].hash != 0)
+			free_entry(&cache->slots[i]);
+
+	free(cache->slots);
+	cache->slots = NULL;
+	cache->capacity = 0;
+	cache->length = 0;
+}
+
+/**
+ * Looks up a compiled function.
+ *
+ * @param cache The cache to be searched through.
+ * @param key The function's text together with the compiler state it is being compiled in.
+ * @return The entry for the function, or NULL if it has not been compiled in that state before.
+ */
+Func_cache_entry * func_cache_find(Func_cache *cache, char *key) {
+	unsigned long long hash = key_hash(key);
+	int i = find_slot(cache->slots, cache->capacity, hash, key);
+
+	if(cache->slots[i].hash == 0) {
+		cache->misses++;
+		return NULL;
+	}
+
+	cache->hits++;
+
+	return &cache->slots[i];
+}
+
+/**
+ * Adds a compiled function to the cache. Every string and the state are copied.
+ * Once the cache holds FUNC_CACHE_MAX functions it is emptied, so a long running server keeps
+ * only what it has compiled recently.
+ *
+ * @param cache The cache to be edited.
+ * @param key The function's text together with the compiler state it was compiled in.
+ * @param code Code written for the function.
+ * @param decls Declarations written for the function.
+ * @param counts Lines written to the --instrument side file.
+ * @param messages Errors and statistics printed while compiling.
+ * @param state The compiler's counters after the function.
+ * @param state_size Size of state.
+ */
+void func_cache_add(Func_cache *cache, char *key, char *code, char *decls, char *counts, char *messages, void *state, size_t state_size) {
+	unsigned long long hash = key_hash(key);
+
+	if(cache->length >= FUNC_CACHE_MAX) {
+		func_cache_free(cache);
+		func_cache_init(cache);
+	}
+
+	if((cache->length + 1) * 4 > cache->capacity * 3) { //Keep the table at most three quarters full
+		int capacity = cache->capacity * 2;
+		Func_cache_entry *slots = (Func_cache_entry *)calloc(capacity, sizeof(Func_cache_entry));
+
+		for(int i = 0; i < cache->capacity; i++)
+			if(cache->slots[i].hash != 0)
+				slots[find_slot(slots, capacity, cache->slots[i].hash, NULL)] = cache->slots[i];
+
+		free(cache->slots);
+		cache->slots = slots;
+		cache->capacity = capacity;
+	}
+
+	int i = find_slot(cache->slots, cache->capacity, hash, key);
+	Func_cache_entry *entry = &cache->slots[i];
+
+	if(entry->hash != 0)
+		free_entry(entry);
+	else
+		cache->length++;
+
+	entry->hash = hash;
+	entry->key = strdup(key);
+	entry->code = strdup(code);
+	entry->decls = strdup(decls);
+	entry->counts = strdup(counts);
+	entry->messages = strdup(messages);
+	entry->state = malloc(state_size);
+	memcpy(entry->state, state, state_size);
+	entry->state_size = state_size;
+}
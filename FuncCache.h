@@ -0,0 +1,38 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "StringOps.h"
+
+#define FUNC_CACHE_MIN 64
+#define FUNC_CACHE_MAX 4096 ///< The cache is emptied rather than grown past this many functions.
+
+/** @struct Func_cache_entry
+ * Everything compiling one function produced, so that it can be replayed instead of compiled again.
+ */
+typedef struct {
+	unsigned long long hash; ///< Hash of key. 0 marks an empty slot.
+	char *key; ///< The function's text together with the compiler state it was compiled in.
+	char *code; ///< Code written for the function.
+	char *decls; ///< Declarations written for the function.
+	char *counts; ///< Lines written to the --instrument side file.
+	char *messages; ///< Errors and statistics printed while compiling.
+	void *state; ///< Copy of the compiler's counters after the function.
+	size_t state_size; ///< Size of state.
+} Func_cache_entry;
+
+/** @struct Func_cache
+ * Open addressing hash table of compiled functions, looked up by their content hash.
+ */
+typedef struct {
+	Func_cache_entry *slots; ///< The slots of the table.
+	int capacity; ///< The number of slots. Always a power of two.
+	int length; ///< The number of slots in use.
+	long hits; ///< Number of lookups that found their function.
+	long misses; ///< Number of lookups that did not.
+} Func_cache;
+
+void func_cache_init(Func_cache *cache);
+void func_cache_free(Func_cache *cache);
+Func_cache_entry * func_cache_find(Func_cache *cache, char *key);
+void func_cache_add(Func_cache *cache, char *key, char *code, char *decls, char *counts, char *messages, void *state, size_t state_size);
@@ -0,0 +1,141 @@
+#include <limits.h>
+#include <unistd.h>
+
+#include "Server.h"
+
+/**
+ * Client for a compiler started with --server. It takes the same arguments as the compiler, plus
+ * --socket <path>, and writes the same files, but leaves the compiling to the warm server process.
+ */
+
+/**
+ * Reads a whole file.
+ *
+ * @param filename The file to be read.
+ * @param len Set to the length of the contents.
+ * @return The contents, which must be freed, or NULL if the file could not be read.
+ */
+static char * read_file(char *filename, size_t *len) {
+	FILE *file = fopen(filename, "r");
+
+	if(file == NULL)
+		return NULL;
+
+	fseek(file, 0, SEEK_END);
+	*len = ftell(file);
+	rewind(file);
+
+	char *data = (char *)malloc(*len + 1);
+
+	*len = fread(data, 1, *len, file);
+	data[*len] = '\0';
+	fclose(file);
+
+	return data;
+}
+
+/**
+ * Writes a whole file.
+ *
+ * @param filename The file to be written.
+ * @param data The contents.
+ * @param len The length of the contents.
+ */
+static void write_file(char *filename, char *data, size_t len) {
+	FILE *file = fopen(filename, "w");
+
+	if(file == NULL) {
+		printf("ERROR: Could not write %s\n", filename);
+		return;
+	}
+
+	fwrite(data, 1, len, file);
+	fclose(file);
+}
+
+int main(int argc, char *argv[]) {
+	char *socket_path = SERVER_SOCKET;
+	char *filename = NULL;
+	char *args;
+	size_t args_len;
+	FILE *args_file = open_memstream(&args, &args_len);
+	char path[PATH_MAX];
+
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+			socket_path = argv[++i];
+		} else if((strcmp(argv[i], "--machine") == 0 || strcmp(argv[i], "--rewrites") == 0) && i + 1 < argc) { //The server may run somewhere else
+			fprintf(args_file, "%s\n%s\n", argv[i], realpath(argv[i + 1], path) != NULL ? path : argv[i + 1]);
+			i++;
+		} else if(strcmp(argv[i], "--stack-limit") == 0 && i + 1 < argc) {
+			fprintf(args_file, "%s\n%s\n", argv[i], argv[i + 1]);
+			i++;
+		} else if(argv[i][0] == '-') {
+			fprintf(args_file, "%s\n", argv[i]);
+		} else {
+			filename = argv[i];
+		}
+	}
+	fclose(args_file);
+
+	if(filename == NULL) {
+		printf("Enter a filename.");
+		return 0;
+	}
+
+	size_t source_len;
+	char *source = read_file(filename, &source_len);
+
+	if(source == NULL || realpath(filename, path) == NULL) {
+		printf("ERROR: Could not read %s\n", filename);
+		return 1;
+	}
+
+	int fd = server_connect(socket_path);
+
+	if(fd < 0) {
+		printf("ERROR: No compiler server at %s. Start one with JALACompiler --server\n", socket_path);
+		return 1;
+	}
+
+	server_send(fd, "path", path, strlen(path));
+	server_send(fd, "args", args, args_len);
+	server_send(fd, "source", source, source_len);
+
+	size_t asm_len, counts_len, output_len, status_len;
+	char *asm_text = server_receive(fd, "asm", &asm_len);
+	char *counts = asm_text == NULL ? NULL : server_receive(fd, "counts", &counts_len);
+	char *output = counts == NULL ? NULL : server_receive(fd, "output", &output_len);
+	char *status = output == NULL ? NULL : server_receive(fd, "status", &status_len);
+
+	close(fd);
+
+	if(status == NULL) {
+		printf("ERROR: The compiler server hung up\n");
+		return 1;
+	}
+
+	char out_filename[PATH_MAX];
+	int ret = atoi(status);
+
+	snprintf(out_filename, sizeof(out_filename), "%s.asm", filename);
+	if(ret == 0)
+		write_file(out_filename, asm_text, asm_len);
+	else //Like the compiler, leave no output from a failed build
+		remove(out_filename);
+	snprintf(out_filename, sizeof(out_filename), "%s.counts", filename);
+	if(ret == 0 && counts_len > 0)
+		write_file(out_filename, counts, counts_len);
+	else if(ret != 0)
+		remove(out_filename);
+	fwrite(output, 1, output_len, stdout);
+
+	free(asm_text);
+	free(counts);
+	free(output);
+	free(status);
+	free(source);
+	free(args);
+
+	return ret;
+}
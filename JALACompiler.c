@@ -2,10 +2,37 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
 #include "Stack.h"
 #include "StringOps.h"
-#include "StringList.h"
+#include "SymbolTable.h"
+#include "Machine.h"
+#include "FuncCache.h"
+#include "Server.h"
+#include "Preprocessor.h"
+#include "Program.h"
+#include "Sccp.h"
+#include "Cse.h"
+#include "DeadStore.h"
+#include "TailMerge.h"
+#include "Report.h"
+#include "LineMap.h"
+#include "Ssa.h"
+#include "Rewrite.h"
+#include "DataLayout.h"
+#include "Frame.h"
+#include "StackSched.h"
+
+#define SWITCH_LINEAR_MAX 3 ///< Switch case sets this small are tested one by one rather than split further.
+#define JUMP_TABLE_MAX_SPREAD 3 ///< A switch jump table may have up to this many entries for each case.
+#define JUMP_STUB_LEN 2 ///< Instructions in each jump table entry.
+#define FOR_TRIP_MAX 1000 ///< For loops are only followed this many iterations when working out how often they run.
+#define UNROLL_MAX_BYTES 96 ///< Most instruction memory the copies of an unrolled for loop body may take.
+#define UNROLL_MAX_FACTOR 8 ///< Most copies of a for loop body in each pass of a partially unrolled loop.
+#define SWITCH_LOAD "pushi push " ///< Instructions that load the switch selector.
+#define SWITCH_EQ SWITCH_LOAD "pushi beq" ///< Instructions that test the selector for a case.
+#define SWITCH_LT SWITCH_LOAD "pushi slt pushi beq" ///< Instructions that test which side of a case the selector is on.
 
 /** @struct Block_ct
  * Holds the current count of each type of block that needs a jump tag
@@ -16,8 +43,40 @@ typedef struct {
 	int if_ct; ///< Number of tags used in if statements.
 	int for_ct; ///< Number of tags used in for loops.
 	int while_ct; ///< Number of tags used in while loops.
+	int switch_ct; ///< Number of tags used in switch statements.
+	int cond_ct; ///< Number of tags used inside && and || conditions.
+	char break_label[STR_LEN]; ///< Where a break statement jumps to. Empty outside of switches and loops.
+	int counter_ct; ///< Number of basic block counters handed out by --instrument.
+	FILE *counter_file; ///< Side file mapping counters to source lines. NULL unless instrumenting.
+	int count_all; ///< Whether derived blocks get a counter too, to check their counts against (--instrument-all).
+	int exit_ct; ///< Number of returns and breaks read so far, which leave a block before its end.
+	int return_ct; ///< Number of returns read so far.
+	char region[4 * STR_LEN]; ///< How to compute the execution count of the block currently being read.
+	FILE *stats_file; ///< Where statistics about the generated code are printed. NULL unless --stats is given.
+	Machine *machine; ///< Description of the target's instructions and their costs.
+	Rewrite_table *rewrites; ///< Cheaper equivalents of short sequences of instructions, found by JALASuperopt.
+	int optimize; ///< 1 to run the optimisation passes over each function's code, 0 with -O0.
+	int optimize_size; ///< 1 to also run the passes that make the code smaller, with -Os.
+	FILE *report_file; ///< Where the --report on each function is written. NULL unless --report is given.
+	FILE *layout_file; ///< Where the --layout of data memory is written. NULL unless --layout is given.
+	int stack_limit; ///< How many entries the target's stack holds, or 0 if there is no limit.
+	Symbol_table *param_cts; ///< How many parameters each function seen so far takes. NULL outside of compile.
+	FILE *linemap_file; ///< Where the map from instruction addresses to source lines is written. NULL unless --linemap is given.
+	int ssa; ///< 1 to take each function's code through the SSA form and back, with --ssa.
+	FILE *ssa_file; ///< Where the SSA form of each function is printed. NULL unless --dump-ssa is given.
+	int frames; ///< 1 to keep the variables of functions other than main in a frame allocated on each call, with --frames.
+	int exp_source_depth; ///< The most stack entries an expression of the function being read needs in the order of the source.
+	int exp_depth; ///< The most stack entries an expression of the function being read needs as written.
 } Block_ct;
 
+/** @struct Switch_case
+ * One case label of a switch statement.
+ */
+typedef struct {
+	int value; ///< The constant the selector is compared to.
+	int index; ///< The position of the case in the source, used to name its jump tag.
+} Switch_case;
+
 /** @enum Comparison
  * Holds the different types of binary comparisons.
  */
@@ -25,6 +84,20 @@ typedef enum {
 	EQUAL, NOT_EQUAL, LESSER, GREATER, LESSER_EQ, GREATER_EQ
 } Comparison;
 
+/** @struct Condition
+ * A node in the tree of a condition given to an if or while.
+ * Comparisons are the leaves, and &&, || and ! join them together.
+ */
+typedef struct Condition {
+	enum {COND_COMPARE, COND_AND, COND_OR, COND_NOT, COND_SELECT} type; ///< What this node does.
+	Comparison comp; ///< The comparison of a COND_COMPARE leaf.
+	char *left; ///< Left operand expression of a COND_COMPARE leaf.
+	char *right; ///< Right operand expression of a COND_COMPARE leaf.
+	struct Condition *a; ///< First child of &&, || and !, or the test of a COND_SELECT.
+	struct Condition *b; ///< Second child of && and ||, or what a COND_SELECT tests when a is true.
+	struct Condition *c; ///< What a COND_SELECT tests when a is false.
+} Condition;
+
 /** @enum Operation
  * Distinguishes between the 4 basic operations.
  * NO_OP is to be used as kind of a "No operation need be executed at this time" marker.
@@ -33,6 +106,21 @@ typedef enum {
 	NO_OP, ADD, SUB
 } Operation;
 
+/** @struct Exp
+ * A node in the tree of an expression.
+ * Constants and variables are the leaves, and + and - join two operands.
+ */
+typedef struct Exp {
+	enum {EXP_CONST, EXP_VAR, EXP_CALL, EXP_OP} type; ///< What this node is.
+	char *word; ///< The constant, the variable or the function called.
+	Operation op; ///< ADD or SUB, for an EXP_OP.
+	struct Exp **kids; ///< The two operands of an EXP_OP, or the arguments of an EXP_CALL.
+	int kid_ct; ///< Number of operands or arguments.
+	int need; ///< How many stack entries evaluating it takes as written.
+	int source_need; ///< How many it would take evaluated in the order of the source.
+	int swapped; ///< 1 if the right operand is evaluated before the left.
+} Exp;
+
 /** @enum Type
  * Holds the different types that are recognized.
  * MAIN is special, since it shouldn't actually return anything, nor write a jr at the end of the function.
@@ -41,10 +129,48 @@ typedef enum {
 	VOID, INT, MAIN
 } Type;
 
-char * read_block(FILE *input_file, FILE *output_file, FILE *final_file, Stack *stack, String_list string_set[], Block_ct *block_ct, int *line_ct, char *curr_func);
-char * parse_exp(FILE *output_file, char *line, char *curr_func, Stack *stack, String_list string_set[]);
-char * read_if_block(FILE *input_file, FILE *output_file, FILE *final_file, Block_ct *block_ct, String_list string_set[], char *headline, Stack *stack, int *line_ct, char *curr_func);
-void read_while_block(FILE *input_file, FILE *output_file, FILE *final_file, Block_ct *block_ct, String_list string_set[], char *headline, Stack *stack, int *line_ct, char *curr_func);
+/** @struct Compile_options
+ * What was asked for on the command line, or in a request to the server.
+ */
+typedef struct {
+	char **filenames; ///< The source files, compiled one after another.
+	int file_ct; ///< Number of source files.
+	int instrument; ///< 1 if --instrument or --instrument-all was given.
+	int count_all; ///< 1 if --instrument-all was given.
+	int stats; ///< 1 if --stats was given.
+	int optimize; ///< 0 if -O0 was given, 1 otherwise.
+	int optimize_size; ///< 1 if -Os was given.
+	int report; ///< 1 if --report was given.
+	int layout; ///< 1 if --layout was given.
+	int linemap; ///< 1 if --linemap was given.
+	int ssa; ///< 1 if --ssa or --dump-ssa was given.
+	int dump_ssa; ///< 1 if --dump-ssa was given.
+	int frames; ///< 1 if --frames was given.
+	int stack_limit; ///< The limit from --stack-limit, or 0 to use the machine description's.
+	char *machine_filename; ///< The machine description from --machine, or NULL for the built-in one.
+	char *rewrites_filename; ///< The rewrite table from --rewrites, or NULL for the built-in one.
+	int server; ///< 1 if --server was given.
+	char *socket_path; ///< Where the server listens.
+} Compile_options;
+
+/** @struct Server_state
+ * What the server keeps between requests.
+ */
+typedef struct {
+	Machine machine; ///< The built-in machine description, loaded once.
+	Rewrite_table rewrites; ///< The built-in rewrite table, loaded once.
+	Func_cache cache; ///< Functions compiled by earlier requests.
+	Preprocessor pp; ///< Keeps included files read by earlier requests.
+} Server_state;
+
+char * read_block(FILE *input_file, FILE *output_file, FILE *final_file, Stack *stack, Symbol_table *symbols, Block_ct *block_ct, int *line_ct, char *curr_func);
+char * parse_exp(FILE *output_file, char *line, char *curr_func, Stack *stack, Symbol_table *symbols, Block_ct *block_ct);
+char * read_if_block(FILE *input_file, FILE *output_file, FILE *final_file, Block_ct *block_ct, Symbol_table *symbols, char *headline, Stack *stack, int *line_ct, char *curr_func);
+void read_while_block(FILE *input_file, FILE *output_file, FILE *final_file, Block_ct *block_ct, Symbol_table *symbols, char *headline, Stack *stack, int *line_ct, char *curr_func);
+void read_switch_block(FILE *input_file, FILE *output_file, FILE *final_file, Block_ct *block_ct, Symbol_table *symbols, char *headline, Stack *stack, int *line_ct, char *curr_func);
+void read_for_block(FILE *input_file, FILE *output_file, FILE *final_file, Block_ct *block_ct, Symbol_table *symbols, char *headline, Stack *stack, int *line_ct, char *curr_func);
+char * trimmed_copy(char *start, char *end);
+void emit_pattern(FILE *output_file, char *root, char *comp, char *operands[2], char *label, Block_ct *block_ct, char *curr_func, Stack *stack, Symbol_table *symbols);
 
 /**
  * Returns the first word in the line as a string.
@@ -137,35 +263,307 @@ char * read_next_line(FILE *input_file, FILE *output_file, int *line_ct) {
 	if(input_file != NULL) {
 		char *line = (char *)malloc(STR_LEN);
 
-		if(fgets(line, STR_LEN, input_file) != NULL)
-			return clean_str(line);
+		if(fgets(line, STR_LEN, input_file) != NULL) {
+			line = clean_str(line);
+
+			if(strstr(line, "#line ") == line) { //Line marker from the preprocessor, the next line has this number
+				char *path = strchr(line, '"');
+
+				*line_ct = atoi(line + 6) - 1;
+				if(path != NULL && output_file != NULL) { //And it is in this file, noted for the line map
+					path[strcspn(path + 1, "\"") + 1] = '\0';
+					fprintf(output_file, "#File: %s\n", path + 1);
+				}
+				line[0] = '\0';
+			}
+
+			return line;
+		}
 	}
 
 	return NULL;
 }
 
+/**
+ * Declares a new counter global and writes the code incrementing it, using plain push/add/pop instructions.
+ *
+ * @param output_file Assembly file that is being written.
+ * @param final_file The final output file, where the counter is declared.
+ * @param block_ct Holds the number of counters already used.
+ * @return The number of the counter.
+ */
+int emit_increment(FILE *output_file, FILE *final_file, Block_ct *block_ct) {
+	int counter = block_ct->counter_ct++;
+
+	fprintf(final_file, "\t.globl count_%d\n", counter);
+	fprintf(output_file, "\tpushi count_%d\n\tpush\n\tpushi 1\n\tadd\n\tpushi count_%d\n\tpop\n", counter, counter);
+
+	return counter;
+}
+
+/**
+ * Notes the source line that the code written next comes from, for the line map. Builds without
+ * CLEAN already note every line.
+ *
+ * @param output_file Assembly file that is being written.
+ * @param block_ct Says whether a line map is being made.
+ * @param line_ct The line number.
+ */
+void emit_line_marker(FILE *output_file, Block_ct *block_ct, int line_ct) {
+#ifdef CLEAN
+	if(block_ct->linemap_file != NULL)
+		fprintf(output_file, "#Line: %d\n", line_ct);
+#endif
+}
+
+/**
+ * Gives the basic block starting at this point its own execution counter when compiling with --instrument.
+ * The counter's function and source line are recorded in the counter side file.
+ * The counter's name becomes the region of the block, so that blocks derived from it can refer to it.
+ *
+ * @param output_file Assembly file that is being written.
+ * @param final_file The final output file, where the counter is declared.
+ * @param block_ct Holds the counter side file and the number of counters already used.
+ * @param line_ct The line number that is currently being parsed.
+ * @param curr_func The name of the function currently being parsed.
+ * @param kind What sort of block is being counted (entry, if, while, while_end or after_if).
+ */
+void emit_counter(FILE *output_file, FILE *final_file, Block_ct *block_ct, int line_ct, char *curr_func, char *kind) {
+	if(block_ct->counter_file == NULL)
+		return;
+
+	int counter = emit_increment(output_file, final_file, block_ct);
+
+	fprintf(block_ct->counter_file, "count_%d %s %d %s\n", counter, curr_func, line_ct, kind);
+
+	sprintf(block_ct->region, "count_%d", counter);
+}
+
+/**
+ * Gives a block whose count is derived a counter of its own anyway when compiling with --instrument-all,
+ * so that the count derived for it can be checked against the one measured.
+ *
+ * @param output_file Assembly file that is being written.
+ * @param final_file The final output file, where the counter is declared.
+ * @param block_ct Holds the counter side file and the number of counters already used.
+ * @return The number of the counter, or -1 if the block gets none.
+ */
+int emit_check_counter(FILE *output_file, FILE *final_file, Block_ct *block_ct) {
+	if(block_ct->counter_file == NULL || !block_ct->count_all)
+		return -1;
+
+	return emit_increment(output_file, final_file, block_ct);
+}
+
+/**
+ * Records a basic block that gets no counter of its own because its execution count can be computed
+ * from the counters of other blocks.
+ *
+ * @param block_ct Holds the counter side file.
+ * @param line_ct The line number the block starts at.
+ * @param curr_func The name of the function currently being parsed.
+ * @param kind What sort of block this is (else, while_condition, after_if or after_while).
+ * @param count The expression over other counters giving this block's execution count.
+ * @param check The counter given to the block by emit_check_counter, or -1.
+ */
+void emit_derived_counter(Block_ct *block_ct, int line_ct, char *curr_func, char *kind, char *count, int check) {
+	if(block_ct->counter_file == NULL)
+		return;
+
+	fprintf(block_ct->counter_file, "derived %s %d %s %s", curr_func, line_ct, kind, count);
+	if(check >= 0)
+		fprintf(block_ct->counter_file, " count_%d", check);
+	fprintf(block_ct->counter_file, "\n");
+}
+
+/**
+ * Builds the tree of an expression. + and - join terms from left to right, and each term is a
+ * constant, a variable, a function call or a group in parentheses. A - with nothing before it
+ * takes its term from 0.
+ *
+ * @param str The expression.
+ * @param end Set to where the expression stops: at the end of the string, a ;, a , or a comparison,
+ *            or a ) with no ( to match it.
+ * @return The root of the tree, or NULL if the expression is empty. Must be freed with free_exp.
+ */
+Exp * parse_exp_tree(char *str, char **end) {
+	Exp *tree = NULL;
+	Operation next_op = NO_OP;
+
+	while(*str != '\0' && strchr(";,=<>!)", *str) == NULL) {
+		Exp *term = NULL;
+
+		if(*str == ' ' || *str == '\t') {
+			str++;
+			continue;
+		} else if(*str == '+' || *str == '-') {
+			next_op = *str++ == '+' ? ADD : SUB;
+			continue;
+		} else if(*str == '(') {
+			term = parse_exp_tree(str + 1, &str);
+			if(*str == ')')
+				str++;
+		} else if(isalnum(*str)) {
+			char *start = str;
+
+			while(isalnum(*str))
+				str++;
+
+			term = (Exp *)calloc(1, sizeof(Exp));
+			term->type = isdigit(*start) ? EXP_CONST : EXP_VAR;
+			term->word = strndup(start, str - start);
+
+			if(*str == '(') { //Function call, with each argument up to the next , or the closing )
+				term->type = EXP_CALL;
+				str++;
+				while(1) {
+					Exp *arg = parse_exp_tree(str, &str);
+
+					if(arg != NULL) {
+						term->kids = (Exp **)realloc(term->kids, (term->kid_ct + 1) * sizeof(Exp *));
+						term->kids[term->kid_ct++] = arg;
+					}
+					if(*str != ',')
+						break;
+					str++;
+				}
+				if(*str == ')')
+					str++;
+			}
+		} else { //Not part of an expression
+			str++;
+			continue;
+		}
+
+		if(term == NULL)
+			continue;
+
+		if(tree == NULL && next_op != SUB) {
+			tree = term;
+		} else {
+			Exp *op = (Exp *)calloc(1, sizeof(Exp));
+
+			op->type = EXP_OP;
+			op->op = next_op == SUB ? SUB : ADD;
+			op->kid_ct = 2;
+			op->kids = (Exp **)malloc(2 * sizeof(Exp *));
+			if(tree == NULL) {
+				tree = (Exp *)calloc(1, sizeof(Exp));
+				tree->type = EXP_CONST;
+				tree->word = strdup("0");
+			}
+			op->kids[0] = tree;
+			op->kids[1] = term;
+			tree = op;
+		}
+		next_op = NO_OP;
+	}
+
+	*end = str;
+
+	return tree;
+}
+
+/**
+ * Frees an expression tree.
+ *
+ * @param exp The root of the tree.
+ */
+void free_exp(Exp *exp) {
+	if(exp == NULL)
+		return;
+
+	for(int i = 0; i < exp->kid_ct; i++)
+		free_exp(exp->kids[i]);
+	free(exp->kids);
+	free(exp->word);
+	free(exp);
+}
+
+/**
+ * Labels each node of an expression tree with how many stack entries evaluating it takes, the
+ * Sethi-Ullman number. Where the right operand of a + takes more than the left, it is evaluated
+ * first, so that only its result waits on the stack while the left is worked out. The operands
+ * of a - and the arguments of a call keep their order, since there is no instruction to swap them.
+ *
+ * @param exp The root of the tree.
+ * @param var_ct How many variables a call saves on the stack before its arguments.
+ * @param reorder 1 to reorder the operands of +, 0 to keep the order of the source.
+ */
+void label_exp(Exp *exp, int var_ct, int reorder) {
+	Exp *a, *b;
+
+	for(int i = 0; i < exp->kid_ct; i++)
+		label_exp(exp->kids[i], var_ct, reorder);
+
+	switch(exp->type) {
+	case EXP_CONST:
+	case EXP_VAR:
+		exp->need = exp->source_need = 1;
+		break;
+	case EXP_CALL: //Saved variables, then each argument on top of those before it, then the tag and the result
+		exp->need = exp->source_need = exp->kid_ct + 1 > 2 ? exp->kid_ct + 1 : 2;
+		for(int i = 0; i < exp->kid_ct; i++) {
+			if(i + exp->kids[i]->need > exp->need)
+				exp->need = i + exp->kids[i]->need;
+			if(i + exp->kids[i]->source_need > exp->source_need)
+				exp->source_need = i + exp->kids[i]->source_need;
+		}
+		exp->need += var_ct;
+		exp->source_need += var_ct;
+		break;
+	case EXP_OP:
+		a = exp->kids[0];
+		b = exp->kids[1];
+		exp->source_need = a->source_need > b->source_need + 1 ? a->source_need : b->source_need + 1;
+		exp->swapped = reorder && exp->op == ADD && b->need > a->need;
+		if(exp->swapped)
+			exp->need = b->need > a->need + 1 ? b->need : a->need + 1;
+		else
+			exp->need = a->need > b->need + 1 ? a->need : b->need + 1;
+		break;
+	}
+}
+
+void emit_exp(FILE *output_file, Exp *exp, char *curr_func, Stack *stack, Symbol_table *symbols, Block_ct *block_ct);
+
 /**
  * Handles calling a function. Pushed parameters onto the stack, then handles jumping to the function.
  * This won't handle assigning a variable to the output, if there is one. That will be handled elsewhere.
+ * With --frames the callee keeps its variables in a frame of its own, so the caller's variables are
+ * not saved around the call and the result is left on the stack where the callee put it.
  *
  * @param output_file The assembly file that is being written to.
- * @param line The line where the function is being called.
- * @param name The name of the function.
+ * @param call The call in the expression tree, with an argument for each parameter.
  * @param curr_func The name of the function currently being parsed.
  * @param stack The current state of the stack.
- * @param string_set The hashmap of all the variables and their memory locations.
+ * @param symbols The table of all the variables and their memory locations.
+ * @param block_ct Tells which calling convention is used.
  */
-void func_call(FILE *output_file, char *line, char *name, char *curr_func, Stack *stack, String_list string_set[]) {
+void func_call(FILE *output_file, Exp *call, char *curr_func, Stack *stack, Symbol_table *symbols, Block_ct *block_ct) {
+	char *name = call->word;
+
 #ifndef CLEAN
 	fprintf(output_file, "\t#Calling function %s\n", name);
 #endif
-	char *call_line = strstr(line, name) + strlen(name) + 1; //The line starting after the name. Plus 1 for the parenthesis
+	if(block_ct->frames) {
+		for(int i = 0; i < call->kid_ct; i++)
+			emit_exp(output_file, call->kids[i], curr_func, stack, symbols, block_ct);
+		fprintf(output_file, "\tpushi %s\n\tjpush\n", name);
+#ifndef CLEAN
+		fprintf(output_file, "\n");
+#endif
+		return;
+	}
+
 	int var_ct = 0;
 
-	for(int i = 0; i < LIST_LEN; i++) {
-		for(int j = 0; j < string_set[i].length; j++) {
-			stack_push(stack, string_set[i].keys[j]);
-			fprintf(output_file, "\tpushi %s\n\tpush\n", string_set[i].keys[j]);
+	for(int i = 0; i < symbols->capacity; i++) {
+		char *key = symbol_table_slot_key(symbols, i);
+
+		if(key != NULL) {
+			stack_push(stack, key);
+			fprintf(output_file, "\tpushi %s\n\tpush\n", key);
 			var_ct++;
 		}
 	}
@@ -173,10 +571,8 @@ void func_call(FILE *output_file, char *line, char *name, char *curr_func, Stack
 	fprintf(output_file, "\n");
 #endif
 
-	while(strchr(call_line, ',') != 0) {
-		call_line = parse_exp(output_file, call_line, curr_func, stack, string_set) + 1;
-	}
-	parse_exp(output_file, call_line, curr_func, stack, string_set); //Once more for last parameter.
+	for(int i = 0; i < call->kid_ct; i++)
+		emit_exp(output_file, call->kids[i], curr_func, stack, symbols, block_ct);
 
 	fprintf(output_file, "\tpushi %s\n\tjpush\n", name);
 #ifndef CLEAN
@@ -194,84 +590,136 @@ void func_call(FILE *output_file, char *line, char *name, char *curr_func, Stack
 }
 
 /**
- * Parses a mathematical expression recursively and writes it to the output.
+ * Writes the code of a labelled expression tree, leaving its value on the stack.
+ *
+ * @param output_file The assembly output file.
+ * @param exp The root of the tree.
+ * @param curr_func The name of the function currently being parsed.
+ * @param stack The current state of the stack in memory.
+ * @param symbols The table of where all variables are stored in memory.
+ * @param block_ct Tells which calling convention is used.
+ */
+void emit_exp(FILE *output_file, Exp *exp, char *curr_func, Stack *stack, Symbol_table *symbols, Block_ct *block_ct) {
+	switch(exp->type) {
+	case EXP_CONST:
+		fprintf(output_file, "\tpushi %s\n", exp->word);
+		break;
+	case EXP_VAR:
+		fprintf(output_file, "\tpushi %s_%s\n\tpush\n", curr_func, exp->word);
+		break;
+	case EXP_CALL:
+		func_call(output_file, exp, curr_func, stack, symbols, block_ct);
+		break;
+	case EXP_OP:
+		emit_exp(output_file, exp->kids[exp->swapped], curr_func, stack, symbols, block_ct);
+		emit_exp(output_file, exp->kids[!exp->swapped], curr_func, stack, symbols, block_ct);
+		fprintf(output_file, exp->op == ADD ? "\tadd\n" : "\tsub\n");
+		break;
+	}
+}
+
+/**
+ * Parses a mathematical expression and writes it to the output. Unless optimising is turned off, the
+ * operands of each + are put in the order that needs the fewest stack entries.
  *
  * @param output_file The assembly output file.
  * @param line The line starting at the beginning of the expression.
  * @param curr_func The name of the function currently being parsed.
  * @param stack The current state of the stack in memory.
- * @param string_set The hashmap of where all variables are stored in memory.
- * @return The line starting at the end of the evaluated expression. Mostly used for recursion.
+ * @param symbols The table of where all variables are stored in memory.
+ * @param block_ct Tells whether to optimise, and keeps the most stack entries an expression needed.
+ * @return The line starting at the end of the evaluated expression.
  */
-char * parse_exp(FILE *output_file, char *line, char *curr_func, Stack *stack, String_list string_set[]) {
-	Operation next_op = NO_OP;
-	int base = 0;
-	char *word;
+char * parse_exp(FILE *output_file, char *line, char *curr_func, Stack *stack, Symbol_table *symbols, Block_ct *block_ct) {
+	char *end;
+	Exp *exp = parse_exp_tree(line, &end);
 
-	while(strlen(line + base) > 0 && line[base] != ';' && line[base] != ',' && line[base] != '=' && line[base] != '>' && line[base] != '<' && line[base] != '!') {
-		while(line[base] == ' ')
-			base++;
+	if(exp == NULL)
+		return end;
 
-		if(line[base] == '(') { //Opens a new parse_exp instance to handle the inside of the expression.
-			base++;
-			line = parse_exp(output_file, line + base, curr_func, stack, string_set);
-
-			switch(next_op) {
-			case NO_OP:
-				break;
-			case ADD:
-				fprintf(output_file, "\tadd\n");
-				next_op = NO_OP;
-				break;
-			case SUB:
-				fprintf(output_file, "\tsub\n");
-				next_op = NO_OP;
-				break;
-			}
-		} else if(line[base] == ')' || line[base] == '<' ||  line[base] == '>' ||  line[base] == '=' ||  line[base] == '!') { //Reached the end of this expression return.
-			if(line[base + 1] == '=')
-				return line + base + 2;
+	label_exp(exp, block_ct->frames ? 0 : symbols->length, block_ct->optimize);
+	if(exp->source_need > block_ct->exp_source_depth)
+		block_ct->exp_source_depth = exp->source_need;
+	if(exp->need > block_ct->exp_depth)
+		block_ct->exp_depth = exp->need;
 
-			return line + base + 1;
-		} else if(line[base] == '+') {
-			base++;
-			next_op = ADD;
-		} else if(line[base] == '-') {
-			base++;
-			next_op = SUB;
-		} else {
-			word = read_word(line + base);
-			base = (strstr(line, word) - line) + strlen(word); //Update the base
+	emit_exp(output_file, exp, curr_func, stack, symbols, block_ct);
+	free_exp(exp);
 
-			if(strchr(word, '(') != 0) { //This is a function call.
-				word[strlen(word) - strlen(strchr(word, '('))] = '\0';
-				func_call(output_file, line, word, curr_func, stack, string_set);
-			} else {
-				if(word[0] >= 48 && word[0] <= 57) { //Is a constant
-					fprintf(output_file, "\tpushi %s\n", word);
-				} else { //Variable
-					fprintf(output_file, "\tpushi %s_%s\n\tpush\n", curr_func, word);
-				}
+	return end;
+}
 
-				switch(next_op) {
-				case NO_OP:
-					break;
-				case ADD:
-					fprintf(output_file, "\tadd\n");
-					next_op = NO_OP;
-					break;
-				case SUB:
-					fprintf(output_file, "\tsub\n");
-					next_op = NO_OP;
-					break;
-				}
-			}
+/**
+ * Writes the assembly code for a single statement line: a variable definition or assignment, or the
+ * header of an if, while or switch block, in which case the whole block is read.
+ *
+ * @param input_file File that is being compiled.
+ * @param output_file Assembly file that is being written.
+ * @param final_file The final rendition of the output file.
+ * @param line The line holding the statement. Will not be freed.
+ * @param stack The current status of the stack at this point in the code.
+ * @param symbols Table linking variables to memory addresses.
+ * @param block_ct Keeps track of the number of each type of block so as to give each unique names.
+ * @param line_ct The line number that is currently being parsed.
+ * @param curr_func The name of the function currently being parsed.
+ * @return A line that was read past the end of the statement and still has to be handled, or NULL.
+ */
+char * read_statement(FILE *input_file, FILE *output_file, FILE *final_file, char *line, Stack *stack, Symbol_table *symbols, Block_ct *block_ct, int *line_ct, char *curr_func) {
+	char *first_word = read_word(line);
+	char *next_line = NULL;
+
+	emit_line_marker(output_file, block_ct, *line_ct);
+
+	if(strstr(first_word, "if") == first_word) { //Check for if statement
+#ifdef DEBUG
+		printf("Reading if statement. With word %s.\n", first_word);
+#endif
+		next_line = read_if_block(input_file, output_file, final_file, block_ct, symbols, line, stack, line_ct, curr_func);
+	} else if(strstr(first_word, "while") == first_word) { //Check for while loop
+		read_while_block(input_file, output_file, final_file, block_ct, symbols, line, stack, line_ct, curr_func);
+	} else if(strcmp(first_word, "for") == 0) { //Check for for loop
+		read_for_block(input_file, output_file, final_file, block_ct, symbols, line, stack, line_ct, curr_func);
+	} else if(strstr(first_word, "switch") == first_word) { //Check for switch statement
+		read_switch_block(input_file, output_file, final_file, block_ct, symbols, line, stack, line_ct, curr_func);
+	} else if(strstr(first_word, "break") == first_word) { //Leave the innermost switch or loop
+		if(block_ct->break_label[0] == '\0')
+			printf("ERROR: break outside of a switch or loop in line %s\n", line);
+		else
+			fprintf(output_file, "\tpushi %s\n\tjpop\n", block_ct->break_label);
+		block_ct->exit_ct++;
+	} else {
+		if(strstr(first_word, "int") > 0) { // Is the line a variable definition?
+			free(first_word);
+			first_word = read_word(line + 3);
+
+#ifdef DEBUG
+			printf("Found declaration of variable %s_%s.\n", curr_func, first_word);
+#endif
+
+            if(!block_ct->frames || strcmp(curr_func, "main") == 0)
+                fprintf(final_file, "\t.globl %s_%s\n", curr_func, first_word);
+
+			char var[STR_LEN];
+			snprintf(var, STR_LEN, "%s_%s", curr_func, first_word);
+			symbol_table_add(symbols, var, symbols->length);
+		}
+
+		if(strchr(line, '=') > 0) { //There is a variable assignment.
+			char *eq = strchr(line, '=');
+			char *end = strchr(eq, ';') != NULL ? strchr(eq, ';') : eq + strlen(eq);
+			char *operands[] = {first_word, trimmed_copy(eq + 1, end)};
+			char *root = eq[-1] == '+' ? "ADDSET" : eq[-1] == '-' ? "SUBSET" : "SET";
 
-			free(word);
+			emit_pattern(output_file, root, "", operands, NULL, block_ct, curr_func, stack, symbols);
+			free(operands[1]);
+		} else {
+			parse_exp(output_file, line, curr_func, stack, symbols, block_ct);
 		}
 	}
 
-	return line + base;
+	free(first_word);
+
+	return next_line;
 }
 
 /**
@@ -283,14 +731,14 @@ char * parse_exp(FILE *output_file, char *line, char *curr_func, Stack *stack, S
  * @param final_file The final rendition of the output file.
  * @param block_ct Keeps track of the number of each type of block so as to give each unique names.
  * @param stack The current status of the stack at this point in the code.
- * @param string_set Hashmap linking variables to memory addresses.
+ * @param symbols Table linking variables to memory addresses.
  * @param line_ct The line number that is currently being parsed.
  * @param curr_func The name of the function currently being parsed.
  * @return The last line read which includes the closing }.
  */
-char * read_block(FILE *input_file, FILE *output_file, FILE *final_file, Stack *stack, String_list string_set[], Block_ct *block_ct, int *line_ct, char *curr_func) {
+char * read_block(FILE *input_file, FILE *output_file, FILE *final_file, Stack *stack, Symbol_table *symbols, Block_ct *block_ct, int *line_ct, char *curr_func) {
 	char *line = read_next_line(input_file, output_file, line_ct);
-	char *first_word = NULL;
+	char *next_line;
 
 	while(strchr(line, '}') <= 0 && strstr(line, "return") <= 0) {
 		if(strlen(line) == 0) { //Check if line is empty
@@ -299,49 +747,38 @@ char * read_block(FILE *input_file, FILE *output_file, FILE *final_file, Stack *
 			continue;
 		}
 
-		first_word = read_word(line);
-
-		if(strstr(first_word, "if") == first_word) { //Check for if statement
-#ifdef DEBUG
-			printf("Reading if statement. With word %s.\n", first_word);
-#endif
-			line = read_if_block(input_file, output_file, final_file, block_ct, string_set, line, stack, line_ct, curr_func);
-		} else if(strstr(first_word, "while") == first_word) { //Check for while loop
-			read_while_block(input_file, output_file, final_file, block_ct, string_set, line, stack, line_ct, curr_func);
-		} else {
-			if(strstr(first_word, "int") > 0) { // Is the line a variable definition?
-				first_word = read_word(line + 3);
-
-#ifdef DEBUG
-				printf("Found declaration of variable %s_%s.\n", curr_func, first_word);
-#endif
+		next_line = read_statement(input_file, output_file, final_file, line, stack, symbols, block_ct, line_ct, curr_func);
 
-                fprintf(final_file, "\t.globl %s_%s\n", curr_func, first_word);
-			}
+		free(line);
+		line = next_line != NULL ? next_line : read_next_line(input_file, output_file, line_ct);
+	}
+	emit_line_marker(output_file, block_ct, *line_ct); //For the return or the end of the block
 
-			if(strchr(line, '=') > 0) { //There is a variable assignment.
-				if((strchr(line, '=') - 1)[0] == '+') { //+= operator
-					fprintf(output_file, "\tpushi %s_%s\n", curr_func, first_word);
-					parse_exp(output_file, strchr(line, '=') + 1, curr_func, stack, string_set);
-					fprintf(output_file, "\tadd\n\tpushi %s_%s\n\tpop\n", curr_func, first_word);
-				} else if((strchr(line, '=') - 1)[0] == '-') { //-= operator
-					fprintf(output_file, "\tpushi %s_%s\n", curr_func, first_word);
-					parse_exp(output_file, strchr(line, '=') + 1, curr_func, stack, string_set);
-					fprintf(output_file, "\tsub\n\tpushi %s_%s\n\tpop\n", curr_func, first_word);
-				} else {
-					parse_exp(output_file, strchr(line, '=') + 1, curr_func, stack, string_set);
-					fprintf(output_file, "\tpushi %s_%s\n\tpop\n", curr_func, first_word);
-				}
-			} else {
-				parse_exp(output_file, line, curr_func, stack, string_set);
-			}
-		}
+	return line;
+}
 
+/**
+ * Writes a return statement that ends a block and skips ahead to the closing } of the block.
+ *
+ * @param input_file File that is being compiled.
+ * @param output_file Assembly file that is being written.
+ * @param line The line holding the return statement. Will be freed.
+ * @param stack The current status of the stack at this point in the code.
+ * @param symbols Table linking variables to memory addresses.
+ * @param block_ct Tells whether to optimise the returned expression.
+ * @param line_ct The line number that is currently being parsed.
+ * @param curr_func The name of the function currently being parsed.
+ * @return The line holding the closing }.
+ */
+char * read_block_return(FILE *input_file, FILE *output_file, char *line, Stack *stack, Symbol_table *symbols, Block_ct *block_ct, int *line_ct, char *curr_func) {
+	parse_exp(output_file, line + 6, curr_func, stack, symbols, block_ct);
+	while(!strchr(line, '}')) {
 		free(line);
-		free(first_word);
 		line = read_next_line(input_file, output_file, line_ct);
 	}
 
+	fprintf(output_file, "\tjr\n");
+
 	return line;
 }
 
@@ -372,202 +809,1194 @@ void read_func_header(Stack *stack, char *headline, char *curr_func) {
 }
 
 /**
- * Reads a while loop block and writes the needed assembly code to the file.
+ * Returns a copy of part of a string with the leading and trailing spaces removed.
  *
- * @param input_file File that is being compiled.
- * @param output_file Assembly file that is being written.
- * @param final_file Final output file
- * @param block_ct Keeps track of the number of each type of block so as to give each unique names.
- * @param string_set The hashmap containing the addresses of each variable in memory.
- * @param headline String representation of the header line of this if statement.
- * @param stack The current status of the stack at this point in the code.
- * @param line_ct The line number that is currently being parsed.
- * @param curr_func The name of the function currently being parsed.
+ * @param start The first character of the part.
+ * @param end The character after the last character of the part.
+ * @return The trimmed copy, which must be freed.
  */
-void read_while_block(FILE *input_file, FILE *output_file, FILE *final_file, Block_ct *block_ct, String_list string_set[], char *headline, Stack *stack, int *line_ct, char *curr_func) {
-	String_list local_set[LIST_LEN];
-	string_set_cpy(local_set, string_set);
+char * trimmed_copy(char *start, char *end) {
+	while(start < end && (*start == ' ' || *start == '\t'))
+		start++;
+	while(end > start && (end[-1] == ' ' || end[-1] == '\t'))
+		end--;
 
-	int while_ct = block_ct->while_ct++;
+	return strndup(start, end - start);
+}
 
-	char *line = (char *)malloc(STR_LEN);
-	line[0] = '\0';
-	strcpy(line, headline);
+/**
+ * Finds the first place an operator appears outside of any parentheses.
+ *
+ * @param str The string to be searched through.
+ * @param op The operator to be searched for.
+ * @return A pointer to the operator in str, or NULL if it is not there.
+ */
+char * find_top_level(char *str, char *op) {
+	int depth = 0;
+
+	for(char *c = str; *c != '\0'; c++) {
+		if(*c == '(')
+			depth++;
+		else if(*c == ')')
+			depth--;
+		else if(depth == 0 && strncmp(c, op, strlen(op)) == 0)
+			return c;
+	}
 
-	fprintf(output_file, "start_while_%d:\n", while_ct);
-	//Find which comparison is being used
-	//Key: if(A [comp] B)
-#ifndef CLEAN
-	fprintf(output_file, "\t#%s\n", line);
-#endif
-	if(strstr(line, "==") > 0) { //A, B, bne
-		parse_exp(output_file, strchr(line, '(') + 1, curr_func, stack, string_set);
-		parse_exp(output_file, strchr(line, '=') + 2, curr_func, stack, string_set);
-
-		fprintf(output_file, "\tbne end_while_%d\n", while_ct);
-	} else if(strstr(line, "!=") > 0) { //A, B, beq
-		parse_exp(output_file, strchr(line, '(') + 1, curr_func, stack, string_set);
-		parse_exp(output_file, strchr(line, '=') + 1, curr_func, stack, string_set);
-
-		fprintf(output_file, "\tbeq end_while_%d\n", while_ct);
-	} else if(strstr(line, ">=") > 0) { //A, B, slt, 1, beq
-		parse_exp(output_file, strchr(line, '(') + 1, curr_func, stack, string_set);
-		parse_exp(output_file, strchr(line, '=') + 1, curr_func, stack, string_set);
-
-		fprintf(output_file, "\tslt\n\tpushi 1\n");
-		fprintf(output_file, "\tbeq end_while_%d\n", while_ct);
-	} else if(strstr(line, "<=") > 0) { //B, A, slt, 1, beq
-		parse_exp(output_file, strchr(line, '=') + 1, curr_func, stack, string_set);
-		parse_exp(output_file, strchr(line, '(') + 1, curr_func, stack, string_set);
-
-		fprintf(output_file, "\tslt\n\tpushi 1\n");
-		fprintf(output_file, "\tbeq end_while_%d\n", while_ct);
-	} else if(strchr(line, '>') > 0) { //B, A, slt, 1, bne
-		parse_exp(output_file, strchr(line, '>') + 1, curr_func, stack, string_set);
-		parse_exp(output_file, strchr(line, '('), curr_func, stack, string_set);
-
-		fprintf(output_file, "\tslt\n\tpushi 1\n");
-		fprintf(output_file, "\tbne end_while_%d\n", while_ct);
-	} else if(strchr(line, '<') > 0) { //A, B, slt, 1, bne
-		parse_exp(output_file, strchr(line, '(') + 1, curr_func, stack, string_set);
-		parse_exp(output_file, strchr(line, '<') + 1, curr_func, stack, string_set);
-
-		fprintf(output_file, "\tslt\n\tpushi 1\n");
-		fprintf(output_file, "\tbne end_while_%d\n", while_ct);
-	} else {
-		printf("ERROR: Unrecognized comparison in line %s\n", headline);
-		parse_exp(output_file, strchr(headline, '('), curr_func, stack, string_set);
+	return NULL;
+}
+
+/**
+ * Returns the parenthesis matching the one at the start of the string.
+ *
+ * @param str A string starting with (.
+ * @return A pointer to the matching ), or NULL if there is none.
+ */
+char * matching_paren(char *str) {
+	int depth = 0;
+
+	for(char *c = str; *c != '\0'; c++) {
+		if(*c == '(')
+			depth++;
+		else if(*c == ')' && --depth == 0)
+			return c;
 	}
 
-#ifndef CLEAN
-	fprintf(output_file, "\n");
-#endif
-	free(line);
+	return NULL;
+}
 
-	line = read_block(input_file, output_file, final_file, stack, local_set, block_ct, line_ct, curr_func);
+/**
+ * Finds the end of the operand of a unary ! or -: a name, a number, a call or a parenthesized part.
+ *
+ * @param str The string starting with the operand.
+ * @return A pointer to the character after the operand.
+ */
+char * unary_end(char *str) {
+	while(*str == ' ' || *str == '\t' || *str == '-' || (str[0] == '!' && str[1] != '='))
+		str++;
+	if(*str != '(')
+		while(char_is_letter(*str) || (*str >= '0' && *str <= '9') || *str == '_')
+			str++;
+	if(*str == '(' && matching_paren(str) != NULL) //A call or a parenthesized part
+		str = matching_paren(str) + 1;
+
+	return str;
+}
 
-	if(strstr(line, "return") == line) { //there was a return statement ending this block
-		parse_exp(output_file, line + 6, curr_func, stack, string_set);
-		while(!strchr(line, '}')) {
-			free(line);
-			line = read_next_line(input_file, output_file, line_ct);
+/**
+ * Builds the tree of a condition. || binds loosest, then &&, then the comparisons, and ! applies only
+ * to the operand right after it, as in C. A leaf without a comparison is true when its value is not 0.
+ *
+ * @param str The condition, without the parentheses of the if or while around it.
+ * @return The root of the tree, which must be freed with free_condition.
+ */
+Condition * parse_condition(char *str) {
+	Condition *cond = (Condition *)calloc(1, sizeof(Condition));
+	char *trimmed = trimmed_copy(str, str + strlen(str));
+	char *op;
+
+	if((op = find_top_level(trimmed, "||")) != NULL || (op = find_top_level(trimmed, "&&")) != NULL) {
+		cond->type = op[0] == '|' ? COND_OR : COND_AND;
+		*op = '\0';
+		cond->a = parse_condition(trimmed);
+		cond->b = parse_condition(op + 2);
+	} else if(trimmed[0] == '!' && trimmed[1] != '=' && *unary_end(trimmed + 1) == '\0') {
+		cond->type = COND_NOT;
+		cond->a = parse_condition(trimmed + 1);
+	} else if(trimmed[0] == '!' && trimmed[1] != '=') { //Something like !a == b, which is 1 == b when a is 0 and 0 == b when it is not
+		char *rest = unary_end(trimmed + 1);
+		char *text = (char *)malloc(strlen(rest) + 2);
+
+		cond->type = COND_SELECT;
+		cond->b = parse_condition(strcat(strcpy(text, "1"), rest));
+		cond->c = parse_condition(strcat(strcpy(text, "0"), rest));
+		*rest = '\0';
+		cond->a = parse_condition(trimmed);
+		free(text);
+	} else if(trimmed[0] == '(' && matching_paren(trimmed) == trimmed + strlen(trimmed) - 1) { //Parentheses around everything
+		free(cond);
+		trimmed[strlen(trimmed) - 1] = '\0';
+		cond = parse_condition(trimmed + 1);
+	} else {
+		//Key: A [comp] B, where the comparison is written in that many characters
+		char *ops[] = {"==", "!=", "<=", ">=", "<", ">"};
+		Comparison comps[] = {EQUAL, NOT_EQUAL, LESSER_EQ, GREATER_EQ, LESSER, GREATER};
+
+		cond->type = COND_COMPARE;
+		for(int i = 0; i < 6 && cond->left == NULL; i++) {
+			if((op = find_top_level(trimmed, ops[i])) != NULL) {
+				cond->comp = comps[i];
+				cond->left = trimmed_copy(trimmed, op);
+				cond->right = trimmed_copy(op + strlen(ops[i]), trimmed + strlen(trimmed));
+			}
 		}
 
-		fprintf(output_file, "\tjr\n");
+		if(cond->left == NULL) { //Plain value, true when not 0
+			cond->comp = NOT_EQUAL;
+			cond->left = strdup(trimmed);
+			cond->right = strdup("0");
+		}
 	}
 
-	free(line);
-	fprintf(output_file, "\tpushi start_while_%d\n\tjpop\nend_while_%d:\n", while_ct, while_ct);
+	free(trimmed);
+
+	return cond;
 }
 
 /**
- * Reads an if block and writes the needed assembly code to the file.
+ * Frees a condition tree.
+ *
+ * @param cond The root of the tree.
+ */
+void free_condition(Condition *cond) {
+	if(cond == NULL)
+		return;
+
+	free_condition(cond->a);
+	free_condition(cond->b);
+	free_condition(cond->c);
+	free(cond->left);
+	free(cond->right);
+	free(cond);
+}
+
+/**
+ * Works out a comparison between two numbers.
+ *
+ * @param comp The comparison.
+ * @param a The left side.
+ * @param b The right side.
+ * @return 1 if the comparison holds, 0 otherwise.
+ */
+int compare_constants(Comparison comp, int a, int b) {
+	int truth[] = {a == b, a != b, a < b, a > b, a <= b, a >= b};
+
+	return truth[comp];
+}
+
+/**
+ * Writes a comparison or assignment using the cheapest pattern of the machine description that fits it.
+ * Each operand's code is generated once, and its cost weighs in on which pattern is picked.
  *
- * @param input_file File that is being compiled.
  * @param output_file Assembly file that is being written.
- * @param final_file Final output file.
- * @param block_ct Keeps track of the number of each type of block so as to give each unique names.
- * @param string_set The hashmap containing the addresses of each variable in memory.
- * @param headline String representation of the header line of this if statement.
- * @param stack The current status of the stack at this point in the code.
- * @param line_ct The line number that is currently being parsed.
+ * @param root JT, JF, SET, ADDSET or SUBSET. See jala.machine.
+ * @param comp The comparison for JT and JF, such as EQ. Ignored for assignments.
+ * @param operands The two operand expressions.
+ * @param label The tag that JT and JF jump to.
+ * @param block_ct Holds the machine description.
  * @param curr_func The name of the function currently being parsed.
- * @return The last line read, that being the first line outside of the if statement.
- * This is necessary as it must check the next line for an else.
+ * @param stack The current status of the stack at this point in the code.
+ * @param symbols The table containing the addresses of each variable in memory.
  */
-char * read_if_block(FILE *input_file, FILE *output_file, FILE *final_file, Block_ct *block_ct, String_list string_set[], char *headline, Stack *stack, int *line_ct, char *curr_func) {
-	String_list local_set[LIST_LEN]; //Holds any variable declarations inside the if block
-	string_set_cpy(local_set, string_set);
+void emit_pattern(FILE *output_file, char *root, char *comp, char *operands[2], char *label, Block_ct *block_ct, char *curr_func, Stack *stack, Symbol_table *symbols) {
+	char *code[2] = {NULL, NULL};
+	int cycles[2];
 
-	int if_ct = block_ct->if_ct++;
+	for(int i = 0; i < 2; i++) {
+		size_t len = 0;
+		FILE *code_file = open_memstream(&code[i], &len);
 
-	char *line = (char *)malloc(STR_LEN);
-	line[0] = '\0';
-	strcpy(line, headline);
+		parse_exp(code_file, operands[i], curr_func, stack, symbols, block_ct);
+		fclose(code_file);
+		cycles[i] = machine_asm_cycles(block_ct->machine, code[i]);
+	}
 
-#ifndef CLEAN
-	fprintf(output_file, "\t#%s\n", headline);
-#endif
+	Machine_pattern *pattern = machine_select(block_ct->machine, root, comp, operands, cycles);
 
-	//Find which comparison is being used
-	//Key: if(A [comp] B)
-	if(strstr(line, "==") > 0) { //A, B, bne
-		parse_exp(output_file, strchr(line, '(') + 1, curr_func, stack, string_set);
-		parse_exp(output_file, strchr(line, '=') + 2, curr_func, stack, string_set);
-
-		fprintf(output_file, "\tbne end_if_%d\n", if_ct);
-	} else if(strstr(line, "!=") > 0) { //A, B, beq
-		parse_exp(output_file, strchr(line, '(') + 1, curr_func, stack, string_set);
-		parse_exp(output_file, strchr(line, '=') + 1, curr_func, stack, string_set);
-
-		fprintf(output_file, "\tbeq end_if_%d\n", if_ct);
-	} else if(strstr(line, ">=") > 0) { //A, B, slt, 1, beq
-		parse_exp(output_file, strchr(line, '(') + 1, curr_func, stack, string_set);
-		parse_exp(output_file, strchr(line, '=') + 1, curr_func, stack, string_set);
-
-		fprintf(output_file, "\tslt\n\tpushi 1\n");
-		fprintf(output_file, "\tbeq end_if_%d\n", if_ct);
-	} else if(strstr(line, "<=") > 0) { //B, A, slt, 1, beq
-		parse_exp(output_file, strchr(line, '=') + 1, curr_func, stack, string_set);
-		parse_exp(output_file, strchr(line, '(') + 1, curr_func, stack, string_set);
-
-		fprintf(output_file, "\tslt\n\tpushi 1\n");
-		fprintf(output_file, "\tbeq end_if_%d\n", if_ct);
-	} else if(strchr(line, '>') > 0) { //B, A, slt, 1, bne
-		parse_exp(output_file, strchr(line, '>') + 1, curr_func, stack, string_set);
-		parse_exp(output_file, strchr(line, '(') + 1, curr_func, stack, string_set);
-
-		fprintf(output_file, "\tslt\n\tpushi 1\n");
-		fprintf(output_file, "\tbne end_if_%d\n", if_ct);
-	} else if(strchr(line, '<') > 0) { //A, B, slt, 1, bne
-		parse_exp(output_file, strchr(line, '(') + 1, curr_func, stack, string_set);
-		parse_exp(output_file, strchr(line, '<') + 1, curr_func, stack, string_set);
-
-		fprintf(output_file, "\tslt\n\tpushi 1\n");
-		fprintf(output_file, "\tbne end_if_%d\n", if_ct);
+	if(pattern == NULL) {
+		printf("ERROR: The machine description has no pattern for %s %s in function %s\n", root, comp, curr_func);
 	} else {
-		printf("ERROR: Unrecognized comparison in line %s\n", headline);
-		parse_exp(output_file, strchr(headline, '(') + 1, curr_func, stack, string_set);
-	}
+		Operand_kind expect = OPERAND_NONE;
+
+		for(int i = 0; i < pattern->token_ct; i++) {
+			char *token = pattern->tokens[i];
+			int n = token[0] == '$' && (token[1] == '1' || token[1] == '2') ? token[1] - '1' : -1;
+
+			if(expect != OPERAND_NONE) { //Operand of the instruction just written
+				if(strcmp(token, "$L") == 0)
+					fprintf(output_file, " %s\n", label);
+				else if(n >= 0 && machine_is_variable(operands[n]))
+					fprintf(output_file, " %s_%s\n", curr_func, operands[n]);
+				else if(n >= 0)
+					fprintf(output_file, " %s\n", operands[n]);
+				else
+					fprintf(output_file, " %s\n", token);
+				expect = OPERAND_NONE;
+			} else if(n >= 0) { //Evaluate the operand onto the stack
+				fprintf(output_file, "%s", code[n]);
+			} else {
+				fprintf(output_file, "\t%s", token);
+				expect = machine_inst(block_ct->machine, token)->operand;
+				if(expect == OPERAND_NONE)
+					fprintf(output_file, "\n");
+			}
+		}
+	}
+
+	free(code[0]);
+	free(code[1]);
+}
+
+/**
+ * Writes the code to branch to a label depending on a condition, falling through otherwise.
+ * && and || short-circuit, so the right side is only evaluated when the left side does not decide the
+ * result, and no true or false value is ever left on the stack.
+ *
+ * @param output_file Assembly file that is being written.
+ * @param cond The condition to be tested.
+ * @param label Where to jump to.
+ * @param jump_if Jump when the condition is this (1 for true, 0 for false).
+ * @param block_ct Keeps track of the number of each type of block so as to give each unique names.
+ * @param curr_func The name of the function currently being parsed.
+ * @param stack The current status of the stack at this point in the code.
+ * @param symbols The table containing the addresses of each variable in memory.
+ */
+void emit_branch(FILE *output_file, Condition *cond, char *label, int jump_if, Block_ct *block_ct, char *curr_func, Stack *stack, Symbol_table *symbols) {
+	char skip_label[STR_LEN];
+	char end_label[STR_LEN];
+
+	switch(cond->type) {
+	case COND_NOT:
+		emit_branch(output_file, cond->a, label, !jump_if, block_ct, curr_func, stack, symbols);
+		break;
+	case COND_SELECT: //Tests a only once, then b or c
+		sprintf(skip_label, "cond_%d", block_ct->cond_ct++);
+		sprintf(end_label, "cond_%d", block_ct->cond_ct++);
+		emit_branch(output_file, cond->a, skip_label, 0, block_ct, curr_func, stack, symbols);
+		emit_branch(output_file, cond->b, label, jump_if, block_ct, curr_func, stack, symbols);
+		fprintf(output_file, "\tpushi %s\n\tjpop\n%s:\n", end_label, skip_label);
+		emit_branch(output_file, cond->c, label, jump_if, block_ct, curr_func, stack, symbols);
+		fprintf(output_file, "%s:\n", end_label);
+		break;
+	case COND_AND:
+	case COND_OR:
+		if((cond->type == COND_AND) != jump_if) { //Either side alone decides the jump
+			emit_branch(output_file, cond->a, label, jump_if, block_ct, curr_func, stack, symbols);
+			emit_branch(output_file, cond->b, label, jump_if, block_ct, curr_func, stack, symbols);
+		} else { //The left side can only rule the jump out, so it skips over the right side
+			sprintf(skip_label, "cond_%d", block_ct->cond_ct++);
+			emit_branch(output_file, cond->a, skip_label, !jump_if, block_ct, curr_func, stack, symbols);
+			emit_branch(output_file, cond->b, label, jump_if, block_ct, curr_func, stack, symbols);
+			fprintf(output_file, "%s:\n", skip_label);
+		}
+		break;
+	case COND_COMPARE:
+		if(machine_is_constant(cond->left) && machine_is_constant(cond->right)) { //Known when compiling
+			if(compare_constants(cond->comp, atoi(cond->left), atoi(cond->right)) == jump_if)
+				fprintf(output_file, "\tpushi %s\n\tjpop\n", label);
+		} else {
+			char *comps[] = {"EQ", "NE", "LT", "GT", "LE", "GE"};
+			char *operands[] = {cond->left, cond->right};
+
+			emit_pattern(output_file, jump_if ? "JT" : "JF", comps[cond->comp], operands, label, block_ct, curr_func, stack, symbols);
+		}
+		break;
+	}
+}
+
+/**
+ * Writes the code to test the condition of an if or while header line.
+ *
+ * @param output_file Assembly file that is being written.
+ * @param headline The header line, such as "if(a == 1 && b != 2) {".
+ * @param label Where to jump to.
+ * @param jump_if Jump when the condition is this (1 for true, 0 for false).
+ * @param block_ct Keeps track of the number of each type of block so as to give each unique names.
+ * @param curr_func The name of the function currently being parsed.
+ * @param stack The current status of the stack at this point in the code.
+ * @param symbols The table containing the addresses of each variable in memory.
+ */
+void emit_condition(FILE *output_file, char *headline, char *label, int jump_if, Block_ct *block_ct, char *curr_func, Stack *stack, Symbol_table *symbols) {
+	char *open = strchr(headline, '(');
+	char *close = open == NULL ? NULL : matching_paren(open);
+
+	if(close == NULL) {
+		printf("ERROR: Unrecognized condition in line %s\n", headline);
+		return;
+	}
+
+	char *text = strndup(open + 1, close - open - 1);
+	Condition *cond = parse_condition(text);
+
+	emit_branch(output_file, cond, label, jump_if, block_ct, curr_func, stack, symbols);
+
+	free_condition(cond);
+	free(text);
+}
+
+/**
+ * Reads the rest of a block, up to and including its closing }, without compiling it.
+ * Used by blocks that need to look at their body before writing any code.
+ *
+ * @param input_file File that is being compiled, just after the header line of the block.
+ * @param depth 1 if the header line held the opening {, 0 if it is still to come.
+ * @param body Set to the raw text of the block, which must be freed.
+ * @param body_len Set to the length of the text.
+ * @param line_ct The line number of the header. Set to the line number of the closing }.
+ */
+void read_ahead_block(FILE *input_file, int depth, char **body, size_t *body_len, int *line_ct) {
+	FILE *body_file = open_memstream(body, body_len);
+	int opened = depth > 0;
+	char raw[STR_LEN];
+
+	while((depth > 0 || !opened) && fgets(raw, STR_LEN, input_file) != NULL) {
+		char *clean = clean_str(strdup(raw));
+
+		fputs(raw, body_file);
+		if(strstr(clean, "#line ") == clean) //Line marker from the preprocessor
+			*line_ct = atoi(clean + 6) - 1;
+		else
+			++(*line_ct);
+		depth += str_char_ct(clean, '{') - str_char_ct(clean, '}');
+		opened = opened || strchr(clean, '{') != NULL;
+		free(clean);
+	}
+	fclose(body_file);
+}
+
+/**
+ * Reads a while loop block and writes the needed assembly code to the file.
+ *
+ * @param input_file File that is being compiled.
+ * @param output_file Assembly file that is being written.
+ * @param final_file Final output file
+ * @param block_ct Keeps track of the number of each type of block so as to give each unique names.
+ * @param symbols The table containing the addresses of each variable in memory.
+ * @param headline String representation of the header line of this if statement.
+ * @param stack The current status of the stack at this point in the code.
+ * @param line_ct The line number that is currently being parsed.
+ * @param curr_func The name of the function currently being parsed.
+ */
+void read_while_block(FILE *input_file, FILE *output_file, FILE *final_file, Block_ct *block_ct, Symbol_table *symbols, char *headline, Stack *stack, int *line_ct, char *curr_func) {
+	Symbol_table local_set;
+	symbol_table_cpy(&local_set, symbols);
+
+	int while_ct = block_ct->while_ct++;
+	char end_label[STR_LEN];
+	char *line;
+
+	sprintf(end_label, "end_while_%d", while_ct);
+
+	fprintf(output_file, "start_while_%d:\n", while_ct);
+	int header_check = emit_check_counter(output_file, final_file, block_ct);
+#ifndef CLEAN
+	fprintf(output_file, "\t#%s\n", headline);
+#endif
+	emit_condition(output_file, headline, end_label, 0, block_ct, curr_func, stack, symbols);
 
 #ifndef CLEAN
 	fprintf(output_file, "\n");
 #endif
+
+	char *parent_region = strdup(block_ct->region);
+	char header_region[sizeof(block_ct->region)];
+	int head_line = *line_ct;
+	int exit_ct = block_ct->exit_ct;
+	char parent_break[STR_LEN];
+
+	strcpy(parent_break, block_ct->break_label);
+	sprintf(block_ct->break_label, "end_while_%d", while_ct);
+
+	emit_counter(output_file, final_file, block_ct, *line_ct, curr_func, "while");
+	snprintf(header_region, sizeof(header_region), "%s+%s", parent_region, block_ct->region);
+
+	line = read_block(input_file, output_file, final_file, stack, &local_set, block_ct, line_ct, curr_func);
+
+	if(strstr(line, "return") == line) { //there was a return statement ending this block
+		block_ct->exit_ct++;
+		block_ct->return_ct++;
+		line = read_block_return(input_file, output_file, line, stack, symbols, block_ct, line_ct, curr_func);
+	}
+
+	if(block_ct->exit_ct != exit_ct) { //Not every run of the body goes round again, so count those that do
+		emit_counter(output_file, final_file, block_ct, *line_ct, curr_func, "while_end");
+		snprintf(header_region, sizeof(header_region), "%s+%s", parent_region, block_ct->region);
+	}
+	emit_derived_counter(block_ct, head_line, curr_func, "while_condition", header_region, header_check);
+
 	free(line);
+	fprintf(output_file, "\tpushi start_while_%d\n\tjpop\nend_while_%d:\n", while_ct, while_ct);
+
+	if(block_ct->exit_ct != exit_ct) { //Some runs leave the loop elsewhere
+		emit_counter(output_file, final_file, block_ct, *line_ct, curr_func, "after_while");
+	} else { //The loop exits as often as it is entered
+		emit_derived_counter(block_ct, *line_ct, curr_func, "after_while", parent_region, emit_check_counter(output_file, final_file, block_ct));
+		strcpy(block_ct->region, parent_region);
+	}
+	strcpy(block_ct->break_label, parent_break);
+	free(parent_region);
+	symbol_table_free(&local_set);
+}
+
+/**
+ * Finds a whole word in a piece of text, skipping places where it is only part of a longer name.
+ *
+ * @param text The text to be searched through.
+ * @param word The word to be searched for.
+ * @return A pointer to the word in text, or NULL if it is not there.
+ */
+char * find_word(char *text, char *word) {
+	int len = strlen(word);
+
+	for(char *c = strstr(text, word); c != NULL; c = strstr(c + 1, word)) {
+		char before = c == text ? ' ' : c[-1];
+		char after = c[len];
+
+		if(!char_is_letter(before) && !(before >= '0' && before <= '9') && !char_is_letter(after) && !(after >= '0' && after <= '9'))
+			return c;
+	}
+
+	return NULL;
+}
+
+/**
+ * Checks whether a piece of code might change a variable, by =, +=, -=, ++, -- or declaring it again.
+ *
+ * @param text The code to be searched through.
+ * @param name The name of the variable.
+ * @return 1 if the variable might be changed, 0 otherwise.
+ */
+int assigns_var(char *text, char *name) {
+	for(char *c = find_word(text, name); c != NULL; c = find_word(c + 1, name)) {
+		char *after = c + strlen(name);
+		char *before = c;
+
+		while(*after == ' ' || *after == '\t')
+			after++;
+		while(before > text && (before[-1] == ' ' || before[-1] == '\t'))
+			before--;
+
+		if((after[0] == '=' && after[1] != '=') || strncmp(after, "+=", 2) == 0 || strncmp(after, "-=", 2) == 0
+		   || strncmp(after, "++", 2) == 0 || strncmp(after, "--", 2) == 0)
+			return 1;
+		if(before - text >= 3 && strncmp(before - 3, "int", 3) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Turns the step of a for loop into a statement that read_statement understands, so i++ becomes i += 1.
+ *
+ * @param step The step, without the header around it.
+ * @return The statement, which must be freed.
+ */
+char * for_step_statement(char *step) {
+	char name[STR_LEN];
+	char op[3];
+	char *statement = (char *)malloc(2 * STR_LEN);
+	int end = -1;
+
+	if(sscanf(step, " %99[A-Za-z0-9] %2[+-] %n", name, op, &end) == 2 && step[end] == '\0' && op[0] == op[1])
+		snprintf(statement, 2 * STR_LEN, "%s %c= 1", name, op[0]);
+	else
+		snprintf(statement, 2 * STR_LEN, "%s", step);
+
+	return statement;
+}
+
+/**
+ * Works out how many times a for loop runs, when its variable is a simple induction variable: set to
+ * a constant, compared to a constant, moved by a constant step each pass and never changed in the body.
+ *
+ * @param init The first part of the header, such as "int i = 0".
+ * @param cond The condition of the loop.
+ * @param step The step statement, from for_step_statement.
+ * @param body The body of the loop.
+ * @param var Set to the name of the induction variable. Holds STR_LEN characters.
+ * @return The number of times the body runs, or -1 if it is not known when compiling.
+ */
+int for_trip_count(char *init, Condition *cond, char *step, char *body, char *var) {
+	char name[STR_LEN];
+	char op[2];
+	int start, bound, inc;
+	int end = -1;
+	Comparison comp;
+
+	if(strncmp(init, "int ", 4) == 0)
+		init += 4;
+	if(sscanf(init, " %99[A-Za-z0-9] = %d %n", var, &start, &end) != 2 || init[end] != '\0')
+		return -1;
+
+	//Key: i += k, i -= k, i = i + k or i = i - k
+	end = -1;
+	if(sscanf(step, " %99[A-Za-z0-9] %1[+-]= %d %n", name, op, &inc, &end) != 3 || step[end] != '\0') {
+		char name2[STR_LEN];
+
+		end = -1;
+		if(sscanf(step, " %99[A-Za-z0-9] = %99[A-Za-z0-9] %1[+-] %d %n", name, name2, op, &inc, &end) != 4
+		   || step[end] != '\0' || strcmp(name, name2) != 0)
+			return -1;
+	}
+	if(strcmp(name, var) != 0)
+		return -1;
+	if(op[0] == '-')
+		inc = -inc;
+
+	if(cond->type != COND_COMPARE)
+		return -1;
+	if(strcmp(cond->left, var) == 0 && machine_is_constant(cond->right)) {
+		comp = cond->comp;
+		bound = atoi(cond->right);
+	} else if(strcmp(cond->right, var) == 0 && machine_is_constant(cond->left)) { //Constant on the left, so flip it around
+		Comparison flipped[] = {EQUAL, NOT_EQUAL, GREATER, LESSER, GREATER_EQ, LESSER_EQ};
+
+		comp = flipped[cond->comp];
+		bound = atoi(cond->left);
+	} else {
+		return -1;
+	}
+
+	if(assigns_var(body, var))
+		return -1;
+
+	int trip_ct = 0;
+
+	for(long i = start; compare_constants(comp, i, bound); i += inc)
+		if(++trip_ct > FOR_TRIP_MAX)
+			return -1;
 
-	line = read_block(input_file, output_file, final_file, stack, local_set, block_ct, line_ct, curr_func);
+	return trip_ct;
+}
+
+/**
+ * Writes one pass of a for loop: its body followed by its step.
+ *
+ * @param output_file Assembly file that is being written.
+ * @param final_file Final output file, where the body's declarations go.
+ * @param body The raw text of the body, ending with its closing }.
+ * @param body_len The length of the body.
+ * @param step The step statement.
+ * @param block_ct Keeps track of the number of each type of block so as to give each unique names.
+ * @param symbols The table containing the addresses of each variable in memory.
+ * @param stack The current status of the stack at this point in the code.
+ * @param head_line The line number of the loop header.
+ * @param curr_func The name of the function currently being parsed.
+ */
+void emit_for_pass(FILE *output_file, FILE *final_file, char *body, size_t body_len, char *step, Block_ct *block_ct, Symbol_table *symbols, Stack *stack, int head_line, char *curr_func) {
+	FILE *body_file = fmemopen(body, body_len, "r");
+	int line_ct = head_line;
+	char *line = read_block(body_file, output_file, final_file, stack, symbols, block_ct, &line_ct, curr_func);
 
 	if(strstr(line, "return") == line) { //there was a return statement ending this block
-		parse_exp(output_file, line + 6, curr_func, stack, string_set);
-		while(!strchr(line, '}')) {
-			free(line);
-			line = read_next_line(input_file, output_file, line_ct);
+		block_ct->exit_ct++;
+		block_ct->return_ct++;
+		line = read_block_return(body_file, output_file, line, stack, symbols, block_ct, &line_ct, curr_func);
+	}
+
+	free(line);
+	fclose(body_file);
+
+	if(step[0] != '\0')
+		free(read_statement(NULL, output_file, final_file, step, stack, symbols, block_ct, &line_ct, curr_func));
+}
+
+/**
+ * Reads a for loop block and writes the needed assembly code to the file.
+ * When the loop's variable is a simple induction variable and the trip count is known, the loop is
+ * unrolled: completely if all the passes fit in UNROLL_MAX_BYTES, or else partially, so that each test
+ * of the condition and jump back covers several passes. Loops with a break or return are not unrolled,
+ * and neither is anything when instrumenting, so each counter still belongs to one block.
+ *
+ * @param input_file File that is being compiled.
+ * @param output_file Assembly file that is being written.
+ * @param final_file Final output file
+ * @param block_ct Keeps track of the number of each type of block so as to give each unique names.
+ * @param symbols The table containing the addresses of each variable in memory.
+ * @param headline String representation of the header line of this for loop.
+ * @param stack The current status of the stack at this point in the code.
+ * @param line_ct The line number that is currently being parsed.
+ * @param curr_func The name of the function currently being parsed.
+ */
+void read_for_block(FILE *input_file, FILE *output_file, FILE *final_file, Block_ct *block_ct, Symbol_table *symbols, char *headline, Stack *stack, int *line_ct, char *curr_func) {
+	Symbol_table local_set;
+	symbol_table_cpy(&local_set, symbols);
+
+	int for_ct = block_ct->for_ct++;
+	int head_line = *line_ct;
+	char *body;
+	size_t body_len;
+	int end_line = head_line;
+
+	read_ahead_block(input_file, 1, &body, &body_len, &end_line);
+
+	//Key: for(init; cond; step) {
+	char *open = strchr(headline, '(');
+	char *close = open == NULL ? NULL : matching_paren(open);
+	char *semi1 = close == NULL ? NULL : find_top_level(open + 1, ";");
+	char *semi2 = semi1 == NULL ? NULL : find_top_level(semi1 + 1, ";");
+
+	if(semi2 == NULL || semi2 > close) {
+		printf("ERROR: Unrecognized for loop in line %s\n", headline);
+		*line_ct = end_line;
+		free(body);
+		symbol_table_free(&local_set);
+		return;
+	}
+
+	char *init = trimmed_copy(open + 1, semi1);
+	char *cond_text = trimmed_copy(semi1 + 1, semi2);
+	char *step_text = trimmed_copy(semi2 + 1, close);
+	char *step = for_step_statement(step_text);
+	char end_label[STR_LEN];
+	char var[STR_LEN];
+
+	if(cond_text[0] == '\0') { //No condition runs forever
+		free(cond_text);
+		cond_text = strdup("1");
+	}
+
+	Condition *cond = parse_condition(cond_text);
+	int trip_ct = for_trip_count(init, cond, step, body, var);
+
+	sprintf(end_label, "end_for_%d", for_ct);
+
+#ifndef CLEAN
+	fprintf(output_file, "\t#%s\n", headline);
+#endif
+	if(init[0] != '\0')
+		free(read_statement(input_file, output_file, final_file, init, stack, &local_set, block_ct, line_ct, curr_func));
+
+	//Decide how far to unroll
+	int factor = 1;
+	int full = 0;
+	int test_cycles = 0;
+	int jump_cycles = machine_cycles(block_ct->machine, "pushi jpop");
+
+	if(trip_ct >= 0 && block_ct->counter_file == NULL && find_word(body, "break") == NULL && find_word(body, "return") == NULL) {
+		char *scratch, *pass, *test;
+		size_t scratch_len, pass_len, test_len;
+		FILE *scratch_file = open_memstream(&scratch, &scratch_len);
+		FILE *pass_file = open_memstream(&pass, &pass_len);
+		FILE *test_file = open_memstream(&test, &test_len);
+		FILE *stats_file = block_ct->stats_file;
+		Symbol_table pass_set;
+
+		//Write one pass and one test aside to measure them
+		symbol_table_cpy(&pass_set, &local_set);
+		block_ct->stats_file = NULL;
+		emit_for_pass(pass_file, scratch_file, body, body_len, step, block_ct, &pass_set, stack, head_line, curr_func);
+		emit_branch(test_file, cond, end_label, 0, block_ct, curr_func, stack, &local_set);
+		block_ct->stats_file = stats_file;
+		fclose(scratch_file);
+		fclose(pass_file);
+		fclose(test_file);
+
+		int pass_bytes = machine_asm_bytes(block_ct->machine, pass);
+
+		test_cycles = machine_asm_cycles(block_ct->machine, test);
+		if(trip_ct * pass_bytes <= UNROLL_MAX_BYTES)
+			full = 1;
+		else if(UNROLL_MAX_BYTES / pass_bytes > 1)
+			factor = UNROLL_MAX_BYTES / pass_bytes < UNROLL_MAX_FACTOR ? UNROLL_MAX_BYTES / pass_bytes : UNROLL_MAX_FACTOR;
+
+		free(scratch);
+		free(pass);
+		free(test);
+		symbol_table_free(&pass_set);
+	}
+
+	char *parent_region = strdup(block_ct->region);
+	char parent_break[STR_LEN];
+	int exit_ct = block_ct->exit_ct;
+
+	strcpy(parent_break, block_ct->break_label);
+	strcpy(block_ct->break_label, end_label);
+
+	if(full) { //Fully unrolled, only the first pass declares the body's variables
+		char *scratch;
+		size_t scratch_len;
+		FILE *scratch_file = open_memstream(&scratch, &scratch_len);
+
+		for(int i = 0; i < trip_ct; i++)
+			emit_for_pass(output_file, i == 0 ? final_file : scratch_file, body, body_len, step, block_ct, &local_set, stack, head_line, curr_func);
+
+		fclose(scratch_file);
+		free(scratch);
+	} else {
+		char *scratch;
+		size_t scratch_len;
+		FILE *scratch_file = open_memstream(&scratch, &scratch_len);
+		int passes = 0;
+
+		if(factor > 1) //Passes left over from the unrolled loop go first
+			for(int i = 0; i < trip_ct % factor; i++)
+				emit_for_pass(output_file, passes++ == 0 ? final_file : scratch_file, body, body_len, step, block_ct, &local_set, stack, head_line, curr_func);
+
+		fprintf(output_file, "start_for_%d:\n", for_ct);
+		int header_check = emit_check_counter(output_file, final_file, block_ct);
+		emit_branch(output_file, cond, end_label, 0, block_ct, curr_func, stack, &local_set);
+
+		char header_region[sizeof(block_ct->region)];
+
+		emit_counter(output_file, final_file, block_ct, head_line, curr_func, "for");
+		snprintf(header_region, sizeof(header_region), "%s+%s", parent_region, block_ct->region);
+
+		for(int i = 0; i < factor; i++)
+			emit_for_pass(output_file, passes++ == 0 ? final_file : scratch_file, body, body_len, step, block_ct, &local_set, stack, head_line, curr_func);
+
+		if(block_ct->exit_ct != exit_ct) { //Not every pass goes round again, so count those that do
+			emit_counter(output_file, final_file, block_ct, end_line, curr_func, "for_end");
+			snprintf(header_region, sizeof(header_region), "%s+%s", parent_region, block_ct->region);
 		}
+		emit_derived_counter(block_ct, head_line, curr_func, "for_condition", header_region, header_check);
 
-		fprintf(output_file, "\tjr\n");
+		fprintf(output_file, "\tpushi start_for_%d\n\tjpop\nend_for_%d:\n", for_ct, for_ct);
+
+		fclose(scratch_file);
+		free(scratch);
+	}
+
+	if(block_ct->stats_file != NULL) {
+		if(trip_ct < 0) {
+			fprintf(block_ct->stats_file, "for at line %d in %s: no induction variable with a known trip count, not unrolled\n", head_line, curr_func);
+		} else {
+			int loop_passes = trip_ct / factor;
+			int rolled_cost = (trip_ct + 1) * test_cycles + trip_ct * jump_cycles;
+			int cost = full ? 0 : (loop_passes + 1) * test_cycles + loop_passes * jump_cycles;
+
+			fprintf(block_ct->stats_file, "for at line %d in %s: induction variable %s, %d iterations, ", head_line, curr_func, var, trip_ct);
+			if(full)
+				fprintf(block_ct->stats_file, "fully unrolled");
+			else if(factor > 1)
+				fprintf(block_ct->stats_file, "unrolled by %d", factor);
+			else
+				fprintf(block_ct->stats_file, "not unrolled");
+			fprintf(block_ct->stats_file, ", saves %d cycles of tests and jumps\n", rolled_cost - cost);
+		}
+	}
+
+	*line_ct = end_line;
+	if(block_ct->exit_ct != exit_ct) { //Some passes leave the loop elsewhere
+		emit_counter(output_file, final_file, block_ct, *line_ct, curr_func, "after_for");
+	} else { //The loop exits as often as it is entered
+		emit_derived_counter(block_ct, *line_ct, curr_func, "after_for", parent_region, emit_check_counter(output_file, final_file, block_ct));
+		strcpy(block_ct->region, parent_region);
+	}
+	strcpy(block_ct->break_label, parent_break);
+
+	free(parent_region);
+	free_condition(cond);
+	free(init);
+	free(cond_text);
+	free(step_text);
+	free(step);
+	free(body);
+	symbol_table_free(&local_set);
+}
+
+/**
+ * Reads an if block and writes the needed assembly code to the file.
+ *
+ * @param input_file File that is being compiled.
+ * @param output_file Assembly file that is being written.
+ * @param final_file Final output file.
+ * @param block_ct Keeps track of the number of each type of block so as to give each unique names.
+ * @param symbols The table containing the addresses of each variable in memory.
+ * @param headline String representation of the header line of this if statement.
+ * @param stack The current status of the stack at this point in the code.
+ * @param line_ct The line number that is currently being parsed.
+ * @param curr_func The name of the function currently being parsed.
+ * @return The first line after the if statement if it had to be read to check for an else, NULL otherwise.
+ */
+char * read_if_block(FILE *input_file, FILE *output_file, FILE *final_file, Block_ct *block_ct, Symbol_table *symbols, char *headline, Stack *stack, int *line_ct, char *curr_func) {
+	Symbol_table local_set; //Holds any variable declarations inside the if block
+	symbol_table_cpy(&local_set, symbols);
+
+	int if_ct = block_ct->if_ct++;
+	char end_label[STR_LEN];
+	char *line;
+
+	sprintf(end_label, "end_if_%d", if_ct);
+
+#ifndef CLEAN
+	fprintf(output_file, "\t#%s\n", headline);
+#endif
+	emit_condition(output_file, headline, end_label, 0, block_ct, curr_func, stack, symbols);
+
+#ifndef CLEAN
+	fprintf(output_file, "\n");
+#endif
+
+	char *parent_region = strdup(block_ct->region);
+	char then_region[sizeof(block_ct->region)];
+	char else_region[sizeof(block_ct->region)];
+	int then_returns = 0;
+	int exit_ct = block_ct->exit_ct;
+
+	emit_counter(output_file, final_file, block_ct, *line_ct, curr_func, "if");
+	strcpy(then_region, block_ct->region);
+	if(strchr(parent_region, '-') || strchr(parent_region, '+'))
+		snprintf(else_region, sizeof(else_region), "(%s)-%s", parent_region, then_region);
+	else
+		snprintf(else_region, sizeof(else_region), "%s-%s", parent_region, then_region);
+
+	line = read_block(input_file, output_file, final_file, stack, &local_set, block_ct, line_ct, curr_func);
+
+	if(strstr(line, "return") == line) { //there was a return statement ending this block
+		then_returns = 1;
+		block_ct->exit_ct++;
+		block_ct->return_ct++;
+		line = read_block_return(input_file, output_file, line, stack, symbols, block_ct, line_ct, curr_func);
 	}
 
 	if(strstr(line, "else") == 0) { //No else on this line, check next line.
 		free(line);
 		line = read_next_line(input_file, output_file, line_ct);
-		if(strstr(line, "else") == 0) { //No paired else statement
-			fprintf(output_file, "end_if_%d:\n", if_ct);
-		} else { //There is an else statement
-			fprintf(output_file, "\tpushi end_else_%d\n\tjpop\nend_if_%d:\n", if_ct, if_ct);
-			free(line);
-			line = read_block(input_file, output_file, final_file, stack, local_set, block_ct, line_ct, curr_func);
-			fprintf(output_file, "end_else_%d:\n", if_ct);
-		}
+	}
+
+	if(line == NULL || strstr(line, "else") == 0) { //No paired else statement
+		fprintf(output_file, "end_if_%d:\n", if_ct);
 	} else { //There is an else statement
 		fprintf(output_file, "\tpushi end_else_%d\n\tjpop\nend_if_%d:\n", if_ct, if_ct);
 		free(line);
-		line = read_block(input_file, output_file, final_file, stack, local_set, block_ct, line_ct, curr_func);
+		emit_derived_counter(block_ct, *line_ct, curr_func, "else", else_region, emit_check_counter(output_file, final_file, block_ct));
+		strcpy(block_ct->region, else_region);
+		line = read_block(input_file, output_file, final_file, stack, &local_set, block_ct, line_ct, curr_func);
+
+		if(strstr(line, "return") == line) { //there was a return statement ending the else block
+			block_ct->exit_ct++;
+			block_ct->return_ct++;
+			line = read_block_return(input_file, output_file, line, stack, symbols, block_ct, line_ct, curr_func);
+		}
+
 		fprintf(output_file, "end_else_%d:\n", if_ct);
+		free(line);
+		line = NULL;
 	}
 
+	if(block_ct->exit_ct == exit_ct) { //Every path comes out the bottom
+		emit_derived_counter(block_ct, *line_ct, curr_func, "after_if", parent_region, emit_check_counter(output_file, final_file, block_ct));
+		strcpy(block_ct->region, parent_region);
+	} else if(then_returns && block_ct->exit_ct == exit_ct + 1) { //Only the paths that skipped the if block reach the code after it
+		emit_derived_counter(block_ct, *line_ct, curr_func, "after_if", else_region, emit_check_counter(output_file, final_file, block_ct));
+		strcpy(block_ct->region, else_region);
+	} else { //Some paths return or break from inside the blocks
+		emit_counter(output_file, final_file, block_ct, *line_ct, curr_func, "after_if");
+	}
+	free(parent_region);
+	symbol_table_free(&local_set);
+
 	return line;
 }
 
+/**
+ * Returns the average of the given costs.
+ *
+ * @param costs Array of costs in cycles.
+ * @param n Number of costs.
+ * @return The average cost.
+ */
+double average_cost(int costs[], int n) {
+	double sum = 0;
+
+	for(int i = 0; i < n; i++)
+		sum += costs[i];
+
+	return n == 0 ? 0 : sum / n;
+}
+
+/**
+ * Sorts switch cases by value. Used with qsort.
+ */
+int compare_switch_cases(const void *a, const void *b) {
+	int x = ((Switch_case *)a)->value;
+	int y = ((Switch_case *)b)->value;
+
+	return (x > y) - (x < y); //Subtracting could overflow
+}
+
+/**
+ * Works out how many cycles a decision tree built by emit_switch_tree takes to reach each case.
+ *
+ * @param machine Description of the target's instruction costs.
+ * @param cases The cases of the switch, sorted by value.
+ * @param lo Index of the first case in this subtree.
+ * @param hi Index of the last case in this subtree.
+ * @param linear_max Subtrees with up to this many cases test them one by one.
+ * @param cost Cycles already spent before reaching this subtree.
+ * @param costs Array indexed like cases that the costs are written to.
+ */
+void switch_tree_costs(Machine *machine, Switch_case cases[], int lo, int hi, int linear_max, int cost, int costs[]) {
+	int eq_cycles = machine_cycles(machine, SWITCH_EQ);
+	int lt_cycles = machine_cycles(machine, SWITCH_LT);
+
+	if(hi - lo < linear_max) {
+		for(int i = lo; i <= hi; i++)
+			costs[i] = cost + (i - lo + 1) * eq_cycles;
+		return;
+	}
+
+	int mid = (lo + hi) / 2;
+
+	costs[mid] = cost + eq_cycles;
+	switch_tree_costs(machine, cases, lo, mid - 1, linear_max, cost + eq_cycles + lt_cycles, costs);
+	switch_tree_costs(machine, cases, mid + 1, hi, linear_max, cost + eq_cycles + lt_cycles, costs);
+}
+
+/**
+ * Returns how many cycles a jump table built by emit_switch_table takes to reach any of its cases.
+ *
+ * @param machine Description of the target's instruction costs.
+ * @param min The smallest case value.
+ * @return The cost of a dispatch in cycles.
+ */
+int switch_table_cost(Machine *machine, int min) {
+	int bounds_cost = 2 * machine_cycles(machine, SWITCH_LT);
+	int index_cost = 2 * machine_cycles(machine, min == 0 ? SWITCH_LOAD : SWITCH_LOAD "pushi sub");
+
+	return bounds_cost + index_cost + machine_cycles(machine, "pushi add add jpop pushi jpop");
+}
+
+/**
+ * Writes a binary decision tree that jumps to the case matching the selector.
+ * Up to linear_max cases are tested one after another. Larger sets test their middle case
+ * for equality, then use slt to decide which half to search.
+ *
+ * @param output_file Assembly file that is being written.
+ * @param cases The cases of the switch, sorted by value.
+ * @param lo Index of the first case in this subtree.
+ * @param hi Index of the last case in this subtree.
+ * @param linear_max Subtrees with up to this many cases test them one by one.
+ * @param sel The memory location holding the selector.
+ * @param switch_ct The number of this switch statement.
+ * @param default_label Where to jump when no case matches.
+ * @param tree_ct The number of subtree tags used so far in this switch.
+ */
+void emit_switch_tree(FILE *output_file, Switch_case cases[], int lo, int hi, int linear_max, char *sel, int switch_ct, char *default_label, int *tree_ct) {
+	if(hi - lo < linear_max) {
+		for(int i = lo; i <= hi; i++)
+			fprintf(output_file, "\tpushi %s\n\tpush\n\tpushi %d\n\tbeq switch_%d_case_%d\n", sel, cases[i].value, switch_ct, cases[i].index);
+		fprintf(output_file, "\tpushi %s\n\tjpop\n", default_label);
+		return;
+	}
+
+	int mid = (lo + hi) / 2;
+	int tree = (*tree_ct)++;
+
+	fprintf(output_file, "\tpushi %s\n\tpush\n\tpushi %d\n\tbeq switch_%d_case_%d\n", sel, cases[mid].value, switch_ct, cases[mid].index);
+	fprintf(output_file, "\tpushi %s\n\tpush\n\tpushi %d\n\tslt\n\tpushi 1\n\tbeq switch_%d_lower_%d\n", sel, cases[mid].value, switch_ct, tree);
+	emit_switch_tree(output_file, cases, mid + 1, hi, linear_max, sel, switch_ct, default_label, tree_ct);
+	fprintf(output_file, "switch_%d_lower_%d:\n", switch_ct, tree);
+	emit_switch_tree(output_file, cases, lo, mid - 1, linear_max, sel, switch_ct, default_label, tree_ct);
+}
+
+/**
+ * Writes a jump table that jumps to the case matching the selector.
+ * After checking the selector is in range, it jumps into a table of pushi/jpop stubs, one for each
+ * value between the smallest and largest case. This assumes that every instruction takes up one address.
+ *
+ * @param output_file Assembly file that is being written.
+ * @param cases The cases of the switch, sorted by value.
+ * @param n Number of cases.
+ * @param sel The memory location holding the selector.
+ * @param switch_ct The number of this switch statement.
+ * @param default_label Where to jump when no case matches.
+ */
+void emit_switch_table(FILE *output_file, Switch_case cases[], int n, char *sel, int switch_ct, char *default_label) {
+	int min = cases[0].value;
+	int max = cases[n - 1].value;
+
+	fprintf(output_file, "\tpushi %s\n\tpush\n\tpushi %d\n\tslt\n\tpushi 1\n\tbeq %s\n", sel, min, default_label);
+	fprintf(output_file, "\tpushi %d\n\tpushi %s\n\tpush\n\tslt\n\tpushi 1\n\tbeq %s\n", max, sel, default_label);
+
+	fprintf(output_file, "\tpushi switch_%d_table\n", switch_ct);
+	for(int i = 0; i < 2; i++) { //The selector is added in twice since each stub is two instructions long
+		fprintf(output_file, "\tpushi %s\n\tpush\n", sel);
+		if(min != 0)
+			fprintf(output_file, "\tpushi %d\n\tsub\n", min);
+	}
+	fprintf(output_file, "\tadd\n\tadd\n\tjpop\n");
+
+	fprintf(output_file, "switch_%d_table:\n", switch_ct);
+	for(int value = min, i = 0; value <= max; value++) {
+		if(cases[i].value == value)
+			fprintf(output_file, "\tpushi switch_%d_case_%d\n\tjpop\n", switch_ct, cases[i++].index);
+		else
+			fprintf(output_file, "\tpushi %s\n\tjpop\n", default_label);
+	}
+}
+
+/**
+ * Reads a switch block and writes the needed assembly code to the file.
+ * The body is read ahead of time to find the case values. Dense case sets are dispatched through a
+ * jump table and sparse ones through a binary decision tree, whichever takes fewer cycles on average.
+ * Each case is expected to be on its own line, as in "case 3:" or "default:".
+ *
+ * @param input_file File that is being compiled.
+ * @param output_file Assembly file that is being written.
+ * @param final_file Final output file.
+ * @param block_ct Keeps track of the number of each type of block so as to give each unique names.
+ * @param symbols The table containing the addresses of each variable in memory.
+ * @param headline String representation of the header line of this switch statement.
+ * @param stack The current status of the stack at this point in the code.
+ * @param line_ct The line number that is currently being parsed.
+ * @param curr_func The name of the function currently being parsed.
+ */
+void read_switch_block(FILE *input_file, FILE *output_file, FILE *final_file, Block_ct *block_ct, Symbol_table *symbols, char *headline, Stack *stack, int *line_ct, char *curr_func) {
+	Symbol_table local_set;
+	symbol_table_cpy(&local_set, symbols);
+
+	int switch_ct = block_ct->switch_ct++;
+	int head_line = *line_ct;
+	char *body;
+	size_t body_len;
+	int end_line = head_line;
+
+	read_ahead_block(input_file, 1, &body, &body_len, &end_line);
+
+	//Find the cases belonging to this switch
+	Switch_case *cases = NULL;
+	int case_ct = 0;
+	int has_default = 0;
+	char *body_line = body;
+	int depth = 1;
+
+	while(body_line < body + body_len) {
+		char *end = strchr(body_line, '\n');
+		int len = end == NULL ? strlen(body_line) : end - body_line;
+		char *raw = (char *)malloc(len + 2);
+		char *clean;
+
+		memcpy(raw, body_line, len); //clean_str expects the line to end in a newline
+		raw[len] = '\n';
+		raw[len + 1] = '\0';
+		clean = clean_str(raw);
+
+		if(depth == 1 && strstr(clean, "case") == clean) {
+			cases = (Switch_case *)realloc(cases, (case_ct + 1) * sizeof(Switch_case));
+			cases[case_ct].value = strtol(clean + 4, NULL, 0);
+			cases[case_ct].index = case_ct;
+			case_ct++;
+		} else if(depth == 1 && strstr(clean, "default") == clean) {
+			has_default = 1;
+		}
+
+		depth += str_char_ct(clean, '{') - str_char_ct(clean, '}');
+		free(clean);
+		body_line += len + 1;
+	}
+
+	//Find somewhere to keep the selector
+	char sel[STR_LEN];
+	char *sel_exp = strchr(headline, '(') + 1;
+	char *sel_word = read_word(sel_exp);
+	char default_label[STR_LEN];
+
+	if(sel_word != NULL && char_is_letter(sel_word[0]) && strchr(sel_word, '(') == NULL
+	   && strpbrk(sel_exp + strlen(sel_word), "+-(") == NULL) { //Plain variable, so it can be read directly
+		snprintf(sel, STR_LEN, "%s_%s", curr_func, sel_word);
+	} else {
+		snprintf(sel, STR_LEN, "switch_%d_val", switch_ct);
+		fprintf(final_file, "\t.globl %s\n", sel);
+		parse_exp(output_file, sel_exp, curr_func, stack, symbols, block_ct);
+		fprintf(output_file, "\tpushi %s\n\tpop\n", sel);
+	}
+	free(sel_word);
+
+	if(has_default)
+		sprintf(default_label, "switch_%d_default", switch_ct);
+	else
+		sprintf(default_label, "end_switch_%d", switch_ct);
+
+	//Pick the cheapest way to dispatch
+	if(case_ct > 0) {
+		int *chain_costs = (int *)malloc(case_ct * sizeof(int));
+		int *tree_costs = (int *)malloc(case_ct * sizeof(int));
+		int tree_ct = 0;
+		char *lowering;
+		double cost;
+
+		for(int i = 0; i < case_ct; i++) //An if-chain tests each case in the order written
+			chain_costs[i] = (i + 1) * machine_cycles(block_ct->machine, SWITCH_EQ);
+
+		qsort(cases, case_ct, sizeof(Switch_case), compare_switch_cases);
+		switch_tree_costs(block_ct->machine, cases, 0, case_ct - 1, SWITCH_LINEAR_MAX, 0, tree_costs);
+
+		double chain_cost = average_cost(chain_costs, case_ct);
+		double tree_cost = average_cost(tree_costs, case_ct);
+		double table_cost = switch_table_cost(block_ct->machine, cases[0].value);
+		long spread = (long)cases[case_ct - 1].value - cases[0].value + 1;
+
+		if(spread <= (long)JUMP_TABLE_MAX_SPREAD * case_ct && table_cost < tree_cost && table_cost < chain_cost) {
+			lowering = "jump table";
+			cost = table_cost;
+			emit_switch_table(output_file, cases, case_ct, sel, switch_ct, default_label);
+		} else if(tree_cost < chain_cost) {
+			lowering = "decision tree";
+			cost = tree_cost;
+			emit_switch_tree(output_file, cases, 0, case_ct - 1, SWITCH_LINEAR_MAX, sel, switch_ct, default_label, &tree_ct);
+		} else {
+			lowering = "if-chain";
+			cost = chain_cost;
+			emit_switch_tree(output_file, cases, 0, case_ct - 1, case_ct, sel, switch_ct, default_label, &tree_ct);
+		}
+
+		if(block_ct->stats_file != NULL)
+			fprintf(block_ct->stats_file, "switch at line %d in %s: %d cases spanning %ld values, %s, %.1f cycles per dispatch (if-chain %.1f, saves %.1f)\n",
+					head_line, curr_func, case_ct, spread, lowering, cost, chain_cost, chain_cost - cost);
+
+		free(chain_costs);
+		free(tree_costs);
+	} else {
+		fprintf(output_file, "\tpushi %s\n\tjpop\n", default_label);
+	}
+
+	//Write the body of the switch
+	char *parent_region = strdup(block_ct->region);
+	char parent_break[STR_LEN];
+	int return_ct = block_ct->return_ct;
+	FILE *case_file = fmemopen(body, body_len, "r");
+	char *line = read_next_line(case_file, output_file, line_ct);
+	char *next_line;
+	int case_index = 0;
+
+	strcpy(parent_break, block_ct->break_label);
+	sprintf(block_ct->break_label, "end_switch_%d", switch_ct);
+
+	while(line != NULL && strchr(line, '}') <= 0) {
+		next_line = NULL;
+
+		if(strlen(line) == 0) { //Nothing to do
+		} else if(strstr(line, "case") == line) {
+			fprintf(output_file, "switch_%d_case_%d:\n", switch_ct, case_index++);
+			emit_counter(output_file, final_file, block_ct, *line_ct, curr_func, "case");
+		} else if(strstr(line, "default") == line) {
+			fprintf(output_file, "%s:\n", default_label);
+			emit_counter(output_file, final_file, block_ct, *line_ct, curr_func, "case");
+		} else if(strstr(line, "return") == line) {
+			block_ct->exit_ct++;
+			block_ct->return_ct++;
+			parse_exp(output_file, line + 6, curr_func, stack, &local_set, block_ct);
+			fprintf(output_file, "\tjr\n");
+		} else {
+			next_line = read_statement(case_file, output_file, final_file, line, stack, &local_set, block_ct, line_ct, curr_func);
+		}
+
+		free(line);
+		line = next_line != NULL ? next_line : read_next_line(case_file, output_file, line_ct);
+	}
+
+	fprintf(output_file, "end_switch_%d:\n", switch_ct);
+
+	*line_ct = end_line;
+	if(block_ct->return_ct != return_ct) { //Some cases return
+		emit_counter(output_file, final_file, block_ct, *line_ct, curr_func, "after_switch");
+	} else { //Every case ends up here, through a break or the end of the body, as does a value with no case
+		emit_derived_counter(block_ct, *line_ct, curr_func, "after_switch", parent_region, emit_check_counter(output_file, final_file, block_ct));
+		strcpy(block_ct->region, parent_region);
+	}
+	strcpy(block_ct->break_label, parent_break);
+
+	free(line);
+	free(parent_region);
+	free(cases);
+	fclose(case_file);
+	free(body);
+	symbol_table_free(&local_set);
+}
+
 /**
  * Generates the assembly code for the function starting at the current point in the file.
  *
@@ -582,26 +2011,32 @@ char * read_if_block(FILE *input_file, FILE *output_file, FILE *final_file, Bloc
  */
 void read_func(FILE *input_file, FILE *output_file, FILE *final_file, char *headline, Block_ct *block_ct, Type ret_type, int *line_ct, char *curr_func) {
 	Stack stack = {NULL, 0};
-	String_list string_set[LIST_LEN];
+	Symbol_table symbols;
 	char *last_line;
 	int num_pars = 0;
 
-	for(int i = 0; i < LIST_LEN; i++) { //Initialize each individual list in the string set
-		string_set[i].length = 0;
-	}
+	symbol_table_init(&symbols);
+	block_ct->exp_source_depth = 0;
+	block_ct->exp_depth = 0;
 
 	read_func_header(&stack, headline, curr_func);
 	if(strchr(headline, '{') <= 0) //Check if there is no opening curly brace on the headline
 		read_next_line(input_file, output_file, line_ct);
 
 	// Make memory locations for the parameters
+	for(int i = 0; i < stack.size; i++)
+		symbol_table_add(&symbols, stack.names[i], i);
+
 	for(int i = stack.size - 1; i >= 0; i--) {
 		num_pars++;
-        fprintf(final_file, "\t.globl %s\n", stack.names[i]);
+        if(!block_ct->frames || strcmp(curr_func, "main") == 0)
+            fprintf(final_file, "\t.globl %s\n", stack.names[i]);
 		fprintf(output_file, "\tpushi %s\n\tpop\n", stack_pop(&stack));
 	}
 
-	last_line = read_block(input_file, output_file, final_file, &stack, &string_set[0], block_ct, line_ct, curr_func);
+	emit_counter(output_file, final_file, block_ct, *line_ct, curr_func, "entry");
+
+	last_line = read_block(input_file, output_file, final_file, &stack, &symbols, block_ct, line_ct, curr_func);
 
 	//Empty stack
 	while(stack.size > 0) {
@@ -621,7 +2056,9 @@ void read_func(FILE *input_file, FILE *output_file, FILE *final_file, char *head
 		}
 		break;
 	case INT:
-		parse_exp(output_file, last_line + 6, curr_func, &stack, string_set);
+		if(strstr(last_line, "return") != last_line) //Every path already returned inside a block
+			break;
+		parse_exp(output_file, last_line + 6, curr_func, &stack, &symbols, block_ct);
 		free(last_line);
 		last_line = read_next_line(input_file, output_file, line_ct);
 		while(!strchr(last_line, '}')) {
@@ -634,6 +2071,12 @@ void read_func(FILE *input_file, FILE *output_file, FILE *final_file, char *head
 	if(ret_type != MAIN) //If main function, don't put the jr at the end
 		fprintf(output_file, "\tjr\n");
 
+	if(block_ct->stats_file != NULL && block_ct->exp_depth > 0)
+		fprintf(block_ct->stats_file, "expressions in %s: need at most %d stack entries in source order and %d reordered\n",
+				curr_func, block_ct->exp_source_depth, block_ct->exp_depth);
+
+	symbol_table_free(&symbols);
+
 #ifdef DEBUG
 	printf("Finished parsing function.\n");
 #endif
@@ -642,112 +2085,639 @@ void read_func(FILE *input_file, FILE *output_file, FILE *final_file, char *head
 /**
  * Starting point for program. Reads off the input file name from the command line.
  */
-int main(int argc, char *argv[]) {
-	if(argc < 2) {
-		printf("Enter a filename.");
-		return 0;
+/**
+ * Takes the code of one function into the SSA form, checks it, and writes it back out as stack code.
+ * If any step fails, the code is left as it was.
+ *
+ * @param prog The function's code, replaced by what the SSA form gives.
+ * @param block_ct Holds the machine description and where statistics and the SSA form go.
+ * @param name The name of the function.
+ */
+void ssa_round_trip(Program *prog, Block_ct *block_ct, char *name) {
+	Ssa ssa;
+	Program out;
+	char *reason = NULL;
+
+	if(!ssa_build(&ssa, prog, block_ct->machine, block_ct->param_cts, name, &reason)) {
+		if(block_ct->stats_file != NULL)
+			fprintf(block_ct->stats_file, "ssa in %s: not built, %s\n", name, reason);
+	} else if(!ssa_verify(&ssa)) {
+		if(block_ct->stats_file != NULL)
+			fprintf(block_ct->stats_file, "ssa in %s: not used, since it does not verify\n", name);
+	} else {
+		if(block_ct->ssa_file != NULL)
+			ssa_dump(&ssa, block_ct->ssa_file);
+		if(!ssa_emit(&ssa, &out, &reason)) {
+			if(block_ct->stats_file != NULL)
+				fprintf(block_ct->stats_file, "ssa in %s: not written back, %s\n", name, reason);
+			program_free(&out);
+		} else {
+			if(block_ct->stats_file != NULL)
+				fprintf(block_ct->stats_file, "ssa in %s: %d blocks, %d values, %d phis, %d bytes of code before and %d after\n",
+						name, ssa.block_ct, ssa.value_ct, ssa_count(&ssa, SSA_PHI), program_bytes(prog, block_ct->machine), program_bytes(&out, block_ct->machine));
+			program_free(prog);
+			*prog = out;
+		}
 	}
 
-	FILE *input_file;
-	FILE *output_file;
-    FILE *final_file;
-	Block_ct block_ct = {0, 0, 0};
-	char *filename = argv[1];
-    char *final_filename = (char *)malloc(STR_LEN);
-	char *line;
-	char *first_word = NULL;
-	int line_ct = 0;
+	ssa_free(&ssa);
+}
 
-    strcpy(final_filename, filename);
+/**
+ * Runs the optimisation passes over the code of one function.
+ *
+ * @param code The function's code.
+ * @param decls_file Where any variables the passes need are declared.
+ * @param block_ct Holds the machine description and where statistics go.
+ * @param name The name of the function.
+ * @return The improved code, which must be freed.
+ */
+char * optimize_func(char *code, FILE *decls_file, Block_ct *block_ct, char *name) {
+	Program prog;
+	Sccp_stats sccp;
+	Cse_stats cse;
+	Dead_store_stats dead;
+	Rewrite_stats rewrite;
+
+	program_parse(&prog, code);
+
+	if(block_ct->optimize) {
+		sccp_run(&prog, block_ct->machine, &sccp);
+		if(block_ct->stats_file != NULL)
+			fprintf(block_ct->stats_file, "constants in %s: %d branches decided, %d blocks removed, %d reads replaced by constants\n",
+					name, sccp.branches, sccp.blocks, sccp.loads);
+
+		cse_run(&prog, block_ct->machine, name, decls_file, &cse);
+		if(block_ct->stats_file != NULL)
+			fprintf(block_ct->stats_file, "cse in %s: %d loads and %d arithmetic ops removed, %d temporaries\n", name, cse.loads, cse.ops, cse.temps);
+
+		dead_store_run(&prog, name, block_ct->machine, block_ct->param_cts, &dead);
+		if(block_ct->stats_file != NULL)
+			fprintf(block_ct->stats_file, "dead stores in %s: %d removed, %d left since nothing else takes their value, memory writes %d before and %d after\n",
+					name, dead.removed, dead.kept, dead.writes_before, dead.writes_after);
+	}
 
-	input_file = fopen(filename, "r");
+	if(block_ct->frames && strcmp(name, "main") != 0) {
+		Frame_stats frame;
 
-	output_file = fopen(strcat(final_filename, ".tmp"), "w");
-    strcpy(final_filename, filename);
+		frame_lower(&prog, name, &frame);
+		if(block_ct->stats_file != NULL)
+			fprintf(block_ct->stats_file, "frame of %s: %d variables, %d loads and stores made relative to the frame, %d returns\n",
+					name, frame.vars, frame.accesses, frame.returns);
+	}
 
-    final_file = fopen(strcat(final_filename, ".asm"), "w");
-    strcpy(final_filename, filename);
+	if(block_ct->optimize) {
+		rewrite_run(&prog, block_ct->rewrites, &rewrite);
+		if(block_ct->stats_file != NULL)
+			fprintf(block_ct->stats_file, "rewrites in %s: %d windows rewritten, %d cycles and %d bytes saved\n", name, rewrite.windows, rewrite.cycles, rewrite.bytes);
+	}
 
-	fprintf(output_file, "\tpushi main\n\tjpop\n");
+	if(block_ct->optimize_size) {
+		Tail_merge_stats tail;
 
-    fprintf(final_file, "\t.globl res\n");
+		tail_merge_run(&prog, block_ct->machine, name, &tail);
+		if(block_ct->stats_file != NULL)
+			fprintf(block_ct->stats_file, "tail merging in %s: %d sequences merged, %d bytes saved\n", name, tail.merged, tail.bytes);
+	}
 
-	while((line = read_next_line(input_file, output_file, &line_ct))) {
-		if(strlen(line) > 1) {
-			first_word = read_word(line);
+	if(block_ct->ssa)
+		ssa_round_trip(&prog, block_ct, name);
 
-			if(first_word == NULL) { //Line is empty
-#ifdef DEBUG
-				printf("Read empty line.\n");
-#endif
+	if(block_ct->optimize) {
+		Stack_sched_stats sched;
 
-				continue;
-			}
+		stack_sched_run(&prog, block_ct->machine, name, &sched);
+		if(block_ct->stats_file != NULL)
+			fprintf(block_ct->stats_file, "stack scheduling in %s: %d loops keep %d variables on the stack, %d left alone, memory accesses in their bodies %d before and %d after\n",
+					name, sched.loops, sched.vars, sched.skipped, sched.accesses_before, sched.accesses_after);
+	}
 
+	char *text = program_text(&prog);
 
-			if(strstr(first_word, "int") == first_word) { //Found an int function
-				char *name = read_word(line + 4);
-				name[strlen(name) - strlen(strchr(name, '('))] = '\0';
+	program_free(&prog);
 
-#ifdef DEBUG
-				printf("Found integer function %s.\n", name);
-#endif
+	return text;
+}
+
+/**
+ * Compiles one function, or replays it from the cache when the same text was compiled before in the
+ * same state. The state covers the block counters, which name the jump tags, and the options.
+ *
+ * @param input_file File that is being compiled, just after the header line.
+ * @param output_file Where the code is written.
+ * @param final_file Where the declarations are written.
+ * @param headline The header line of the function.
+ * @param block_ct Keeps track of the number of each type of block so as to give each unique names.
+ * @param ret_type The return type of the function.
+ * @param line_ct The line number of the header. Set to the line of the closing }.
+ * @param name The name of the function.
+ * @param cache Functions compiled before, or NULL to always compile.
+ */
+void compile_func(FILE *input_file, FILE *output_file, FILE *final_file, char *headline, Block_ct *block_ct, Type ret_type, int *line_ct, char *name, Func_cache *cache) {
+	int head_line = *line_ct;
+	char *body;
+	size_t body_len;
+	int end_line = head_line;
+
+	read_ahead_block(input_file, strchr(headline, '{') != NULL, &body, &body_len, &end_line);
+	char *key = NULL;
+	size_t key_len;
+	Func_cache_entry *entry = NULL;
+
+	if(cache != NULL) {
+		FILE *key_file = open_memstream(&key, &key_len);
+		int line_matters = block_ct->counter_file != NULL || block_ct->stats_file != NULL || block_ct->linemap_file != NULL;
 
 #ifndef CLEAN
-				fprintf(output_file, "\n#################\n%s:\n#################\n", name);
-#else
-				fprintf(output_file, "%s:\n", name);
-#endif
-				if(strcmp(name, "main") == 0)
-					read_func(input_file, output_file, final_file, line, &block_ct, MAIN, &line_ct, name);
-				else
-					read_func(input_file, output_file, final_file, line, &block_ct, INT, &line_ct, name);
-			} else if(strstr(first_word, "void") == first_word) { //Found a void function
-#ifdef DEBUG
-				printf("Found void function %s.\n", read_word(line + 5));
+		line_matters = 1;
 #endif
+		fprintf(key_file, "%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %llu %llu %s\n%s\n", block_ct->if_ct, block_ct->for_ct, block_ct->while_ct,
+				block_ct->switch_ct, block_ct->cond_ct, block_ct->counter_ct, line_matters ? head_line : 0,
+				block_ct->counter_file != NULL, block_ct->count_all, block_ct->stats_file != NULL, block_ct->linemap_file != NULL,
+				block_ct->optimize, block_ct->optimize_size, block_ct->ssa, block_ct->ssa_file != NULL, block_ct->frames,
+				block_ct->machine->hash, block_ct->rewrites->hash, block_ct->region, headline);
+		fwrite(body, 1, body_len, key_file);
+		fclose(key_file);
+
+		entry = func_cache_find(cache, key);
+	}
+
+	if(entry != NULL) { //Compiled before, so write down what it gave
+		FILE *counter_file = block_ct->counter_file;
+		FILE *stats_file = block_ct->stats_file;
+		FILE *report_file = block_ct->report_file;
+		FILE *layout_file = block_ct->layout_file;
+		FILE *linemap_file = block_ct->linemap_file;
+		FILE *ssa_file = block_ct->ssa_file;
+		int stack_limit = block_ct->stack_limit;
+		Symbol_table *param_cts = block_ct->param_cts;
+		Machine *machine = block_ct->machine;
+		Rewrite_table *rewrites = block_ct->rewrites;
+
+		fputs(entry->code, output_file);
+		fputs(entry->decls, final_file);
+		if(counter_file != NULL)
+			fputs(entry->counts, counter_file);
+		fputs(entry->messages, stdout);
+
+		memcpy(block_ct, entry->state, sizeof(Block_ct));
+		block_ct->counter_file = counter_file;
+		block_ct->stats_file = stats_file;
+		block_ct->report_file = report_file;
+		block_ct->layout_file = layout_file;
+		block_ct->linemap_file = linemap_file;
+		block_ct->ssa_file = ssa_file;
+		block_ct->stack_limit = stack_limit;
+		block_ct->param_cts = param_cts;
+		block_ct->machine = machine;
+		block_ct->rewrites = rewrites;
+	} else if(body_len > 0) {
+		char *code, *decls, *counts = NULL;
+		size_t code_len, decls_len, counts_len = 0;
+		FILE *code_file = open_memstream(&code, &code_len);
+		FILE *decls_file = open_memstream(&decls, &decls_len);
+		FILE *counter_file = block_ct->counter_file;
+		FILE *body_file = fmemopen(body, body_len, "r");
+		off_t messages_start = -1;
+
+		if(counter_file != NULL)
+			block_ct->counter_file = open_memstream(&counts, &counts_len);
+		if(cache != NULL) { //Note where this function's messages start, if stdout is a file
+			fflush(stdout);
+			messages_start = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+		}
 
-				if(strlen(line) > 5) {
-					char *name = read_word(line + 5);
 #ifndef CLEAN
-                    fprintf(output_file, "\n#################\n%s:\n#################\n", name);
+		fprintf(code_file, "\n#################\n%s:\n#################\n", name);
 #else
-                    fprintf(output_file, "%s:\n", name);
+		fprintf(code_file, "%s:\n", name);
 #endif
-					if(strcmp(name, "main") == 0)
-						read_func(input_file, output_file, final_file, line, &block_ct, MAIN, &line_ct, name);
-					else
-						read_func(input_file, output_file, final_file, line, &block_ct, VOID, &line_ct, name);
-				}
+		emit_line_marker(code_file, block_ct, head_line);
+		read_func(body_file, code_file, decls_file, headline, block_ct, ret_type, line_ct, name);
+
+		fclose(body_file);
+		fclose(code_file);
+		if(block_ct->optimize || block_ct->ssa || block_ct->frames) {
+			char *better = optimize_func(code, decls_file, block_ct, name);
+
+			free(code);
+			code = better;
+		}
+		fclose(decls_file);
+		fputs(code, output_file);
+		fputs(decls, final_file);
+		if(counter_file != NULL) {
+			fclose(block_ct->counter_file);
+			block_ct->counter_file = counter_file;
+			fputs(counts, counter_file);
+		}
+
+		if(messages_start >= 0) {
+			fflush(stdout);
+
+			off_t messages_end = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+			char *messages = (char *)malloc(messages_end - messages_start + 1);
+			ssize_t messages_len = pread(STDOUT_FILENO, messages, messages_end - messages_start, messages_start);
+
+			if(messages_len == messages_end - messages_start) {
+				messages[messages_len] = '\0';
+				func_cache_add(cache, key, code, decls, counts != NULL ? counts : "", messages, block_ct, sizeof(Block_ct));
 			}
-		} else {
+			free(messages);
+		}
+
+		free(code);
+		free(decls);
+		free(counts);
+	}
+
+	*line_ct = end_line;
+	free(key);
+	free(body);
+}
+
+/**
+ * Compiles a whole source file.
+ *
+ * @param input_file The source to be compiled.
+ * @param final_file Where the assembly program is written.
+ * @param block_ct Holds the options, with every counter at 0.
+ * @param cache Functions compiled before, or NULL to always compile.
+ * @return 1 on success, 0 if the program does not fit in the stack or in data memory.
+ */
+int compile(FILE *input_file, FILE *final_file, Block_ct *block_ct, Func_cache *cache) {
+	char *code, *decls;
+	size_t code_len, decls_len;
+	FILE *output_file = open_memstream(&code, &code_len);
+	FILE *decls_file = open_memstream(&decls, &decls_len);
+	Data_layout layout;
+	char *line;
+	int line_ct = 0;
+	char **funcs = NULL;
+	int func_ct = 0;
+	Symbol_table param_cts;
+	int ok = 1;
+
+	symbol_table_init(&param_cts);
+	block_ct->param_cts = &param_cts;
+
+	if(block_ct->frames) //The frames start after every other cell
+		fprintf(output_file, "\tpushi %s\n\tpushi %s\n\tpop\n", FRAME_AREA, FRAME_TOP);
+	fprintf(output_file, "\tpushi main\n\tjpop\n");
+
+	fprintf(decls_file, "\t.globl res\n");
+	if(block_ct->frames)
+		fprintf(decls_file, "\t.globl %s\n\t.globl %s\n", FRAME_POINTER, FRAME_TOP);
+
+	while((line = read_next_line(input_file, output_file, &line_ct))) {
+		char *first_word = strlen(line) > 1 ? read_word(line) : NULL;
+		char *name = NULL;
+		Type ret_type = VOID;
+
+		if(first_word == NULL) { //Line is empty
 #ifdef DEBUG
 			printf("Read empty line.\n");
 #endif
+		} else if(strstr(first_word, "int") == first_word) { //Found an int function
+			name = read_word(line + 4);
+			ret_type = INT;
+		} else if(strstr(first_word, "void") == first_word && strlen(line) > 5) { //Found a void function
+			name = read_word(line + 5);
+			ret_type = VOID;
 		}
+
+		if(name != NULL) {
+			if(strchr(name, '(')) //Strip the parameter list
+				name[strlen(name) - strlen(strchr(name, '('))] = '\0';
+
+#ifdef DEBUG
+			printf("Found %s function %s.\n", ret_type == INT ? "integer" : "void", name);
+#endif
+
+			if(strcmp(name, "main") == 0)
+				ret_type = MAIN;
+
+			int param_ct = 0;
+
+			for(char *param = strchr(line, '('); param != NULL && (param = strstr(param, "int ")); param += 4)
+				param_ct++;
+			symbol_table_add(&param_cts, name, param_ct);
+
+			compile_func(input_file, output_file, decls_file, line, block_ct, ret_type, &line_ct, name, cache);
+
+			funcs = (char **)realloc(funcs, (func_ct + 1) * sizeof(char *));
+			funcs[func_ct++] = strdup(name);
+		}
+
+		free(name);
+		free(first_word);
+		free(line);
 	}
 
+	if(block_ct->frames)
+		fprintf(decls_file, "\t.globl %s\n", FRAME_AREA);
+	fclose(output_file);
+	fclose(decls_file);
+
+	data_layout_build(&layout, code, decls, funcs, func_ct, block_ct->optimize);
+	if(block_ct->optimize) {
+		char *shared = data_layout_apply(&layout, code);
+
+		free(code);
+		code = shared;
+	}
+	data_layout_decls(&layout, final_file);
 #ifndef CLEAN
-    fprintf(final_file, "\n");
+	fprintf(final_file, "\n");
+#endif
+	if(block_ct->stats_file != NULL)
+		fprintf(block_ct->stats_file, "data memory: %d variables in %d cells\n", layout.var_ct, layout.cell_ct);
+	if(block_ct->layout_file != NULL)
+		data_layout_write(&layout, block_ct->layout_file);
+	if(block_ct->machine->data_size > 0 && layout.cell_ct > block_ct->machine->data_size) {
+		printf("ERROR: The program needs %d data memory cells, but data memory holds %d\n", layout.cell_ct, block_ct->machine->data_size);
+		ok = 0;
+	}
+	data_layout_free(&layout);
+	free(decls);
+
+	if(block_ct->report_file != NULL || block_ct->stack_limit > 0)
+		ok = report_run(code, funcs, func_ct, &param_cts, block_ct->machine, block_ct->report_file, block_ct->stack_limit) && ok;
+	symbol_table_free(&param_cts);
+	block_ct->param_cts = NULL;
+
+	if(block_ct->linemap_file != NULL) {
+		Program prog;
+
+		program_parse(&prog, code);
+		program_append(&prog, ASM_INST, "beq", "-1");
+		line_map_write(&prog, funcs, func_ct, block_ct->linemap_file);
+		program_free(&prog);
+	}
+
+#ifdef CLEAN
+	for(char *start = code; *start != '\0';) { //Leave out the comments kept for the line map
+		char *end = strchr(start, '\n') != NULL ? strchr(start, '\n') + 1 : start + strlen(start);
+
+		if(start[0] != '#')
+			fwrite(start, 1, end - start, final_file);
+		start = end;
+	}
+#else
+	fputs(code, final_file);
 #endif
+	fputs("\tbeq -1", final_file);
+	free(code);
+	for(int i = 0; i < func_ct; i++)
+		free(funcs[i]);
+	free(funcs);
+
+	return ok;
+}
+
+/**
+ * Reads the command line options.
+ *
+ * @param argc Number of arguments.
+ * @param argv The arguments. Those that are not options name the source files.
+ * @param options Filled in from the arguments. Its filenames must be freed.
+ * @return 1 if every option was understood, 0 otherwise.
+ */
+int parse_options(int argc, char *argv[], Compile_options *options) {
+	memset(options, 0, sizeof(Compile_options));
+	options->socket_path = SERVER_SOCKET;
+	options->optimize = 1;
+	options->filenames = (char **)malloc((argc + 1) * sizeof(char *));
+
+	for(int i = 0; i < argc; i++) {
+		if(strcmp(argv[i], "--instrument") == 0) {
+			options->instrument = 1;
+		} else if(strcmp(argv[i], "--instrument-all") == 0) {
+			options->instrument = 1;
+			options->count_all = 1;
+		} else if(strcmp(argv[i], "--stats") == 0) {
+			options->stats = 1;
+		} else if(strcmp(argv[i], "--report") == 0) {
+			options->report = 1;
+		} else if(strcmp(argv[i], "--layout") == 0) {
+			options->layout = 1;
+		} else if(strcmp(argv[i], "--linemap") == 0) {
+			options->linemap = 1;
+		} else if(strcmp(argv[i], "--frames") == 0) {
+			options->frames = 1;
+		} else if(strcmp(argv[i], "--ssa") == 0) {
+			options->ssa = 1;
+		} else if(strcmp(argv[i], "--dump-ssa") == 0) {
+			options->ssa = 1;
+			options->dump_ssa = 1;
+		} else if(strcmp(argv[i], "--stack-limit") == 0 && i + 1 < argc) {
+			options->stack_limit = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "-O0") == 0) {
+			options->optimize = 0;
+		} else if(strcmp(argv[i], "-Os") == 0) {
+			options->optimize = 1;
+			options->optimize_size = 1;
+		} else if(strcmp(argv[i], "--machine") == 0 && i + 1 < argc) {
+			options->machine_filename = argv[++i];
+		} else if(strcmp(argv[i], "--rewrites") == 0 && i + 1 < argc) {
+			options->rewrites_filename = argv[++i];
+		} else if(strcmp(argv[i], "--server") == 0) {
+			options->server = 1;
+			if(i + 1 < argc && argv[i + 1][0] != '-')
+				options->socket_path = argv[++i];
+		} else if(argv[i][0] == '-') {
+			printf("ERROR: Unrecognized option %s\n", argv[i]);
+			return 0;
+		} else {
+			options->filenames[options->file_ct++] = argv[i];
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Preprocesses a source file and compiles the result.
+ *
+ * @param pp The preprocessor, which keeps the files it reads for later calls.
+ * @param path The source file's path.
+ * @param source The source file's text, or NULL to read it from path.
+ * @param source_len The length of source.
+ * @param final_file Where the assembly program is written.
+ * @param block_ct Holds the options, with every counter at 0.
+ * @param cache Functions compiled before, or NULL to always compile.
+ * @return 1 on success, 0 if the preprocessor failed or the program does not fit in the stack.
+ */
+int preprocess_and_compile(Preprocessor *pp, char *path, char *source, size_t source_len, FILE *final_file, Block_ct *block_ct, Func_cache *cache) {
+	char *text;
+	size_t text_len;
+	FILE *text_file = open_memstream(&text, &text_len);
+	int ok = pp_run(pp, path, source, source_len, text_file);
 
-    fclose(output_file);
-    output_file = fopen(strcat(final_filename, ".tmp"), "r");
+	fclose(text_file);
 
-    line = (char *)malloc(STR_LEN * sizeof(char));
+	if(ok && text_len > 0) {
+		FILE *input_file = fmemopen(text, text_len, "r");
 
-    while(final_file != NULL && fgets(line, STR_LEN, output_file) != NULL) {
-        fputs(line, final_file);
-    }
+		ok = compile(input_file, final_file, block_ct, cache);
+		fclose(input_file);
+	}
+	free(text);
+
+	return ok;
+}
+
+/**
+ * Compiles one request sent to the server. See Server_compile.
+ */
+int server_compile(char *path, char *source, size_t source_len, int argc, char **argv, FILE *asm_file, FILE *counts_file, void *data) {
+	Server_state *state = (Server_state *)data;
+	Compile_options options;
+	Block_ct block_ct = {0};
+	Machine machine;
+	Rewrite_table rewrites;
+
+	if(!parse_options(argc, argv, &options)) {
+		free(options.filenames);
+		return 1;
+	}
+	free(options.filenames);
+
+	if(options.linemap) {
+		printf("ERROR: --linemap is not supported by the server\n");
+		return 1;
+	}
+
+	if(options.machine_filename == NULL)
+		block_ct.machine = &state->machine;
+	else if(machine_load(&machine, options.machine_filename))
+		block_ct.machine = &machine;
+	else
+		return 1;
+
+	if(options.machine_filename == NULL && options.rewrites_filename == NULL) {
+		block_ct.rewrites = &state->rewrites;
+	} else if(rewrite_load(&rewrites, block_ct.machine, options.rewrites_filename)) { //Which rewrites are kept depends on the machine
+		block_ct.rewrites = &rewrites;
+	} else {
+		rewrite_free(&rewrites);
+		if(block_ct.machine == &machine)
+			machine_free(&machine);
+		return 1;
+	}
+
+	block_ct.counter_file = options.instrument ? counts_file : NULL;
+	block_ct.count_all = options.count_all;
+	block_ct.stats_file = options.stats ? stdout : NULL;
+	block_ct.optimize = options.optimize;
+	block_ct.optimize_size = options.optimize_size;
+	block_ct.ssa = options.ssa;
+	block_ct.frames = options.frames;
+	block_ct.ssa_file = options.dump_ssa ? stdout : NULL;
+	block_ct.report_file = options.report ? stdout : NULL;
+		block_ct.layout_file = options.layout ? stdout : NULL;
+	block_ct.stack_limit = options.stack_limit > 0 ? options.stack_limit : block_ct.machine->stack_size;
+
+	int ok = preprocess_and_compile(&state->pp, path, source, source_len, asm_file, &block_ct, &state->cache);
+
+	if(block_ct.rewrites == &rewrites)
+		rewrite_free(&rewrites);
+	if(block_ct.machine == &machine)
+		machine_free(&machine);
+
+	return ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+	FILE *final_file;
+	Compile_options options;
+	Machine machine;
+	Rewrite_table rewrites;
+	Preprocessor pp;
+	char final_filename[STR_LEN + 8];
+	char counts_filename[STR_LEN + 8];
+	char linemap_filename[STR_LEN + 8];
+	int ret = 0;
+
+	if(!parse_options(argc - 1, argv + 1, &options))
+		return 1;
+
+	if(options.server) {
+		Server_state state;
+
+		if(!machine_load(&state.machine, options.machine_filename) || !rewrite_load(&state.rewrites, &state.machine, options.rewrites_filename))
+			return 1;
+		func_cache_init(&state.cache);
+		pp_init(&state.pp);
+
+		return server_run(options.socket_path, server_compile, &state);
+	}
+
+	if(options.file_ct == 0) {
+		printf("Enter a filename.");
+		return 0;
+	}
+
+	if(!machine_load(&machine, options.machine_filename) || !rewrite_load(&rewrites, &machine, options.rewrites_filename))
+		return 1;
+	pp_init(&pp);
+
+	for(int i = 0; i < options.file_ct; i++) { //Batch mode shares the files read by the preprocessor
+		char *filename = options.filenames[i];
+		Block_ct block_ct = {0};
+
+		block_ct.machine = &machine;
+		block_ct.rewrites = &rewrites;
+		block_ct.stats_file = options.stats ? stdout : NULL;
+		block_ct.count_all = options.count_all;
+		block_ct.optimize = options.optimize;
+		block_ct.optimize_size = options.optimize_size;
+		block_ct.ssa = options.ssa;
+		block_ct.frames = options.frames;
+		block_ct.ssa_file = options.dump_ssa ? stdout : NULL;
+		block_ct.report_file = options.report ? stdout : NULL;
+		block_ct.layout_file = options.layout ? stdout : NULL;
+		block_ct.stack_limit = options.stack_limit > 0 ? options.stack_limit : machine.stack_size;
+
+		if(options.instrument) {
+			snprintf(counts_filename, sizeof(counts_filename), "%s.counts", filename);
+			block_ct.counter_file = fopen(counts_filename, "w");
+		}
+		if(options.linemap) {
+			snprintf(linemap_filename, sizeof(linemap_filename), "%s.linemap", filename);
+			block_ct.linemap_file = fopen(linemap_filename, "wb");
+		}
+
+		snprintf(final_filename, sizeof(final_filename), "%s.asm", filename);
+		final_file = fopen(final_filename, "w");
+
+		int ok = final_file != NULL && preprocess_and_compile(&pp, filename, NULL, 0, final_file, &block_ct, NULL);
+
+		if(final_file != NULL)
+			fclose(final_file);
+		if(block_ct.counter_file != NULL)
+			fclose(block_ct.counter_file);
+		if(block_ct.linemap_file != NULL)
+			fclose(block_ct.linemap_file);
+
+		if(!ok) { //Leave nothing behind that a build could mistake for a good program
+			remove(final_filename);
+			if(options.instrument)
+				remove(counts_filename);
+			if(options.linemap)
+				remove(linemap_filename);
+			ret = 1;
+		}
+	}
 
-    free(line);
-    fputs("\tbeq -1", final_file);
+	if(options.stats)
+		printf("preprocessor: %ld files read from disk, %ld reused from memory, %ld includes skipped by their guard\n",
+			   pp.reads, pp.reuses, pp.guarded);
 
-    fclose(input_file);
-    fclose(output_file);
-    fclose(final_file);
+	pp_free(&pp);
+	rewrite_free(&rewrites);
+	machine_free(&machine);
+	free(options.filenames);
 
-    remove(strcat(filename, ".tmp"));
-    
-    return 0;
+	return ret;
 }
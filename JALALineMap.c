@@ -0,0 +1,134 @@
+#include "LineMap.h"
+
+/**
+ * Reads the line maps written by the compiler's --linemap.
+ *
+ * JALALineMap <map>                  lists every run of instructions and where it comes from.
+ * JALALineMap <map> <address>...     gives where the instruction at each address comes from.
+ * JALALineMap <map> --profile        reads "<address> <count>" lines, such as cycles or samples from a
+ *                                    simulator or the hardware, and totals the counts by source line,
+ *                                    highest first.
+ */
+
+/** @struct Profile_line
+ * The total count of one source line.
+ */
+typedef struct {
+	Line_map_run *run; ///< A run from the line, for its file, line and function.
+	long count; ///< The total of the counts of its instructions.
+} Profile_line;
+
+/**
+ * Orders source lines by their count, highest first.
+ */
+static int compare_profile_lines(const void *a, const void *b) {
+	const Profile_line *x = (const Profile_line *)a;
+	const Profile_line *y = (const Profile_line *)b;
+
+	return (y->count > x->count) - (y->count < x->count);
+}
+
+/**
+ * Prints where a run of instructions comes from.
+ */
+static void print_place(Line_map_run *run) {
+	printf("%s:%d %s\n", run->file[0] != '\0' ? run->file : "?", run->line, run->func[0] != '\0' ? run->func : "-");
+}
+
+/**
+ * Totals counts read from stdin by source line.
+ *
+ * @param map The line map.
+ * @return 0 on success, 1 if an address is outside the program.
+ */
+static int profile(Line_map *map) {
+	Symbol_table index;
+	Profile_line *lines = NULL;
+	int line_ct = 0;
+	long total = 0;
+	int addr, ret = 0;
+	long count;
+
+	symbol_table_init(&index);
+
+	while(scanf("%d %ld", &addr, &count) == 2) {
+		Line_map_run *run = line_map_find(map, addr);
+		char key[2 * STR_LEN];
+
+		if(run == NULL) {
+			printf("ERROR: Address %d is outside the program\n", addr);
+			ret = 1;
+			continue;
+		}
+
+		snprintf(key, sizeof(key), "%s:%d %s", run->file, run->line, run->func);
+
+		int i = symbol_table_contains(&index, key);
+
+		if(i < 0) {
+			i = line_ct++;
+			lines = (Profile_line *)realloc(lines, line_ct * sizeof(Profile_line));
+			lines[i] = (Profile_line){run, 0};
+			symbol_table_add(&index, key, i);
+		}
+		lines[i].count += count;
+		total += count;
+	}
+
+	qsort(lines, line_ct, sizeof(Profile_line), compare_profile_lines);
+	for(int i = 0; i < line_ct; i++) {
+		printf("%10ld %5.1f%% ", lines[i].count, total > 0 ? 100.0 * lines[i].count / total : 0.0);
+		print_place(lines[i].run);
+	}
+
+	free(lines);
+	symbol_table_free(&index);
+
+	return ret;
+}
+
+int main(int argc, char *argv[]) {
+	Line_map map;
+	int ret = 0;
+
+	if(argc < 2) {
+		printf("Usage: %s <map> [--profile | <address>...]\n", argv[0]);
+		return 1;
+	}
+
+	FILE *map_file = fopen(argv[1], "rb");
+
+	if(map_file == NULL) {
+		printf("ERROR: Could not open %s\n", argv[1]);
+		return 1;
+	}
+
+	if(!line_map_read(&map, map_file)) {
+		printf("ERROR: %s is not a line map\n", argv[1]);
+		ret = 1;
+	} else if(argc == 2) {
+		for(int r = 0; r < map.run_ct; r++) {
+			printf("%d-%d ", map.runs[r].addr, map.runs[r].addr + map.runs[r].inst_ct - 1);
+			print_place(&map.runs[r]);
+		}
+	} else if(strcmp(argv[2], "--profile") == 0) {
+		ret = profile(&map);
+	} else {
+		for(int i = 2; i < argc; i++) {
+			Line_map_run *run = line_map_find(&map, atoi(argv[i]));
+
+			if(run == NULL) {
+				printf("ERROR: Address %s is outside the program\n", argv[i]);
+				ret = 1;
+				continue;
+			}
+			printf("%s ", argv[i]);
+			print_place(run);
+		}
+	}
+
+	fclose(map_file);
+	line_map_free(&map);
+
+	return ret;
+}
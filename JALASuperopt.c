@@ -0,0 +1,716 @@
+#include <stdint.h>
+
+#include "Program.h"
+
+/**
+ * Finds cheaper equivalents for the short sequences of instructions seen most often in generated code,
+ * and writes them as a rewrite table for the compiler (see Rewrite.h).
+ *
+ * JALASuperopt [--machine <file>] [--length <n>] [--window <n>] [--top <n>] [--out <file>] <asm file>...
+ *
+ * The .asm files are cut into windows of 2 to --window straight-line instructions that only work on
+ * the stack: pushi of a constant, arithmetic and comparisons, and a conditional branch at the end.
+ * For the --top windows seen most often, every sequence of up to --length instructions of the target
+ * is tried, cheapest first, and the first one that does the same is kept. When it still does the same
+ * with the window's constant replaced by others, the rewrite is written for any constant ($K). Two sequences do the same if
+ * they leave the same values on the stack and take the same branch, for every one of many tests:
+ * random values, then every combination of small values and of the largest and smallest ones,
+ * evaluated both with 64 bit and with 32 bit wrapping arithmetic.
+ */
+
+#define SUPEROPT_MAX_LEN 8 ///< The longest window or sequence searched.
+#define SUPEROPT_MAX_IMMS 16 ///< The most constants tried as operands of pushi and addi.
+#define SUPEROPT_RANDOM_TESTS 64 ///< Number of tests with random values, tried first.
+#define SUPEROPT_DOMAIN 48 ///< The most small values every combination of which is tested.
+#define SUPEROPT_MAX_TESTS 100000 ///< The most tests of every combination of small values.
+
+/** @enum Sem
+ * The instructions whose meaning the superoptimiser knows.
+ */
+typedef enum {
+	SEM_PUSHI, SEM_ADDI, SEM_ADD, SEM_SUB, SEM_SLT, SEM_BEQ, SEM_BNE, SEM_BLT, SEM_BGE, SEM_BEQZ, SEM_BNEZ, SEM_CT
+} Sem;
+
+static char *sem_names[SEM_CT] = {"pushi", "addi", "add", "sub", "slt", "beq", "bne", "blt", "bge", "beqz", "bnez"};
+
+/** @struct Op
+ * One instruction of a sequence.
+ */
+typedef struct {
+	Sem sem; ///< What it does.
+	long long imm; ///< The operand of pushi and addi.
+	int sym; ///< In a rewrite that holds for any constant, 1 if the operand is written $K, -1 if -$K, 0 if as it is.
+} Op;
+
+/** @struct Seq
+ * A sequence of instructions, with what it costs on the target.
+ */
+typedef struct {
+	Op ops[SUPEROPT_MAX_LEN]; ///< The instructions.
+	int len; ///< Number of instructions.
+	int cycles; ///< Cycles taken.
+	int bytes; ///< Bytes of instruction memory taken.
+} Seq;
+
+/** @struct Window
+ * A window of the corpus and how often it was seen.
+ */
+typedef struct {
+	Seq seq; ///< The instructions.
+	int seen; ///< How many times it was seen.
+} Window;
+
+/** @struct Outcome
+ * What a sequence does for one test.
+ */
+typedef struct {
+	int ok; ///< 0 if it takes more values off the stack than the test gives.
+	int depth; ///< Number of values left.
+	long long stack[2 * SUPEROPT_MAX_LEN]; ///< The values left, deepest first.
+	int taken; ///< 1 if it ends in a branch that is taken, 0 if not, -1 if it has no branch.
+	int max_depth; ///< The most values on the stack at once.
+} Outcome;
+
+/** @struct Search
+ * The tests a window is checked against, and what the window does for each.
+ */
+typedef struct {
+	Machine *machine; ///< The target.
+	int inputs; ///< How many values the window takes off the stack.
+	long long *tests; ///< The values of each test, inputs to a test, deepest first.
+	int test_ct; ///< Number of tests.
+	Outcome *expect; ///< What the window does for each test, with 64 bit and then 32 bit arithmetic.
+	Op *alphabet; ///< The instructions a sequence may be made of.
+	int alphabet_ct; ///< Number of such instructions.
+	Seq best; ///< The cheapest sequence found so far.
+	int found; ///< 1 once a cheaper sequence is found.
+} Search;
+
+/**
+ * Returns how many values an instruction takes off the stack and leaves.
+ */
+static void sem_effect(Sem sem, int *pops, int *pushes) {
+	static int effects[SEM_CT][2] = {{0, 1}, {1, 1}, {2, 1}, {2, 1}, {2, 1}, {2, 0}, {2, 0}, {2, 0}, {2, 0}, {1, 0}, {1, 0}};
+
+	*pops = effects[sem][0];
+	*pushes = effects[sem][1];
+}
+
+/**
+ * Returns 1 if the instruction is a conditional branch.
+ */
+static int sem_is_branch(Sem sem) {
+	return sem >= SEM_BEQ;
+}
+
+/**
+ * Works out what a sequence does with the given values on the stack.
+ *
+ * @param seq The sequence.
+ * @param inputs The values on the stack, deepest first.
+ * @param input_ct Number of values. Taking more fails.
+ * @param wrap 1 to wrap every result to 32 bits, 0 for 64 bit arithmetic.
+ * @param out Filled in with the outcome.
+ */
+static void run(Seq *seq, long long *inputs, int input_ct, int wrap, Outcome *out) {
+	long long stack[3 * SUPEROPT_MAX_LEN];
+	int depth = input_ct;
+
+	memcpy(stack, inputs, input_ct * sizeof(long long));
+	out->ok = 1;
+	out->taken = -1;
+	out->max_depth = 0;
+
+	for(int i = 0; i < seq->len; i++) {
+		Op *op = &seq->ops[i];
+		int pops, pushes;
+		long long a = 0, b = 0, r = 0;
+
+		sem_effect(op->sem, &pops, &pushes);
+		if(depth < pops) {
+			out->ok = 0;
+			return;
+		}
+		if(pops == 2)
+			b = stack[--depth];
+		if(pops >= 1)
+			a = stack[--depth];
+
+		switch(op->sem) {
+		case SEM_PUSHI: r = op->imm; break;
+		case SEM_ADDI: r = a + op->imm; break;
+		case SEM_ADD: r = a + b; break;
+		case SEM_SUB: r = a - b; break;
+		case SEM_SLT: r = a < b; break;
+		case SEM_BEQ: out->taken = a == b; break;
+		case SEM_BNE: out->taken = a != b; break;
+		case SEM_BLT: out->taken = a < b; break;
+		case SEM_BGE: out->taken = a >= b; break;
+		case SEM_BEQZ: out->taken = a == 0; break;
+		case SEM_BNEZ: out->taken = a != 0; break;
+		default: break;
+		}
+
+		if(pushes == 1)
+			stack[depth++] = wrap ? (long long)(int32_t)(uint32_t)r : r;
+		if(depth > out->max_depth)
+			out->max_depth = depth;
+	}
+
+	out->depth = depth;
+	memcpy(out->stack, stack, depth * sizeof(long long));
+}
+
+/**
+ * Returns 1 if two outcomes are the same.
+ */
+static int same_outcome(Outcome *a, Outcome *b) {
+	return a->ok && b->ok && a->depth == b->depth && a->taken == b->taken && memcmp(a->stack, b->stack, a->depth * sizeof(long long)) == 0;
+}
+
+/**
+ * Returns 1 if a sequence does what the window does for every test.
+ */
+static int equivalent(Search *search, Seq *seq) {
+	Outcome out;
+
+	for(int t = 0; t < search->test_ct; t++) //The random tests come first, and rule out most sequences
+		for(int wrap = 0; wrap < 2; wrap++) {
+			Outcome *expect = &search->expect[2 * t + wrap];
+
+			run(seq, &search->tests[t * search->inputs], search->inputs, wrap, &out);
+			if(!same_outcome(&out, expect) || out.max_depth > expect->max_depth)
+				return 0;
+		}
+
+	return 1;
+}
+
+/**
+ * Returns 1 if one cost is lower than another: fewer cycles, or as many in fewer bytes.
+ */
+static int cheaper(int cycles, int bytes, Seq *than) {
+	return cycles < than->cycles || (cycles == than->cycles && bytes < than->bytes);
+}
+
+/**
+ * Tries every sequence that starts with the given instructions, up to a length, keeping the cheapest
+ * that does what the window does.
+ *
+ * @param search The window's tests and the best sequence so far.
+ * @param seq The instructions so far.
+ * @param max_len The longest sequence to try.
+ * @param branch 1 if the sequence must end in a branch, as the window does.
+ */
+static void enumerate(Search *search, Seq *seq, int max_len, int branch) {
+	int ends_right = seq->len > 0 ? branch == sem_is_branch(seq->ops[seq->len - 1].sem) : !branch;
+
+	if(ends_right && cheaper(seq->cycles, seq->bytes, &search->best) && equivalent(search, seq)) {
+		search->best = *seq;
+		search->found = 1;
+	}
+	if(seq->len >= max_len || (seq->len > 0 && sem_is_branch(seq->ops[seq->len - 1].sem)))
+		return;
+
+	for(int a = 0; a < search->alphabet_ct; a++) {
+		Op *op = &search->alphabet[a];
+		Machine_inst *inst = machine_inst(search->machine, sem_names[op->sem]);
+
+		if(sem_is_branch(op->sem) && !branch)
+			continue;
+		if(!cheaper(seq->cycles + inst->cycles, seq->bytes + inst->bytes, &search->best))
+			continue;
+
+		seq->ops[seq->len++] = *op;
+		seq->cycles += inst->cycles;
+		seq->bytes += inst->bytes;
+		enumerate(search, seq, max_len, branch);
+		seq->cycles -= inst->cycles;
+		seq->bytes -= inst->bytes;
+		seq->len--;
+	}
+}
+
+/**
+ * Adds a value to a list, unless it is there already or the list is full.
+ */
+static void add_value(long long *values, int *value_ct, long long value, int max) {
+	for(int i = 0; i < *value_ct; i++)
+		if(values[i] == value)
+			return;
+	if(*value_ct < max)
+		values[(*value_ct)++] = value;
+}
+
+/**
+ * Adds a constant to those tried as operands.
+ */
+static void add_imm(long long *imms, int *imm_ct, long long imm) {
+	add_value(imms, imm_ct, imm, SUPEROPT_MAX_IMMS);
+}
+
+/**
+ * Adds one test, working out what the window does for it.
+ */
+static void add_test(Search *search, Seq *window, long long *values) {
+	search->tests = (long long *)realloc(search->tests, (search->test_ct + 1) * (search->inputs + 1) * sizeof(long long));
+	search->expect = (Outcome *)realloc(search->expect, 2 * (search->test_ct + 1) * sizeof(Outcome));
+	memcpy(&search->tests[search->test_ct * search->inputs], values, search->inputs * sizeof(long long));
+	for(int wrap = 0; wrap < 2; wrap++)
+		run(window, values, search->inputs, wrap, &search->expect[2 * search->test_ct + wrap]);
+	search->test_ct++;
+}
+
+/**
+ * Adds a test for every combination of the given values.
+ */
+static void add_product(Search *search, Seq *window, long long *domain, int domain_ct) {
+	long long values[SUPEROPT_MAX_LEN + 1];
+	int index[SUPEROPT_MAX_LEN + 1] = {0};
+
+	for(;;) {
+		int i;
+
+		for(i = 0; i < search->inputs; i++)
+			values[i] = domain[index[i]];
+		add_test(search, window, values);
+
+		for(i = 0; i < search->inputs && ++index[i] == domain_ct; i++)
+			index[i] = 0;
+		if(i == search->inputs)
+			return;
+	}
+}
+
+/**
+ * Adds a value and those next to it, and their negations, to the values tested.
+ */
+static void add_near(long long *domain, int *domain_ct, long long value) {
+	for(long long d = -1; d <= 1; d++) {
+		add_value(domain, domain_ct, value + d, SUPEROPT_DOMAIN);
+		add_value(domain, domain_ct, -value + d, SUPEROPT_DOMAIN);
+	}
+}
+
+/**
+ * Works out the tests a window is checked against, and what the window does for each.
+ *
+ * @param search Filled in with the tests. Only the machine need be set.
+ * @param window The window.
+ */
+static void make_tests(Search *search, Seq *window) {
+	static long long edges[] = {INT32_MIN, INT32_MIN + 1, -1, 0, 1, INT32_MAX - 1, INT32_MAX};
+	long long domain[SUPEROPT_DOMAIN];
+	int domain_ct = 0;
+	int depth = 0;
+	long long values[SUPEROPT_MAX_LEN + 1];
+
+	for(int i = 0; i < window->len; i++) { //How many values it takes off the stack
+		int pops, pushes;
+
+		sem_effect(window->ops[i].sem, &pops, &pushes);
+		depth -= pops;
+		if(-depth > search->inputs)
+			search->inputs = -depth;
+		depth += pushes;
+	}
+
+	srand(1);
+	for(int t = 0; t < SUPEROPT_RANDOM_TESTS; t++) {
+		for(int i = 0; i < search->inputs; i++)
+			values[i] = (long long)(int32_t)((uint32_t)rand() << 16 ^ (uint32_t)rand());
+		add_test(search, window, values);
+	}
+	//Small values, and those around the window's constants and their sums and differences, where
+	//comparisons change their outcome
+	for(int v = 0; v <= 2; v++)
+		add_near(domain, &domain_ct, v);
+	for(int i = 0; i < window->len; i++)
+		for(int j = i; j < window->len; j++)
+			if((window->ops[i].sem == SEM_PUSHI || window->ops[i].sem == SEM_ADDI) && (window->ops[j].sem == SEM_PUSHI || window->ops[j].sem == SEM_ADDI)) {
+				add_near(domain, &domain_ct, window->ops[i].imm);
+				add_near(domain, &domain_ct, window->ops[i].imm + window->ops[j].imm);
+				add_near(domain, &domain_ct, window->ops[i].imm - window->ops[j].imm);
+			}
+	for(long long tests = 1, n = 0; n < search->inputs; n++) { //As many of them as fit in the number of tests
+		while(tests * domain_ct > SUPEROPT_MAX_TESTS && domain_ct > 3)
+			domain_ct--;
+		tests *= domain_ct;
+	}
+	add_product(search, window, domain, domain_ct);
+	if(search->inputs <= 4)
+		add_product(search, window, edges, 7);
+}
+
+/**
+ * Searches for the cheapest sequence that does what a window does.
+ *
+ * @param machine The target.
+ * @param window The window.
+ * @param max_len The longest sequence to try.
+ * @param best Set to the sequence found.
+ * @return 1 if a cheaper sequence was found, 0 otherwise.
+ */
+static int superoptimize(Machine *machine, Seq *window, int max_len, Seq *best) {
+	Search search = {machine};
+	long long imms[SUPEROPT_MAX_IMMS];
+	int imm_ct = 0;
+	int branch = sem_is_branch(window->ops[window->len - 1].sem);
+	Seq seq = {0};
+
+	make_tests(&search, window);
+
+	add_imm(imms, &imm_ct, 0);
+	add_imm(imms, &imm_ct, 1);
+	add_imm(imms, &imm_ct, -1);
+	for(int i = 0; i < window->len; i++)
+		if(window->ops[i].sem == SEM_PUSHI || window->ops[i].sem == SEM_ADDI) {
+			add_imm(imms, &imm_ct, window->ops[i].imm);
+			add_imm(imms, &imm_ct, -window->ops[i].imm);
+		}
+	for(int d = 0; d < search.expect[0].depth; d++) //Values the window leaves the same for two random tests are constants worth trying
+		if(search.expect[0].stack[d] == search.expect[2].stack[d])
+			add_imm(imms, &imm_ct, search.expect[0].stack[d]);
+
+	search.alphabet = (Op *)malloc((SEM_CT * SUPEROPT_MAX_IMMS + 1) * sizeof(Op));
+	for(int s = 0; s < SEM_CT; s++) {
+		if(machine_inst(machine, sem_names[s]) == NULL)
+			continue;
+		for(int i = 0; i < (s == SEM_PUSHI || s == SEM_ADDI ? imm_ct : 1); i++)
+			search.alphabet[search.alphabet_ct++] = (Op){s, imms[i]};
+	}
+
+	search.best = *window;
+	enumerate(&search, &seq, max_len, branch);
+	*best = search.best;
+
+	free(search.tests);
+	free(search.expect);
+	free(search.alphabet);
+
+	return search.found;
+}
+
+/**
+ * Returns 1 if the instruction has a constant operand.
+ */
+static int sem_has_imm(Sem sem) {
+	return sem == SEM_PUSHI || sem == SEM_ADDI;
+}
+
+/**
+ * Makes a rewrite hold for any constant, when it can. If the window has one constant operand, and the
+ * sequence found still does the same when that constant is replaced by each of many others, the
+ * constant is written $K in both, and its negation -$K in the sequence found.
+ *
+ * @param machine The target.
+ * @param window The window, changed to use $K if the rewrite holds for any constant.
+ * @param best The sequence found for it, changed to use $K and -$K to match.
+ * @return 1 if the rewrite now holds for any constant, 0 if it was left as it was.
+ */
+static int generalize(Machine *machine, Seq *window, Seq *best) {
+	static long long others[] = {0, 1, -1, 2, -2, 3, 7, -9, 100, -100, 4096, 65535, -12345678, INT32_MAX, INT32_MIN + 1};
+	int at = -1;
+
+	for(int i = 0; i < window->len; i++)
+		if(sem_has_imm(window->ops[i].sem)) {
+			if(at >= 0)
+				return 0;
+			at = i;
+		}
+	if(at < 0 || window->ops[at].imm == INT32_MIN)
+		return 0;
+
+	long long imm = window->ops[at].imm;
+
+	for(int o = 0; o < (int)(sizeof(others) / sizeof(others[0])); o++) {
+		Search search = {machine};
+		Seq w = *window, b = *best;
+		int same;
+
+		w.ops[at].imm = others[o];
+		for(int i = 0; i < b.len; i++)
+			if(sem_has_imm(b.ops[i].sem) && b.ops[i].imm == imm)
+				b.ops[i].imm = others[o];
+			else if(sem_has_imm(b.ops[i].sem) && b.ops[i].imm == -imm)
+				b.ops[i].imm = -others[o];
+
+		make_tests(&search, &w);
+		same = equivalent(&search, &b);
+		free(search.tests);
+		free(search.expect);
+		if(!same)
+			return 0;
+	}
+
+	window->ops[at].sym = 1;
+	for(int i = 0; i < best->len; i++)
+		if(sem_has_imm(best->ops[i].sem) && best->ops[i].imm == imm)
+			best->ops[i].sym = 1;
+		else if(sem_has_imm(best->ops[i].sem) && best->ops[i].imm == -imm)
+			best->ops[i].sym = -1;
+
+	return 1;
+}
+
+/**
+ * Writes a sequence as the compiler's code would have it, on one line.
+ */
+static void write_seq(FILE *out_file, Seq *seq) {
+	for(int i = 0; i < seq->len; i++) {
+		fprintf(out_file, " %s", sem_names[seq->ops[i].sem]);
+		if(sem_has_imm(seq->ops[i].sem) && seq->ops[i].sym != 0)
+			fprintf(out_file, " %s", seq->ops[i].sym > 0 ? "$K" : "-$K");
+		else if(sem_has_imm(seq->ops[i].sem))
+			fprintf(out_file, " %lld", seq->ops[i].imm);
+		else if(sem_is_branch(seq->ops[i].sem))
+			fprintf(out_file, " $L");
+	}
+}
+
+/**
+ * Reads an instruction of the corpus.
+ *
+ * @return 1 if it is one the superoptimiser knows, with a constant operand if it has one.
+ */
+static int read_op(Machine *machine, Asm_line *line, Op *op) {
+	if(line->kind != ASM_INST || machine_inst(machine, line->op) == NULL)
+		return 0;
+
+	for(int s = 0; s < SEM_CT; s++)
+		if(strcmp(line->op, sem_names[s]) == 0) {
+			op->sem = s;
+			op->imm = 0;
+			if(s == SEM_PUSHI || s == SEM_ADDI) {
+				if(line->arg == NULL || !machine_is_constant(line->arg))
+					return 0;
+				op->imm = atoll(line->arg);
+			}
+			return 1;
+		}
+
+	return 0;
+}
+
+/**
+ * Counts the windows of one .asm file.
+ */
+static void count_windows(Machine *machine, Program *prog, int max_window, Symbol_table *index, Window **windows, int *window_ct) {
+	for(int i = 0; i < prog->line_ct; i++)
+		for(int len = 1; len <= max_window && i + len <= prog->line_ct; len++) {
+			Seq seq = {0};
+			int ok = 1;
+
+			for(int j = 0; ok && j < len; j++) {
+				ok = read_op(machine, &prog->lines[i + j], &seq.ops[j]);
+				ok = ok && (j == len - 1 || !sem_is_branch(seq.ops[j].sem));
+			}
+			if(!ok)
+				break;
+			if(len < 2)
+				continue;
+			seq.len = len;
+
+			char *text;
+			size_t text_len;
+			FILE *text_file = open_memstream(&text, &text_len);
+
+			write_seq(text_file, &seq);
+			fclose(text_file);
+
+			int w = symbol_table_contains(index, text);
+
+			if(w < 0) {
+				w = (*window_ct)++;
+				*windows = (Window *)realloc(*windows, *window_ct * sizeof(Window));
+				(*windows)[w].seq = seq;
+				(*windows)[w].seen = 0;
+				for(int j = 0; j < len; j++) {
+					Machine_inst *inst = machine_inst(machine, sem_names[seq.ops[j].sem]);
+
+					(*windows)[w].seq.cycles += inst->cycles;
+					(*windows)[w].seq.bytes += inst->bytes;
+				}
+				symbol_table_add(index, text, w);
+			}
+			(*windows)[w].seen++;
+			free(text);
+		}
+}
+
+/**
+ * Applies rewrites already found to a window, the way the compiler would, to see whether the window
+ * needs one of its own.
+ *
+ * @param machine The target.
+ * @param window The window.
+ * @param from The windows of the rewrites found.
+ * @param to What each is rewritten to.
+ * @param found Number of rewrites found.
+ * @return The window after rewriting, with its costs.
+ */
+static Seq apply_found(Machine *machine, Seq *window, Seq *from, Seq *to, int found) {
+	Seq seq = *window;
+	int changed = 1;
+
+	while(changed) {
+		changed = 0;
+		for(int i = 0; !changed && i < seq.len; i++)
+			for(int r = 0; !changed && r < found; r++) {
+				int match = i + from[r].len <= seq.len;
+				long long imm = 0;
+
+				for(int j = 0; match && j < from[r].len; j++) {
+					Op *op = &seq.ops[i + j], *want = &from[r].ops[j];
+
+					match = op->sem == want->sem && (want->sym != 0 || op->imm == want->imm);
+					if(want->sym != 0)
+						imm = op->imm;
+				}
+				if(!match)
+					continue;
+
+				memmove(&seq.ops[i + to[r].len], &seq.ops[i + from[r].len], (seq.len - i - from[r].len) * sizeof(Op));
+				memcpy(&seq.ops[i], to[r].ops, to[r].len * sizeof(Op));
+				for(int j = 0; j < to[r].len; j++) { //What $K and -$K stand for here
+					if(seq.ops[i + j].sym != 0)
+						seq.ops[i + j].imm = seq.ops[i + j].sym * imm;
+					seq.ops[i + j].sym = 0;
+				}
+				seq.len += to[r].len - from[r].len;
+				seq.cycles -= from[r].cycles - to[r].cycles;
+				seq.bytes -= from[r].bytes - to[r].bytes;
+				changed = 1;
+			}
+	}
+
+	return seq;
+}
+
+/**
+ * Orders windows by how often they were seen, most first.
+ */
+static int compare_windows(const void *a, const void *b) {
+	return ((const Window *)b)->seen - ((const Window *)a)->seen;
+}
+
+int main(int argc, char *argv[]) {
+	Machine machine;
+	char *machine_filename = NULL;
+	char *out_filename = NULL;
+	int max_len = 3, max_window = 4, top = 50;
+	Symbol_table index;
+	Window *windows = NULL;
+	int window_ct = 0, file_ct = 0, found = 0;
+	FILE *out_file = stdout;
+
+	symbol_table_init(&index);
+
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--machine") == 0 && i + 1 < argc) {
+			machine_filename = argv[++i];
+		} else if(strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+			out_filename = argv[++i];
+		} else if(strcmp(argv[i], "--length") == 0 && i + 1 < argc) {
+			max_len = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+			max_window = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+			top = atoi(argv[++i]);
+		} else if(argv[i][0] == '-') {
+			printf("ERROR: Unrecognized option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if(max_len < 0 || max_len > SUPEROPT_MAX_LEN || max_window < 2 || max_window > SUPEROPT_MAX_LEN) {
+		printf("ERROR: --length and --window must be at most %d, and --window at least 2\n", SUPEROPT_MAX_LEN);
+		return 1;
+	}
+	if(!machine_load(&machine, machine_filename))
+		return 1;
+
+	for(int i = 1; i < argc; i++) { //The corpus
+		if(argv[i][0] == '-') {
+			i++;
+			continue;
+		}
+
+		FILE *asm_file = fopen(argv[i], "r");
+		char *text;
+		size_t text_len;
+		FILE *text_file = open_memstream(&text, &text_len);
+		char buf[4096];
+		size_t len;
+		Program prog;
+
+		if(asm_file == NULL) {
+			printf("ERROR: Could not open %s\n", argv[i]);
+			fclose(text_file);
+			free(text);
+			continue;
+		}
+		while((len = fread(buf, 1, sizeof(buf), asm_file)) > 0)
+			fwrite(buf, 1, len, text_file);
+		fclose(asm_file);
+		fclose(text_file);
+
+		program_parse(&prog, text);
+		count_windows(&machine, &prog, max_window, &index, &windows, &window_ct);
+		program_free(&prog);
+		free(text);
+		file_ct++;
+	}
+
+	if(file_ct == 0) {
+		printf("Usage: %s [--machine <file>] [--length <n>] [--window <n>] [--top <n>] [--out <file>] <asm file>...\n", argv[0]);
+		return 1;
+	}
+
+	if(out_filename != NULL && (out_file = fopen(out_filename, "w")) == NULL) {
+		printf("ERROR: Could not open %s\n", out_filename);
+		return 1;
+	}
+
+	qsort(windows, window_ct, sizeof(Window), compare_windows);
+	fprintf(out_file, "# Rewrite table, generated by JALASuperopt from %d files with --length %d --window %d --top %d%s%s.\n",
+			file_ct, max_len, max_window, top, machine_filename != NULL ? " --machine " : "", machine_filename != NULL ? machine_filename : "");
+	fprintf(out_file, "# Regenerate it rather than editing it: make rewrites, or make rewrites CORPUS=\"<asm files>\"\n");
+	fprintf(out_file, "#\n# rewrite <instructions> : <cheaper instructions that do the same>\n");
+	fprintf(out_file, "#   $L stands for the tag a branch goes to, $K for any constant and -$K for its negation.\n");
+
+	Seq *from = (Seq *)malloc((top + 1) * sizeof(Seq));
+	Seq *to = (Seq *)malloc((top + 1) * sizeof(Seq));
+
+	for(int w = 0; w < window_ct && w < top; w++) {
+		Seq window = windows[w].seq, best;
+		Seq already = apply_found(&machine, &window, from, to, found);
+
+		if(!superoptimize(&machine, &window, max_len, &best) || !cheaper(best.cycles, best.bytes, &already))
+			continue; //Nothing cheaper, or the rewrites found before do as well
+		generalize(&machine, &window, &best);
+		from[found] = window;
+		to[found] = best;
+
+		fprintf(out_file, "\n# seen %d times, saves %d cycles and %d bytes\nrewrite", windows[w].seen,
+				window.cycles - best.cycles, window.bytes - best.bytes);
+		write_seq(out_file, &window);
+		fprintf(out_file, " :");
+		write_seq(out_file, &best);
+		fprintf(out_file, "\n");
+		found++;
+	}
+
+	if(out_file != stdout) {
+		fclose(out_file);
+		printf("%d windows, %d cheaper sequences found for the %d seen most often\n", window_ct, found, top < window_ct ? top : window_ct);
+	}
+
+	free(from);
+	free(to);
+	free(windows);
+	symbol_table_free(&index);
+	machine_free(&machine);
+
+	return 0;
+}
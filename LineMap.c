@@ -0,0 +1,240 @@
+#include "LineMap.h"
+
+/*
+ * A line map file holds, in order:
+ * - the 4 bytes of LINE_MAP_MAGIC,
+ * - the number of instructions in the program,
+ * - the number of names, then each name as its length and its bytes,
+ * - the number of runs, then each run as:
+ *   - its number of instructions, shifted left by 2, with bit 1 set if the file changes from the run
+ *     before and bit 0 set if the function does,
+ *   - the index of the new file's name, if it changes,
+ *   - the index of the new function's name, if it changes,
+ *   - the difference from the line of the run before, zigzag encoded.
+ * Every number is an unsigned LEB128 varint. Addresses are not stored, since each run starts where
+ * the one before it ends, and the first starts at 0.
+ */
+
+/**
+ * Writes a number as a varint: 7 bits to a byte, lowest first, with the top bit set on all but the last.
+ */
+static void write_varint(FILE *map_file, unsigned int value) {
+	while(value >= 0x80) {
+		fputc((value & 0x7f) | 0x80, map_file);
+		value >>= 7;
+	}
+	fputc(value, map_file);
+}
+
+/**
+ * Reads a varint.
+ *
+ * @return 1 on success, 0 at the end of the file or if the number is too long.
+ */
+static int read_varint(FILE *map_file, unsigned int *value) {
+	int c;
+
+	*value = 0;
+	for(int shift = 0; shift < 35 && (c = fgetc(map_file)) != EOF; shift += 7) {
+		*value |= (unsigned int)(c & 0x7f) << shift;
+		if(!(c & 0x80))
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Returns the index of a name in the table of names, adding it if it is new.
+ */
+static int name_index(Symbol_table *index, char ***strings, int *string_ct, char *name) {
+	int i = symbol_table_contains(index, name);
+
+	if(i < 0) {
+		i = (*string_ct)++;
+		*strings = (char **)realloc(*strings, *string_ct * sizeof(char *));
+		(*strings)[i] = name;
+		symbol_table_add(index, name, i);
+	}
+
+	return i;
+}
+
+/**
+ * Writes the map from the address of each instruction of a program to the source file, line and
+ * function it comes from. Lines are known from the "#Line: N" comments of the generated code, files
+ * from its "#File: path" comments, and functions from their tags.
+ *
+ * @param prog The whole program, with its comments.
+ * @param names The names of the functions.
+ * @param func_ct Number of functions.
+ * @param map_file Where the map is written.
+ */
+void line_map_write(Program *prog, char **names, int func_ct, FILE *map_file) {
+	Symbol_table index;
+	char **strings = NULL;
+	int string_ct = 0;
+	Line_map_run *runs = NULL;
+	int run_ct = 0;
+	int inst_ct = 0;
+	char *file = "";
+	char *func = "";
+	int line_no = 0;
+
+	symbol_table_init(&index);
+
+	for(int i = 0; i < prog->line_ct; i++) {
+		Asm_line *line = &prog->lines[i];
+
+		if(line->kind == ASM_OTHER && line->arg != NULL && strncmp(line->arg, "#File: ", 7) == 0) {
+			file = line->arg + 7;
+		} else if(line->kind == ASM_OTHER && line->arg != NULL && strncmp(line->arg, "#Line: ", 7) == 0) {
+			line_no = atoi(line->arg + 7);
+		} else if(line->kind == ASM_TAG) {
+			for(int f = 0; f < func_ct; f++)
+				if(strcmp(names[f], line->arg) == 0)
+					func = names[f];
+		} else if(line->kind == ASM_INST) {
+			Line_map_run *last = run_ct > 0 ? &runs[run_ct - 1] : NULL;
+
+			if(last != NULL && last->line == line_no && strcmp(last->file, file) == 0 && strcmp(last->func, func) == 0) {
+				last->inst_ct++;
+			} else {
+				runs = (Line_map_run *)realloc(runs, (run_ct + 1) * sizeof(Line_map_run));
+				runs[run_ct++] = (Line_map_run){inst_ct, 1, file, line_no, func};
+			}
+			inst_ct++;
+		}
+	}
+
+	int *file_index = (int *)malloc((run_ct + 1) * sizeof(int));
+	int *func_index = (int *)malloc((run_ct + 1) * sizeof(int));
+
+	for(int r = 0; r < run_ct; r++) {
+		file_index[r] = name_index(&index, &strings, &string_ct, runs[r].file);
+		func_index[r] = name_index(&index, &strings, &string_ct, runs[r].func);
+	}
+
+	fwrite(LINE_MAP_MAGIC, 1, 4, map_file);
+	write_varint(map_file, inst_ct);
+	write_varint(map_file, string_ct);
+	for(int s = 0; s < string_ct; s++) {
+		write_varint(map_file, strlen(strings[s]));
+		fwrite(strings[s], 1, strlen(strings[s]), map_file);
+	}
+
+	write_varint(map_file, run_ct);
+	for(int r = 0; r < run_ct; r++) {
+		int new_file = r == 0 || file_index[r] != file_index[r - 1];
+		int new_func = r == 0 || func_index[r] != func_index[r - 1];
+		int delta = runs[r].line - (r > 0 ? runs[r - 1].line : 0);
+
+		write_varint(map_file, (unsigned int)runs[r].inst_ct << 2 | new_file << 1 | new_func);
+		if(new_file)
+			write_varint(map_file, file_index[r]);
+		if(new_func)
+			write_varint(map_file, func_index[r]);
+		write_varint(map_file, (unsigned int)delta << 1 ^ (unsigned int)(delta >> 31));
+	}
+
+	free(file_index);
+	free(func_index);
+	free(strings);
+	free(runs);
+	symbol_table_free(&index);
+}
+
+/**
+ * Reads a line map written by line_map_write.
+ *
+ * @param map Filled in from the file. Must be freed with line_map_free, even if reading fails.
+ * @param map_file The file.
+ * @return 1 on success, 0 if the file is not a line map or is cut short.
+ */
+int line_map_read(Line_map *map, FILE *map_file) {
+	char magic[4];
+	unsigned int inst_ct, string_ct, run_ct;
+	int file = -1, func = -1, line_no = 0, addr = 0;
+
+	memset(map, 0, sizeof(Line_map));
+
+	if(fread(magic, 1, 4, map_file) != 4 || memcmp(magic, LINE_MAP_MAGIC, 4) != 0)
+		return 0;
+	if(!read_varint(map_file, &inst_ct) || !read_varint(map_file, &string_ct))
+		return 0;
+
+	map->inst_ct = inst_ct;
+	map->strings = (char **)calloc(string_ct + 1, sizeof(char *));
+	for(; map->string_ct < (int)string_ct; map->string_ct++) {
+		unsigned int len;
+
+		if(!read_varint(map_file, &len))
+			return 0;
+		map->strings[map->string_ct] = (char *)malloc(len + 1);
+		if(fread(map->strings[map->string_ct], 1, len, map_file) != len) {
+			free(map->strings[map->string_ct]);
+			return 0;
+		}
+		map->strings[map->string_ct][len] = '\0';
+	}
+
+	if(!read_varint(map_file, &run_ct))
+		return 0;
+	map->runs = (Line_map_run *)malloc((run_ct + 1) * sizeof(Line_map_run));
+	for(; map->run_ct < (int)run_ct; map->run_ct++) {
+		unsigned int head, value;
+
+		if(!read_varint(map_file, &head))
+			return 0;
+		if(head & 2) {
+			if(!read_varint(map_file, &value) || value >= string_ct)
+				return 0;
+			file = value;
+		}
+		if(head & 1) {
+			if(!read_varint(map_file, &value) || value >= string_ct)
+				return 0;
+			func = value;
+		}
+		if(!read_varint(map_file, &value) || file < 0 || func < 0)
+			return 0;
+		line_no += (int)(value >> 1) ^ -(int)(value & 1);
+
+		map->runs[map->run_ct] = (Line_map_run){addr, head >> 2, map->strings[file], line_no, map->strings[func]};
+		addr += head >> 2;
+	}
+
+	return addr == map->inst_ct;
+}
+
+/**
+ * Returns the run holding the instruction at an address, or NULL if the address is outside the program.
+ */
+Line_map_run * line_map_find(Line_map *map, int addr) {
+	int lo = 0, hi = map->run_ct - 1;
+
+	while(lo <= hi) {
+		int mid = (lo + hi) / 2;
+		Line_map_run *run = &map->runs[mid];
+
+		if(addr < run->addr)
+			hi = mid - 1;
+		else if(addr >= run->addr + run->inst_ct)
+			lo = mid + 1;
+		else
+			return run;
+	}
+
+	return NULL;
+}
+
+/**
+ * Frees the memory held by a line map.
+ */
+void line_map_free(Line_map *map) {
+	for(int s = 0; s < map->string_ct; s++)
+		free(map->strings[s]);
+	free(map->strings);
+	free(map->runs);
+	memset(map, 0, sizeof(Line_map));
+}
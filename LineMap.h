@@ -0,0 +1,35 @@
+#ifndef LINE_MAP_H
+#define LINE_MAP_H
+
+#include "Program.h"
+
+#define LINE_MAP_MAGIC "JLM1" ///< The first bytes of a line map file, with the version of the format.
+
+/** @struct Line_map_run
+ * Instructions in a row that come from the same source line.
+ */
+typedef struct {
+	int addr; ///< The address of the first instruction.
+	int inst_ct; ///< Number of instructions.
+	char *file; ///< The source file, or "" if unknown.
+	int line; ///< The line in the source file, or 0 if unknown.
+	char *func; ///< The function the instructions belong to, or "" outside of any.
+} Line_map_run;
+
+/** @struct Line_map
+ * A line map as read back from its file.
+ */
+typedef struct {
+	char **strings; ///< The file and function names, each stored once.
+	int string_ct; ///< Number of names.
+	Line_map_run *runs; ///< The runs in order of address.
+	int run_ct; ///< Number of runs.
+	int inst_ct; ///< Number of instructions in the program.
+} Line_map;
+
+void line_map_write(Program *prog, char **names, int func_ct, FILE *map_file);
+int line_map_read(Line_map *map, FILE *map_file);
+Line_map_run * line_map_find(Line_map *map, int addr);
+void line_map_free(Line_map *map);
+
+#endif
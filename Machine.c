@@ -0,0 +1,358 @@
+#include "Machine.h"
+
+/**
+ * The machine description the compiler was built with, made from jala.machine by the Makefile.
+ */
+static char machine_default[] =
+#include "MachineDefault.h"
+	;
+
+/**
+ * Returns the instruction with the given name.
+ *
+ * @param machine The machine description to search.
+ * @param name The mnemonic of the instruction.
+ * @return The instruction, or NULL if the target does not have it.
+ */
+Machine_inst * machine_inst(Machine *machine, char *name) {
+	for(int i = 0; i < machine->inst_ct; i++)
+		if(strcmp(machine->insts[i].name, name) == 0)
+			return &machine->insts[i];
+
+	return NULL;
+}
+
+/**
+ * Returns how many cycles a sequence of instructions takes.
+ *
+ * @param machine The machine description to use.
+ * @param seq Instructions separated by spaces, such as "pushi push add". Operands are skipped.
+ * @return The total number of cycles.
+ */
+int machine_cycles(Machine *machine, char *seq) {
+	char *cpy = strdup(seq);
+	int cycles = 0;
+
+	for(char *token = strtok(cpy, " \t\n"); token != NULL; token = strtok(NULL, " \t\n")) {
+		Machine_inst *inst = machine_inst(machine, token);
+
+		if(inst != NULL)
+			cycles += inst->cycles;
+	}
+
+	free(cpy);
+
+	return cycles;
+}
+
+/**
+ * Adds up the cycles or bytes of a piece of assembly code, going by the first word on each line.
+ * Tags, comments and directives cost nothing.
+ *
+ * @param machine The machine description to use.
+ * @param text Assembly code, one instruction per line.
+ * @param bytes 1 to add up bytes, 0 to add up cycles.
+ * @return The total.
+ */
+static int asm_cost(Machine *machine, char *text, int bytes) {
+	int cost = 0;
+	char name[MACHINE_NAME_LEN];
+
+	while(text != NULL && *text != '\0') {
+		if(sscanf(text, "%15s", name) == 1) {
+			Machine_inst *inst = machine_inst(machine, name);
+
+			if(inst != NULL)
+				cost += bytes ? inst->bytes : inst->cycles;
+		}
+
+		text = strchr(text, '\n');
+		if(text != NULL)
+			text++;
+	}
+
+	return cost;
+}
+
+/**
+ * Returns how many cycles a piece of assembly code takes, if each instruction in it runs once.
+ *
+ * @param machine The machine description to use.
+ * @param text Assembly code, one instruction per line.
+ * @return The total number of cycles.
+ */
+int machine_asm_cycles(Machine *machine, char *text) {
+	return asm_cost(machine, text, 0);
+}
+
+/**
+ * Returns how much instruction memory a piece of assembly code takes.
+ *
+ * @param machine The machine description to use.
+ * @param text Assembly code, one instruction per line.
+ * @return The total number of bytes.
+ */
+int machine_asm_bytes(Machine *machine, char *text) {
+	return asm_cost(machine, text, 1);
+}
+
+/**
+ * Returns 1 if the operand is an integer constant such as 12 or -3, 0 otherwise.
+ */
+int machine_is_constant(char *operand) {
+	if(*operand == '-')
+		operand++;
+	if(*operand == '\0')
+		return 0;
+
+	for(; *operand != '\0'; operand++)
+		if(*operand < '0' || *operand > '9')
+			return 0;
+
+	return 1;
+}
+
+/**
+ * Returns 1 if the operand is a plain variable name, 0 otherwise.
+ */
+int machine_is_variable(char *operand) {
+	if(!((*operand >= 'a' && *operand <= 'z') || (*operand >= 'A' && *operand <= 'Z')))
+		return 0;
+
+	for(; *operand != '\0'; operand++)
+		if(!((*operand >= 'a' && *operand <= 'z') || (*operand >= 'A' && *operand <= 'Z') || (*operand >= '0' && *operand <= '9')))
+			return 0;
+
+	return 1;
+}
+
+/**
+ * Reads a pattern line. The pattern is only kept if the target has every instruction it uses.
+ *
+ * @param machine The machine description being loaded. Its instructions must already be read.
+ * @param text The line after the word "pattern".
+ * @param line_ct The line number, for error messages.
+ * @return 1 if the line could be read, 0 otherwise.
+ */
+static int read_pattern(Machine *machine, char *text, int line_ct) {
+	Machine_pattern pattern;
+	char tree[4 * MACHINE_NAME_LEN];
+	char *colon = strchr(text, ':');
+	int len = 0;
+
+	memset(&pattern, 0, sizeof(pattern));
+
+	if(colon == NULL) {
+		printf("ERROR: Missing : in machine description line %d\n", line_ct);
+		return 0;
+	}
+
+	for(char *c = text; c < colon && len < sizeof(tree) - 1; c++) //Drop the spaces from the tree
+		if(*c != ' ' && *c != '\t')
+			tree[len++] = *c;
+	tree[len] = '\0';
+
+	//Key: ROOT(COMP(a,b)) or ROOT(a,b)
+	char *open = strchr(tree, '(');
+	char *close = strrchr(tree, ')');
+	if(open == NULL || close == NULL || open - tree >= MACHINE_NAME_LEN) {
+		printf("ERROR: Bad pattern tree in machine description line %d\n", line_ct);
+		return 0;
+	}
+	strncpy(pattern.root, tree, open - tree);
+	*close = '\0';
+
+	char *args = open + 1;
+	if(strcmp(pattern.root, "JT") == 0 || strcmp(pattern.root, "JF") == 0) {
+		open = strchr(args, '(');
+		close = strrchr(args, ')');
+		if(open == NULL || close == NULL || open - args >= MACHINE_NAME_LEN) {
+			printf("ERROR: Bad comparison in machine description line %d\n", line_ct);
+			return 0;
+		}
+		strncpy(pattern.comp, args, open - args);
+		*close = '\0';
+		args = open + 1;
+	}
+
+	char *comma = strchr(args, ',');
+	if(comma == NULL) {
+		printf("ERROR: Patterns need two operands, in machine description line %d\n", line_ct);
+		return 0;
+	}
+	*comma = '\0';
+	strncpy(pattern.operands[0], args, MACHINE_NAME_LEN - 1);
+	strncpy(pattern.operands[1], comma + 1, MACHINE_NAME_LEN - 1);
+
+	//Split up the instructions
+	Operand_kind expect = OPERAND_NONE;
+	char *cpy = strdup(colon + 1);
+
+	for(char *token = strtok(cpy, " \t\n"); token != NULL; token = strtok(NULL, " \t\n")) {
+		pattern.tokens = (char **)realloc(pattern.tokens, (pattern.token_ct + 1) * sizeof(char *));
+		pattern.tokens[pattern.token_ct++] = strdup(token);
+
+		if(expect != OPERAND_NONE) { //Operand of the previous instruction
+			expect = OPERAND_NONE;
+		} else if(token[0] == '$') { //Operand evaluated onto the stack
+			if(token[1] == '1' || token[1] == '2')
+				pattern.evals[token[1] - '1']++;
+		} else {
+			Machine_inst *inst = machine_inst(machine, token);
+
+			if(inst == NULL) { //The target lacks this instruction
+				for(int i = 0; i < pattern.token_ct; i++)
+					free(pattern.tokens[i]);
+				free(pattern.tokens);
+				free(cpy);
+				return 1;
+			}
+
+			pattern.cycles += inst->cycles;
+			expect = inst->operand;
+		}
+	}
+	free(cpy);
+
+	machine->patterns = (Machine_pattern *)realloc(machine->patterns, (machine->pattern_ct + 1) * sizeof(Machine_pattern));
+	machine->patterns[machine->pattern_ct++] = pattern;
+
+	return 1;
+}
+
+/**
+ * Loads a machine description.
+ * Instructions must be listed before the patterns that use them.
+ *
+ * @param machine The machine description to be filled in.
+ * @param filename The file to read, or NULL for the description the compiler was built with.
+ * @return 1 if the description was loaded, 0 otherwise.
+ */
+int machine_load(Machine *machine, char *filename) {
+	FILE *file = filename == NULL ? fmemopen(machine_default, strlen(machine_default), "r") : fopen(filename, "r");
+	char line[4 * MACHINE_NAME_LEN + 200];
+	int line_ct = 0;
+	int ok = 1;
+
+	memset(machine, 0, sizeof(Machine));
+	machine->hash = STR_HASH_SEED;
+
+	if(file == NULL) {
+		printf("ERROR: Could not open machine description %s\n", filename);
+		return 0;
+	}
+
+	while(fgets(line, sizeof(line), file) != NULL) {
+		char word[MACHINE_NAME_LEN + 1];
+		int len = 0;
+
+		line_ct++;
+		machine->hash = str_hash(line, strlen(line), machine->hash);
+		if(sscanf(line, "%16s%n", word, &len) != 1 || word[0] == '#')
+			continue;
+
+		if(strcmp(word, "inst") == 0) {
+			Machine_inst inst;
+			char operand[MACHINE_NAME_LEN];
+
+			if(sscanf(line + len, "%15s %15s %d %d %d %d", inst.name, operand, &inst.pops, &inst.pushes, &inst.cycles, &inst.bytes) != 6) {
+				printf("ERROR: Bad instruction in machine description line %d\n", line_ct);
+				ok = 0;
+				continue;
+			}
+
+			inst.operand = strcmp(operand, "imm") == 0 ? OPERAND_IMM : strcmp(operand, "label") == 0 ? OPERAND_LABEL : OPERAND_NONE;
+			machine->insts = (Machine_inst *)realloc(machine->insts, (machine->inst_ct + 1) * sizeof(Machine_inst));
+			machine->insts[machine->inst_ct++] = inst;
+		} else if(strcmp(word, "stack") == 0) {
+			if(sscanf(line + len, "%d", &machine->stack_size) != 1 || machine->stack_size < 0) {
+				printf("ERROR: Bad stack size in machine description line %d\n", line_ct);
+				ok = 0;
+			}
+		} else if(strcmp(word, "data") == 0) {
+			if(sscanf(line + len, "%d", &machine->data_size) != 1 || machine->data_size < 0) {
+				printf("ERROR: Bad data memory size in machine description line %d\n", line_ct);
+				ok = 0;
+			}
+		} else if(strcmp(word, "pattern") == 0) {
+			ok = read_pattern(machine, line + len, line_ct) && ok;
+		} else {
+			printf("ERROR: Unrecognized entry %s in machine description line %d\n", word, line_ct);
+			ok = 0;
+		}
+	}
+
+	fclose(file);
+
+	return ok;
+}
+
+/**
+ * Frees the memory held by a machine description.
+ *
+ * @param machine The machine description to be freed.
+ */
+void machine_free(Machine *machine) {
+	for(int i = 0; i < machine->pattern_ct; i++) {
+		for(int j = 0; j < machine->patterns[i].token_ct; j++)
+			free(machine->patterns[i].tokens[j]);
+		free(machine->patterns[i].tokens);
+	}
+
+	free(machine->patterns);
+	free(machine->insts);
+	memset(machine, 0, sizeof(Machine));
+}
+
+/**
+ * Checks whether an operand fits a pattern's operand.
+ *
+ * @param want The pattern's operand: e, v, c or #N.
+ * @param operand The operand's text.
+ * @return 1 if it fits, 0 otherwise.
+ */
+static int operand_matches(char *want, char *operand) {
+	if(strcmp(want, "e") == 0)
+		return 1;
+	if(strcmp(want, "v") == 0)
+		return machine_is_variable(operand);
+	if(strcmp(want, "c") == 0)
+		return machine_is_constant(operand);
+	if(want[0] == '#')
+		return machine_is_constant(operand) && atoi(want + 1) == atoi(operand);
+
+	return 0;
+}
+
+/**
+ * Picks the cheapest pattern for a comparison or assignment.
+ *
+ * @param machine The machine description to use.
+ * @param root JT, JF, SET, ADDSET or SUBSET.
+ * @param comp The comparison for JT and JF, ignored otherwise.
+ * @param operands The text of the two operands.
+ * @param operand_cycles The cycles it takes to evaluate each operand onto the stack.
+ * @return The cheapest matching pattern, or NULL if none match.
+ */
+Machine_pattern * machine_select(Machine *machine, char *root, char *comp, char *operands[2], int operand_cycles[2]) {
+	Machine_pattern *best = NULL;
+	int best_cost = 0;
+
+	for(int i = 0; i < machine->pattern_ct; i++) {
+		Machine_pattern *pattern = &machine->patterns[i];
+
+		if(strcmp(pattern->root, root) != 0 || (pattern->comp[0] != '\0' && strcmp(pattern->comp, comp) != 0))
+			continue;
+		if(!operand_matches(pattern->operands[0], operands[0]) || !operand_matches(pattern->operands[1], operands[1]))
+			continue;
+
+		int cost = pattern->cycles + pattern->evals[0] * operand_cycles[0] + pattern->evals[1] * operand_cycles[1];
+
+		if(best == NULL || cost < best_cost) {
+			best = pattern;
+			best_cost = cost;
+		}
+	}
+
+	return best;
+}
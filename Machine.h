@@ -0,0 +1,67 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "StringOps.h"
+
+#define MACHINE_NAME_LEN 16
+
+/** @enum Operand_kind
+ * What an instruction takes after its name.
+ */
+typedef enum {
+	OPERAND_NONE, OPERAND_IMM, OPERAND_LABEL
+} Operand_kind;
+
+/** @struct Machine_inst
+ * One instruction of the target CPU, as listed in its machine description.
+ */
+typedef struct {
+	char name[MACHINE_NAME_LEN]; ///< The instruction's mnemonic.
+	Operand_kind operand; ///< What the instruction takes after its name.
+	int pops; ///< How many values the instruction takes off the stack.
+	int pushes; ///< How many values the instruction leaves on the stack.
+	int cycles; ///< How many cycles the instruction takes.
+	int bytes; ///< How much instruction memory the instruction takes.
+} Machine_inst;
+
+/** @struct Machine_pattern
+ * One way of writing a comparison or assignment, matched against a small tree.
+ */
+typedef struct {
+	char root[MACHINE_NAME_LEN]; ///< JT, JF, SET, ADDSET or SUBSET.
+	char comp[MACHINE_NAME_LEN]; ///< The comparison under JT and JF. Empty for assignments.
+	char operands[2][MACHINE_NAME_LEN]; ///< What each operand must be: e, v, c or #N.
+	char **tokens; ///< The instructions to write, split on spaces.
+	int token_ct; ///< Number of tokens.
+	int cycles; ///< Cycles taken by the instructions, not counting the operands.
+	int evals[2]; ///< How many times each operand is evaluated onto the stack.
+} Machine_pattern;
+
+/** @struct Machine
+ * A machine description: the instructions of the target and the patterns that use them.
+ */
+typedef struct {
+	Machine_inst *insts; ///< The instructions of the target.
+	int inst_ct; ///< Number of instructions.
+	Machine_pattern *patterns; ///< The patterns whose instructions all exist.
+	int pattern_ct; ///< Number of patterns.
+	int stack_size; ///< How many entries the operand stack holds, or 0 if not given.
+	int data_size; ///< How many cells data memory holds, or 0 if not given.
+	unsigned long long hash; ///< Hash of the description's text, to tell descriptions apart.
+} Machine;
+
+int machine_load(Machine *machine, char *filename);
+void machine_free(Machine *machine);
+Machine_inst * machine_inst(Machine *machine, char *name);
+int machine_cycles(Machine *machine, char *seq);
+int machine_asm_cycles(Machine *machine, char *text);
+int machine_asm_bytes(Machine *machine, char *text);
+int machine_is_constant(char *operand);
+int machine_is_variable(char *operand);
+Machine_pattern * machine_select(Machine *machine, char *root, char *comp, char *operands[2], int operand_cycles[2]);
+
+#endif
@@ -0,0 +1,491 @@
+#include <sys/stat.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "Preprocessor.h"
+
+/**
+ * Returns 1 if the character may start an identifier.
+ */
+static int ident_start(char c) {
+	return char_is_letter(c) || c == '_';
+}
+
+/**
+ * Returns 1 if the character may continue an identifier.
+ */
+static int ident_char(char c) {
+	return ident_start(c) || (c >= '0' && c <= '9');
+}
+
+/**
+ * Finds the identifiers in a line of text. Numbers such as 0x1F are skipped whole.
+ *
+ * @param text The line to be searched.
+ * @param idents Set to the start and length of each identifier, which must be freed.
+ * @return The number of identifiers.
+ */
+static int scan_idents(char *text, int **idents) {
+	int ct = 0;
+	int i = 0;
+
+	*idents = NULL;
+
+	while(text[i] != '\0') {
+		if(ident_start(text[i])) {
+			int start = i;
+
+			while(ident_char(text[i]))
+				i++;
+
+			*idents = (int *)realloc(*idents, 2 * (ct + 1) * sizeof(int));
+			(*idents)[2 * ct] = start;
+			(*idents)[2 * ct + 1] = i - start;
+			ct++;
+		} else if(text[i] >= '0' && text[i] <= '9') {
+			while(ident_char(text[i]))
+				i++;
+		} else {
+			i++;
+		}
+	}
+
+	return ct;
+}
+
+/**
+ * Copies the first word of a string, such as a macro name.
+ *
+ * @param str The string, which may start with spaces.
+ * @param rest Set to the character after the word.
+ * @return The word, which must be freed.
+ */
+static char * copy_word(char *str, char **rest) {
+	while(*str == ' ' || *str == '\t')
+		str++;
+
+	char *end = str;
+
+	while(*end != '\0' && *end != ' ' && *end != '\t' && *end != '\n' && *end != '\r')
+		end++;
+
+	*rest = end;
+
+	return strndup(str, end - str);
+}
+
+/**
+ * Splits one line of source up for the preprocessor.
+ *
+ * @param raw The line, without its newline.
+ * @param line The line to be filled in.
+ */
+static void read_line(char *raw, Pp_line *line) {
+	char *c = raw;
+	char *rest;
+
+	memset(line, 0, sizeof(Pp_line));
+
+	while(*c == ' ' || *c == '\t')
+		c++;
+
+	if(*c != '#') {
+		line->kind = PP_TEXT;
+		line->text = strdup(raw);
+		line->ident_ct = scan_idents(line->text, &line->idents);
+		return;
+	}
+
+	char *directive = copy_word(c + 1, &rest);
+	char *names[] = {"define", "undef", "include", "ifdef", "ifndef", "else", "endif"};
+	Pp_kind kinds[] = {PP_DEFINE, PP_UNDEF, PP_INCLUDE, PP_IFDEF, PP_IFNDEF, PP_ELSE, PP_ENDIF};
+
+	line->kind = PP_UNKNOWN;
+	for(int i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+		if(strcmp(directive, names[i]) == 0)
+			line->kind = kinds[i];
+	free(directive);
+
+	switch(line->kind) {
+	case PP_DEFINE:
+		line->text = copy_word(rest, &rest);
+		if(strstr(rest, "//") != NULL) //Drop a comment after the value
+			*strstr(rest, "//") = '\0';
+		while(*rest == ' ' || *rest == '\t')
+			rest++;
+		line->value = strdup(rest);
+		for(int i = strlen(line->value) - 1; i >= 0 && strchr(" \t\r", line->value[i]) != NULL; i--)
+			line->value[i] = '\0';
+		line->ident_ct = scan_idents(line->value, &line->idents);
+		break;
+	case PP_UNDEF:
+	case PP_IFDEF:
+	case PP_IFNDEF:
+		line->text = copy_word(rest, &rest);
+		break;
+	case PP_INCLUDE: { //Key: #include "file"
+		char *open = strchr(rest, '"');
+		char *close = open == NULL ? NULL : strchr(open + 1, '"');
+
+		line->text = close == NULL ? strdup(rest) : strndup(open + 1, close - open - 1);
+		if(close == NULL) //Library includes like <stdio.h> are not supported
+			line->kind = PP_UNKNOWN;
+		break;
+	}
+	default:
+		line->text = strdup(raw);
+		break;
+	}
+}
+
+/**
+ * Finds the include guard of a file: an #ifndef and #define of the same macro on its first lines and
+ * the matching #endif on its last line, with nothing but blank lines outside of them.
+ *
+ * @param file The file, with its lines read.
+ * @return A copy of the guard macro's name, or NULL if the file has no guard.
+ */
+static char * find_guard(Pp_file *file) {
+	int first = -1, second = -1, last = -1;
+	int depth = 0;
+
+	for(int i = 0; i < file->line_ct; i++) {
+		Pp_line *line = &file->lines[i];
+
+		if(line->kind == PP_TEXT && strspn(line->text, " \t\r") == strlen(line->text))
+			continue;
+
+		if(first < 0)
+			first = i;
+		else if(second < 0)
+			second = i;
+		last = i;
+	}
+
+	if(second < 0 || file->lines[first].kind != PP_IFNDEF || file->lines[second].kind != PP_DEFINE
+	   || strcmp(file->lines[first].text, file->lines[second].text) != 0 || file->lines[last].kind != PP_ENDIF)
+		return NULL;
+
+	for(int i = first; i <= last; i++) { //The #endif on the last line must close the #ifndef on the first
+		if(file->lines[i].kind == PP_IFDEF || file->lines[i].kind == PP_IFNDEF)
+			depth++;
+		else if(file->lines[i].kind == PP_ENDIF && --depth == 0 && i != last)
+			return NULL;
+	}
+
+	return strdup(file->lines[first].text);
+}
+
+/**
+ * Splits a whole file's text into lines for the preprocessor.
+ *
+ * @param file The file to be filled in. Its path must already be set.
+ * @param text The file's text.
+ * @param len The length of the text.
+ */
+static void read_text(Pp_file *file, char *text, size_t len) {
+	char *end = text + len;
+
+	file->lines = NULL;
+	file->line_ct = 0;
+
+	while(text < end) {
+		char *newline = memchr(text, '\n', end - text);
+		char *line_end = newline == NULL ? end : newline;
+		char *raw = strndup(text, line_end - text);
+
+		file->lines = (Pp_line *)realloc(file->lines, (file->line_ct + 1) * sizeof(Pp_line));
+		read_line(raw, &file->lines[file->line_ct++]);
+		free(raw);
+
+		text = line_end + 1;
+	}
+
+	file->guard = find_guard(file);
+}
+
+/**
+ * Frees the lines of a file.
+ */
+static void free_file(Pp_file *file) {
+	for(int i = 0; i < file->line_ct; i++) {
+		free(file->lines[i].text);
+		free(file->lines[i].value);
+		free(file->lines[i].idents);
+	}
+
+	free(file->lines);
+	free(file->guard);
+	free(file->path);
+	memset(file, 0, sizeof(Pp_file));
+}
+
+/**
+ * Returns a file, read from disk only if it is new or was modified since it was last read.
+ * A file is checked at most once per run, so it never changes while it is being preprocessed.
+ *
+ * @param pp The preprocessor.
+ * @param path The file's path.
+ * @return The file, or NULL if it could not be read.
+ */
+static Pp_file * load_file(Preprocessor *pp, char *path) {
+	char full_path[PATH_MAX];
+	struct stat st;
+
+	if(realpath(path, full_path) == NULL)
+		return NULL;
+
+	int index = symbol_table_contains(&pp->file_index, full_path);
+	Pp_file *file = index >= 0 ? pp->files[index] : NULL;
+
+	if(file != NULL && file->run == pp->run) {
+		pp->reuses++;
+		return file;
+	}
+
+	if(stat(full_path, &st) != 0)
+		return NULL;
+
+	if(file != NULL && file->size == st.st_size && file->mtime.tv_sec == st.st_mtim.tv_sec && file->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+		file->run = pp->run;
+		pp->reuses++;
+		return file;
+	}
+
+	FILE *input_file = fopen(full_path, "r");
+
+	if(input_file == NULL)
+		return NULL;
+
+	if(file != NULL) {
+		free_file(file);
+	} else {
+		file = (Pp_file *)malloc(sizeof(Pp_file));
+		pp->files = (Pp_file **)realloc(pp->files, (pp->file_ct + 1) * sizeof(Pp_file *));
+		pp->files[pp->file_ct] = file;
+		symbol_table_add(&pp->file_index, full_path, pp->file_ct++);
+	}
+
+	char *text = (char *)malloc(st.st_size + 1);
+	size_t len = fread(text, 1, st.st_size, input_file);
+
+	memset(file, 0, sizeof(Pp_file));
+	file->path = strdup(full_path);
+	file->mtime = st.st_mtim;
+	file->size = st.st_size;
+	file->run = pp->run;
+	read_text(file, text, len);
+
+	free(text);
+	fclose(input_file);
+	pp->reads++;
+
+	return file;
+}
+
+/**
+ * Writes a piece of text with every macro in it replaced by its value. Values are expanded too, up
+ * to PP_MAX_DEPTH macros deep, which also stops a macro that names itself.
+ *
+ * @param pp The preprocessor.
+ * @param text The text.
+ * @param idents The identifiers in the text, from scan_idents.
+ * @param ident_ct Number of identifiers.
+ * @param output_file Where the text is written.
+ * @param depth How many macros deep this text is.
+ */
+static void expand(Preprocessor *pp, char *text, int *idents, int ident_ct, FILE *output_file, int depth) {
+	int pos = 0;
+
+	for(int i = 0; i < ident_ct; i++) {
+		int start = idents[2 * i];
+		int len = idents[2 * i + 1];
+		char *name = strndup(text + start, len);
+		int index = depth < PP_MAX_DEPTH ? symbol_table_contains(&pp->macros, name) : -1;
+
+		fwrite(text + pos, 1, start - pos, output_file);
+
+		if(index >= 0) {
+			Pp_line *value = pp->values[index];
+
+			expand(pp, value->value, value->idents, value->ident_ct, output_file, depth + 1);
+		} else {
+			fwrite(text + start, 1, len, output_file);
+		}
+
+		free(name);
+		pos = start + len;
+	}
+
+	fputs(text + pos, output_file);
+}
+
+/**
+ * Writes a file through the preprocessor.
+ * Every line of the file turns into one line of output. Included files are wrapped in "#line N "path""
+ * markers, which the compiler's line reader follows so that line numbers and files still match the source.
+ *
+ * @param pp The preprocessor.
+ * @param file The file.
+ * @param output_file Where the result is written.
+ * @param depth How many files are including this one.
+ * @return 1 on success, 0 if there was an error.
+ */
+static int process_file(Preprocessor *pp, Pp_file *file, FILE *output_file, int depth) {
+	int base_cond_ct = pp->cond_ct;
+	int ok = 1;
+
+	for(int i = 0; i < file->line_ct; i++) {
+		Pp_line *line = &file->lines[i];
+		int active = pp->cond_ct == 0 || pp->conds[pp->cond_ct - 1];
+
+		if(line->kind == PP_IFDEF || line->kind == PP_IFNDEF) {
+			if(pp->cond_ct == PP_MAX_DEPTH) {
+				printf("ERROR: #ifdef nested too deeply in %s line %d\n", file->path, i + 1);
+				return 0;
+			}
+			pp->conds[pp->cond_ct++] = active && (symbol_table_contains(&pp->macros, line->text) >= 0) == (line->kind == PP_IFDEF);
+		} else if(line->kind == PP_ELSE || line->kind == PP_ENDIF) {
+			if(pp->cond_ct == base_cond_ct) {
+				printf("ERROR: #%s without #ifdef in %s line %d\n", line->kind == PP_ELSE ? "else" : "endif", file->path, i + 1);
+				ok = 0;
+			} else if(line->kind == PP_ENDIF) {
+				pp->cond_ct--;
+			} else {
+				int parent = pp->cond_ct < 2 || pp->conds[pp->cond_ct - 2];
+
+				pp->conds[pp->cond_ct - 1] = parent && !pp->conds[pp->cond_ct - 1];
+			}
+		} else if(!active) { //Skipped by an #ifdef
+		} else if(line->kind == PP_TEXT) {
+			expand(pp, line->text, line->idents, line->ident_ct, output_file, 0);
+		} else if(line->kind == PP_DEFINE) {
+			int index = symbol_table_contains(&pp->macros, line->text);
+
+			if(index < 0) {
+				index = pp->value_ct++;
+				pp->values = (Pp_line **)realloc(pp->values, pp->value_ct * sizeof(Pp_line *));
+				symbol_table_add(&pp->macros, line->text, index);
+			}
+			pp->values[index] = line;
+		} else if(line->kind == PP_UNDEF) {
+			symbol_table_remove(&pp->macros, line->text);
+		} else if(line->kind == PP_INCLUDE) {
+			char path[PATH_MAX];
+			char *slash = strrchr(file->path, '/');
+
+			//Relative to the including file, or else to the current directory
+			if(line->text[0] == '/' || slash == NULL)
+				snprintf(path, sizeof(path), "%s", line->text);
+			else
+				snprintf(path, sizeof(path), "%.*s/%s", (int)(slash - file->path), file->path, line->text);
+			if(access(path, R_OK) != 0)
+				snprintf(path, sizeof(path), "%s", line->text);
+
+			Pp_file *included = load_file(pp, path);
+
+			if(included == NULL) {
+				printf("ERROR: Could not include %s in %s line %d\n", line->text, file->path, i + 1);
+				ok = 0;
+			} else if(included->guard != NULL && symbol_table_contains(&pp->macros, included->guard) >= 0) {
+				pp->guarded++;
+			} else if(depth + 1 >= PP_MAX_DEPTH) {
+				printf("ERROR: #include nested too deeply in %s line %d\n", file->path, i + 1);
+				return 0;
+			} else { //The included lines take the place of this one, with markers to keep the line numbers right
+				fprintf(output_file, "#line 1 \"%s\"\n", included->path);
+				ok = process_file(pp, included, output_file, depth + 1) && ok;
+				fprintf(output_file, "#line %d \"%s\"\n", i + 2, file->path);
+				continue;
+			}
+		} else {
+			printf("ERROR: Unrecognized preprocessor line %s in %s line %d\n", line->text, file->path, i + 1);
+			ok = 0;
+		}
+
+		fputs("\n", output_file);
+	}
+
+	if(pp->cond_ct != base_cond_ct) {
+		printf("ERROR: Missing #endif in %s\n", file->path);
+		pp->cond_ct = base_cond_ct;
+		ok = 0;
+	}
+
+	return ok;
+}
+
+/**
+ * Initializes a preprocessor with no files read.
+ *
+ * @param pp The preprocessor to be initialized.
+ */
+void pp_init(Preprocessor *pp) {
+	memset(pp, 0, sizeof(Preprocessor));
+	symbol_table_init(&pp->file_index);
+}
+
+/**
+ * Frees the memory held by a preprocessor, including every file it has read.
+ *
+ * @param pp The preprocessor to be freed.
+ */
+void pp_free(Preprocessor *pp) {
+	for(int i = 0; i < pp->file_ct; i++) {
+		free_file(pp->files[i]);
+		free(pp->files[i]);
+	}
+
+	free(pp->files);
+	symbol_table_free(&pp->file_index);
+	memset(pp, 0, sizeof(Preprocessor));
+}
+
+/**
+ * Preprocesses one source file. Macros start out empty for every file, but the files read stay
+ * in memory for later runs.
+ *
+ * @param pp The preprocessor.
+ * @param path The source file's path. Included files are searched for next to it.
+ * @param text The source file's text, or NULL to read it from path.
+ * @param len The length of text.
+ * @param output_file Where the result is written.
+ * @return 1 on success, 0 if there was an error.
+ */
+int pp_run(Preprocessor *pp, char *path, char *text, size_t len, FILE *output_file) {
+	Pp_file given;
+	Pp_file *file = &given;
+	int ok;
+
+	pp->run++;
+	pp->cond_ct = 0;
+	pp->value_ct = 0;
+	pp->values = NULL;
+	symbol_table_init(&pp->macros);
+
+	if(text != NULL) {
+		char full_path[PATH_MAX];
+
+		memset(&given, 0, sizeof(Pp_file));
+		given.path = strdup(realpath(path, full_path) != NULL ? full_path : path);
+		read_text(&given, text, len);
+	} else {
+		file = load_file(pp, path);
+	}
+
+	if(file == NULL) {
+		printf("ERROR: Could not open %s\n", path);
+		ok = 0;
+	} else {
+		fprintf(output_file, "#line 1 \"%s\"\n", file->path);
+		ok = process_file(pp, file, output_file, 0);
+	}
+
+	if(file == &given)
+		free_file(&given);
+	free(pp->values);
+	pp->values = NULL;
+	symbol_table_free(&pp->macros);
+
+	return ok;
+}
@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "StringOps.h"
+#include "SymbolTable.h"
+
+#define PP_MAX_DEPTH 32 ///< Most files that may include each other at once, and most macros inside each other.
+
+/** @enum Pp_kind
+ * What a line of source is to the preprocessor.
+ */
+typedef enum {
+	PP_TEXT, PP_DEFINE, PP_UNDEF, PP_INCLUDE, PP_IFDEF, PP_IFNDEF, PP_ELSE, PP_ENDIF, PP_UNKNOWN
+} Pp_kind;
+
+/** @struct Pp_line
+ * One line of a source file, split up once when the file is read.
+ */
+typedef struct {
+	Pp_kind kind; ///< What the line is.
+	char *text; ///< The whole line for text, or the name a directive acts on.
+	char *value; ///< The value of a #define.
+	int *idents; ///< Start and length of each identifier in a text line, so macros are found without scanning.
+	int ident_ct; ///< Number of identifiers.
+} Pp_line;
+
+/** @struct Pp_file
+ * A source file as read by the preprocessor. Kept for as long as the file is not modified.
+ */
+typedef struct {
+	char *path; ///< The file's path.
+	struct timespec mtime; ///< When the file was last modified when it was read.
+	off_t size; ///< The file's size when it was read.
+	Pp_line *lines; ///< The lines of the file.
+	int line_ct; ///< Number of lines.
+	char *guard; ///< The macro of an include guard around the whole file, or NULL.
+	long run; ///< The last run of the preprocessor that checked the file was up to date.
+} Pp_file;
+
+/** @struct Preprocessor
+ * Expands #include, #define, #undef, #ifdef, #ifndef, #else and #endif. Files are read once per process,
+ * and read again only when their modification time or size changes.
+ */
+typedef struct {
+	Symbol_table file_index; ///< Maps a file's path to its place in files.
+	Pp_file **files; ///< Every file read so far.
+	int file_ct; ///< Number of files.
+	Symbol_table macros; ///< Maps a macro name to its place in values, while a file is preprocessed.
+	Pp_line **values; ///< The #define line of each macro. Files do not change during a run, so these stay valid.
+	int value_ct; ///< Number of values.
+	int conds[PP_MAX_DEPTH]; ///< For each open #ifdef, whether its lines are kept.
+	int cond_ct; ///< Number of open #ifdef's.
+	long run; ///< Number of files preprocessed so far.
+	long reads; ///< Number of times a file was read from disk.
+	long reuses; ///< Number of times an include was served from memory.
+	long guarded; ///< Number of includes skipped because their guard macro was defined.
+} Preprocessor;
+
+void pp_init(Preprocessor *pp);
+void pp_free(Preprocessor *pp);
+int pp_run(Preprocessor *pp, char *path, char *text, size_t len, FILE *output_file);
@@ -0,0 +1,308 @@
+#include "Program.h"
+
+/**
+ * Reads the generated code of a function into a list of lines.
+ *
+ * @param prog The program to be filled in.
+ * @param text The code, one instruction or tag per line.
+ */
+void program_parse(Program *prog, char *text) {
+	memset(prog, 0, sizeof(Program));
+
+	while(text != NULL && *text != '\0') {
+		char *end = strchr(text, '\n');
+		int len = end == NULL ? strlen(text) : end - text;
+		char *line = strndup(text, len);
+		char op[MACHINE_NAME_LEN];
+		int op_len = 0;
+
+		if(line[0] == '\t' && line[1] != '#' && sscanf(line + 1, "%15s%n", op, &op_len) == 1) {
+			char *arg = line + 1 + op_len;
+
+			while(*arg == ' ' || *arg == '\t')
+				arg++;
+			program_append(prog, ASM_INST, op, *arg != '\0' ? arg : NULL);
+		} else if(len > 1 && line[len - 1] == ':' && line[0] != '#' && line[0] != '\t') {
+			line[len - 1] = '\0';
+			program_append(prog, ASM_TAG, "", line);
+		} else {
+			program_append(prog, ASM_OTHER, "", line);
+		}
+
+		free(line);
+		text = end == NULL ? NULL : end + 1;
+	}
+}
+
+/**
+ * Writes a program back out as assembly code.
+ *
+ * @param prog The program.
+ * @param output_file Where the code is written.
+ */
+void program_write(Program *prog, FILE *output_file) {
+	for(int i = 0; i < prog->line_ct; i++) {
+		Asm_line *line = &prog->lines[i];
+
+		if(line->kind == ASM_INST && line->arg != NULL)
+			fprintf(output_file, "\t%s %s\n", line->op, line->arg);
+		else if(line->kind == ASM_INST)
+			fprintf(output_file, "\t%s\n", line->op);
+		else if(line->kind == ASM_TAG)
+			fprintf(output_file, "%s:\n", line->arg);
+		else
+			fprintf(output_file, "%s\n", line->arg);
+	}
+}
+
+/**
+ * Returns a program as assembly code.
+ *
+ * @param prog The program.
+ * @return The code, which must be freed.
+ */
+char * program_text(Program *prog) {
+	char *text;
+	size_t len;
+	FILE *text_file = open_memstream(&text, &len);
+
+	program_write(prog, text_file);
+	fclose(text_file);
+
+	return text;
+}
+
+/**
+ * Frees the memory held by a program.
+ *
+ * @param prog The program to be freed.
+ */
+void program_free(Program *prog) {
+	for(int i = 0; i < prog->line_ct; i++)
+		free(prog->lines[i].arg);
+
+	free(prog->lines);
+	memset(prog, 0, sizeof(Program));
+}
+
+/**
+ * Adds a line to the end of a program.
+ *
+ * @param prog The program to be edited.
+ * @param kind What the line is.
+ * @param op The mnemonic of an instruction, ignored otherwise.
+ * @param arg The operand, tag name or text. Copied. May be NULL.
+ */
+void program_append(Program *prog, Asm_kind kind, char *op, char *arg) {
+	if(prog->line_ct == prog->capacity) {
+		prog->capacity = prog->capacity == 0 ? 64 : prog->capacity * 2;
+		prog->lines = (Asm_line *)realloc(prog->lines, prog->capacity * sizeof(Asm_line));
+	}
+
+	Asm_line *line = &prog->lines[prog->line_ct++];
+
+	line->kind = kind;
+	strncpy(line->op, op, MACHINE_NAME_LEN - 1);
+	line->op[MACHINE_NAME_LEN - 1] = '\0';
+	line->arg = arg == NULL ? NULL : strdup(arg);
+}
+
+/**
+ * Adds a copy of a line to the end of a program.
+ *
+ * @param prog The program to be edited.
+ * @param line The line to be copied.
+ */
+void program_copy_line(Program *prog, Asm_line *line) {
+	program_append(prog, line->kind, line->op, line->arg);
+}
+
+/**
+ * Drops the lines at the end of a program.
+ *
+ * @param prog The program to be edited.
+ * @param line_ct How many lines to keep.
+ */
+void program_truncate(Program *prog, int line_ct) {
+	while(prog->line_ct > line_ct)
+		free(prog->lines[--prog->line_ct].arg);
+}
+
+/**
+ * Returns 1 if the line is the given instruction, 0 otherwise.
+ */
+int program_is(Asm_line *line, char *op) {
+	return line->kind == ASM_INST && strcmp(line->op, op) == 0;
+}
+
+/**
+ * Returns 1 if control may leave straight-line code after this line: a tag, any branch or jump, a call
+ * or a return. Calls end a block because the callee takes its arguments off the stack.
+ */
+int program_ends_block(Asm_line *line) {
+	if(line->kind == ASM_TAG)
+		return 1;
+	if(line->kind != ASM_INST)
+		return 0;
+
+	return line->op[0] == 'b' || line->op[0] == 'j';
+}
+
+/**
+ * Returns how many cycles the program takes if each instruction runs once.
+ */
+int program_cycles(Program *prog, Machine *machine) {
+	int cycles = 0;
+
+	for(int i = 0; i < prog->line_ct; i++) {
+		Machine_inst *inst = prog->lines[i].kind == ASM_INST ? machine_inst(machine, prog->lines[i].op) : NULL;
+
+		if(inst != NULL)
+			cycles += inst->cycles;
+	}
+
+	return cycles;
+}
+
+/**
+ * Returns how much instruction memory the program takes.
+ */
+int program_bytes(Program *prog, Machine *machine) {
+	int bytes = 0;
+
+	for(int i = 0; i < prog->line_ct; i++) {
+		Machine_inst *inst = prog->lines[i].kind == ASM_INST ? machine_inst(machine, prog->lines[i].op) : NULL;
+
+		if(inst != NULL)
+			bytes += inst->bytes;
+	}
+
+	return bytes;
+}
+
+/**
+ * Returns how many times an instruction appears in the program.
+ */
+int program_count(Program *prog, char *op) {
+	int ct = 0;
+
+	for(int i = 0; i < prog->line_ct; i++)
+		ct += program_is(&prog->lines[i], op);
+
+	return ct;
+}
+
+/**
+ * Returns the block a tag starts, or -1 if the tag is not in the program.
+ */
+int program_cfg_tag(Program_cfg *cfg, char *tag) {
+	return tag == NULL ? -1 : symbol_table_contains(&cfg->tags, tag);
+}
+
+/**
+ * Adds a successor to a block.
+ */
+static void add_succ(Program_block *block, int succ) {
+	block->succs = (int *)realloc(block->succs, (block->succ_ct + 1) * sizeof(int));
+	block->succs[block->succ_ct++] = succ;
+}
+
+/**
+ * Splits a program into basic blocks and links each to the blocks that may run after it.
+ * A jump is to a tag when the line before it pushes the tag, and otherwise may land on any block
+ * whose tag's address is taken or that nothing runs into, like the entries of a jump table.
+ *
+ * @param prog The program.
+ * @param cfg The graph to be filled in. Must be freed with program_cfg_free.
+ */
+void program_cfg(Program *prog, Program_cfg *cfg) {
+	int has_inst = 0;
+
+	memset(cfg, 0, sizeof(Program_cfg));
+	symbol_table_init(&cfg->tags);
+
+	for(int i = 0; i < prog->line_ct; i++) {
+		Asm_line *line = &prog->lines[i];
+		int starts = i == 0 || (line->kind == ASM_TAG && has_inst);
+
+		if(i > 0 && !starts) { //Also after branches and jumps
+			Asm_line *prev = &prog->lines[i - 1];
+
+			starts = prev->kind == ASM_INST && program_ends_block(prev);
+		}
+
+		if(starts) {
+			Program_block block = {0};
+			Asm_line *last = cfg->block_ct > 0 ? &prog->lines[cfg->blocks[cfg->block_ct - 1].last] : NULL;
+
+			block.first = i;
+			block.has_tag = line->kind == ASM_TAG;
+			block.falls_in = last != NULL && !program_is(last, "jpop") && !program_is(last, "jr");
+			block.after_call = last != NULL && program_is(last, "jpush");
+			cfg->blocks = (Program_block *)realloc(cfg->blocks, (cfg->block_ct + 1) * sizeof(Program_block));
+			cfg->blocks[cfg->block_ct++] = block;
+			has_inst = 0;
+		}
+
+		cfg->blocks[cfg->block_ct - 1].last = i;
+		if(line->kind == ASM_TAG)
+			symbol_table_add(&cfg->tags, line->arg, cfg->block_ct - 1);
+		has_inst |= line->kind == ASM_INST;
+	}
+
+	for(int i = 0; i < prog->line_ct; i++) { //Tags pushed other than to jump straight to them
+		Asm_line *line = &prog->lines[i];
+		int target = program_is(line, "pushi") ? program_cfg_tag(cfg, line->arg) : -1;
+
+		if(target >= 0 && !(i + 1 < prog->line_ct && program_is(&prog->lines[i + 1], "jpop")))
+			cfg->blocks[target].computed = 1;
+	}
+
+	for(int b = 1; b < cfg->block_ct; b++) //Jump table entries have neither a tag nor code running into them
+		if(!cfg->blocks[b].has_tag && !cfg->blocks[b].falls_in)
+			cfg->blocks[b].computed = 1;
+
+	for(int b = 0; b < cfg->block_ct; b++) {
+		Program_block *block = &cfg->blocks[b];
+		Asm_line *last = &prog->lines[block->last];
+		int next = b + 1 < cfg->block_ct ? b + 1 : -1;
+
+		if(program_is(last, "jpop")) {
+			Asm_line *prev = block->last > block->first ? &prog->lines[block->last - 1] : NULL;
+
+			if(prev != NULL && program_is(prev, "pushi") && !machine_is_constant(prev->arg)) {
+				int target = program_cfg_tag(cfg, prev->arg);
+
+				if(target >= 0)
+					add_succ(block, target);
+			} else {
+				for(int i = 0; i < cfg->block_ct; i++)
+					if(cfg->blocks[i].computed)
+						add_succ(block, i);
+			}
+		} else if(program_is(last, "jr")) {
+			continue;
+		} else if(last->kind == ASM_INST && last->op[0] == 'b' && last->arg != NULL) {
+			int target = program_cfg_tag(cfg, last->arg);
+
+			if(target >= 0)
+				add_succ(block, target);
+			if(next >= 0 && next != target)
+				add_succ(block, next);
+		} else if(next >= 0) {
+			add_succ(block, next);
+		}
+	}
+}
+
+/**
+ * Frees the memory held by a control flow graph.
+ */
+void program_cfg_free(Program_cfg *cfg) {
+	for(int b = 0; b < cfg->block_ct; b++)
+		free(cfg->blocks[b].succs);
+
+	free(cfg->blocks);
+	symbol_table_free(&cfg->tags);
+	memset(cfg, 0, sizeof(Program_cfg));
+}
@@ -0,0 +1,76 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "Machine.h"
+#include "SymbolTable.h"
+
+/** @enum Asm_kind
+ * What a line of generated assembly is.
+ */
+typedef enum {
+	ASM_INST, ASM_TAG, ASM_OTHER
+} Asm_kind;
+
+/** @struct Asm_line
+ * One line of generated assembly.
+ */
+typedef struct {
+	Asm_kind kind; ///< What the line is.
+	char op[MACHINE_NAME_LEN]; ///< The mnemonic of an instruction.
+	char *arg; ///< The operand of an instruction, the name of a tag or the text of any other line. May be NULL.
+} Asm_line;
+
+/** @struct Program
+ * The generated code of one function as a list of lines, for the passes that improve it.
+ */
+typedef struct {
+	Asm_line *lines; ///< The lines in order.
+	int line_ct; ///< Number of lines.
+	int capacity; ///< Number of lines allocated.
+} Program;
+
+/** @struct Program_block
+ * A basic block: straight-line code that starts at a tag or after a jump, and ends at a jump or before a tag.
+ */
+typedef struct {
+	int first; ///< Its first line.
+	int last; ///< Its last line.
+	int has_tag; ///< 1 if it starts with a tag.
+	int falls_in; ///< 1 if the block before it can run on into it.
+	int after_call; ///< 1 if it starts just after a call.
+	int computed; ///< 1 if a jump to a computed address may land on it, like a jump table entry.
+	int *succs; ///< The blocks that may run after it.
+	int succ_ct; ///< Number of successors.
+} Program_block;
+
+/** @struct Program_cfg
+ * The control flow graph of a function.
+ */
+typedef struct {
+	Program_block *blocks; ///< The basic blocks in order.
+	int block_ct; ///< Number of basic blocks.
+	Symbol_table tags; ///< Maps each tag to the block it starts.
+} Program_cfg;
+
+void program_parse(Program *prog, char *text);
+void program_write(Program *prog, FILE *output_file);
+char * program_text(Program *prog);
+void program_free(Program *prog);
+void program_append(Program *prog, Asm_kind kind, char *op, char *arg);
+void program_copy_line(Program *prog, Asm_line *line);
+void program_truncate(Program *prog, int line_ct);
+int program_is(Asm_line *line, char *op);
+int program_ends_block(Asm_line *line);
+int program_cycles(Program *prog, Machine *machine);
+int program_bytes(Program *prog, Machine *machine);
+int program_count(Program *prog, char *op);
+
+void program_cfg(Program *prog, Program_cfg *cfg);
+void program_cfg_free(Program_cfg *cfg);
+int program_cfg_tag(Program_cfg *cfg, char *tag);
+
+#endif
@@ -0,0 +1,334 @@
+#include <limits.h>
+
+#include "Report.h"
+
+/** @struct Report_func
+ * What the report works out about one function.
+ */
+typedef struct {
+	char *name; ///< The function's name.
+	Program prog; ///< The function's code.
+	int params; ///< Number of parameters it takes off the stack.
+	int net; ///< How much deeper the stack is when it returns than when it was called.
+	int own; ///< The deepest the stack gets in the function itself, above where it was called.
+	int depth; ///< The deepest the stack gets in the function and everything it calls.
+	char *recursion; ///< A function whose calls loop back to itself on the way here, or NULL.
+	int state; ///< 0 before it is looked at, 1 while it is, 2 once it is done.
+} Report_func;
+
+/**
+ * Returns the function with the given name, or -1 if it is not in the program.
+ */
+static int find_func(Report_func *funcs, int func_ct, char *name) {
+	for(int i = 0; name != NULL && i < func_ct; i++)
+		if(strcmp(funcs[i].name, name) == 0)
+			return i;
+
+	return -1;
+}
+
+/**
+ * Returns how many parameters a function takes: the values it stores straight away when called.
+ */
+static int count_params(Program *prog) {
+	int params = 0;
+	int i = 1;
+
+	while(1) {
+		while(i < prog->line_ct && prog->lines[i].kind == ASM_OTHER)
+			i++;
+		if(i + 1 >= prog->line_ct || !program_is(&prog->lines[i], "pushi") || !program_is(&prog->lines[i + 1], "pop"))
+			return params;
+
+		params++;
+		i += 2;
+	}
+}
+
+/**
+ * Works out how deep the stack gets in a function and everything it calls. Callees are looked at
+ * first. A call to a function that is still being looked at is a recursion, whose depth has no bound.
+ *
+ * @param funcs Every function in the program.
+ * @param func_ct Number of functions.
+ * @param f The function to look at.
+ * @param machine The machine description, for each instruction's effect on the stack.
+ */
+static void find_depth(Report_func *funcs, int func_ct, int f, Machine *machine) {
+	Report_func *func = &funcs[f];
+	Program *prog = &func->prog;
+	Program_cfg cfg;
+	int has_net = 0;
+
+	func->state = 1;
+	program_cfg(prog, &cfg);
+
+	int *entry = (int *)malloc((cfg.block_ct + 1) * sizeof(int));
+	int *worklist = (int *)malloc((cfg.block_ct + 1) * sizeof(int));
+	int work_ct = 0;
+
+	for(int b = 0; b < cfg.block_ct; b++)
+		entry[b] = INT_MIN;
+	if(cfg.block_ct > 0) {
+		entry[0] = 0;
+		worklist[work_ct++] = 0;
+	}
+
+	while(work_ct > 0) { //Each block is followed once, from the first depth it is reached at
+		Program_block *block = &cfg.blocks[worklist[--work_ct]];
+		int depth = entry[block - cfg.blocks];
+		char *callee = NULL;
+
+		for(int i = block->first; i <= block->last; i++) {
+			Asm_line *line = &prog->lines[i];
+			Machine_inst *inst = line->kind == ASM_INST ? machine_inst(machine, line->op) : NULL;
+
+			if(inst == NULL)
+				continue;
+
+			depth -= inst->pops;
+			if(program_is(line, "jpush")) {
+				int g = find_func(funcs, func_ct, callee);
+
+				if(g >= 0 && funcs[g].state == 0)
+					find_depth(funcs, func_ct, g, machine);
+
+				if(g >= 0 && funcs[g].state == 1) { //Back to a function still being looked at
+					func->recursion = funcs[g].name;
+					depth += 1 - funcs[g].params;
+				} else if(g >= 0) {
+					if(funcs[g].recursion != NULL && func->recursion == NULL)
+						func->recursion = funcs[g].recursion;
+					if(depth + funcs[g].depth > func->depth)
+						func->depth = depth + funcs[g].depth;
+					depth += funcs[g].net;
+				} else { //Not in this program, so assume it returns a value
+					depth++;
+				}
+			}
+			depth += inst->pushes;
+
+			if(depth > func->own)
+				func->own = depth;
+			if(program_is(line, "jr") && !has_net) {
+				func->net = depth;
+				has_net = 1;
+			}
+			callee = program_is(line, "pushi") ? line->arg : NULL;
+		}
+
+		for(int i = 0; i < block->succ_ct; i++) {
+			int succ = block->succs[i];
+
+			if(entry[succ] == INT_MIN) {
+				entry[succ] = depth;
+				worklist[work_ct++] = succ;
+			}
+		}
+	}
+
+	if(func->own > func->depth)
+		func->depth = func->own;
+	func->state = 2;
+
+	free(entry);
+	free(worklist);
+	program_cfg_free(&cfg);
+}
+
+/**
+ * Returns the cycles the instructions of a block take, and adds its instructions to inst_ct unless it is NULL.
+ */
+static int block_cycles(Program *prog, Program_block *block, Machine *machine, int *inst_ct) {
+	int cycles = 0;
+
+	for(int i = block->first; i <= block->last; i++) {
+		Machine_inst *inst = prog->lines[i].kind == ASM_INST ? machine_inst(machine, prog->lines[i].op) : NULL;
+
+		if(inst != NULL) {
+			cycles += inst->cycles;
+			if(inst_ct != NULL)
+				(*inst_ct)++;
+		}
+	}
+
+	return cycles;
+}
+
+/**
+ * Reports each loop of a function: the blocks that a jump back to an earlier block can run again.
+ * The cost of an iteration is that of the longest path from the top of the loop to the jump back,
+ * counting loops inside it once.
+ *
+ * @param func The function.
+ * @param machine The machine description, for costs.
+ * @param report_file Where the report is written.
+ */
+static void report_loops(Report_func *func, Machine *machine, FILE *report_file) {
+	Program *prog = &func->prog;
+	Program_cfg cfg;
+
+	program_cfg(prog, &cfg);
+
+	char *in_loop = (char *)malloc(cfg.block_ct + 1);
+	int *cost = (int *)malloc((cfg.block_ct + 1) * sizeof(int));
+	int *worklist = (int *)malloc((cfg.block_ct + 1) * sizeof(int));
+
+	for(int head = 0; head < cfg.block_ct; head++) {
+		int work_ct = 0;
+
+		memset(in_loop, 0, cfg.block_ct);
+		for(int b = head; b < cfg.block_ct; b++) //The blocks that jump back to the head
+			for(int i = 0; i < cfg.blocks[b].succ_ct; i++)
+				if(cfg.blocks[b].succs[i] == head && !in_loop[b]) {
+					in_loop[b] = 1;
+					worklist[work_ct++] = b;
+				}
+
+		if(work_ct == 0)
+			continue;
+
+		while(work_ct > 0) { //Everything that reaches them without passing the head
+			int b = worklist[--work_ct];
+
+			if(b == head)
+				continue;
+			for(int p = 0; p < cfg.block_ct; p++)
+				for(int i = 0; i < cfg.blocks[p].succ_ct; i++)
+					if(cfg.blocks[p].succs[i] == b && !in_loop[p]) {
+						in_loop[p] = 1;
+						worklist[work_ct++] = p;
+					}
+		}
+		in_loop[head] = 1;
+
+		int inst_ct = 0;
+		int longest = 0;
+
+		for(int b = 0; b < cfg.block_ct; b++)
+			cost[b] = INT_MIN;
+		cost[head] = block_cycles(prog, &cfg.blocks[head], machine, &inst_ct);
+
+		for(int b = head; b < cfg.block_ct; b++) { //Blocks only run on into later ones, except by jumping back
+			if(!in_loop[b])
+				continue;
+			if(b != head)
+				block_cycles(prog, &cfg.blocks[b], machine, &inst_ct);
+			if(cost[b] == INT_MIN)
+				continue;
+
+			for(int i = 0; i < cfg.blocks[b].succ_ct; i++) {
+				int succ = cfg.blocks[b].succs[i];
+
+				if(succ == head && cost[b] > longest)
+					longest = cost[b];
+				if(succ > b && in_loop[succ]) {
+					int through = cost[b] + block_cycles(prog, &cfg.blocks[succ], machine, NULL);
+
+					if(through > cost[succ])
+						cost[succ] = through;
+				}
+			}
+		}
+
+		Asm_line *tag = &prog->lines[cfg.blocks[head].first];
+
+		if(tag->kind == ASM_TAG)
+			fprintf(report_file, "  loop %s: %d instructions, at most %d cycles per iteration\n", tag->arg, inst_ct, longest);
+		else
+			fprintf(report_file, "  loop at line %d of %s: %d instructions, at most %d cycles per iteration\n", cfg.blocks[head].first, func->name,
+					inst_ct, longest);
+	}
+
+	free(in_loop);
+	free(cost);
+	free(worklist);
+	program_cfg_free(&cfg);
+}
+
+/**
+ * Works out how deep the operand stack gets in each function of a program, counting the functions
+ * it calls, and optionally reports that along with the size of each function and each of its loops.
+ * Recursion is flagged, since nothing bounds how deep it goes.
+ *
+ * @param code The code of every function.
+ * @param names The names of the functions, in order.
+ * @param func_ct Number of functions.
+ * @param param_cts How many parameters each function takes, or NULL to count the values each one
+ *                  stores straight away when called.
+ * @param machine The machine description, for each instruction's effect on the stack and its cost.
+ * @param report_file Where the report is written, or NULL to only check the stack limit.
+ * @param stack_limit How many entries the stack holds, or 0 if there is no limit.
+ * @return 1 if the program fits in the stack, 0 otherwise.
+ */
+int report_run(char *code, char **names, int func_ct, Symbol_table *param_cts, Machine *machine, FILE *report_file, int stack_limit) {
+	Report_func *funcs = (Report_func *)calloc(func_ct + 1, sizeof(Report_func));
+	Program all;
+	int f = -1;
+	int ok = 1;
+
+	program_parse(&all, code);
+	for(int i = 0; i < func_ct; i++)
+		funcs[i].name = names[i];
+
+	for(int i = 0; i < all.line_ct; i++) { //Split the program at the start of each function
+		Asm_line *line = &all.lines[i];
+
+		if(line->kind == ASM_TAG && find_func(funcs, func_ct, line->arg) >= 0)
+			f = find_func(funcs, func_ct, line->arg);
+		if(f >= 0)
+			program_copy_line(&funcs[f].prog, line);
+	}
+
+	for(f = 0; f < func_ct; f++) {
+		int params = param_cts != NULL ? symbol_table_contains(param_cts, funcs[f].name) : -1;
+
+		funcs[f].params = params >= 0 ? params : count_params(&funcs[f].prog);
+		funcs[f].net = 1 - funcs[f].params;
+	}
+
+	for(f = 0; f < func_ct; f++)
+		if(funcs[f].state == 0)
+			find_depth(funcs, func_ct, f, machine);
+
+	for(f = 0; report_file != NULL && f < func_ct; f++) {
+		Report_func *func = &funcs[f];
+
+		int inst_ct = 0;
+
+		for(int i = 0; i < func->prog.line_ct; i++)
+			inst_ct += func->prog.lines[i].kind == ASM_INST;
+
+		fprintf(report_file, "function %s: %d instructions, ", func->name, inst_ct);
+		if(func->recursion != NULL)
+			fprintf(report_file, "stack depth unbounded, recursion through %s (%d in %s itself)\n", func->recursion, func->own, func->name);
+		else
+			fprintf(report_file, "stack depth %d (%d in %s itself)\n", func->depth, func->own, func->name);
+		report_loops(func, machine, report_file);
+	}
+
+	int main_func = find_func(funcs, func_ct, "main");
+
+	for(f = 0; stack_limit > 0 && f < func_ct; f++) { //What main needs covers everything it calls
+		Report_func *func = &funcs[f];
+
+		if(main_func >= 0 && f != main_func)
+			continue;
+
+		if(func->recursion != NULL) {
+			printf("ERROR: Stack depth of %s has no bound because of recursion through %s, but the stack holds %d entries\n",
+				   func->name, func->recursion, stack_limit);
+			ok = 0;
+		} else if(func->depth > stack_limit) {
+			printf("ERROR: %s needs %d stack entries, but the stack holds %d\n", func->name, func->depth, stack_limit);
+			ok = 0;
+		}
+	}
+
+	for(f = 0; f < func_ct; f++)
+		program_free(&funcs[f].prog);
+	free(funcs);
+	program_free(&all);
+
+	return ok;
+}
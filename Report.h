@@ -0,0 +1,8 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include "Program.h"
+
+int report_run(char *code, char **names, int func_ct, Symbol_table *param_cts, Machine *machine, FILE *report_file, int stack_limit);
+
+#endif
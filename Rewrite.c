@@ -0,0 +1,284 @@
+#include "Rewrite.h"
+
+/**
+ * The rewrite table the compiler was built with, made from jala.rewrites by the Makefile.
+ */
+static char rewrite_default[] =
+#include "RewritesDefault.h"
+	;
+
+/**
+ * Reads a sequence of instructions, each mnemonic followed by its operand if it takes one.
+ *
+ * @param machine The machine description, for which instructions take an operand.
+ * @param text The instructions, separated by spaces.
+ * @param seq Filled in with the instructions.
+ * @param pops Set to how many values the sequence takes off the stack, counting from its start.
+ * @param pushes Set to how many it leaves.
+ * @return 1 if read, 0 if the target lacks one of the instructions, -1 if the text is bad.
+ */
+static int read_seq(Machine *machine, char *text, Program *seq, int *pops, int *pushes) {
+	char *cpy = strdup(text);
+	Machine_inst *inst = NULL;
+	int depth = 0, ret = 1;
+
+	*pops = 0;
+	for(char *token = strtok(cpy, " \t\n"); token != NULL; token = strtok(NULL, " \t\n")) {
+		if(inst != NULL && inst->operand != OPERAND_NONE) { //Operand of the instruction before
+			free(seq->lines[seq->line_ct - 1].arg);
+			seq->lines[seq->line_ct - 1].arg = strdup(token);
+			inst = NULL;
+			continue;
+		}
+
+		inst = machine_inst(machine, token);
+		if(inst == NULL) {
+			ret = 0;
+			break;
+		}
+		program_append(seq, ASM_INST, token, NULL);
+		depth -= inst->pops;
+		if(-depth > *pops)
+			*pops = -depth;
+		depth += inst->pushes;
+	}
+
+	if(ret == 1 && inst != NULL && inst->operand != OPERAND_NONE)
+		ret = -1;
+	*pushes = depth + *pops;
+	free(cpy);
+
+	return ret;
+}
+
+/**
+ * Returns 1 if an instruction of a sequence has the given operand, 0 otherwise.
+ */
+static int seq_uses(Program *seq, char *arg) {
+	for(int i = 0; i < seq->line_ct; i++)
+		if(seq->lines[i].arg != NULL && strcmp(seq->lines[i].arg, arg) == 0)
+			return 1;
+
+	return 0;
+}
+
+/**
+ * Reads a rewrite line. The rewrite is only kept if the target has every instruction it uses and it
+ * saves something by the machine description's costs.
+ *
+ * @param table The table being loaded.
+ * @param machine The machine description.
+ * @param text The line after the word "rewrite".
+ * @param line_ct The line number, for error messages.
+ * @return 1 if the line could be read, 0 otherwise.
+ */
+static int read_rewrite(Rewrite_table *table, Machine *machine, char *text, int line_ct) {
+	Rewrite rewrite = {0};
+	char *colon = strchr(text, ':');
+	int from_pops, from_pushes, to_pops, to_pushes;
+
+	if(colon == NULL) {
+		printf("ERROR: Missing : in rewrite table line %d\n", line_ct);
+		return 0;
+	}
+	*colon = '\0';
+
+	int from_ok = read_seq(machine, text, &rewrite.from, &from_pops, &from_pushes);
+	int to_ok = read_seq(machine, colon + 1, &rewrite.to, &to_pops, &to_pushes);
+
+	if(from_ok >= 0 && to_ok >= 0 && (seq_uses(&rewrite.from, "-$K") || (!seq_uses(&rewrite.from, "$K") && (seq_uses(&rewrite.to, "$K") || seq_uses(&rewrite.to, "-$K")))))
+		from_ok = -1; //$K must be matched before it can be used
+
+	if(from_ok < 0 || to_ok < 0 || rewrite.from.line_ct == 0) {
+		printf("ERROR: Bad rewrite in rewrite table line %d\n", line_ct);
+	} else if(from_ok && to_ok && (to_pops > from_pops || to_pushes - to_pops != from_pushes - from_pops)) {
+		printf("ERROR: Rewrite in rewrite table line %d does not leave the stack as it was\n", line_ct);
+		from_ok = -1;
+	} else if(from_ok && to_ok) {
+		rewrite.cycles = program_cycles(&rewrite.from, machine) - program_cycles(&rewrite.to, machine);
+		rewrite.bytes = program_bytes(&rewrite.from, machine) - program_bytes(&rewrite.to, machine);
+		if(rewrite.cycles >= 0 && rewrite.bytes >= 0 && rewrite.cycles + rewrite.bytes > 0) {
+			table->rewrites = (Rewrite *)realloc(table->rewrites, (table->rewrite_ct + 1) * sizeof(Rewrite));
+			table->rewrites[table->rewrite_ct++] = rewrite;
+			return 1;
+		}
+	}
+
+	program_free(&rewrite.from);
+	program_free(&rewrite.to);
+
+	return from_ok >= 0 && to_ok >= 0;
+}
+
+/**
+ * Loads a rewrite table, as written by JALASuperopt.
+ *
+ * @param table The table to be filled in.
+ * @param machine The machine description. Rewrites using instructions it lacks, or that would not save
+ *                anything by its costs, are left out.
+ * @param filename The file to read, or NULL for the table the compiler was built with.
+ * @return 1 if the table was loaded, 0 otherwise.
+ */
+int rewrite_load(Rewrite_table *table, Machine *machine, char *filename) {
+	FILE *file = filename == NULL ? fmemopen(rewrite_default, strlen(rewrite_default), "r") : fopen(filename, "r");
+	char line[1024];
+	int line_ct = 0;
+	int ok = 1;
+
+	memset(table, 0, sizeof(Rewrite_table));
+	table->hash = STR_HASH_SEED;
+
+	if(file == NULL) {
+		printf("ERROR: Could not open rewrite table %s\n", filename);
+		return 0;
+	}
+
+	while(fgets(line, sizeof(line), file) != NULL) {
+		char word[MACHINE_NAME_LEN + 1];
+		int len = 0;
+
+		line_ct++;
+		table->hash = str_hash(line, strlen(line), table->hash);
+		if(sscanf(line, "%16s%n", word, &len) != 1 || word[0] == '#')
+			continue;
+
+		if(strcmp(word, "rewrite") == 0) {
+			ok = read_rewrite(table, machine, line + len, line_ct) && ok;
+		} else {
+			printf("ERROR: Unrecognized entry %s in rewrite table line %d\n", word, line_ct);
+			ok = 0;
+		}
+	}
+
+	fclose(file);
+
+	return ok;
+}
+
+/**
+ * Frees the memory held by a rewrite table.
+ */
+void rewrite_free(Rewrite_table *table) {
+	for(int i = 0; i < table->rewrite_ct; i++) {
+		program_free(&table->rewrites[i].from);
+		program_free(&table->rewrites[i].to);
+	}
+
+	free(table->rewrites);
+	memset(table, 0, sizeof(Rewrite_table));
+}
+
+/**
+ * Checks whether a rewrite's window is at a line. The window must be straight-line code, so that
+ * nothing jumps into the middle of it.
+ *
+ * @param prog The code.
+ * @param i The line.
+ * @param rewrite The rewrite.
+ * @param label Set to the tag $L stands for, if the window has one.
+ * @param konst Set to the constant $K stands for, if the window has one.
+ * @return 1 if it matches, 0 otherwise.
+ */
+static int matches(Program *prog, int i, Rewrite *rewrite, char **label, char **konst) {
+	*label = NULL;
+	*konst = NULL;
+	if(i + rewrite->from.line_ct > prog->line_ct)
+		return 0;
+
+	for(int j = 0; j < rewrite->from.line_ct; j++) {
+		Asm_line *line = &prog->lines[i + j];
+		Asm_line *want = &rewrite->from.lines[j];
+
+		if(line->kind != ASM_INST || strcmp(line->op, want->op) != 0 || (line->arg == NULL) != (want->arg == NULL))
+			return 0;
+		if(want->arg == NULL)
+			continue;
+		if(strcmp(want->arg, "$K") == 0) {
+			if(!machine_is_constant(line->arg) || (*konst != NULL && strcmp(*konst, line->arg) != 0))
+				return 0;
+			*konst = line->arg;
+		} else if(strcmp(want->arg, "$L") != 0) {
+			if(strcmp(want->arg, line->arg) != 0)
+				return 0;
+		} else if(*label != NULL && strcmp(*label, line->arg) != 0) {
+			return 0;
+		} else {
+			*label = line->arg;
+		}
+	}
+
+	//The smallest constant has no negation that fits in 32 bits
+	return *konst == NULL || atoll(*konst) != -2147483648LL || !seq_uses(&rewrite->to, "-$K");
+}
+
+/**
+ * Returns what an operand of a rewrite's replacement stands for.
+ *
+ * @param arg The operand, which may be $L, $K or -$K.
+ * @param label The tag matched by $L.
+ * @param konst The constant matched by $K.
+ * @param buf Space for a negated constant.
+ * @return The operand to write.
+ */
+static char * substitute(char *arg, char *label, char *konst, char *buf) {
+	if(arg == NULL)
+		return NULL;
+	if(strcmp(arg, "$L") == 0)
+		return label;
+	if(strcmp(arg, "$K") == 0)
+		return konst;
+	if(strcmp(arg, "-$K") == 0) {
+		snprintf(buf, STR_LEN, "%lld", -atoll(konst));
+		return buf;
+	}
+
+	return arg;
+}
+
+/**
+ * Replaces each window of a function's code found in the rewrite table by its cheaper equivalent.
+ * A rewrite can make a window for another, so the code is gone over until nothing changes.
+ *
+ * @param prog The function's code, rewritten in place.
+ * @param table The rewrite table. May be NULL.
+ * @param stats Filled in with what was rewritten.
+ */
+void rewrite_run(Program *prog, Rewrite_table *table, Rewrite_stats *stats) {
+	int changed = table != NULL;
+
+	memset(stats, 0, sizeof(Rewrite_stats));
+
+	while(changed) {
+		Program out = {0};
+
+		changed = 0;
+		for(int i = 0; i < prog->line_ct;) {
+			Rewrite *rewrite = NULL;
+			char *label = NULL, *konst = NULL;
+			char buf[STR_LEN];
+
+			for(int r = 0; rewrite == NULL && r < table->rewrite_ct; r++)
+				if(matches(prog, i, &table->rewrites[r], &label, &konst))
+					rewrite = &table->rewrites[r];
+
+			if(rewrite == NULL) {
+				program_copy_line(&out, &prog->lines[i++]);
+				continue;
+			}
+
+			for(int j = 0; j < rewrite->to.line_ct; j++) {
+				Asm_line *line = &rewrite->to.lines[j];
+
+				program_append(&out, ASM_INST, line->op, substitute(line->arg, label, konst, buf));
+			}
+			i += rewrite->from.line_ct;
+			stats->windows++;
+			stats->cycles += rewrite->cycles;
+			stats->bytes += rewrite->bytes;
+			changed = 1;
+		}
+
+		program_free(prog);
+		*prog = out;
+	}
+}
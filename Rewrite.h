@@ -0,0 +1,38 @@
+#ifndef REWRITE_H
+#define REWRITE_H
+
+#include "Program.h"
+
+/** @struct Rewrite
+ * One entry of the rewrite table: a window of instructions and a cheaper sequence that does the same.
+ */
+typedef struct {
+	Program from; ///< The instructions to look for. An operand of $L stands for any tag, and $K for any constant.
+	Program to; ///< What they are replaced by. $L and $K are what they matched in from, and -$K is the constant negated.
+	int cycles; ///< Cycles saved each time, by the machine description.
+	int bytes; ///< Bytes of instruction memory saved each time.
+} Rewrite;
+
+/** @struct Rewrite_table
+ * The rewrites the target can use, in the order of the table.
+ */
+typedef struct {
+	Rewrite *rewrites; ///< The rewrites.
+	int rewrite_ct; ///< Number of rewrites.
+	unsigned long long hash; ///< Hash of the table's text, to tell tables apart.
+} Rewrite_table;
+
+/** @struct Rewrite_stats
+ * What the rewrite table did to one function.
+ */
+typedef struct {
+	int windows; ///< Windows of instructions rewritten.
+	int cycles; ///< Cycles saved, counting each instruction once.
+	int bytes; ///< Bytes of instruction memory saved.
+} Rewrite_stats;
+
+int rewrite_load(Rewrite_table *table, Machine *machine, char *filename);
+void rewrite_free(Rewrite_table *table);
+void rewrite_run(Program *prog, Rewrite_table *table, Rewrite_stats *stats);
+
+#endif
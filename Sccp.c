@@ -0,0 +1,497 @@
+#include "Sccp.h"
+
+/** @enum Sccp_kind
+ * What is known about a value.
+ */
+typedef enum {
+	SCCP_TOP, ///< Nothing yet, since no path to it has been found to run.
+	SCCP_CONST, ///< Always the same integer.
+	SCCP_LABEL, ///< Always the address of the same variable or tag.
+	SCCP_SAVED, ///< Put on the stack by a call's caller to be restored after it. Only seen just after calls.
+	SCCP_BOTTOM ///< Not known.
+} Sccp_kind;
+
+/** @struct Sccp_value
+ * A value in the constant propagation lattice.
+ */
+typedef struct {
+	Sccp_kind kind; ///< What is known.
+	int value; ///< The integer of a constant, or the interned name of a label.
+} Sccp_value;
+
+/** @struct Sccp_slot
+ * One entry of the simulated stack.
+ */
+typedef struct {
+	Sccp_value value; ///< What is known about the entry.
+	int start; ///< The first output line of the side effect free code that computes it, or -1 if there is none.
+} Sccp_slot;
+
+/** @struct Sccp_block
+ * What the pass knows about a basic block of the function's control flow graph.
+ */
+typedef struct {
+	int reached; ///< 1 once some path to it has been found to run.
+	int queued; ///< 1 while it is on the worklist.
+	Sccp_value *in; ///< What is known about each variable when it starts.
+} Sccp_block;
+
+/** @struct Sccp
+ * Constant propagation over one function.
+ */
+typedef struct {
+	Program *prog; ///< The function's code.
+	Machine *machine; ///< The machine description, for instructions the pass does not know.
+	Program_cfg cfg; ///< The function's control flow graph.
+	Sccp_block *blocks; ///< What is known about each of its blocks.
+	Symbol_table vars; ///< Maps every other label the function pushes to its variable number.
+	int var_ct; ///< Number of variables.
+	Sccp_slot *stack; ///< The simulated stack.
+	int depth; ///< Number of entries on the simulated stack.
+	int underflows; ///< Entries taken from below the start of the block so far.
+	int last_impure; ///< The last output line with a side effect.
+} Sccp;
+
+static const Sccp_value sccp_bottom = {SCCP_BOTTOM, 0};
+
+/**
+ * Takes the top entry off the simulated stack. Below the start of the block entries are unknown,
+ * except just after a call, where the first one is the return value and the rest were saved by the caller.
+ */
+static Sccp_slot stack_pop(Sccp *sccp, Program_block *block) {
+	if(sccp->depth > 0)
+		return sccp->stack[--sccp->depth];
+
+	if(block->after_call && sccp->underflows++ > 0)
+		return (Sccp_slot){{SCCP_SAVED, 0}, -1};
+
+	return (Sccp_slot){sccp_bottom, -1};
+}
+
+/**
+ * Puts an entry on the simulated stack.
+ */
+static void stack_push(Sccp *sccp, Sccp_value value, int start) {
+	sccp->stack = (Sccp_slot *)realloc(sccp->stack, (sccp->depth + 1) * sizeof(Sccp_slot));
+	sccp->stack[sccp->depth++] = (Sccp_slot){value, start};
+}
+
+/**
+ * Returns the variable number a value is the address of, or -1 if it is not a known variable.
+ */
+static int value_var(Sccp *sccp, Sccp_value value) {
+	if(value.kind != SCCP_LABEL)
+		return -1;
+
+	return symbol_table_contains(&sccp->vars, symbol_key_str(value.value));
+}
+
+/**
+ * Writes a line to the improved code, if it is being written.
+ *
+ * @return The index of the line, or 0 when nothing is written.
+ */
+static int emit(Program *out, Asm_kind kind, char *op, char *arg) {
+	if(out == NULL)
+		return 0;
+
+	program_append(out, kind, op, arg);
+
+	return out->line_ct - 1;
+}
+
+/**
+ * Replaces the code computing some entries on the stack by a single constant, if that code is free
+ * of side effects.
+ *
+ * @param sccp The pass.
+ * @param out The improved code, or NULL.
+ * @param start Where the code starts in out.
+ * @param value The constant.
+ * @return 1 if the code was replaced, 0 otherwise.
+ */
+static int fold(Sccp *sccp, Program *out, int start, int value) {
+	char text[STR_LEN];
+
+	if(out == NULL || start < 0 || start <= sccp->last_impure)
+		return 0;
+
+	program_truncate(out, start);
+	snprintf(text, STR_LEN, "%d", value);
+	program_append(out, ASM_INST, "pushi", text);
+
+	return 1;
+}
+
+/**
+ * Works out which way a conditional branch goes.
+ *
+ * @param op The branch instruction.
+ * @param a The first operand.
+ * @param b The second operand, ignored by branches that take one.
+ * @return 1 if always taken, 0 if never taken, -1 if not known.
+ */
+static int branch_outcome(char *op, Sccp_value a, Sccp_value b) {
+	if(a.kind != SCCP_CONST || (b.kind != SCCP_CONST && strcmp(op, "beqz") != 0 && strcmp(op, "bnez") != 0))
+		return -1;
+
+	if(strcmp(op, "beq") == 0)
+		return a.value == b.value;
+	if(strcmp(op, "bne") == 0)
+		return a.value != b.value;
+	if(strcmp(op, "blt") == 0)
+		return a.value < b.value;
+	if(strcmp(op, "bge") == 0)
+		return a.value >= b.value;
+	if(strcmp(op, "beqz") == 0)
+		return a.value == 0;
+	if(strcmp(op, "bnez") == 0)
+		return a.value != 0;
+
+	return -1;
+}
+
+/**
+ * Adds the blocks a computed jump may land on to a list of successors.
+ */
+static int add_computed(Sccp *sccp, int succ[], int succ_ct) {
+	for(int i = 0; i < sccp->cfg.block_ct; i++)
+		if(sccp->cfg.blocks[i].computed)
+			succ[succ_ct++] = i;
+
+	return succ_ct;
+}
+
+/**
+ * Runs one block over what is known when it starts, and optionally writes its improved code.
+ *
+ * @param sccp The pass.
+ * @param b The block.
+ * @param mem What is known about each variable when it starts. Left holding what is known at its end.
+ * @param succ Filled in with the blocks that may run after it.
+ * @param out Where the improved code is written, or NULL to only work out the successors.
+ * @param stats Counts what was improved, when writing.
+ * @return Number of successors.
+ */
+static int run_block(Sccp *sccp, int b, Sccp_value *mem, int succ[], Program *out, Sccp_stats *stats) {
+	Program_block *block = &sccp->cfg.blocks[b];
+	Sccp_value *saved = NULL;
+	int succ_ct = 0;
+	int ends = 0;
+
+	sccp->depth = 0;
+	sccp->underflows = 0;
+	sccp->last_impure = out == NULL ? 0 : out->line_ct - 1;
+
+	if(block->after_call) { //The callee may change anything, until the caller's variables are restored
+		saved = (Sccp_value *)malloc((sccp->var_ct + 1) * sizeof(Sccp_value));
+		memcpy(saved, mem, sccp->var_ct * sizeof(Sccp_value));
+		for(int i = 0; i < sccp->var_ct; i++)
+			mem[i] = sccp_bottom;
+	}
+
+	for(int i = block->first; i <= block->last; i++) {
+		Asm_line *line = &sccp->prog->lines[i];
+		char *op = line->op;
+
+		if(line->kind != ASM_INST) {
+			emit(out, line->kind, op, line->arg);
+			continue;
+		}
+
+		if(strcmp(op, "pushi") == 0) {
+			Sccp_value value = {SCCP_CONST, 0};
+
+			if(line->arg != NULL && machine_is_constant(line->arg))
+				value.value = atoi(line->arg);
+			else if(line->arg != NULL)
+				value = (Sccp_value){SCCP_LABEL, symbol_intern(line->arg, symbol_hash(line->arg))};
+			stack_push(sccp, value, emit(out, ASM_INST, op, line->arg));
+		} else if(strcmp(op, "push") == 0) {
+			Sccp_slot addr = stack_pop(sccp, block);
+			int var = value_var(sccp, addr.value);
+			Sccp_value value = var < 0 ? sccp_bottom : mem[var];
+
+			if(value.kind == SCCP_CONST && fold(sccp, out, addr.start, value.value))
+				stats->loads++;
+			else
+				emit(out, ASM_INST, op, NULL);
+			stack_push(sccp, value, addr.start);
+		} else if(strcmp(op, "pop") == 0) {
+			Sccp_slot addr = stack_pop(sccp, block);
+			Sccp_slot value = stack_pop(sccp, block);
+			int var = value_var(sccp, addr.value);
+
+			if(var >= 0 && value.value.kind == SCCP_SAVED) {
+				mem[var] = saved[var];
+			} else if(var >= 0) {
+				mem[var] = value.value.kind == SCCP_CONST ? value.value : sccp_bottom;
+			} else { //Stored through a computed address
+				for(int j = 0; j < sccp->var_ct; j++)
+					mem[j] = sccp_bottom;
+			}
+			sccp->last_impure = emit(out, ASM_INST, op, NULL);
+		} else if(strcmp(op, "add") == 0 || strcmp(op, "sub") == 0 || strcmp(op, "slt") == 0 || strcmp(op, "addi") == 0) {
+			Sccp_slot y = strcmp(op, "addi") == 0 ? (Sccp_slot){{SCCP_CONST, atoi(line->arg)}, 0} : stack_pop(sccp, block);
+			Sccp_slot x = stack_pop(sccp, block);
+			Sccp_value value = sccp_bottom;
+			int pure = x.start >= 0 && y.start >= 0;
+
+			if(x.value.kind == SCCP_CONST && y.value.kind == SCCP_CONST) {
+				value.kind = SCCP_CONST;
+				value.value = op[0] == 'a' ? x.value.value + y.value.value : op[0] == 's' && op[1] == 'u' ? x.value.value - y.value.value
+							  : x.value.value < y.value.value;
+			}
+
+			if(value.kind != SCCP_CONST || !fold(sccp, out, x.start, value.value))
+				emit(out, ASM_INST, op, line->arg);
+			stack_push(sccp, value, pure ? x.start : -1);
+		} else if(op[0] == 'b' && line->arg != NULL) { //Conditional branches
+			int two = strcmp(op, "beqz") != 0 && strcmp(op, "bnez") != 0;
+			Sccp_slot y = two ? stack_pop(sccp, block) : (Sccp_slot){sccp_bottom, 0};
+			Sccp_slot x = stack_pop(sccp, block);
+			int taken = branch_outcome(op, x.value, y.value);
+			int target = program_cfg_tag(&sccp->cfg, line->arg);
+
+			if(taken >= 0 && out != NULL && x.start >= 0 && y.start >= 0 && x.start > sccp->last_impure) {
+				program_truncate(out, x.start);
+				if(taken) {
+					program_append(out, ASM_INST, "pushi", line->arg);
+					program_append(out, ASM_INST, "jpop", NULL);
+				}
+				stats->branches++;
+			} else {
+				emit(out, ASM_INST, op, line->arg);
+			}
+
+			if(taken != 0 && target >= 0)
+				succ[succ_ct++] = target;
+			if(taken != 1 && b + 1 < sccp->cfg.block_ct)
+				succ[succ_ct++] = b + 1;
+			ends = 1;
+		} else if(strcmp(op, "jpop") == 0) {
+			Sccp_slot addr = stack_pop(sccp, block);
+
+			emit(out, ASM_INST, op, NULL);
+			if(addr.value.kind == SCCP_LABEL) {
+				int target = program_cfg_tag(&sccp->cfg, symbol_key_str(addr.value.value));
+
+				if(target >= 0)
+					succ[succ_ct++] = target;
+			} else {
+				succ_ct = add_computed(sccp, succ, succ_ct);
+			}
+			ends = 1;
+		} else if(strcmp(op, "jr") == 0) {
+			emit(out, ASM_INST, op, NULL);
+			ends = 1;
+		} else { //Calls and anything else
+			Machine_inst *inst = machine_inst(sccp->machine, op);
+
+			for(int j = 0; inst != NULL && j < inst->pops; j++)
+				stack_pop(sccp, block);
+			for(int j = 0; inst != NULL && j < inst->pushes; j++)
+				stack_push(sccp, sccp_bottom, -1);
+			if(inst == NULL)
+				sccp->depth = 0;
+			for(int j = 0; j < sccp->var_ct && strcmp(op, "jpush") != 0; j++) //Calls are dealt with in the block after them
+				mem[j] = sccp_bottom;
+			sccp->last_impure = emit(out, ASM_INST, op, line->arg);
+		}
+	}
+
+	if(!ends && b + 1 < sccp->cfg.block_ct)
+		succ[succ_ct++] = b + 1;
+
+	free(saved);
+
+	return succ_ct;
+}
+
+/**
+ * Merges what is known at the end of a block into what is known at the start of a successor.
+ *
+ * @return 1 if anything changed, 0 otherwise.
+ */
+static int merge(Sccp *sccp, Sccp_block *block, Sccp_value *mem) {
+	int changed = 0;
+
+	if(!block->reached) {
+		memcpy(block->in, mem, sccp->var_ct * sizeof(Sccp_value));
+		block->reached = 1;
+		return 1;
+	}
+
+	for(int i = 0; i < sccp->var_ct; i++) {
+		Sccp_value *into = &block->in[i];
+
+		if(into->kind == SCCP_BOTTOM || (into->kind == mem[i].kind && into->value == mem[i].value))
+			continue;
+
+		*into = sccp_bottom;
+		changed = 1;
+	}
+
+	return changed;
+}
+
+/**
+ * Numbers the labels the function pushes that are not its own tags. These are its variables.
+ */
+static void find_vars(Sccp *sccp) {
+	Program *prog = sccp->prog;
+
+	for(int i = 0; i < prog->line_ct; i++) {
+		Asm_line *line = &prog->lines[i];
+
+		if(program_is(line, "pushi") && line->arg != NULL && !machine_is_constant(line->arg)
+				&& program_cfg_tag(&sccp->cfg, line->arg) < 0 && symbol_table_contains(&sccp->vars, line->arg) < 0)
+			symbol_table_add(&sccp->vars, line->arg, sccp->var_ct++);
+	}
+
+	sccp->blocks = (Sccp_block *)calloc(sccp->cfg.block_ct, sizeof(Sccp_block));
+	for(int b = 0; b < sccp->cfg.block_ct; b++)
+		sccp->blocks[b].in = (Sccp_value *)malloc((sccp->var_ct + 1) * sizeof(Sccp_value));
+}
+
+/**
+ * Drops tags of removed blocks that nothing jumps to any more, and jumps to the very next line.
+ *
+ * @param prog The improved code.
+ * @param removed Tags of the blocks that were removed.
+ */
+static void clean_up(Program *prog, Symbol_table *removed) {
+	Symbol_table used;
+	Program out = {0};
+
+	symbol_table_init(&used);
+	for(int i = 0; i < prog->line_ct; i++)
+		if(prog->lines[i].kind == ASM_INST && prog->lines[i].arg != NULL)
+			symbol_table_add(&used, prog->lines[i].arg, 1);
+
+	for(int i = 0; i < prog->line_ct; i++) {
+		Asm_line *line = &prog->lines[i];
+
+		if(line->kind == ASM_TAG && symbol_table_contains(removed, line->arg) >= 0 && symbol_table_contains(&used, line->arg) < 0)
+			continue;
+
+		if(program_is(line, "pushi") && line->arg != NULL && i + 1 < prog->line_ct && program_is(&prog->lines[i + 1], "jpop")) {
+			int next = i + 2, to_next = 0;
+
+			while(next < prog->line_ct && prog->lines[next].kind != ASM_INST) { //The tags before the next instruction, dropped or not
+				if(prog->lines[next].kind == ASM_TAG && strcmp(prog->lines[next].arg, line->arg) == 0)
+					to_next = 1;
+				next++;
+			}
+			if(to_next) {
+				i++;
+				continue;
+			}
+		}
+
+		program_copy_line(&out, line);
+	}
+
+	symbol_table_free(&used);
+	program_free(prog);
+	*prog = out;
+}
+
+/**
+ * Conditional constant propagation. Works out, for each basic block that can run, which variables
+ * always hold the same constant when it starts, following only the branches that can be taken. Blocks
+ * are revisited until nothing changes, so loop headers settle on what holds on every pass.
+ * Blocks that can never run are removed, branches that always go the same way become jumps or
+ * nothing, and reads of variables with known values become constants.
+ *
+ * A call may change any variable, but its caller's variables are then restored from the stack, so
+ * they keep what was known before the call.
+ *
+ * @param prog The function's code, rewritten in place.
+ * @param machine The machine description.
+ * @param stats Filled in with what was improved.
+ */
+void sccp_run(Program *prog, Machine *machine, Sccp_stats *stats) {
+	Sccp sccp = {0};
+	int *worklist, *succ;
+	int work_ct = 0;
+
+	memset(stats, 0, sizeof(Sccp_stats));
+	if(prog->line_ct == 0)
+		return;
+
+	sccp.prog = prog;
+	sccp.machine = machine;
+	symbol_table_init(&sccp.vars);
+	program_cfg(prog, &sccp.cfg);
+	find_vars(&sccp);
+
+	Sccp_value *mem = (Sccp_value *)malloc((sccp.var_ct + 1) * sizeof(Sccp_value));
+
+	worklist = (int *)malloc(sccp.cfg.block_ct * sizeof(int));
+	succ = (int *)malloc((sccp.cfg.block_ct + 2) * sizeof(int));
+
+	for(int i = 0; i < sccp.var_ct; i++) //Nothing is known when the function starts
+		mem[i] = sccp_bottom;
+	merge(&sccp, &sccp.blocks[0], mem);
+	worklist[work_ct++] = 0;
+	sccp.blocks[0].queued = 1;
+
+	while(work_ct > 0) {
+		int b = worklist[--work_ct];
+
+		sccp.blocks[b].queued = 0;
+		memcpy(mem, sccp.blocks[b].in, sccp.var_ct * sizeof(Sccp_value));
+
+		int succ_ct = run_block(&sccp, b, mem, succ, NULL, stats);
+
+		for(int i = 0; i < succ_ct; i++) {
+			Sccp_block *next = &sccp.blocks[succ[i]];
+
+			if(merge(&sccp, next, mem) && !next->queued) {
+				next->queued = 1;
+				worklist[work_ct++] = succ[i];
+			}
+		}
+	}
+
+	Program out = {0};
+	Symbol_table removed;
+
+	symbol_table_init(&removed);
+	for(int b = 0; b < sccp.cfg.block_ct; b++) {
+		Program_block *block = &sccp.cfg.blocks[b];
+
+		if(sccp.blocks[b].reached) {
+			memcpy(mem, sccp.blocks[b].in, sccp.var_ct * sizeof(Sccp_value));
+			run_block(&sccp, b, mem, succ, &out, stats);
+			continue;
+		}
+
+		int has_inst = 0;
+
+		for(int i = block->first; i <= block->last; i++) { //Keep the tags in case something still names them
+			if(prog->lines[i].kind == ASM_TAG) {
+				symbol_table_add(&removed, prog->lines[i].arg, 1);
+				program_copy_line(&out, &prog->lines[i]);
+			}
+			has_inst |= prog->lines[i].kind == ASM_INST;
+		}
+		stats->blocks += has_inst;
+	}
+
+	clean_up(&out, &removed);
+	program_free(prog);
+	*prog = out;
+
+	for(int i = 0; i < sccp.cfg.block_ct; i++)
+		free(sccp.blocks[i].in);
+	free(sccp.blocks);
+	free(sccp.stack);
+	free(mem);
+	free(worklist);
+	free(succ);
+	symbol_table_free(&removed);
+	program_cfg_free(&sccp.cfg);
+	symbol_table_free(&sccp.vars);
+}
@@ -0,0 +1,18 @@
+#ifndef SCCP_H
+#define SCCP_H
+
+#include "Program.h"
+#include "SymbolTable.h"
+
+/** @struct Sccp_stats
+ * What constant propagation did to one function.
+ */
+typedef struct {
+	int branches; ///< Conditional branches whose outcome was decided.
+	int blocks; ///< Basic blocks removed because they can never run.
+	int loads; ///< Variable reads replaced by constants.
+} Sccp_stats;
+
+void sccp_run(Program *prog, Machine *machine, Sccp_stats *stats);
+
+#endif
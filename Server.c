@@ -0,0 +1,259 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "Server.h"
+
+/**
+ * The requests and replies between JALAClient and a compiler started with --server are lists of
+ * sections, each a header line "<name> <length>" followed by that many bytes.
+ *
+ * A request holds the sections path, args (the options, one per line) and source.
+ * A reply holds the sections asm, counts, output (everything the compiler printed) and status.
+ */
+
+/**
+ * Writes a whole buffer to a socket.
+ *
+ * @return 1 on success, 0 if the connection was lost.
+ */
+static int write_all(int fd, char *data, size_t len) {
+	while(len > 0) {
+		ssize_t written = write(fd, data, len);
+
+		if(written <= 0)
+			return 0;
+		data += written;
+		len -= written;
+	}
+
+	return 1;
+}
+
+/**
+ * Reads exactly len bytes from a socket.
+ *
+ * @return 1 on success, 0 if the connection ended first.
+ */
+static int read_all(int fd, char *data, size_t len) {
+	while(len > 0) {
+		ssize_t got = read(fd, data, len);
+
+		if(got <= 0)
+			return 0;
+		data += got;
+		len -= got;
+	}
+
+	return 1;
+}
+
+/**
+ * Sends one section.
+ *
+ * @param fd The socket.
+ * @param name The name of the section.
+ * @param data The contents of the section.
+ * @param len The length of the contents.
+ * @return 1 on success, 0 if the connection was lost.
+ */
+int server_send(int fd, char *name, char *data, size_t len) {
+	char header[64];
+	int header_len = snprintf(header, sizeof(header), "%s %zu\n", name, len);
+
+	return write_all(fd, header, header_len) && write_all(fd, data, len);
+}
+
+/**
+ * Receives one section.
+ *
+ * @param fd The socket.
+ * @param name The name the section must have.
+ * @param len Set to the length of the contents.
+ * @return The contents with a '\0' added after them, which must be freed, or NULL on failure or if
+ * the section is longer than SERVER_MAX_LEN.
+ */
+char * server_receive(int fd, char *name, size_t *len) {
+	char header[64];
+	char got_name[64];
+	int i = 0;
+
+	do { //The header line is short, so read it a byte at a time
+		if(i == sizeof(header) - 1 || read(fd, header + i, 1) != 1)
+			return NULL;
+	} while(header[i++] != '\n');
+	header[i] = '\0';
+
+	if(sscanf(header, "%63s %zu", got_name, len) != 2 || strcmp(got_name, name) != 0 || *len > SERVER_MAX_LEN)
+		return NULL;
+
+	char *data = (char *)malloc(*len + 1);
+
+	if(data == NULL || !read_all(fd, data, *len)) {
+		free(data);
+		return NULL;
+	}
+	data[*len] = '\0';
+
+	return data;
+}
+
+/**
+ * Connects to a server.
+ *
+ * @param socket_path Where the server listens.
+ * @return The socket, or -1 if there is no server.
+ */
+int server_connect(char *socket_path) {
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+	if(fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		fd = -1;
+	}
+
+	return fd;
+}
+
+/**
+ * Answers one request. Everything the compiler prints is caught in a temporary file and sent back.
+ *
+ * @param fd The connection to the client.
+ * @param compile The function that compiles the request.
+ * @param data Passed on to compile.
+ */
+static void serve_request(int fd, Server_compile compile, void *data) {
+	size_t path_len, args_len, source_len;
+	char *path = server_receive(fd, "path", &path_len);
+	char *args = path == NULL ? NULL : server_receive(fd, "args", &args_len);
+	char *source = args == NULL ? NULL : server_receive(fd, "source", &source_len);
+	struct timeval start, end;
+
+	gettimeofday(&start, NULL);
+
+	if(source == NULL) {
+		printf("ERROR: Malformed request\n");
+		free(path);
+		free(args);
+		return;
+	}
+
+	char *argv[SERVER_MAX_ARGS];
+	int argc = 0;
+
+	for(char *arg = strtok(args, "\n"); arg != NULL; arg = strtok(NULL, "\n")) {
+		if(argc == SERVER_MAX_ARGS) { //Compiling without the rest of the options would give the wrong program
+			char message[64];
+			int message_len = snprintf(message, sizeof(message), "ERROR: More than %d options\n", SERVER_MAX_ARGS);
+
+			printf("ERROR: Too many options for %s\n", path);
+			fflush(stdout);
+			server_send(fd, "asm", "", 0);
+			server_send(fd, "counts", "", 0);
+			server_send(fd, "output", message, message_len);
+			server_send(fd, "status", "1", 1);
+			free(path);
+			free(args);
+			free(source);
+			return;
+		}
+		argv[argc++] = arg;
+	}
+
+	char *asm_text, *counts, *output;
+	size_t asm_len, counts_len;
+	FILE *asm_file = open_memstream(&asm_text, &asm_len);
+	FILE *counts_file = open_memstream(&counts, &counts_len);
+	FILE *output_file = tmpfile();
+	int saved_stdout = dup(STDOUT_FILENO);
+
+	fflush(stdout);
+	dup2(fileno(output_file), STDOUT_FILENO);
+	int status = compile(path, source, source_len, argc, argv, asm_file, counts_file, data);
+	fflush(stdout);
+	dup2(saved_stdout, STDOUT_FILENO);
+	close(saved_stdout);
+
+	fclose(asm_file);
+	fclose(counts_file);
+
+	fseek(output_file, 0, SEEK_END);
+	long output_len = ftell(output_file);
+	char status_text[16];
+	int status_len = snprintf(status_text, sizeof(status_text), "%d", status);
+
+	output = (char *)malloc(output_len + 1);
+	rewind(output_file);
+	output_len = fread(output, 1, output_len, output_file);
+	fclose(output_file);
+
+	server_send(fd, "asm", asm_text, asm_len);
+	server_send(fd, "counts", counts, counts_len);
+	server_send(fd, "output", output, output_len);
+	server_send(fd, "status", status_text, status_len);
+
+	gettimeofday(&end, NULL);
+	printf("Compiled %s in %ld us\n", path, (end.tv_sec - start.tv_sec) * 1000000L + end.tv_usec - start.tv_usec);
+	fflush(stdout);
+
+	free(asm_text);
+	free(counts);
+	free(output);
+	free(path);
+	free(args);
+	free(source);
+}
+
+/**
+ * Listens on a Unix socket and compiles requests one after another until killed.
+ *
+ * @param socket_path Where to listen. A socket left there by an earlier server is removed.
+ * @param compile The function that compiles each request.
+ * @param data Passed on to compile, for state kept between requests.
+ * @return 1 if the socket could not be opened. Does not return otherwise.
+ */
+int server_run(char *socket_path, Server_compile compile, void *data) {
+	struct sockaddr_un addr;
+	struct stat old;
+
+	if(lstat(socket_path, &old) == 0) {
+		if(!S_ISSOCK(old.st_mode)) { //Never remove a file that is not ours
+			printf("ERROR: %s exists and is not a socket\n", socket_path);
+			return 1;
+		}
+		unlink(socket_path);
+	}
+
+	int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+	if(listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 16) < 0) {
+		printf("ERROR: Could not listen on %s\n", socket_path);
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN); //A client that goes away should not take the server with it
+	printf("Listening on %s\n", socket_path);
+	fflush(stdout);
+
+	while(1) {
+		int fd = accept(listen_fd, NULL, NULL);
+
+		if(fd < 0)
+			continue;
+
+		serve_request(fd, compile, data);
+		close(fd);
+	}
+}
@@ -0,0 +1,27 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define SERVER_SOCKET "/tmp/jala.sock" ///< Where the server listens unless told otherwise.
+#define SERVER_MAX_ARGS 16 ///< Most options a request may carry.
+#define SERVER_MAX_LEN (64 << 20) ///< Longest section that will be received.
+
+/**
+ * Compiles one request. Anything printed to stdout is sent back to the client.
+ *
+ * @param path Absolute path of the source file.
+ * @param source The contents of the source file.
+ * @param source_len The length of the contents.
+ * @param argc Number of options.
+ * @param argv The options, as they would be given on the command line.
+ * @param asm_file Where the assembly program is written.
+ * @param counts_file Where the --instrument side file is written.
+ * @param data The pointer given to server_run.
+ * @return The exit status the compiler would have had.
+ */
+typedef int (*Server_compile)(char *path, char *source, size_t source_len, int argc, char **argv, FILE *asm_file, FILE *counts_file, void *data);
+
+int server_run(char *socket_path, Server_compile compile, void *data);
+int server_connect(char *socket_path);
+int server_send(int fd, char *name, char *data, size_t len);
+char * server_receive(int fd, char *name, size_t *len);
@@ -0,0 +1,1284 @@
+#include "Ssa.h"
+
+/*
+ * The SSA form is lifted from the stack code of one function. Each block is run through with a
+ * stack of value numbers in place of the machine's stack, so that every instruction names the values
+ * it takes. A load or store is the address push and the push or pop after it; a call is the address
+ * push and the jpush. Since a call takes a known number of values off the stack and leaves one,
+ * calls do not end blocks. The variables are then renamed the usual way: phis are placed at the
+ * iterated dominance frontiers of the blocks that write each variable, and a walk of the dominator
+ * tree gives each load the store or phi it reads.
+ *
+ * Going back to stack code, each block is written out in order while keeping track of what is on the
+ * stack and which value each variable holds in memory. Operands that are not on top of the stack
+ * where they are needed are pushed again if they are constants or are held by a variable. Code that
+ * cannot be scheduled this way is reported, and the caller keeps the code it had.
+ */
+
+/**
+ * Adds an instruction to a block.
+ *
+ * @param block The block.
+ * @param at Where the instruction goes among the block's instructions.
+ * @param kind What the instruction does.
+ * @return The new instruction, valid until the next one is added to the block.
+ */
+static Ssa_inst * insert_inst(Ssa_block *block, int at, Ssa_kind kind) {
+	block->insts = (Ssa_inst *)realloc(block->insts, (block->inst_ct + 1) * sizeof(Ssa_inst));
+	memmove(&block->insts[at + 1], &block->insts[at], (block->inst_ct - at) * sizeof(Ssa_inst));
+	block->inst_ct++;
+
+	Ssa_inst *inst = &block->insts[at];
+
+	memset(inst, 0, sizeof(Ssa_inst));
+	inst->kind = kind;
+	inst->value = -1;
+	inst->var = -1;
+
+	return inst;
+}
+
+/**
+ * Adds an instruction to the end of a block.
+ */
+static Ssa_inst * add_inst(Ssa_block *block, Ssa_kind kind) {
+	return insert_inst(block, block->inst_ct, kind);
+}
+
+/**
+ * Numbers a new value defined in a block.
+ */
+static int new_value(Ssa *ssa, int b) {
+	ssa->value_block = (int *)realloc(ssa->value_block, (ssa->value_ct + 1) * sizeof(int));
+	ssa->value_block[ssa->value_ct] = b;
+
+	return ssa->value_ct++;
+}
+
+/**
+ * Adds an edge to a list of blocks, unless it is there already.
+ */
+static void add_edge(int **list, int *ct, int b) {
+	for(int i = 0; i < *ct; i++)
+		if((*list)[i] == b)
+			return;
+
+	*list = (int *)realloc(*list, (*ct + 1) * sizeof(int));
+	(*list)[(*ct)++] = b;
+}
+
+/**
+ * Returns 1 if one block dominates another. A block that never runs is dominated by none.
+ */
+static int dominates(Ssa *ssa, int a, int b) {
+	if(!ssa->blocks[b].reachable)
+		return a == b;
+
+	for(; b >= 0; b = ssa->blocks[b].idom)
+		if(b == a)
+			return 1;
+
+	return 0;
+}
+
+/**
+ * Splits a function's code into blocks. A block starts at the first line, at a tag after code, and
+ * after a branch, jump or return.
+ *
+ * @return The first line of each block, with the line count after the last.
+ */
+static int * split_blocks(Ssa *ssa, Program *prog, Symbol_table *tags) {
+	int *firsts = (int *)malloc((prog->line_ct + 2) * sizeof(int));
+	int has_inst = 0;
+
+	for(int i = 0; i < prog->line_ct; i++) {
+		Asm_line *line = &prog->lines[i];
+		Asm_line *prev = i > 0 ? &prog->lines[i - 1] : NULL;
+		int ends = prev != NULL && prev->kind == ASM_INST && (prev->op[0] == 'b' || program_is(prev, "jpop") || program_is(prev, "jr"));
+
+		if(i == 0 || ends || (line->kind == ASM_TAG && has_inst)) {
+			firsts[ssa->block_ct++] = i;
+			has_inst = 0;
+		}
+		if(line->kind == ASM_INST)
+			has_inst = 1;
+		if(line->kind == ASM_TAG)
+			symbol_table_add(tags, line->arg, ssa->block_ct - 1);
+	}
+	firsts[ssa->block_ct] = prog->line_ct;
+
+	ssa->blocks = (Ssa_block *)calloc(ssa->block_ct + 1, sizeof(Ssa_block));
+	for(int b = 0; b < ssa->block_ct; b++) {
+		ssa->blocks[b].target = -1;
+		ssa->blocks[b].idom = -1;
+	}
+
+	return firsts;
+}
+
+/**
+ * Numbers the variables: what the code pushes the address of to load or store it.
+ *
+ * @param loaded Set to 1 for each variable that is loaded somewhere, and so needs phis.
+ */
+static void find_vars(Ssa *ssa, Program *prog, Symbol_table *tags, char **loaded) {
+	for(int i = 0; i + 1 < prog->line_ct; i++) {
+		Asm_line *line = &prog->lines[i];
+
+		if(program_is(line, "pushi") && line->arg != NULL && !machine_is_constant(line->arg) && symbol_table_contains(tags, line->arg) < 0
+				&& (program_is(&prog->lines[i + 1], "push") || program_is(&prog->lines[i + 1], "pop"))
+				&& symbol_table_contains(&ssa->var_index, line->arg) < 0) {
+			ssa->vars = (char **)realloc(ssa->vars, (ssa->var_ct + 1) * sizeof(char *));
+			ssa->vars[ssa->var_ct] = strdup(line->arg);
+			symbol_table_add(&ssa->var_index, line->arg, ssa->var_ct++);
+		}
+	}
+
+	*loaded = (char *)calloc(ssa->var_ct + 1, 1);
+	for(int i = 0; i + 1 < prog->line_ct; i++)
+		if(program_is(&prog->lines[i], "pushi") && program_is(&prog->lines[i + 1], "push")) {
+			int var = symbol_table_contains(&ssa->var_index, prog->lines[i].arg);
+
+			if(var >= 0)
+				(*loaded)[var] = 1;
+		}
+}
+
+/**
+ * Adds an instruction for each loaded variable, giving the value it holds in memory at this point.
+ */
+static void add_mems(Ssa *ssa, int b, int at, char *loaded) {
+	for(int v = ssa->var_ct - 1; v >= 0; v--) {
+		if(!loaded[v])
+			continue;
+
+		int value = new_value(ssa, b);
+		Ssa_inst *inst = insert_inst(&ssa->blocks[b], at, SSA_MEM);
+
+		inst->var = v;
+		inst->value = value;
+	}
+}
+
+/** @struct Ssa_lift
+ * The stack of values while a block is lifted.
+ */
+typedef struct {
+	Ssa *ssa; ///< The SSA form being built.
+	int b; ///< The block.
+	int *stack; ///< The values on the stack, deepest first.
+	int depth; ///< Number of values on the stack.
+	int *args; ///< The values the caller left, found when the first block takes more than it pushed. Top first.
+	int arg_ct; ///< Number of such values.
+	char **reason; ///< Set to why lifting failed.
+} Ssa_lift;
+
+/**
+ * Takes the top value off the stack. Only the first block may take values it did not push, which
+ * are the caller's arguments.
+ *
+ * @return The value, or -1 if the stack is empty.
+ */
+static int lift_pop(Ssa_lift *lift) {
+	if(lift->depth > 0)
+		return lift->stack[--lift->depth];
+
+	if(lift->b != 0) {
+		*lift->reason = "a value is carried on the stack from one block into another";
+		return -1;
+	}
+
+	int value = new_value(lift->ssa, 0);
+
+	lift->args = (int *)realloc(lift->args, (lift->arg_ct + 1) * sizeof(int));
+	lift->args[lift->arg_ct++] = value;
+
+	return value;
+}
+
+/**
+ * Takes operands off the stack, deepest first.
+ *
+ * @return 1 on success, 0 on failure.
+ */
+static int lift_operands(Ssa_lift *lift, int **operands, int ct) {
+	*operands = (int *)malloc((ct + 1) * sizeof(int));
+	for(int i = ct - 1; i >= 0; i--)
+		if(((*operands)[i] = lift_pop(lift)) < 0)
+			return 0;
+
+	return 1;
+}
+
+/**
+ * Lifts the lines of one block into SSA instructions. Loads and stores name their variable, but not
+ * yet the value they read.
+ *
+ * @return 1 on success, 0 if the code does something the SSA form does not cover.
+ */
+static int lift_block(Ssa_lift *lift, Program *prog, int first, int last, Machine *machine, Symbol_table *param_cts, Symbol_table *tags, char *loaded) {
+	Ssa *ssa = lift->ssa;
+	int b = lift->b;
+	Ssa_block *block = &ssa->blocks[b];
+
+	block->exit = b + 1 < ssa->block_ct ? SSA_FALL : SSA_END;
+	lift->depth = 0;
+
+	for(int i = first; i <= last; i++) {
+		Asm_line *line = &prog->lines[i];
+		Asm_line *next = i < last ? &prog->lines[i + 1] : NULL;
+		Machine_inst *mi = line->kind == ASM_INST ? machine_inst(machine, line->op) : NULL;
+		int var = program_is(line, "pushi") && line->arg != NULL ? symbol_table_contains(&ssa->var_index, line->arg) : -1;
+		Ssa_inst *inst;
+
+		if(line->kind == ASM_TAG) {
+			block->tags = (char **)realloc(block->tags, (block->tag_ct + 1) * sizeof(char *));
+			block->tags[block->tag_ct++] = strdup(line->arg);
+		} else if(line->kind == ASM_OTHER) {
+			add_inst(block, SSA_NOTE)->arg = line->arg != NULL ? strdup(line->arg) : NULL;
+		} else if(mi == NULL || mi->pushes > 1) {
+			*lift->reason = "an instruction the machine description does not cover";
+			return 0;
+		} else if(var >= 0 && next != NULL && program_is(next, "push")) {
+			int value = new_value(ssa, b);
+
+			inst = add_inst(block, SSA_LOAD);
+			inst->var = var;
+			inst->value = value;
+			inst->operands = (int *)malloc(sizeof(int));
+			inst->operands[0] = -1;
+			inst->operand_ct = 1;
+			lift->stack[lift->depth++] = value;
+			i++;
+		} else if(var >= 0 && next != NULL && program_is(next, "pop")) {
+			int *operands;
+
+			if(!lift_operands(lift, &operands, 1)) {
+				free(operands);
+				return 0;
+			}
+			inst = add_inst(block, SSA_STORE);
+			inst->var = var;
+			inst->operands = operands;
+			inst->operand_ct = 1;
+			i++;
+		} else if(var >= 0) {
+			*lift->reason = "the address of a variable is used other than to load or store it";
+			return 0;
+		} else if(program_is(line, "pushi") && next != NULL && program_is(next, "jpop")) {
+			block->target = symbol_table_contains(tags, line->arg);
+			if(block->target < 0) {
+				*lift->reason = "a jump out of the function";
+				return 0;
+			}
+			block->exit = SSA_JUMP;
+			block->exit_label = strdup(line->arg);
+			i++;
+		} else if(program_is(line, "pushi") && next != NULL && program_is(next, "jpush")) {
+			int arity = param_cts != NULL && line->arg != NULL ? symbol_table_contains(param_cts, line->arg) : -1;
+			int *operands;
+
+			if(arity < 0) {
+				*lift->reason = "a call to a function whose parameters are not known";
+				return 0;
+			}
+			if(!lift_operands(lift, &operands, arity)) {
+				free(operands);
+				return 0;
+			}
+
+			int value = new_value(ssa, b);
+
+			inst = add_inst(block, SSA_CALL);
+			inst->arg = strdup(line->arg);
+			inst->value = value;
+			inst->operands = operands;
+			inst->operand_ct = arity;
+			lift->stack[lift->depth++] = value;
+			add_mems(ssa, b, block->inst_ct, loaded); //The callee may have changed any variable
+			i++;
+		} else if(program_is(line, "pushi")) {
+			int value = new_value(ssa, b);
+
+			inst = add_inst(block, SSA_CONST);
+			inst->arg = line->arg != NULL ? strdup(line->arg) : NULL;
+			inst->value = value;
+			lift->stack[lift->depth++] = value;
+		} else if(program_is(line, "push") || program_is(line, "pop") || program_is(line, "jpush") || program_is(line, "jpop")) {
+			*lift->reason = "an address computed at run time, like a jump table";
+			return 0;
+		} else if(program_is(line, "jr")) {
+			block->exit = SSA_RETURN;
+			block->exit_operands = (int *)malloc((lift->depth + 1) * sizeof(int));
+			memcpy(block->exit_operands, lift->stack, lift->depth * sizeof(int));
+			block->exit_operand_ct = lift->depth;
+			lift->depth = 0;
+		} else if(line->op[0] == 'b') {
+			block->target = line->arg != NULL ? symbol_table_contains(tags, line->arg) : -1;
+			if(block->target < 0) {
+				*lift->reason = "a branch out of the function";
+				return 0;
+			}
+			if(!lift_operands(lift, &block->exit_operands, mi->pops))
+				return 0;
+			block->exit = SSA_BRANCH;
+			strcpy(block->exit_op, line->op);
+			block->exit_label = strdup(line->arg);
+			block->exit_operand_ct = mi->pops;
+		} else {
+			int *operands;
+
+			if(!lift_operands(lift, &operands, mi->pops)) {
+				free(operands);
+				return 0;
+			}
+
+			int value = mi->pushes == 1 ? new_value(ssa, b) : -1;
+
+			inst = add_inst(block, SSA_OP);
+			strcpy(inst->op, line->op);
+			inst->arg = line->arg != NULL ? strdup(line->arg) : NULL;
+			inst->value = value;
+			inst->operands = operands;
+			inst->operand_ct = mi->pops;
+			if(value >= 0)
+				lift->stack[lift->depth++] = value;
+		}
+	}
+
+	if(lift->depth != 0) {
+		*lift->reason = "values are left on the stack at the end of a block";
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Links the blocks by their exits, and finds the blocks that can run.
+ */
+static void link_blocks(Ssa *ssa) {
+	for(int b = 0; b < ssa->block_ct; b++) {
+		Ssa_block *block = &ssa->blocks[b];
+
+		if(block->exit == SSA_BRANCH || block->exit == SSA_JUMP)
+			add_edge(&block->succs, &block->succ_ct, block->target);
+		if((block->exit == SSA_BRANCH || block->exit == SSA_FALL) && b + 1 < ssa->block_ct)
+			add_edge(&block->succs, &block->succ_ct, b + 1);
+	}
+
+	for(int b = 0; b < ssa->block_ct; b++)
+		for(int s = 0; s < ssa->blocks[b].succ_ct; s++) {
+			Ssa_block *succ = &ssa->blocks[ssa->blocks[b].succs[s]];
+
+			add_edge(&succ->preds, &succ->pred_ct, b);
+		}
+}
+
+/**
+ * Orders the blocks that can run so that each comes after those before it on any path from the first,
+ * apart from loops: the reverse of the order in which a depth-first walk finishes them.
+ *
+ * @param order Filled in with the blocks.
+ * @return Number of blocks in the order.
+ */
+static int reverse_postorder(Ssa *ssa, int *order) {
+	int *stack = (int *)malloc((ssa->block_ct + 1) * sizeof(int));
+	int *next = (int *)calloc(ssa->block_ct + 1, sizeof(int));
+	int depth = 0, ct = 0;
+
+	stack[depth++] = 0;
+	ssa->blocks[0].reachable = 1;
+	while(depth > 0) {
+		Ssa_block *block = &ssa->blocks[stack[depth - 1]];
+
+		if(next[stack[depth - 1]] < block->succ_ct) {
+			int succ = block->succs[next[stack[depth - 1]]++];
+
+			if(!ssa->blocks[succ].reachable) {
+				ssa->blocks[succ].reachable = 1;
+				stack[depth++] = succ;
+			}
+		} else {
+			order[ct++] = stack[--depth];
+		}
+	}
+
+	for(int i = 0; i < ct / 2; i++) {
+		int tmp = order[i];
+
+		order[i] = order[ct - 1 - i];
+		order[ct - 1 - i] = tmp;
+	}
+
+	free(stack);
+	free(next);
+
+	return ct;
+}
+
+/**
+ * Finds the immediate dominator of each block that can run, by the method of Cooper, Harvey and
+ * Kennedy: each block's dominator is narrowed to the common dominator of its predecessors, in reverse
+ * postorder, until nothing changes.
+ */
+static void find_dominators(Ssa *ssa) {
+	int *order = (int *)malloc((ssa->block_ct + 1) * sizeof(int));
+	int *index = (int *)malloc((ssa->block_ct + 1) * sizeof(int));
+	int ct = reverse_postorder(ssa, order);
+	int changed = 1;
+
+	for(int i = 0; i < ct; i++)
+		index[order[i]] = i;
+	ssa->blocks[0].idom = 0;
+
+	while(changed) {
+		changed = 0;
+		for(int i = 1; i < ct; i++) {
+			Ssa_block *block = &ssa->blocks[order[i]];
+			int idom = -1;
+
+			for(int p = 0; p < block->pred_ct; p++) {
+				int pred = block->preds[p];
+
+				if(!ssa->blocks[pred].reachable || ssa->blocks[pred].idom < 0)
+					continue;
+				if(idom < 0) {
+					idom = pred;
+					continue;
+				}
+				while(pred != idom) {
+					while(index[pred] > index[idom])
+						pred = ssa->blocks[pred].idom;
+					while(index[idom] > index[pred])
+						idom = ssa->blocks[idom].idom;
+				}
+			}
+			if(idom != block->idom) {
+				block->idom = idom;
+				changed = 1;
+			}
+		}
+	}
+	ssa->blocks[0].idom = -1;
+
+	free(order);
+	free(index);
+}
+
+/**
+ * Places a phi for each loaded variable at the start of every block where different writes of it
+ * meet: the iterated dominance frontier of the blocks that write it.
+ */
+static void place_phis(Ssa *ssa, char *loaded) {
+	int **frontier = (int **)calloc(ssa->block_ct + 1, sizeof(int *));
+	int *frontier_ct = (int *)calloc(ssa->block_ct + 1, sizeof(int));
+	int *work = (int *)malloc((ssa->block_ct + 1) * sizeof(int));
+	char *has_phi = (char *)malloc(ssa->block_ct + 1);
+	char *queued = (char *)malloc(ssa->block_ct + 1);
+
+	for(int b = 0; b < ssa->block_ct; b++) {
+		Ssa_block *block = &ssa->blocks[b];
+
+		if(!block->reachable || block->pred_ct < 2)
+			continue;
+		for(int p = 0; p < block->pred_ct; p++)
+			for(int runner = block->preds[p]; runner >= 0 && runner != block->idom && ssa->blocks[runner].reachable; runner = ssa->blocks[runner].idom)
+				add_edge(&frontier[runner], &frontier_ct[runner], b);
+	}
+
+	for(int v = 0; v < ssa->var_ct; v++) {
+		int work_ct = 0;
+
+		if(!loaded[v])
+			continue;
+
+		memset(has_phi, 0, ssa->block_ct);
+		memset(queued, 0, ssa->block_ct);
+		for(int b = 0; b < ssa->block_ct; b++)
+			for(int i = 0; i < ssa->blocks[b].inst_ct; i++) {
+				Ssa_inst *inst = &ssa->blocks[b].insts[i];
+
+				if(ssa->blocks[b].reachable && !queued[b] && inst->var == v && (inst->kind == SSA_STORE || inst->kind == SSA_MEM)) {
+					queued[b] = 1;
+					work[work_ct++] = b;
+				}
+			}
+
+		while(work_ct > 0) {
+			int b = work[--work_ct];
+
+			for(int f = 0; f < frontier_ct[b]; f++) {
+				int join = frontier[b][f];
+
+				if(has_phi[join])
+					continue;
+
+				int value = new_value(ssa, join);
+				Ssa_inst *phi = insert_inst(&ssa->blocks[join], 0, SSA_PHI);
+
+				has_phi[join] = 1;
+				phi->var = v;
+				phi->value = value;
+				phi->operand_ct = ssa->blocks[join].pred_ct;
+				phi->operands = (int *)malloc((phi->operand_ct + 1) * sizeof(int));
+				for(int p = 0; p < phi->operand_ct; p++)
+					phi->operands[p] = -1;
+				if(!queued[join]) {
+					queued[join] = 1;
+					work[work_ct++] = join;
+				}
+			}
+		}
+	}
+
+	for(int b = 0; b < ssa->block_ct; b++)
+		free(frontier[b]);
+	free(frontier);
+	free(frontier_ct);
+	free(work);
+	free(has_phi);
+	free(queued);
+}
+
+/** @struct Ssa_rename
+ * The value each variable holds while the blocks are renamed.
+ */
+typedef struct {
+	int **stacks; ///< For each variable, the values it took on the way down the dominator tree, latest last.
+	int *depths; ///< Number of values on each variable's stack.
+	char *loaded; ///< 1 for each variable that is loaded somewhere.
+	int **children; ///< The blocks each block immediately dominates.
+	int *child_ct; ///< Number of children of each block.
+} Ssa_rename;
+
+/**
+ * Returns the value a variable holds, or -1 if it is not known.
+ */
+static int current_value(Ssa_rename *rename, int v) {
+	return rename->depths[v] > 0 ? rename->stacks[v][rename->depths[v] - 1] : -1;
+}
+
+/**
+ * Gives each load in a block and in the blocks it dominates the value it reads, and each phi in a
+ * successor the value coming from this block.
+ */
+static void rename_block(Ssa *ssa, Ssa_rename *rename, int b) {
+	Ssa_block *block = &ssa->blocks[b];
+	int *pushed = (int *)calloc(ssa->var_ct + 1, sizeof(int));
+
+	block->entry_values = (int *)malloc((ssa->var_ct + 1) * sizeof(int));
+	for(int i = 0; i <= block->inst_ct; i++) {
+		Ssa_inst *inst = &block->insts[i];
+		int value = -1;
+
+		if(i == 0 || block->insts[i - 1].kind == SSA_PHI) //Once past the phis
+			for(int v = 0; v < ssa->var_ct; v++)
+				block->entry_values[v] = current_value(rename, v);
+		if(i == block->inst_ct)
+			break;
+
+		if(inst->kind == SSA_PHI || inst->kind == SSA_MEM)
+			value = inst->value;
+		else if(inst->kind == SSA_STORE && rename->loaded[inst->var])
+			value = inst->operands[0];
+		else if(inst->kind == SSA_LOAD)
+			inst->operands[0] = current_value(rename, inst->var);
+
+		if(value >= 0) {
+			rename->stacks[inst->var][rename->depths[inst->var]++] = value;
+			pushed[inst->var]++;
+		}
+	}
+
+	for(int s = 0; s < block->succ_ct; s++) {
+		Ssa_block *succ = &ssa->blocks[block->succs[s]];
+		int p = 0;
+
+		while(succ->preds[p] != b)
+			p++;
+		for(int i = 0; i < succ->inst_ct && succ->insts[i].kind == SSA_PHI; i++)
+			succ->insts[i].operands[p] = current_value(rename, succ->insts[i].var);
+	}
+
+	for(int c = 0; c < rename->child_ct[b]; c++)
+		rename_block(ssa, rename, rename->children[b][c]);
+
+	for(int v = 0; v < ssa->var_ct; v++)
+		rename->depths[v] -= pushed[v];
+	free(pushed);
+}
+
+/**
+ * Renames the variables, starting from the first block, then from each block that never runs, with
+ * the variables holding unknown values.
+ */
+static void rename_vars(Ssa *ssa, char *loaded) {
+	int values = 0;
+
+	for(int b = 0; b < ssa->block_ct; b++)
+		values += ssa->blocks[b].inst_ct;
+
+	Ssa_rename rename = {
+		(int **)malloc((ssa->var_ct + 1) * sizeof(int *)), (int *)calloc(ssa->var_ct + 1, sizeof(int)), loaded,
+		(int **)calloc(ssa->block_ct + 1, sizeof(int *)), (int *)calloc(ssa->block_ct + 1, sizeof(int))
+	};
+
+	for(int v = 0; v < ssa->var_ct; v++)
+		rename.stacks[v] = (int *)malloc((values + ssa->block_ct + 1) * sizeof(int));
+	for(int b = 1; b < ssa->block_ct; b++)
+		if(ssa->blocks[b].reachable)
+			add_edge(&rename.children[ssa->blocks[b].idom], &rename.child_ct[ssa->blocks[b].idom], b);
+
+	rename_block(ssa, &rename, 0);
+	for(int b = 1; b < ssa->block_ct; b++)
+		if(!ssa->blocks[b].reachable) {
+			int at = 0;
+
+			while(at < ssa->blocks[b].inst_ct && ssa->blocks[b].insts[at].kind == SSA_PHI)
+				at++;
+			add_mems(ssa, b, at, loaded);
+			rename_block(ssa, &rename, b);
+		}
+
+	for(int v = 0; v < ssa->var_ct; v++)
+		free(rename.stacks[v]);
+	for(int b = 0; b < ssa->block_ct; b++)
+		free(rename.children[b]);
+	free(rename.stacks);
+	free(rename.depths);
+	free(rename.children);
+	free(rename.child_ct);
+}
+
+/**
+ * Drops the phis and values found in memory that nothing uses, and numbers the values left in order.
+ */
+static void prune(Ssa *ssa) {
+	char *used = (char *)calloc(ssa->value_ct + 1, 1);
+	int *renumber = (int *)malloc((ssa->value_ct + 1) * sizeof(int));
+	int changed = 1;
+	int value_ct = 0;
+
+	for(int b = 0; b < ssa->block_ct; b++) {
+		Ssa_block *block = &ssa->blocks[b];
+
+		for(int i = 0; i < block->inst_ct; i++)
+			if(block->insts[i].kind != SSA_PHI && block->insts[i].kind != SSA_MEM)
+				for(int o = 0; o < block->insts[i].operand_ct; o++)
+					if(block->insts[i].operands[o] >= 0)
+						used[block->insts[i].operands[o]] = 1;
+		for(int o = 0; o < block->exit_operand_ct; o++)
+			used[block->exit_operands[o]] = 1;
+	}
+
+	while(changed) { //A phi that is used keeps the values it merges
+		changed = 0;
+		for(int b = 0; b < ssa->block_ct; b++)
+			for(int i = 0; i < ssa->blocks[b].inst_ct; i++) {
+				Ssa_inst *inst = &ssa->blocks[b].insts[i];
+
+				if(inst->kind != SSA_PHI || !used[inst->value])
+					continue;
+				for(int o = 0; o < inst->operand_ct; o++)
+					if(inst->operands[o] >= 0 && !used[inst->operands[o]]) {
+						used[inst->operands[o]] = 1;
+						changed = 1;
+					}
+			}
+	}
+
+	for(int v = 0; v < ssa->value_ct; v++)
+		renumber[v] = -1;
+	for(int b = 0; b < ssa->block_ct; b++) {
+		Ssa_block *block = &ssa->blocks[b];
+		int kept = 0;
+
+		for(int i = 0; i < block->inst_ct; i++) {
+			Ssa_inst *inst = &block->insts[i];
+
+			if((inst->kind == SSA_PHI || inst->kind == SSA_MEM) && !used[inst->value]) {
+				free(inst->operands);
+				continue;
+			}
+			if(inst->value >= 0) {
+				renumber[inst->value] = value_ct;
+				ssa->value_block[value_ct++] = b;
+			}
+			block->insts[kept++] = *inst;
+		}
+		block->inst_ct = kept;
+	}
+
+	for(int b = 0; b < ssa->block_ct; b++) {
+		Ssa_block *block = &ssa->blocks[b];
+
+		for(int i = 0; i < block->inst_ct; i++) {
+			Ssa_inst *inst = &block->insts[i];
+
+			if(inst->value >= 0)
+				inst->value = renumber[inst->value];
+			for(int o = 0; o < inst->operand_ct; o++)
+				if(inst->operands[o] >= 0)
+					inst->operands[o] = renumber[inst->operands[o]];
+		}
+		for(int o = 0; o < block->exit_operand_ct; o++)
+			block->exit_operands[o] = renumber[block->exit_operands[o]];
+		for(int v = 0; block->entry_values != NULL && v < ssa->var_ct; v++)
+			if(block->entry_values[v] >= 0)
+				block->entry_values[v] = renumber[block->entry_values[v]];
+	}
+	ssa->value_ct = value_ct;
+
+	free(used);
+	free(renumber);
+}
+
+/**
+ * Builds the SSA form of a function's code.
+ *
+ * @param ssa Filled in. Must be freed with ssa_free, even if building fails.
+ * @param prog The function's code, from its tag to its return.
+ * @param machine The machine description, for each instruction's effect on the stack.
+ * @param param_cts How many parameters each function takes, to follow the stack across calls. May be NULL.
+ * @param func The function's name.
+ * @param reason Set to why the code has no SSA form, when building fails.
+ * @return 1 on success, 0 if the code does something the SSA form does not cover, like a jump table.
+ */
+int ssa_build(Ssa *ssa, Program *prog, Machine *machine, Symbol_table *param_cts, char *func, char **reason) {
+	Symbol_table tags;
+	char *loaded = NULL;
+	int ok = 1;
+
+	memset(ssa, 0, sizeof(Ssa));
+	ssa->func = strdup(func);
+	symbol_table_init(&ssa->var_index);
+	symbol_table_init(&tags);
+
+	if(prog->line_ct == 0) {
+		*reason = "the function has no code";
+		symbol_table_free(&tags);
+		return 0;
+	}
+
+	int *firsts = split_blocks(ssa, prog, &tags);
+	Ssa_lift lift = {ssa, 0, (int *)malloc((prog->line_ct + 1) * sizeof(int)), 0, NULL, 0, reason};
+
+	find_vars(ssa, prog, &tags, &loaded);
+	for(int b = 0; ok && b < ssa->block_ct; b++) {
+		lift.b = b;
+		ok = lift_block(&lift, prog, firsts[b], firsts[b + 1] - 1, machine, param_cts, &tags, loaded);
+	}
+
+	if(ok) {
+		add_mems(ssa, 0, 0, loaded);
+		for(int a = 0; a < lift.arg_ct; a++) { //The deepest argument first, as they are on the stack
+			Ssa_inst *inst = insert_inst(&ssa->blocks[0], 0, SSA_ARG);
+
+			inst->value = lift.args[a];
+			inst->arg = (char *)malloc(16);
+			sprintf(inst->arg, "%d", a);
+		}
+
+		link_blocks(ssa);
+		if(ssa->blocks[0].pred_ct > 0) {
+			*reason = "a jump back to the start of the function";
+			ok = 0;
+		}
+	}
+
+	if(ok) {
+		find_dominators(ssa);
+		place_phis(ssa, loaded);
+		rename_vars(ssa, loaded);
+		prune(ssa);
+	}
+
+	free(lift.stack);
+	free(lift.args);
+	free(firsts);
+	free(loaded);
+	symbol_table_free(&tags);
+
+	return ok;
+}
+
+/**
+ * Prints a problem found by the verifier.
+ */
+static void verify_error(Ssa *ssa, int b, char *problem) {
+	printf("ERROR: SSA of %s: block %d: %s\n", ssa->func, b, problem);
+}
+
+/**
+ * Checks that a value is defined and that its definition comes before a use.
+ *
+ * @param ssa The SSA form.
+ * @param defined The position of each value's definition in its block, or -1 if it is not defined.
+ * @param value The value used.
+ * @param b The block of the use.
+ * @param at The position of the use in the block, or the number of instructions for the block's exit.
+ * @return 1 if the use is fine, 0 otherwise.
+ */
+static int check_use(Ssa *ssa, int *defined, int value, int b, int at) {
+	if(value < 0 || value >= ssa->value_ct || defined[value] < 0) {
+		verify_error(ssa, b, "use of a value that is not defined");
+		return 0;
+	}
+
+	int def_block = ssa->value_block[value];
+
+	if(def_block == b ? defined[value] >= at : !dominates(ssa, def_block, b)) {
+		verify_error(ssa, b, "use of a value whose definition does not come before it on every path");
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Checks the SSA form: that the edges match the exits and go both ways, that phis come first with a
+ * value for each predecessor, that each value is defined once, and that each definition dominates its
+ * uses. Each problem is printed.
+ *
+ * @return 1 if the SSA form is sound, 0 otherwise.
+ */
+int ssa_verify(Ssa *ssa) {
+	int *defined = (int *)malloc((ssa->value_ct + 1) * sizeof(int));
+	int ok = 1;
+
+	for(int v = 0; v < ssa->value_ct; v++)
+		defined[v] = -1;
+
+	for(int b = 0; b < ssa->block_ct; b++) {
+		Ssa_block *block = &ssa->blocks[b];
+		int expect = (block->exit == SSA_BRANCH || block->exit == SSA_JUMP) + ((block->exit == SSA_BRANCH || block->exit == SSA_FALL) && b + 1 < ssa->block_ct);
+
+		if(block->succ_ct > expect || block->succ_ct < (expect > 0) || ((block->exit == SSA_BRANCH || block->exit == SSA_JUMP) && (block->target < 0 || block->target >= ssa->block_ct))) {
+			verify_error(ssa, b, "successors do not match how the block ends");
+			ok = 0;
+		}
+		for(int s = 0; s < block->succ_ct; s++) {
+			Ssa_block *succ = &ssa->blocks[block->succs[s]];
+			int found = 0;
+
+			for(int p = 0; p < succ->pred_ct; p++)
+				found |= succ->preds[p] == b;
+			if(!found) {
+				verify_error(ssa, b, "a successor does not have the block as a predecessor");
+				ok = 0;
+			}
+		}
+
+		for(int i = 0; i < block->inst_ct; i++) {
+			Ssa_inst *inst = &block->insts[i];
+
+			if(inst->kind == SSA_PHI && (i > 0 && block->insts[i - 1].kind != SSA_PHI)) {
+				verify_error(ssa, b, "a phi after other instructions");
+				ok = 0;
+			}
+			if(inst->kind == SSA_PHI && inst->operand_ct != block->pred_ct) {
+				verify_error(ssa, b, "a phi without one value for each predecessor");
+				ok = 0;
+			}
+			if(inst->value >= ssa->value_ct || (inst->value >= 0 && (defined[inst->value] >= 0 || ssa->value_block[inst->value] != b))) {
+				verify_error(ssa, b, "a value defined more than once or in the wrong block");
+				ok = 0;
+			} else if(inst->value >= 0) {
+				defined[inst->value] = i;
+			}
+		}
+	}
+
+	for(int b = 0; ok && b < ssa->block_ct; b++) {
+		Ssa_block *block = &ssa->blocks[b];
+
+		for(int i = 0; i < block->inst_ct; i++) {
+			Ssa_inst *inst = &block->insts[i];
+
+			for(int o = 0; o < inst->operand_ct; o++) {
+				if(inst->kind != SSA_PHI)
+					ok &= check_use(ssa, defined, inst->operands[o], b, i);
+				else if(ssa->blocks[block->preds[o]].reachable || inst->operands[o] >= 0)
+					ok &= check_use(ssa, defined, inst->operands[o], block->preds[o], ssa->blocks[block->preds[o]].inst_ct);
+			}
+		}
+		for(int o = 0; o < block->exit_operand_ct; o++)
+			ok &= check_use(ssa, defined, block->exit_operands[o], b, block->inst_ct);
+	}
+
+	free(defined);
+
+	return ok;
+}
+
+/**
+ * Returns the number of instructions of one kind, like phis.
+ */
+int ssa_count(Ssa *ssa, Ssa_kind kind) {
+	int ct = 0;
+
+	for(int b = 0; b < ssa->block_ct; b++)
+		for(int i = 0; i < ssa->blocks[b].inst_ct; i++)
+			ct += ssa->blocks[b].insts[i].kind == kind;
+
+	return ct;
+}
+
+/**
+ * Prints a list of blocks.
+ */
+static void dump_blocks(FILE *dump_file, char *title, int *blocks, int ct) {
+	fprintf(dump_file, " %s", title);
+	for(int i = 0; i < ct; i++)
+		fprintf(dump_file, " b%d", blocks[i]);
+}
+
+/**
+ * Prints the SSA form, a block to a paragraph:
+ *
+ *     b1 [start_while_0] preds: b0 b2 succs: b3 b2 idom: b0
+ *         %3 = phi main_x [b0: %0] [b2: %13]
+ *         %4 = const 0
+ *         %5 = load main_x %3
+ *         %6 = slt %4 %5
+ *         %7 = const 1
+ *         bne %6 %7 -> b3 else b2
+ *
+ * @param ssa The SSA form.
+ * @param dump_file Where it is printed.
+ */
+void ssa_dump(Ssa *ssa, FILE *dump_file) {
+	fprintf(dump_file, "ssa for %s: %d blocks, %d values, %d phis\n", ssa->func, ssa->block_ct, ssa->value_ct, ssa_count(ssa, SSA_PHI));
+
+	for(int b = 0; b < ssa->block_ct; b++) {
+		Ssa_block *block = &ssa->blocks[b];
+
+		fprintf(dump_file, "b%d [", b);
+		for(int t = 0; t < block->tag_ct; t++)
+			fprintf(dump_file, t > 0 ? " %s" : "%s", block->tags[t]);
+		fprintf(dump_file, "]");
+		dump_blocks(dump_file, "preds:", block->preds, block->pred_ct);
+		dump_blocks(dump_file, "succs:", block->succs, block->succ_ct);
+		if(block->idom >= 0)
+			fprintf(dump_file, " idom: b%d", block->idom);
+		else if(!block->reachable)
+			fprintf(dump_file, " never runs");
+		fprintf(dump_file, "\n");
+
+		for(int i = 0; i < block->inst_ct; i++) {
+			Ssa_inst *inst = &block->insts[i];
+
+			fprintf(dump_file, "\t");
+			if(inst->value >= 0)
+				fprintf(dump_file, "%%%d = ", inst->value);
+			switch(inst->kind) {
+			case SSA_ARG: fprintf(dump_file, "arg %s", inst->arg); break;
+			case SSA_MEM: fprintf(dump_file, "mem %s", ssa->vars[inst->var]); break;
+			case SSA_PHI: fprintf(dump_file, "phi %s", ssa->vars[inst->var]); break;
+			case SSA_CONST: fprintf(dump_file, "const %s", inst->arg != NULL ? inst->arg : ""); break;
+			case SSA_LOAD: fprintf(dump_file, "load %s", ssa->vars[inst->var]); break;
+			case SSA_OP: fprintf(dump_file, inst->arg != NULL ? "%s %s" : "%s", inst->op, inst->arg); break;
+			case SSA_CALL: fprintf(dump_file, "call %s", inst->arg); break;
+			case SSA_STORE: fprintf(dump_file, "store %s", ssa->vars[inst->var]); break;
+			case SSA_NOTE: fprintf(dump_file, "note %s", inst->arg != NULL ? inst->arg : ""); break;
+			}
+			for(int o = 0; o < inst->operand_ct; o++) {
+				if(inst->kind == SSA_PHI)
+					fprintf(dump_file, " [b%d: ", block->preds[o]);
+				else
+					fprintf(dump_file, " ");
+				if(inst->operands[o] >= 0)
+					fprintf(dump_file, "%%%d", inst->operands[o]);
+				else
+					fprintf(dump_file, "?");
+				if(inst->kind == SSA_PHI)
+					fprintf(dump_file, "]");
+			}
+			fprintf(dump_file, "\n");
+		}
+
+		fprintf(dump_file, "\t");
+		switch(block->exit) {
+		case SSA_FALL: fprintf(dump_file, "-> b%d", b + 1); break;
+		case SSA_BRANCH: fprintf(dump_file, "%s", block->exit_op); break;
+		case SSA_JUMP: fprintf(dump_file, "jump -> b%d", block->target); break;
+		case SSA_RETURN: fprintf(dump_file, "return"); break;
+		case SSA_END: fprintf(dump_file, "end"); break;
+		}
+		for(int o = 0; o < block->exit_operand_ct; o++)
+			fprintf(dump_file, " %%%d", block->exit_operands[o]);
+		if(block->exit == SSA_BRANCH)
+			fprintf(dump_file, " -> b%d else b%d", block->target, b + 1);
+		fprintf(dump_file, "\n");
+	}
+}
+
+/** @struct Ssa_emit
+ * What is known while a block is written back out as stack code.
+ */
+typedef struct {
+	Ssa *ssa; ///< The SSA form.
+	Program *out; ///< Where the code is written.
+	int *stack; ///< The values on the stack, deepest first.
+	int depth; ///< Number of values on the stack.
+	int *mem; ///< The value each variable holds in memory, or -1 if not known.
+	char **reason; ///< Set to why writing failed.
+} Ssa_emit;
+
+/**
+ * Returns the instruction defining a value.
+ */
+static Ssa_inst * value_def(Ssa *ssa, int value) {
+	Ssa_block *block = &ssa->blocks[ssa->value_block[value]];
+
+	for(int i = 0; i < block->inst_ct; i++)
+		if(block->insts[i].value == value)
+			return &block->insts[i];
+
+	return NULL;
+}
+
+/**
+ * Pushes a value that is not on the stack: the value of a variable holding it, or a constant again.
+ *
+ * @param emit The state of the writer.
+ * @param value The value.
+ * @param var The variable to load it from if it holds it, or -1.
+ * @return 1 on success, 0 if the value cannot be had again.
+ */
+static int emit_value(Ssa_emit *emit, int value, int var) {
+	Ssa_inst *def = value_def(emit->ssa, value);
+
+	if((var < 0 || emit->mem[var] != value) && def != NULL && def->kind == SSA_CONST) {
+		program_append(emit->out, ASM_INST, "pushi", def->arg);
+		emit->stack[emit->depth++] = value;
+		return 1;
+	}
+
+	if(var < 0 || emit->mem[var] != value)
+		for(var = 0; var < emit->ssa->var_ct && emit->mem[var] != value; var++);
+	if(var >= emit->ssa->var_ct) {
+		*emit->reason = "a value is needed where it is neither on the stack nor in memory";
+		return 0;
+	}
+
+	program_append(emit->out, ASM_INST, "pushi", emit->ssa->vars[var]);
+	program_append(emit->out, ASM_INST, "push", NULL);
+	emit->stack[emit->depth++] = value;
+
+	return 1;
+}
+
+/**
+ * Makes sure operands are on top of the stack, deepest first, pushing them if they are not. Then
+ * takes them off.
+ *
+ * @return 1 on success, 0 if an operand cannot be had.
+ */
+static int emit_operands(Ssa_emit *emit, int *operands, int ct) {
+	int on_top = emit->depth >= ct;
+
+	for(int o = 0; on_top && o < ct; o++)
+		on_top = emit->stack[emit->depth - ct + o] == operands[o];
+	for(int o = 0; !on_top && o < ct; o++)
+		if(!emit_value(emit, operands[o], -1))
+			return 0;
+
+	emit->depth -= ct;
+
+	return 1;
+}
+
+/**
+ * Checks that every variable a successor expects to find in memory holds the value it expects.
+ */
+static int check_succs(Ssa_emit *emit, int b) {
+	Ssa *ssa = emit->ssa;
+	Ssa_block *block = &ssa->blocks[b];
+
+	for(int s = 0; s < block->succ_ct; s++) {
+		Ssa_block *succ = &ssa->blocks[block->succs[s]];
+		int p = 0;
+		char *merged = (char *)calloc(ssa->var_ct + 1, 1);
+		int ok = 1;
+
+		while(succ->preds[p] != b)
+			p++;
+		for(int i = 0; i < succ->inst_ct && succ->insts[i].kind == SSA_PHI; i++) {
+			merged[succ->insts[i].var] = 1;
+			ok &= succ->insts[i].operands[p] == emit->mem[succ->insts[i].var];
+		}
+		for(int v = 0; v < ssa->var_ct; v++)
+			ok &= merged[v] || succ->entry_values == NULL || succ->entry_values[v] < 0 || succ->entry_values[v] == emit->mem[v];
+		free(merged);
+
+		if(!ok) {
+			*emit->reason = "a variable does not hold the value the next block expects";
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Writes one block as stack code.
+ *
+ * @return 1 on success, 0 if it cannot be scheduled.
+ */
+static int emit_block(Ssa_emit *emit, int b) {
+	Ssa *ssa = emit->ssa;
+	Ssa_block *block = &ssa->blocks[b];
+	Program *out = emit->out;
+
+	for(int t = 0; t < block->tag_ct; t++)
+		program_append(out, ASM_TAG, "", block->tags[t]);
+
+	emit->depth = 0;
+	for(int v = 0; v < ssa->var_ct; v++)
+		emit->mem[v] = block->entry_values != NULL ? block->entry_values[v] : -1;
+
+	for(int i = 0; i < block->inst_ct; i++) {
+		Ssa_inst *inst = &block->insts[i];
+
+		switch(inst->kind) {
+		case SSA_ARG:
+			emit->stack[emit->depth++] = inst->value;
+			break;
+		case SSA_MEM:
+		case SSA_PHI:
+			emit->mem[inst->var] = inst->value;
+			break;
+		case SSA_NOTE:
+			program_append(out, ASM_OTHER, "", inst->arg);
+			break;
+		case SSA_CONST:
+			program_append(out, ASM_INST, "pushi", inst->arg);
+			emit->stack[emit->depth++] = inst->value;
+			break;
+		case SSA_LOAD:
+			if(!emit_value(emit, inst->operands[0], inst->var))
+				return 0;
+			emit->stack[emit->depth - 1] = inst->value;
+			break;
+		case SSA_OP:
+			if(!emit_operands(emit, inst->operands, inst->operand_ct))
+				return 0;
+			program_append(out, ASM_INST, inst->op, inst->arg);
+			if(inst->value >= 0)
+				emit->stack[emit->depth++] = inst->value;
+			break;
+		case SSA_CALL:
+			if(!emit_operands(emit, inst->operands, inst->operand_ct))
+				return 0;
+			program_append(out, ASM_INST, "pushi", inst->arg);
+			program_append(out, ASM_INST, "jpush", NULL);
+			emit->stack[emit->depth++] = inst->value;
+			for(int v = 0; v < ssa->var_ct; v++)
+				emit->mem[v] = -1;
+			break;
+		case SSA_STORE:
+			if(!emit_operands(emit, inst->operands, 1))
+				return 0;
+			program_append(out, ASM_INST, "pushi", ssa->vars[inst->var]);
+			program_append(out, ASM_INST, "pop", NULL);
+			emit->mem[inst->var] = inst->operands[0];
+			break;
+		}
+	}
+
+	if(block->exit == SSA_RETURN) {
+		int same = emit->depth == block->exit_operand_ct;
+
+		for(int o = 0; same && o < emit->depth; o++)
+			same = emit->stack[o] == block->exit_operands[o];
+		if(!same) {
+			*emit->reason = "the stack at a return is not what the function leaves";
+			return 0;
+		}
+		program_append(out, ASM_INST, "jr", NULL);
+		return 1;
+	}
+
+	if(block->exit == SSA_BRANCH && !emit_operands(emit, block->exit_operands, block->exit_operand_ct))
+		return 0;
+	if(emit->depth != 0) {
+		*emit->reason = "values are left on the stack at the end of a block";
+		return 0;
+	}
+	if(block->reachable && !check_succs(emit, b)) //What a block that never runs leaves does not matter
+		return 0;
+
+	if(block->exit == SSA_BRANCH) {
+		program_append(out, ASM_INST, block->exit_op, block->exit_label);
+	} else if(block->exit == SSA_JUMP) {
+		program_append(out, ASM_INST, "pushi", block->exit_label);
+		program_append(out, ASM_INST, "jpop", NULL);
+	}
+
+	return 1;
+}
+
+/**
+ * Writes the SSA form back out as stack code, in the order of its blocks. Each value is used from the
+ * stack where it was left, or pushed again when it is a constant or a variable holds it.
+ *
+ * @param ssa The SSA form.
+ * @param out Filled in with the code.
+ * @param reason Set to why writing failed, if it does.
+ * @return 1 on success, 0 if some value cannot be had where it is needed.
+ */
+int ssa_emit(Ssa *ssa, Program *out, char **reason) {
+	int values = 1;
+
+	for(int b = 0; b < ssa->block_ct; b++) {
+		values += ssa->blocks[b].exit_operand_ct;
+		for(int i = 0; i < ssa->blocks[b].inst_ct; i++)
+			values += ssa->blocks[b].insts[i].operand_ct + 1;
+	}
+
+	Ssa_emit emit = {ssa, out, (int *)malloc(values * sizeof(int)), 0, (int *)malloc((ssa->var_ct + 1) * sizeof(int)), reason};
+	int ok = 1;
+
+	memset(out, 0, sizeof(Program));
+	for(int b = 0; ok && b < ssa->block_ct; b++)
+		ok = emit_block(&emit, b);
+
+	free(emit.stack);
+	free(emit.mem);
+
+	return ok;
+}
+
+/**
+ * Frees the memory held by an SSA form.
+ */
+void ssa_free(Ssa *ssa) {
+	for(int b = 0; b < ssa->block_ct; b++) {
+		Ssa_block *block = &ssa->blocks[b];
+
+		for(int t = 0; t < block->tag_ct; t++)
+			free(block->tags[t]);
+		for(int i = 0; i < block->inst_ct; i++) {
+			free(block->insts[i].arg);
+			free(block->insts[i].operands);
+		}
+		free(block->tags);
+		free(block->insts);
+		free(block->exit_label);
+		free(block->exit_operands);
+		free(block->succs);
+		free(block->preds);
+		free(block->entry_values);
+	}
+	for(int v = 0; v < ssa->var_ct; v++)
+		free(ssa->vars[v]);
+
+	free(ssa->blocks);
+	free(ssa->vars);
+	free(ssa->value_block);
+	free(ssa->func);
+	symbol_table_free(&ssa->var_index);
+	memset(ssa, 0, sizeof(Ssa));
+}
@@ -0,0 +1,90 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include "Program.h"
+#include "SymbolTable.h"
+
+/** @enum Ssa_kind
+ * What an instruction of the SSA form does.
+ */
+typedef enum {
+	SSA_ARG, ///< A value the caller left on the stack.
+	SSA_MEM, ///< The value a variable holds in memory at the start of the function or after a call.
+	SSA_PHI, ///< The value of a variable coming from whichever block ran before.
+	SSA_CONST, ///< A constant or the address of a tag.
+	SSA_LOAD, ///< A copy of a variable's value.
+	SSA_OP, ///< A machine instruction working on values, like add.
+	SSA_CALL, ///< A call to a function.
+	SSA_STORE, ///< A store of a value to a variable, which becomes its new value.
+	SSA_NOTE ///< A comment of the generated code, kept where it was.
+} Ssa_kind;
+
+/** @enum Ssa_exit
+ * How a block ends.
+ */
+typedef enum {
+	SSA_FALL, ///< Runs on into the next block.
+	SSA_BRANCH, ///< A conditional branch to a target, otherwise running on into the next block.
+	SSA_JUMP, ///< A jump to a target.
+	SSA_RETURN, ///< A return, leaving its operands on the stack.
+	SSA_END ///< The end of the code, as at the end of main.
+} Ssa_exit;
+
+/** @struct Ssa_inst
+ * One instruction of the SSA form.
+ */
+typedef struct {
+	Ssa_kind kind; ///< What it does.
+	int value; ///< The value it defines, or -1.
+	char op[MACHINE_NAME_LEN]; ///< The machine instruction of an SSA_OP.
+	char *arg; ///< The constant, the operand of an SSA_OP, the function called or the text of a note. May be NULL.
+	int var; ///< The variable it loads, stores, finds in memory or merges, or -1.
+	int *operands; ///< The values it uses, deepest on the stack first. A phi has one for each predecessor.
+	int operand_ct; ///< Number of operands.
+} Ssa_inst;
+
+/** @struct Ssa_block
+ * A basic block of the SSA form. Calls do not end blocks.
+ */
+typedef struct {
+	char **tags; ///< The tags at its start.
+	int tag_ct; ///< Number of tags.
+	Ssa_inst *insts; ///< Its instructions, phis first.
+	int inst_ct; ///< Number of instructions.
+	Ssa_exit exit; ///< How it ends.
+	char exit_op[MACHINE_NAME_LEN]; ///< The branch instruction of an SSA_BRANCH.
+	char *exit_label; ///< The tag a branch or jump names, or NULL.
+	int *exit_operands; ///< The values the branch compares or the return leaves, deepest first.
+	int exit_operand_ct; ///< Number of exit operands.
+	int target; ///< The block a branch or jump goes to, or -1.
+	int *succs; ///< The blocks that may run after it.
+	int succ_ct; ///< Number of successors.
+	int *preds; ///< The blocks that may run before it, in the order of the operands of its phis.
+	int pred_ct; ///< Number of predecessors.
+	int *entry_values; ///< The value each variable holds in memory at the start of the block, or -1 if none is used.
+	int idom; ///< Its immediate dominator, or -1 for the first block and blocks that never run.
+	int reachable; ///< 1 if it can run.
+} Ssa_block;
+
+/** @struct Ssa
+ * The control flow graph of a function with its variables in SSA form.
+ */
+typedef struct {
+	char *func; ///< The function's name.
+	Ssa_block *blocks; ///< The blocks in the order of the code.
+	int block_ct; ///< Number of blocks.
+	char **vars; ///< The names of the variables.
+	int var_ct; ///< Number of variables.
+	Symbol_table var_index; ///< Maps each variable's name to its number.
+	int value_ct; ///< Number of values.
+	int *value_block; ///< The block defining each value.
+} Ssa;
+
+int ssa_build(Ssa *ssa, Program *prog, Machine *machine, Symbol_table *param_cts, char *func, char **reason);
+int ssa_verify(Ssa *ssa);
+int ssa_count(Ssa *ssa, Ssa_kind kind);
+void ssa_dump(Ssa *ssa, FILE *dump_file);
+int ssa_emit(Ssa *ssa, Program *out, char **reason);
+void ssa_free(Ssa *ssa);
+
+#endif
@@ -1,5 +1,5 @@
 #include "Stack.h"
-#include "StringList.h"
+#include "StringOps.h"
 
 /**
  * Adds the passed value to the given stack.
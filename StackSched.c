@@ -0,0 +1,488 @@
+#include "StackSched.h"
+#include "StringOps.h"
+
+/** @struct Sched_var
+ * A variable a loop loads or stores.
+ */
+typedef struct {
+	char *name; ///< The variable.
+	int uses; ///< Loads and stores of it in the loop.
+	int escapes; ///< 1 if the loop uses its address other than to load or store it.
+	int resident; ///< 1 once it is chosen to stay on the stack.
+} Sched_var;
+
+/** @struct Sched_loop
+ * A loop: the code from its tag to the jump back to it.
+ */
+typedef struct {
+	int head; ///< The line of the loop's tag.
+	int back; ///< The line of the jpop that goes back to it.
+	int *depth; ///< For each line from head to back, how many values are on the stack before it, counting from the stack at head.
+	int max_depth; ///< The most values the loop has on the stack.
+	Sched_var *vars; ///< The variables it loads or stores.
+	int var_ct; ///< Number of variables.
+	int accesses; ///< Loads and stores of memory in it.
+} Sched_loop;
+
+/**
+ * Returns the line a tag of the function is on, or -1 if the operand is not one.
+ */
+static int tag_line(Symbol_table *tags, char *arg) {
+	return arg == NULL || machine_is_constant(arg) ? -1 : symbol_table_contains(tags, arg);
+}
+
+/**
+ * Returns 1 if the line starts a load or store of a variable: pushi of its address, then push or pop.
+ */
+static int is_access(Program *prog, Symbol_table *tags, int i) {
+	Asm_line *line = &prog->lines[i];
+
+	return program_is(line, "pushi") && line->arg != NULL && !machine_is_constant(line->arg) && tag_line(tags, line->arg) < 0
+			&& i + 1 < prog->line_ct && (program_is(&prog->lines[i + 1], "push") || program_is(&prog->lines[i + 1], "pop"));
+}
+
+/**
+ * Returns how many entries at the top of the stack an instruction needs. For the instructions that
+ * reach below the values they pop, this is more than it pops.
+ */
+static int reach(Asm_line *line, Machine_inst *inst) {
+	if(program_is(line, "over") || program_is(line, "swap"))
+		return 2;
+	if(program_is(line, "pick") && line->arg != NULL)
+		return atoi(line->arg) + 1;
+	if(program_is(line, "stick") && line->arg != NULL)
+		return atoi(line->arg) + 2;
+
+	return inst->pops;
+}
+
+/**
+ * Notes a use of a variable in a loop.
+ *
+ * @param loop The loop.
+ * @param name The variable.
+ * @param escapes 1 if its address is used other than to load or store it, 0 for a load or store.
+ */
+static void add_use(Sched_loop *loop, char *name, int escapes) {
+	int v = 0;
+
+	while(v < loop->var_ct && strcmp(loop->vars[v].name, name) != 0)
+		v++;
+
+	if(v == loop->var_ct) {
+		loop->vars = (Sched_var *)realloc(loop->vars, (loop->var_ct + 1) * sizeof(Sched_var));
+		loop->vars[loop->var_ct++] = (Sched_var){name, 0, 0, 0};
+	}
+
+	if(escapes)
+		loop->vars[v].escapes = 1;
+	else
+		loop->vars[v].uses++;
+}
+
+/**
+ * Checks that a loop can keep variables on the stack, and works out the depth of the stack at each of
+ * its lines. The loop must only be entered by running on into its tag, must not call or return, and
+ * must leave the stack as it found it wherever it goes back to its tag or out of the loop, so that
+ * the variables kept on the stack are always just below what the loop itself pushes.
+ *
+ * @param prog The function's code.
+ * @param machine The machine description, for each instruction's effect on the stack.
+ * @param tags Maps each tag of the function to its line.
+ * @param loop The loop, with head and back set. The rest is filled in.
+ * @return 1 if it can, 0 otherwise.
+ */
+static int check_loop(Program *prog, Machine *machine, Symbol_table *tags, Sched_loop *loop) {
+	int head = loop->head, back = loop->back;
+	int *entry = (int *)malloc((back - head + 1) * sizeof(int)); //The depth each tag in the loop is reached at
+	int prev = head - 1;
+	int d = 0, live = 1, ok = 1;
+
+	while(prev >= 0 && prog->lines[prev].kind == ASM_OTHER)
+		prev--;
+	if(prev < 0 || program_is(&prog->lines[prev], "jpop") || program_is(&prog->lines[prev], "jr"))
+		ok = 0;
+
+	for(int i = 0; ok && i < prog->line_ct; i++) { //Nothing outside may jump into the loop or to its tag
+		int target = prog->lines[i].kind == ASM_INST ? tag_line(tags, prog->lines[i].arg) : -1;
+
+		if((i < head || i > back) && target >= head && target <= back)
+			ok = 0;
+	}
+
+	for(int i = 0; i <= back - head; i++)
+		entry[i] = -1;
+	entry[0] = 0;
+	loop->max_depth = 0;
+
+	for(int i = head; ok && i <= back; i++) {
+		Asm_line *line = &prog->lines[i];
+		Machine_inst *inst = line->kind == ASM_INST ? machine_inst(machine, line->op) : NULL;
+		int target = -1, jump = 0;
+
+		if(line->kind == ASM_TAG) {
+			if(live && entry[i - head] >= 0 && entry[i - head] != d)
+				ok = 0;
+			else if(live)
+				entry[i - head] = d;
+			else if(entry[i - head] < 0) //Only reached by a jump back from further on
+				ok = 0;
+			else
+				d = entry[i - head];
+			live = 1;
+			loop->depth[i - head] = d;
+			continue;
+		}
+
+		loop->depth[i - head] = d;
+		if(line->kind == ASM_OTHER)
+			continue;
+		if(!live || inst == NULL || program_is(line, "jpush") || program_is(line, "jr")) {
+			ok = 0;
+			continue;
+		}
+
+		if(is_access(prog, tags, i)) {
+			int store = program_is(&prog->lines[i + 1], "pop");
+
+			add_use(loop, line->arg, 0);
+			loop->accesses++;
+			loop->depth[i + 1 - head] = d + 1;
+			if(store && d < 1)
+				ok = 0;
+			d += store ? -1 : 1;
+			i++;
+		} else if(program_is(line, "pushi") && tag_line(tags, line->arg) >= 0) {
+			if(i == back || !program_is(&prog->lines[i + 1], "jpop")) { //A tag's address used as data, like a jump table
+				ok = 0;
+				continue;
+			}
+			loop->depth[i + 1 - head] = d + 1;
+			target = tag_line(tags, line->arg);
+			jump = 1;
+			i++;
+		} else if(program_is(line, "push") || program_is(line, "pop") || program_is(line, "jpop")) { //An address computed at run time
+			ok = 0;
+			continue;
+		} else {
+			if(program_is(line, "pushi") && line->arg != NULL && !machine_is_constant(line->arg))
+				add_use(loop, line->arg, 1);
+			if(d < reach(line, inst))
+				ok = 0;
+			d += inst->pushes - inst->pops;
+			if(inst->operand == OPERAND_LABEL && (target = tag_line(tags, line->arg)) < 0)
+				ok = 0;
+		}
+
+		if(d > loop->max_depth)
+			loop->max_depth = d;
+
+		if(target >= 0) {
+			if(target <= head || target > back) { //Back to the loop's tag, or out of the loop
+				if(d != 0)
+					ok = 0;
+			} else if(entry[target - head] >= 0 && entry[target - head] != d) {
+				ok = 0;
+			} else {
+				entry[target - head] = d;
+			}
+			if(jump)
+				live = 0;
+		}
+	}
+
+	free(entry);
+
+	return ok;
+}
+
+/**
+ * Returns the cycles and then the bytes one or two instructions take, as one number to compare, or -1
+ * if the target lacks one of them.
+ */
+static int cost(Machine *machine, char *a, char *b) {
+	Machine_inst *x = machine_inst(machine, a);
+	Machine_inst *y = b != NULL ? machine_inst(machine, b) : NULL;
+
+	if(x == NULL || (b != NULL && y == NULL))
+		return -1;
+
+	return (x->cycles + (y != NULL ? y->cycles : 0)) * 1000 + x->bytes + (y != NULL ? y->bytes : 0);
+}
+
+/**
+ * Writes the cheapest instruction the target has for copying the value n entries below the top of the
+ * stack onto the top: dup, over or pick n.
+ *
+ * @return 1 if written, 0 if the target has no way to.
+ */
+static int emit_copy(Program *out, Machine *machine, int n) {
+	char *ops[] = {n == 0 ? "dup" : NULL, n == 1 ? "over" : NULL, "pick"};
+	char *best = NULL;
+	int best_cost = 0;
+	char imm[STR_LEN];
+
+	for(int o = 0; o < 3; o++) {
+		int c = ops[o] != NULL ? cost(machine, ops[o], NULL) : -1;
+
+		if(c >= 0 && (best == NULL || c < best_cost)) {
+			best = ops[o];
+			best_cost = c;
+		}
+	}
+
+	if(best == NULL)
+		return 0;
+
+	snprintf(imm, STR_LEN, "%d", n);
+	program_append(out, ASM_INST, best, strcmp(best, "pick") == 0 ? imm : NULL);
+
+	return 1;
+}
+
+/**
+ * Writes the cheapest instructions the target has for popping the top of the stack into the entry n
+ * below the new top: swap and drop, or stick n.
+ *
+ * @return 1 if written, 0 if the target has no way to.
+ */
+static int emit_replace(Program *out, Machine *machine, int n) {
+	int swap_cost = n == 0 ? cost(machine, "swap", "drop") : -1;
+	int stick_cost = cost(machine, "stick", NULL);
+	char imm[STR_LEN];
+
+	if(swap_cost >= 0 && (stick_cost < 0 || swap_cost <= stick_cost)) {
+		program_append(out, ASM_INST, "swap", NULL);
+		program_append(out, ASM_INST, "drop", NULL);
+	} else if(stick_cost >= 0) {
+		snprintf(imm, STR_LEN, "%d", n);
+		program_append(out, ASM_INST, "stick", imm);
+	} else {
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Returns which of the variables kept on the stack a name is, or -1 if it is none of them.
+ */
+static int resident(Sched_var **res, int res_ct, char *name) {
+	for(int r = 0; r < res_ct; r++)
+		if(strcmp(res[r]->name, name) == 0)
+			return r;
+
+	return -1;
+}
+
+/**
+ * Writes the code that leaves a loop by one of its exits: each variable kept on the stack is stored
+ * back to memory, then the exit goes where it went before.
+ *
+ * @param out The code being written.
+ * @param stub The exit's tag.
+ * @param res The variables kept on the stack, deepest first.
+ * @param res_ct Number of them.
+ * @param target Where the exit goes, or NULL when it runs on into there.
+ */
+static void emit_spill(Program *out, char *stub, Sched_var **res, int res_ct, char *target) {
+	program_append(out, ASM_TAG, "", stub);
+	for(int r = res_ct - 1; r >= 0; r--) {
+		program_append(out, ASM_INST, "pushi", res[r]->name);
+		program_append(out, ASM_INST, "pop", NULL);
+	}
+
+	if(target != NULL) {
+		program_append(out, ASM_INST, "pushi", target);
+		program_append(out, ASM_INST, "jpop", NULL);
+	}
+}
+
+/**
+ * Keeps the most used variables of a loop on the stack. They are loaded before its tag, each load and
+ * store in the loop becomes a copy to or from their entry on the stack, and each exit stores them back
+ * on its way out.
+ *
+ * @param prog The function's code, rewritten in place if the loop is changed.
+ * @param machine The machine description.
+ * @param tags Maps each tag of the function to its line.
+ * @param loop The loop, as checked by check_loop.
+ * @param func The function's name, to name new tags after.
+ * @param stub_ct Number of tags made so far in the function, counted up.
+ * @param stats Counted up with what was done.
+ * @return The line of the jump back to the loop's tag in the new code, or -1 if the loop was left as it was.
+ */
+static int schedule(Program *prog, Machine *machine, Symbol_table *tags, Sched_loop *loop, char *func, int *stub_ct, Stack_sched_stats *stats) {
+	Sched_var *res[STACK_SCHED_MAX_VARS];
+	int res_ct = 0, limit = STACK_SCHED_MAX_VARS;
+	int head = loop->head, back = loop->back;
+
+	if(machine->stack_size > 0 && strcmp(func, "main") != 0) //Callers may need the rest of the stack
+		limit = 0;
+	else if(machine->stack_size > 0 && machine->stack_size - loop->max_depth < limit)
+		limit = machine->stack_size - loop->max_depth;
+
+	while(res_ct < limit) { //The most used first
+		Sched_var *best = NULL;
+
+		for(int v = 0; v < loop->var_ct; v++) {
+			Sched_var *var = &loop->vars[v];
+
+			if(!var->escapes && !var->resident && var->uses > 0 && (best == NULL || var->uses > best->uses))
+				best = var;
+		}
+		if(best == NULL)
+			break;
+		best->resident = 1;
+		res[res_ct++] = best;
+	}
+
+	if(res_ct == 0)
+		return -1;
+
+	Program out = {0};
+	char **exits = NULL;
+	int exit_ct = 0, fall = -1, new_back = -1, saved = 0, ok = 1;
+	char stub[STR_LEN];
+
+	for(int i = 0; i < head; i++)
+		program_copy_line(&out, &prog->lines[i]);
+	for(int r = 0; r < res_ct; r++) {
+		program_append(&out, ASM_INST, "pushi", res[r]->name);
+		program_append(&out, ASM_INST, "push", NULL);
+	}
+
+	for(int i = head; ok && i <= back; i++) {
+		Asm_line *line = &prog->lines[i];
+		int r = is_access(prog, tags, i) ? resident(res, res_ct, line->arg) : -1;
+		int d = loop->depth[i - head];
+		int target = line->kind == ASM_INST ? tag_line(tags, line->arg) : -1;
+
+		if(i == back)
+			new_back = out.line_ct;
+
+		if(r >= 0) {
+			if(program_is(&prog->lines[i + 1], "push"))
+				ok = emit_copy(&out, machine, d + res_ct - 1 - r);
+			else
+				ok = emit_replace(&out, machine, d - 1 + res_ct - 1 - r);
+			saved++;
+			i++;
+		} else if(target >= 0 && (target < head || target > back)) {
+			int e = 0;
+
+			while(e < exit_ct && strcmp(exits[e], line->arg) != 0)
+				e++;
+			if(e == exit_ct) {
+				exits = (char **)realloc(exits, (exit_ct + 1) * sizeof(char *));
+				exits[exit_ct++] = line->arg;
+			}
+			snprintf(stub, STR_LEN, "sched_%s_%d", func, *stub_ct + e);
+			program_append(&out, ASM_INST, line->op, stub);
+		} else {
+			program_copy_line(&out, line);
+		}
+	}
+
+	for(int i = back + 1; i < prog->line_ct && prog->lines[i].kind == ASM_TAG; i++) //The exit the loop runs on into
+		for(int e = 0; e < exit_ct; e++)
+			if(strcmp(exits[e], prog->lines[i].arg) == 0)
+				fall = e;
+
+	for(int e = 0; ok && e < exit_ct; e++) {
+		if(e == fall)
+			continue;
+		snprintf(stub, STR_LEN, "sched_%s_%d", func, *stub_ct + e);
+		emit_spill(&out, stub, res, res_ct, exits[e]);
+	}
+	if(ok && fall >= 0) {
+		snprintf(stub, STR_LEN, "sched_%s_%d", func, *stub_ct + fall);
+		emit_spill(&out, stub, res, res_ct, NULL);
+	}
+
+	for(int i = back + 1; ok && i < prog->line_ct; i++)
+		program_copy_line(&out, &prog->lines[i]);
+
+	free(exits);
+
+	if(!ok) {
+		program_free(&out);
+		return -1;
+	}
+
+	*stub_ct += exit_ct;
+	stats->loops++;
+	stats->vars += res_ct;
+	stats->accesses_before += loop->accesses;
+	stats->accesses_after += loop->accesses - saved;
+
+	program_free(prog);
+	*prog = out;
+
+	return new_back;
+}
+
+/**
+ * Fills in a table mapping each tag of the function to its line.
+ */
+static void find_tags(Program *prog, Symbol_table *tags) {
+	symbol_table_init(tags);
+	for(int i = 0; i < prog->line_ct; i++)
+		if(prog->lines[i].kind == ASM_TAG)
+			symbol_table_add(tags, prog->lines[i].arg, i);
+}
+
+/**
+ * Stack scheduling of loops, after Koopman. Every read of a variable is otherwise a load from memory
+ * and every write a store, while the stack is idle between statements. In each loop that makes no
+ * calls, the most used variables are loaded onto the stack before it starts, read and written there
+ * with the target's stack instructions (dup, over, pick, swap, drop and stick), and stored back to
+ * memory on the way out. Inner loops are done first, so an outer loop can then keep its own
+ * variables below theirs. Nothing is done on a target without those instructions. When the machine
+ * description gives the size of the stack, only main's loops are done, and only as far as the stack
+ * holds, since how deep the stack already is when another function is called is not known here.
+ *
+ * @param prog The function's code, rewritten in place.
+ * @param machine The machine description, for which stack instructions the target has and their costs.
+ * @param func The function's name, to name new tags after.
+ * @param stats Filled in with what was done.
+ */
+void stack_sched_run(Program *prog, Machine *machine, char *func, Stack_sched_stats *stats) {
+	Symbol_table tags;
+	int stub_ct = 0;
+
+	memset(stats, 0, sizeof(Stack_sched_stats));
+	if(machine_inst(machine, "dup") == NULL && machine_inst(machine, "over") == NULL && machine_inst(machine, "pick") == NULL)
+		return;
+
+	find_tags(prog, &tags);
+
+	for(int i = 1; i < prog->line_ct; i++) {
+		if(!program_is(&prog->lines[i], "jpop") || !program_is(&prog->lines[i - 1], "pushi"))
+			continue;
+
+		Sched_loop loop = {tag_line(&tags, prog->lines[i - 1].arg), i, NULL, 0, NULL, 0, 0};
+
+		if(loop.head < 0 || loop.head > i)
+			continue;
+
+		int new_back = -1;
+
+		loop.depth = (int *)malloc((i - loop.head + 1) * sizeof(int));
+		if(check_loop(prog, machine, &tags, &loop))
+			new_back = schedule(prog, machine, &tags, &loop, func, &stub_ct, stats);
+
+		if(new_back < 0) {
+			stats->skipped++;
+		} else {
+			i = new_back;
+			symbol_table_free(&tags);
+			find_tags(prog, &tags);
+		}
+
+		free(loop.depth);
+		free(loop.vars);
+	}
+
+	symbol_table_free(&tags);
+}
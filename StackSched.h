@@ -0,0 +1,21 @@
+#ifndef STACK_SCHED_H
+#define STACK_SCHED_H
+
+#include "Program.h"
+
+#define STACK_SCHED_MAX_VARS 4 ///< The most variables one loop keeps on the stack.
+
+/** @struct Stack_sched_stats
+ * What stack scheduling did to one function.
+ */
+typedef struct {
+	int loops; ///< Loops that keep variables on the stack.
+	int skipped; ///< Loops left as they were.
+	int vars; ///< Variables kept on the stack, counted once for each loop.
+	int accesses_before; ///< Loads and stores of memory in the bodies of those loops before.
+	int accesses_after; ///< And after.
+} Stack_sched_stats;
+
+void stack_sched_run(Program *prog, Machine *machine, char *func, Stack_sched_stats *stats);
+
+#endif
@@ -2,8 +2,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#include "StringOps.h"
+
 #define LIST_LEN 100
-#define STR_LEN 100
 
 /** @struct String_list
  * Holds a short list of strings representing variables.
@@ -36,6 +36,45 @@ int str_inst_ct(char *base, char *search) {
 	return ct;
 }
 
+/**
+ * Hashes a block of bytes with 64 bit FNV-1a. Long texts can be hashed in parts by passing the
+ * hash of the earlier parts back in.
+ *
+ * @param data The bytes to be hashed.
+ * @param len The number of bytes.
+ * @param hash STR_HASH_SEED, or the hash of the text before data.
+ * @return The hash of everything so far.
+ */
+unsigned long long str_hash(const char *data, size_t len, unsigned long long hash) {
+	for(size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+/**
+ * Returns the number of times a character appears in a string.
+ *
+ * @param str String to be searched through.
+ * @param c Character to be counted.
+ * @return Number of times c appears in str.
+ */
+int str_char_ct(char *str, char c) {
+	int ct = 0;
+
+	if(str == NULL)
+		return 0;
+
+	while((str = strchr(str, c)) != NULL) {
+		ct++;
+		str++;
+	}
+
+	return ct;
+}
+
 /**
  * Returns the value of the string as an integer.
  * e.g. "123" -> 123
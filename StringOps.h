@@ -2,7 +2,12 @@
 #include <string.h>
 #include <stdio.h>
 
+#define STR_LEN 100
+#define STR_HASH_SEED 14695981039346656037ull ///< Starting value for str_hash.
+
 int char_is_letter(char input);
 int str_inst_ct(char *base, char *search);
+int str_char_ct(char *str, char c);
+unsigned long long str_hash(const char *data, size_t len, unsigned long long hash);
 int str_to_int(char *str);
 char * clean_str(char *str);
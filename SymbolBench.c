@@ -0,0 +1,137 @@
+#include <time.h>
+
+#include "StringList.h"
+#include "SymbolTable.h"
+
+/**
+ * Micro-benchmark comparing the old String_list bucket set with the open addressing Symbol_table.
+ * Run with "make bench". Each size inserts that many variable names, then looks every one of them
+ * up, then looks up as many names that are not there.
+ *
+ * Each String_list bucket only holds LIST_LEN names, so the old set cannot take much more than
+ * LIST_LEN * LIST_LEN names. Names that would overflow their bucket are skipped, and the number
+ * actually held is printed next to its timings.
+ */
+
+/**
+ * Returns the current time in nanoseconds.
+ */
+static double now_ns() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Fills names with n variable names shaped like the ones the compiler generates.
+ *
+ * @param names Array of n strings of STR_LEN characters to be written to.
+ * @param n Number of names.
+ * @param func Function name to prefix each name with.
+ */
+static void make_names(char (*names)[STR_LEN], int n, char *func) {
+	for(int i = 0; i < n; i++)
+		snprintf(names[i], STR_LEN, "%s_var%d", func, i);
+}
+
+/**
+ * Times the old String_list set.
+ *
+ * @param names The names to be inserted.
+ * @param misses Names that are never inserted.
+ * @param n Number of names in each array.
+ */
+static void bench_string_set(char (*names)[STR_LEN], char (*misses)[STR_LEN], int n) {
+	String_list *set = (String_list *)calloc(LIST_LEN, sizeof(String_list));
+	char *held = (char *)calloc(n, 1);
+	int held_ct = 0;
+	double start, insert_ns, hit_ns, miss_ns;
+	long found = 0;
+
+	start = now_ns();
+	for(int i = 0; i < n; i++) {
+		if(set[hash_func(names[i])].length < LIST_LEN) { //string_set_add would write past the bucket otherwise
+			string_set_add(set, names[i], i + 1);
+			held[i] = 1;
+			held_ct++;
+		}
+	}
+	insert_ns = now_ns() - start;
+
+	start = now_ns();
+	for(int i = 0; i < n; i++)
+		if(held[i])
+			found += string_set_contains(set, names[i]) != 0;
+	hit_ns = now_ns() - start;
+
+	start = now_ns();
+	for(int i = 0; i < n; i++)
+		found += string_set_contains(set, misses[i]) != 0;
+	miss_ns = now_ns() - start;
+
+	printf("%-12s %8d %8d %10.1f %10.1f %10.1f %8ld\n", "String_list", n, held_ct,
+		   insert_ns / held_ct, hit_ns / held_ct, miss_ns / n, found);
+
+	free(held);
+	free(set);
+}
+
+/**
+ * Times the open addressing Symbol_table.
+ *
+ * @param names The names to be inserted.
+ * @param misses Names that are never inserted.
+ * @param n Number of names in each array.
+ */
+static void bench_symbol_table(char (*names)[STR_LEN], char (*misses)[STR_LEN], int n) {
+	Symbol_table table;
+	double start, insert_ns, hit_ns, miss_ns;
+	long found = 0;
+
+	symbol_table_init(&table);
+
+	start = now_ns();
+	for(int i = 0; i < n; i++)
+		symbol_table_add(&table, names[i], i + 1);
+	insert_ns = now_ns() - start;
+
+	start = now_ns();
+	for(int i = 0; i < n; i++)
+		found += symbol_table_contains(&table, names[i]) >= 0;
+	hit_ns = now_ns() - start;
+
+	start = now_ns();
+	for(int i = 0; i < n; i++)
+		found += symbol_table_contains(&table, misses[i]) >= 0;
+	miss_ns = now_ns() - start;
+
+	printf("%-12s %8d %8d %10.1f %10.1f %10.1f %8ld\n", "Symbol_table", n, table.length,
+		   insert_ns / n, hit_ns / n, miss_ns / n, found);
+
+	symbol_table_free(&table);
+}
+
+int main(int argc, char *argv[]) {
+	int sizes[] = {10000, 100000, 1000000};
+
+	printf("%-12s %8s %8s %10s %10s %10s %8s\n", "table", "symbols", "held", "insert ns", "hit ns", "miss ns", "found");
+
+	for(int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		int n = sizes[i];
+		char (*names)[STR_LEN] = malloc((size_t)n * STR_LEN);
+		char (*misses)[STR_LEN] = malloc((size_t)n * STR_LEN);
+
+		make_names(names, n, "func");
+		make_names(misses, n, "other");
+
+		bench_string_set(names, misses, n);
+		bench_symbol_table(names, misses, n);
+
+		free(names);
+		free(misses);
+	}
+
+	return 0;
+}
@@ -0,0 +1,303 @@
+#include "SymbolTable.h"
+
+/** @struct Intern_pool
+ * Holds one copy of every key ever added to a Symbol_table, so tables only need to store
+ * small integer handles and can be copied without touching any strings.
+ */
+typedef struct {
+	char *chars; ///< Every interned string, each followed by its '\0'.
+	int length; ///< Bytes of chars in use.
+	int size; ///< Bytes allocated for chars.
+	Symbol_slot *index; ///< Open addressing index from a string's hash to its handle.
+	int capacity; ///< Number of slots in the index. Always a power of two.
+	int count; ///< Number of strings interned.
+} Intern_pool;
+
+static Intern_pool pool = {NULL, 0, 0, NULL, 0, 0};
+
+/**
+ * Returns a hash of the passed string.
+ * FNV-1a followed by a final mix so that the low bits, which pick the slot, depend on every character.
+ *
+ * @param str The string to be hashed. Will not be modified.
+ * @return Hash code representing str. Never 0, since 0 marks an empty slot.
+ */
+unsigned int symbol_hash(char *str) {
+	unsigned int hash = 2166136261u;
+	unsigned char c;
+
+	while((c = (unsigned char)*str++)) {
+		hash ^= c;
+		hash *= 16777619u;
+	}
+
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35u;
+	hash ^= hash >> 16;
+
+	return hash == 0 ? 1 : hash;
+}
+
+/**
+ * Finds the slot in an index that either holds the given key or is the empty slot where it belongs.
+ *
+ * @param slots The slots to be searched through.
+ * @param capacity The number of slots. Must be a power of two.
+ * @param hash The hash of the key.
+ * @param key The handle of the key.
+ * @return The index of the slot.
+ */
+static int find_slot(Symbol_slot *slots, int capacity, unsigned int hash, int key) {
+	int mask = capacity - 1;
+	int i = hash & mask;
+
+	while(slots[i].hash != 0 && (slots[i].hash != hash || slots[i].key != key))
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+/**
+ * Looks up the handle of an interned string without adding it.
+ *
+ * @param str The string to be searched for.
+ * @param hash The hash of str.
+ * @return The handle of str, or -1 if it has never been interned.
+ */
+static int intern_find(char *str, unsigned int hash) {
+	if(pool.capacity == 0)
+		return -1;
+
+	int mask = pool.capacity - 1;
+	int i = hash & mask;
+
+	while(pool.index[i].hash != 0) {
+		if(pool.index[i].hash == hash && strcmp(pool.chars + pool.index[i].key, str) == 0)
+			return pool.index[i].key;
+		i = (i + 1) & mask;
+	}
+
+	return -1;
+}
+
+/**
+ * Returns the handle of the passed string, adding it to the intern pool if it is new.
+ * Two equal strings always get the same handle, so handles can be compared instead of strings.
+ *
+ * @param str The string to be interned.
+ * @param hash The hash of str, from symbol_hash.
+ * @return The handle of str.
+ */
+int symbol_intern(char *str, unsigned int hash) {
+	int key = intern_find(str, hash);
+	int len = strlen(str) + 1;
+
+	if(key >= 0)
+		return key;
+
+	if((pool.count + 1) * 4 > pool.capacity * 3) { //Keep the index at most three quarters full
+		int capacity = pool.capacity == 0 ? SYMBOL_TABLE_MIN : pool.capacity * 2;
+		Symbol_slot *index = (Symbol_slot *)calloc(capacity, sizeof(Symbol_slot));
+
+		for(int i = 0; i < pool.capacity; i++)
+			if(pool.index[i].hash != 0)
+				index[find_slot(index, capacity, pool.index[i].hash, pool.index[i].key)] = pool.index[i];
+
+		free(pool.index);
+		pool.index = index;
+		pool.capacity = capacity;
+	}
+
+	if(pool.length + len > pool.size) {
+		pool.size = pool.size == 0 ? 1024 : pool.size * 2;
+		while(pool.length + len > pool.size)
+			pool.size *= 2;
+		pool.chars = (char *)realloc(pool.chars, pool.size);
+	}
+
+	key = pool.length;
+	strcpy(pool.chars + key, str);
+	pool.length += len;
+
+	pool.index[find_slot(pool.index, pool.capacity, hash, key)] = (Symbol_slot){hash, key, 0};
+	pool.count++;
+
+	return key;
+}
+
+/**
+ * Returns the string behind an interned handle.
+ * The returned string is only valid until the next string is interned.
+ *
+ * @param key The handle of the string.
+ * @return The interned string.
+ */
+char * symbol_key_str(int key) {
+	return pool.chars + key;
+}
+
+/**
+ * Initializes an empty symbol table.
+ *
+ * @param table The table to be initialized.
+ */
+void symbol_table_init(Symbol_table *table) {
+	table->slots = (Symbol_slot *)calloc(SYMBOL_TABLE_MIN, sizeof(Symbol_slot));
+	table->capacity = SYMBOL_TABLE_MIN;
+	table->length = 0;
+}
+
+/**
+ * Frees the memory held by a symbol table. The interned keys stay in the pool.
+ *
+ * @param table The table to be freed.
+ */
+void symbol_table_free(Symbol_table *table) {
+	free(table->slots);
+	table->slots = NULL;
+	table->capacity = 0;
+	table->length = 0;
+}
+
+/**
+ * Doubles the number of slots in the table and reinserts every entry.
+ *
+ * @param table The table to be grown.
+ */
+static void symbol_table_grow(Symbol_table *table) {
+	int capacity = table->capacity * 2;
+	Symbol_slot *slots = (Symbol_slot *)calloc(capacity, sizeof(Symbol_slot));
+
+	for(int i = 0; i < table->capacity; i++)
+		if(table->slots[i].hash != 0)
+			slots[find_slot(slots, capacity, table->slots[i].hash, table->slots[i].key)] = table->slots[i];
+
+	free(table->slots);
+	table->slots = slots;
+	table->capacity = capacity;
+}
+
+/**
+ * Adds the passed string into the table. If it is already there, its address is updated.
+ *
+ * @param table The table to be edited.
+ * @param str The string to be added to the table.
+ * @param addr The address where the variable named by str is stored.
+ */
+void symbol_table_add(Symbol_table *table, char str[], int addr) {
+	unsigned int hash = symbol_hash(str);
+	int key = symbol_intern(str, hash);
+
+	if((table->length + 1) * 4 > table->capacity * 3)
+		symbol_table_grow(table);
+
+	int i = find_slot(table->slots, table->capacity, hash, key);
+
+	if(table->slots[i].hash == 0)
+		table->length++;
+
+	table->slots[i] = (Symbol_slot){hash, key, addr};
+}
+
+/**
+ * Removes the passed string from the table.
+ * The entries after it in its probe sequence are shifted back, so no tombstones are needed.
+ *
+ * @param table The table to be edited.
+ * @param str The string to be removed from the table.
+ * @return The memory address of str if the removal is successful, -1 otherwise.
+ */
+int symbol_table_remove(Symbol_table *table, char str[]) {
+	unsigned int hash = symbol_hash(str);
+	int key = intern_find(str, hash);
+
+	if(key < 0)
+		return -1;
+
+	int mask = table->capacity - 1;
+	int i = find_slot(table->slots, table->capacity, hash, key);
+
+	if(table->slots[i].hash == 0)
+		return -1;
+
+	int ret_addr = table->slots[i].addr;
+	int j = i;
+
+	while(1) {
+		table->slots[i].hash = 0;
+
+		do { //Find the next entry that may be moved into the hole at i
+			j = (j + 1) & mask;
+			if(table->slots[j].hash == 0) {
+				table->length--;
+				return ret_addr;
+			}
+		} while(((j - (int)(table->slots[j].hash & mask)) & mask) < ((j - i) & mask));
+
+		table->slots[i] = table->slots[j];
+		i = j;
+	}
+}
+
+/**
+ * Checks if the table contains a string matching the passed string.
+ *
+ * @param table The table to be searched through.
+ * @param str The string to be searched for.
+ * @return The memory address of str if the string is contained in the table, -1 otherwise.
+ */
+int symbol_table_contains(Symbol_table *table, char str[]) {
+	unsigned int hash = symbol_hash(str);
+	int key = intern_find(str, hash);
+
+	if(key < 0)
+		return -1;
+
+	int i = find_slot(table->slots, table->capacity, hash, key);
+
+	return table->slots[i].hash == 0 ? -1 : table->slots[i].addr;
+}
+
+/**
+ * Duplicates the orig table into the dest table. Only the slots are copied, since keys are interned.
+ *
+ * @param dest An uninitialized table to be copied into.
+ * @param orig The table that is read from.
+ */
+void symbol_table_cpy(Symbol_table *dest, Symbol_table *orig) {
+	dest->slots = (Symbol_slot *)malloc(orig->capacity * sizeof(Symbol_slot));
+	memcpy(dest->slots, orig->slots, orig->capacity * sizeof(Symbol_slot));
+	dest->capacity = orig->capacity;
+	dest->length = orig->length;
+}
+
+/**
+ * Returns the key held in one slot of the table. Used to walk through every entry.
+ *
+ * @param table The table to be read.
+ * @param slot The index of the slot, from 0 up to the table's capacity.
+ * @return The key in the slot, or NULL if the slot is empty.
+ */
+char * symbol_table_slot_key(Symbol_table *table, int slot) {
+	if(table->slots[slot].hash == 0)
+		return NULL;
+
+	return symbol_key_str(table->slots[slot].key);
+}
+
+/**
+ * Prints the passed table. Only used for debugging.
+ *
+ * @param table The table to be printed.
+ */
+void print_symbol_table(Symbol_table *table) {
+	printf("---------------------------\n");
+	printf("\tL: %d / %d\n", table->length, table->capacity);
+	for(int i = 0; i < table->capacity; i++) {
+		if(table->slots[i].hash != 0)
+			printf("\t%d: %s:\n\t%#x\n", i, symbol_key_str(table->slots[i].key), table->slots[i].addr);
+	}
+	printf("---------------------------\n");
+}
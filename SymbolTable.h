@@ -0,0 +1,44 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define SYMBOL_TABLE_MIN 16
+
+/** @struct Symbol_slot
+ * One slot of a Symbol_table. Kept small so that a probe sequence stays within a cache line or two.
+ */
+typedef struct {
+	unsigned int hash; ///< The full hash of the key. 0 marks an empty slot.
+	int key; ///< Handle of the interned key, see symbol_intern.
+	int addr; ///< The memory address reserved for this variable.
+} Symbol_slot;
+
+/** @struct Symbol_table
+ * Open addressing hash table mapping variable names to their memory addresses.
+ * Uses linear probing and grows once it is three quarters full, so lookups stay fast no matter
+ * how many variables a function has.
+ */
+typedef struct {
+	Symbol_slot *slots; ///< The slots of the table.
+	int capacity; ///< The number of slots. Always a power of two.
+	int length; ///< The number of slots in use.
+} Symbol_table;
+
+unsigned int symbol_hash(char *str);
+int symbol_intern(char *str, unsigned int hash);
+char * symbol_key_str(int key);
+
+void symbol_table_init(Symbol_table *table);
+void symbol_table_free(Symbol_table *table);
+void symbol_table_add(Symbol_table *table, char str[], int addr);
+int symbol_table_remove(Symbol_table *table, char str[]);
+int symbol_table_contains(Symbol_table *table, char str[]);
+void symbol_table_cpy(Symbol_table *dest, Symbol_table *orig);
+char * symbol_table_slot_key(Symbol_table *table, int slot);
+
+void print_symbol_table(Symbol_table *table);
+
+#endif
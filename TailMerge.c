@@ -0,0 +1,182 @@
+#include "TailMerge.h"
+
+/** @struct Tail_exit
+ * Straight-line code that always goes on to the same place: a return, a jump to a tag, or the tag
+ * right after it.
+ */
+typedef struct {
+	int start; ///< The first line of the straight-line code.
+	int end; ///< The last line of the straight-line code, before the exit. Below start if there is none.
+	int exit_len; ///< Lines making up the exit: 1 for jr, 2 for pushi and jpop, 0 when running on into a tag.
+	char *target; ///< The tag it goes on to, or NULL for a return.
+} Tail_exit;
+
+/**
+ * Returns 1 if the line can be part of the straight-line code before an exit, 0 otherwise.
+ */
+static int straight_line(Asm_line *line) {
+	if(line->kind != ASM_INST)
+		return 0;
+
+	return !program_is(line, "jpop") && !program_is(line, "jr") && !(line->op[0] == 'b' && line->arg != NULL);
+}
+
+/**
+ * Returns 1 if the two lines are the same instruction, 0 otherwise.
+ */
+static int same_line(Asm_line *a, Asm_line *b) {
+	if(a->kind != ASM_INST || b->kind != ASM_INST || strcmp(a->op, b->op) != 0)
+		return 0;
+	if(a->arg == NULL || b->arg == NULL)
+		return a->arg == b->arg;
+
+	return strcmp(a->arg, b->arg) == 0;
+}
+
+/**
+ * Finds every exit in a program.
+ *
+ * @param prog The program.
+ * @param exits Set to the exits found. Must be freed.
+ * @return Number of exits.
+ */
+static int find_exits(Program *prog, Tail_exit **exits) {
+	int exit_ct = 0;
+
+	*exits = NULL;
+
+	for(int i = 0; i < prog->line_ct; i++) {
+		Asm_line *line = &prog->lines[i];
+		Tail_exit exit = {0, i - 1, 0, NULL};
+
+		if(program_is(line, "jr")) {
+			exit.exit_len = 1;
+		} else if(program_is(line, "jpop") && i > 0 && program_is(&prog->lines[i - 1], "pushi") && !machine_is_constant(prog->lines[i - 1].arg)) {
+			exit.end = i - 2;
+			exit.exit_len = 2;
+			exit.target = prog->lines[i - 1].arg;
+		} else if(line->kind == ASM_TAG && i > 0 && straight_line(&prog->lines[i - 1])) {
+			exit.target = line->arg;
+		} else {
+			continue;
+		}
+
+		exit.start = exit.end + 1;
+		while(exit.start > 0 && straight_line(&prog->lines[exit.start - 1]))
+			exit.start--;
+
+		*exits = (Tail_exit *)realloc(*exits, (exit_ct + 1) * sizeof(Tail_exit));
+		(*exits)[exit_ct++] = exit;
+	}
+
+	return exit_ct;
+}
+
+/**
+ * Returns how many instructions two exits share at the end of their straight-line code.
+ */
+static int common_suffix(Program *prog, Tail_exit *a, Tail_exit *b) {
+	int len = 0;
+
+	while(a->end - len >= a->start && b->end - len >= b->start && same_line(&prog->lines[a->end - len], &prog->lines[b->end - len]))
+		len++;
+
+	return len;
+}
+
+/**
+ * Returns the bytes taken by some lines of a program.
+ */
+static int lines_bytes(Program *prog, Machine *machine, int first, int last) {
+	int bytes = 0;
+
+	for(int i = first; i <= last; i++) {
+		Machine_inst *inst = prog->lines[i].kind == ASM_INST ? machine_inst(machine, prog->lines[i].op) : NULL;
+
+		if(inst != NULL)
+			bytes += inst->bytes;
+	}
+
+	return bytes;
+}
+
+/**
+ * Tail merging, or cross-jumping. When two pieces of straight-line code go on to the same place and
+ * end with the same instructions, one copy of those instructions is replaced by a jump to the other,
+ * which gets a tag of its own. The pair that saves the most instruction memory is merged first, and
+ * this repeats until no merge saves anything.
+ *
+ * @param prog The function's code, rewritten in place.
+ * @param machine The machine description, for the size of each instruction.
+ * @param func The function's name, to name new tags after.
+ * @param stats Filled in with what was saved.
+ */
+void tail_merge_run(Program *prog, Machine *machine, char *func, Tail_merge_stats *stats) {
+	int jump_bytes = machine_inst(machine, "pushi")->bytes + machine_inst(machine, "jpop")->bytes;
+	int start_bytes = program_bytes(prog, machine);
+
+	memset(stats, 0, sizeof(Tail_merge_stats));
+
+	while(1) {
+		Tail_exit *exits;
+		int exit_ct = find_exits(prog, &exits);
+		Tail_exit *keep = NULL, *drop = NULL;
+		int best_len = 0, best_saving = 0;
+
+		for(int i = 0; i < exit_ct; i++)
+			for(int j = 0; j < exit_ct; j++) {
+				Tail_exit *a = &exits[i], *b = &exits[j];
+
+				if(i == j || (a->target == NULL) != (b->target == NULL) || (a->target != NULL && strcmp(a->target, b->target) != 0))
+					continue;
+				if(a->exit_len > b->exit_len || (a->exit_len == b->exit_len && i > j)) //Keep the copy that needs no jump of its own
+					continue;
+
+				int len = common_suffix(prog, a, b);
+				int saving = lines_bytes(prog, machine, b->end - len + 1, b->end + b->exit_len) - jump_bytes;
+
+				if(len > 0 && saving > best_saving) {
+					keep = a;
+					drop = b;
+					best_len = len;
+					best_saving = saving;
+				}
+			}
+
+		if(keep == NULL) {
+			free(exits);
+			break;
+		}
+
+		Program out = {0};
+		int shared = keep->end - best_len + 1;
+		int tagged = shared > 0 && prog->lines[shared - 1].kind == ASM_TAG;
+		char tag[STR_LEN];
+
+		if(tagged) //Already has a tag, perhaps from an earlier merge
+			snprintf(tag, STR_LEN, "%s", prog->lines[shared - 1].arg);
+		else
+			snprintf(tag, STR_LEN, "tail_%s_%d", func, stats->merged);
+
+		for(int i = 0; i < prog->line_ct; i++) {
+			if(i == shared && !tagged)
+				program_append(&out, ASM_TAG, "", tag);
+
+			if(i == drop->end - best_len + 1) {
+				program_append(&out, ASM_INST, "pushi", tag);
+				program_append(&out, ASM_INST, "jpop", NULL);
+				i = drop->end + drop->exit_len;
+				continue;
+			}
+
+			program_copy_line(&out, &prog->lines[i]);
+		}
+
+		stats->merged++;
+		free(exits);
+		program_free(prog);
+		*prog = out;
+	}
+
+	stats->bytes = start_bytes - program_bytes(prog, machine);
+}
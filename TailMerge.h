@@ -0,0 +1,16 @@
+#ifndef TAIL_MERGE_H
+#define TAIL_MERGE_H
+
+#include "Program.h"
+
+/** @struct Tail_merge_stats
+ * What tail merging did to one function.
+ */
+typedef struct {
+	int merged; ///< Copies of code replaced by a jump to an identical copy.
+	int bytes; ///< Instruction memory saved.
+} Tail_merge_stats;
+
+void tail_merge_run(Program *prog, Machine *machine, char *func, Tail_merge_stats *stats);
+
+#endif
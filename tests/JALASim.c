@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Runs the assembly code written by the compiler, for the tests.
+ *
+ * JALASim <file.asm>     runs the program until it branches to -1 or runs off its end, then prints
+ *                        the value of each variable declared with .globl as "<name>=<value>".
+ *
+ * Besides the base instructions it runs the optional ones listed in jala.machine, so code compiled
+ * for any revision of the CPU can be checked.
+ */
+
+#define SIM_LINE_LEN 256 ///< Longest line of assembly read.
+#define SIM_MEMORY (1 << 16) ///< Cells of data memory.
+#define SIM_STACK 4096 ///< Entries of the operand stack and of the return stack.
+#define SIM_STEPS 50000000 ///< Instructions run before the program is taken to be stuck.
+
+/** @struct Sim_inst
+ * One instruction of the program, with its operand worked out.
+ */
+typedef struct {
+	char op[SIM_LINE_LEN]; ///< The mnemonic.
+	char arg[SIM_LINE_LEN]; ///< The operand as written, empty if there is none.
+	long value; ///< The operand: a constant, or the address of a tag or a variable.
+} Sim_inst;
+
+/** @struct Sim_name
+ * A tag or a variable and the address it stands for.
+ */
+typedef struct {
+	char name[SIM_LINE_LEN]; ///< The tag or variable.
+	int addr; ///< The instruction the tag is in front of, or the cell of the variable.
+} Sim_name;
+
+/** @struct Sim
+ * A program loaded into the simulator, and the state of the machine running it.
+ */
+typedef struct {
+	Sim_inst *code; ///< The instructions in order.
+	int code_ct; ///< Number of instructions.
+	Sim_name *tags; ///< The tags.
+	int tag_ct; ///< Number of tags.
+	Sim_name *cells; ///< The declared variables in order.
+	int cell_ct; ///< Number of declared variables.
+	long memory[SIM_MEMORY]; ///< Data memory.
+	long stack[SIM_STACK]; ///< The operand stack.
+	int sp; ///< Entries on the operand stack.
+	int returns[SIM_STACK]; ///< The return stack of jpush and jr.
+	int rp; ///< Entries on the return stack.
+} Sim;
+
+/**
+ * Adds a tag or a variable to a list of names.
+ */
+static void add_name(Sim_name **names, int *name_ct, char *name, int addr) {
+	*names = (Sim_name *)realloc(*names, (*name_ct + 1) * sizeof(Sim_name));
+	strcpy((*names)[*name_ct].name, name);
+	(*names)[(*name_ct)++].addr = addr;
+}
+
+/**
+ * Looks a name up in a list of names.
+ *
+ * @return Its address, or -1 if it is not there.
+ */
+static int find_name(Sim_name *names, int name_ct, char *name) {
+	for(int i = 0; i < name_ct; i++)
+		if(strcmp(names[i].name, name) == 0)
+			return names[i].addr;
+
+	return -1;
+}
+
+/**
+ * Loads a program: its instructions, its tags and its variables, then works out each operand.
+ */
+static void load(Sim *sim, FILE *file) {
+	char text[SIM_LINE_LEN];
+	char op[SIM_LINE_LEN];
+	char arg[SIM_LINE_LEN];
+
+	while(fgets(text, sizeof(text), file)) {
+		int words = sscanf(text, "%s %s", op, arg);
+
+		if(words < 1 || op[0] == '#') {
+			continue;
+		} else if(op[strlen(op) - 1] == ':') {
+			op[strlen(op) - 1] = '\0';
+			add_name(&sim->tags, &sim->tag_ct, op, sim->code_ct);
+		} else if(strcmp(op, ".globl") == 0 && words == 2) {
+			add_name(&sim->cells, &sim->cell_ct, arg, sim->cell_ct);
+		} else if(op[0] != '.') {
+			sim->code = (Sim_inst *)realloc(sim->code, (sim->code_ct + 1) * sizeof(Sim_inst));
+			strcpy(sim->code[sim->code_ct].op, op);
+			strcpy(sim->code[sim->code_ct++].arg, words == 2 ? arg : "");
+		}
+	}
+
+	for(int i = 0; i < sim->code_ct; i++) {
+		Sim_inst *inst = &sim->code[i];
+		char *end;
+
+		if(inst->arg[0] == '\0')
+			continue;
+		inst->value = strtol(inst->arg, &end, 10);
+		if(*end == '\0')
+			continue;
+		if((inst->value = find_name(sim->tags, sim->tag_ct, inst->arg)) < 0 && (inst->value = find_name(sim->cells, sim->cell_ct, inst->arg)) < 0) {
+			printf("ERROR: Unknown symbol %s\n", inst->arg);
+			exit(1);
+		}
+	}
+}
+
+/**
+ * Pushes a value onto the operand stack.
+ */
+static void push(Sim *sim, long value) {
+	if(sim->sp == SIM_STACK) {
+		printf("ERROR: Operand stack overflow\n");
+		exit(1);
+	}
+	sim->stack[sim->sp++] = value;
+}
+
+/**
+ * Takes a value off the operand stack.
+ */
+static long pop(Sim *sim) {
+	if(sim->sp == 0) {
+		printf("ERROR: Operand stack underflow\n");
+		exit(1);
+	}
+
+	return sim->stack[--sim->sp];
+}
+
+/**
+ * Returns a data memory address after checking it is in range.
+ */
+static long cell(long addr) {
+	if(addr < 0 || addr >= SIM_MEMORY) {
+		printf("ERROR: Data memory address %ld out of range\n", addr);
+		exit(1);
+	}
+
+	return addr;
+}
+
+/**
+ * Returns the entry n below the top of the operand stack after checking it exists.
+ */
+static long *entry(Sim *sim, long n) {
+	if(n < 0 || n >= sim->sp) {
+		printf("ERROR: Operand stack underflow\n");
+		exit(1);
+	}
+
+	return &sim->stack[sim->sp - 1 - n];
+}
+
+/**
+ * Runs the loaded program.
+ *
+ * @return 1 if it finished, 0 if it ran too long.
+ */
+static int run(Sim *sim) {
+	long steps = 0;
+
+	for(int pc = 0; pc >= 0 && pc < sim->code_ct; steps++) {
+		Sim_inst *inst = &sim->code[pc++];
+		long a, b;
+
+		if(steps == SIM_STEPS)
+			return 0;
+
+		if(strcmp(inst->op, "pushi") == 0) {
+			push(sim, inst->value);
+		} else if(strcmp(inst->op, "push") == 0) {
+			push(sim, sim->memory[cell(pop(sim))]);
+		} else if(strcmp(inst->op, "pop") == 0) {
+			a = cell(pop(sim));
+			sim->memory[a] = pop(sim);
+		} else if(strcmp(inst->op, "add") == 0 || strcmp(inst->op, "sub") == 0 || strcmp(inst->op, "slt") == 0) {
+			b = pop(sim);
+			a = pop(sim);
+			push(sim, inst->op[0] == 'a' ? a + b : inst->op[1] == 'u' ? a - b : a < b);
+		} else if(strcmp(inst->op, "addi") == 0) {
+			push(sim, pop(sim) + inst->value);
+		} else if(strcmp(inst->op, "beq") == 0 || strcmp(inst->op, "bne") == 0 || strcmp(inst->op, "blt") == 0 || strcmp(inst->op, "bge") == 0) {
+			if(strcmp(inst->arg, "-1") == 0) //The end of the program
+				break;
+			b = pop(sim);
+			a = pop(sim);
+			if(inst->op[1] == 'e' ? a == b : inst->op[1] == 'n' ? a != b : inst->op[1] == 'l' ? a < b : a >= b)
+				pc = inst->value;
+		} else if(strcmp(inst->op, "beqz") == 0 || strcmp(inst->op, "bnez") == 0) {
+			a = pop(sim);
+			if((a == 0) == (inst->op[1] == 'e'))
+				pc = inst->value;
+		} else if(strcmp(inst->op, "jpop") == 0) {
+			pc = pop(sim);
+		} else if(strcmp(inst->op, "jpush") == 0) {
+			if(sim->rp == SIM_STACK) {
+				printf("ERROR: Return stack overflow\n");
+				exit(1);
+			}
+			a = pop(sim);
+			sim->returns[sim->rp++] = pc;
+			pc = a;
+		} else if(strcmp(inst->op, "jr") == 0) {
+			if(sim->rp == 0) {
+				printf("ERROR: Return stack underflow\n");
+				exit(1);
+			}
+			pc = sim->returns[--sim->rp];
+		} else if(strcmp(inst->op, "dup") == 0 || strcmp(inst->op, "over") == 0 || strcmp(inst->op, "pick") == 0) {
+			push(sim, *entry(sim, inst->op[0] == 'd' ? 0 : inst->op[0] == 'o' ? 1 : inst->value));
+		} else if(strcmp(inst->op, "swap") == 0) {
+			a = *entry(sim, 0);
+			*entry(sim, 0) = *entry(sim, 1);
+			*entry(sim, 1) = a;
+		} else if(strcmp(inst->op, "drop") == 0) {
+			pop(sim);
+		} else if(strcmp(inst->op, "stick") == 0) {
+			a = pop(sim);
+			*entry(sim, inst->value) = a;
+		} else {
+			printf("ERROR: Unknown instruction %s\n", inst->op);
+			exit(1);
+		}
+	}
+
+	return 1;
+}
+
+int main(int argc, char **argv) {
+	Sim *sim = (Sim *)calloc(1, sizeof(Sim));
+	FILE *file;
+
+	if(argc != 2) {
+		printf("Usage: JALASim <file.asm>\n");
+		return 1;
+	}
+	if((file = fopen(argv[1], "r")) == NULL) {
+		printf("ERROR: Could not open %s\n", argv[1]);
+		return 1;
+	}
+
+	load(sim, file);
+	fclose(file);
+
+	if(!run(sim)) {
+		printf("ERROR: Still running after %d instructions\n", SIM_STEPS);
+		return 1;
+	}
+
+	for(int i = 0; i < sim->cell_ct; i++)
+		printf("%s=%ld\n", sim->cells[i].name, sim->memory[i]);
+
+	free(sim->code);
+	free(sim->tags);
+	free(sim->cells);
+	free(sim);
+
+	return 0;
+}
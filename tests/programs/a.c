@@ -0,0 +1,14 @@
+int add(int a, int b) {
+	int c = a + b;
+	return c;
+}
+
+void main() {
+	int x = 0;
+	int y = 0;
+	while(x < 10) {
+		y += x;
+		x += 1;
+	}
+	int z = add(x, y);
+}
@@ -0,0 +1,29 @@
+int pick(int v) {
+	int r = 0;
+	switch(v) {
+	case 1:
+		r = 5;
+		break;
+	case 2:
+		return 7;
+	default:
+		r = 9;
+	}
+	r = r + 1;
+	return r;
+}
+
+void main() {
+	int i = 0;
+	int s = 0;
+	while(i < 5) {
+		i = i + 1;
+		if(i == 3) {
+			break;
+		}
+		s = s + i;
+	}
+	int a = pick(1);
+	int b = pick(2);
+	int c = pick(3);
+}
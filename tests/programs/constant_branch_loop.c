@@ -0,0 +1,13 @@
+void main() {
+	int i = 0;
+	int s = 0;
+	int c = 1;
+	while(i < 5) {
+		if(c == 1) {
+			s += 2;
+		} else {
+			s += 3;
+		}
+		i += 1;
+	}
+}
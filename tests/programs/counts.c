@@ -0,0 +1,34 @@
+int f(int n) {
+	int s = 0;
+	int i = 0;
+	while(i < n) {
+		i = i + 1;
+		if(i == 3) {
+			if(n == 5) {
+				return s;
+			} else {
+				s = s + 100;
+			}
+		} else {
+			s = s + 1;
+		}
+	}
+	return s;
+}
+
+int g(int n) {
+	int i = 0;
+	while(i < n) {
+		i = i + 1;
+		return i;
+	}
+	return i;
+}
+
+void main() {
+	int a = f(5);
+	int b = f(8);
+	int c = f(2);
+	int d = g(3);
+	int e = g(0);
+}
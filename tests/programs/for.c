@@ -0,0 +1,46 @@
+int sq(int n) {
+	int r = 0;
+	for(int k = 0; k < n; k++) {
+		r += n;
+	}
+	return r;
+}
+
+void main() {
+	int a = 0;
+	int b = 0;
+	int c = 0;
+	int d = 0;
+	int e = 0;
+	int f = 0;
+	int i = 0;
+	for(i = 0; i < 4; i++) {
+		a += i;
+	}
+	for(int j = 10; j > 0; j -= 3) {
+		b += j;
+		if(j == 4) {
+			c = 1;
+		}
+	}
+	for(int m = 0; m < 40; m = m + 1) {
+		int t = m + 1;
+		d += t;
+		e += 2;
+		e -= 1;
+	}
+	for(int z = 5; z < 3; z++) {
+		f = 99;
+	}
+	for(int w = 0; w < 7; w++) {
+		if(w == 5) {
+			break;
+		}
+		f += 1;
+	}
+	int g = sq(5);
+	int h = 0;
+	for(int q = 0; 3 > q; q++) {
+		h += q;
+	}
+}
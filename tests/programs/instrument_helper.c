@@ -0,0 +1,16 @@
+int twice(int x) {
+	int y = x + x;
+	if(y > 10) {
+		y = 10;
+	}
+	return y;
+}
+
+void main() {
+	int i = 0;
+	int s = 0;
+	while(i < 10) {
+		s += twice(i);
+		i += 1;
+	}
+}
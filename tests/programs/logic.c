@@ -0,0 +1,44 @@
+int side(int v) {
+	int k = v;
+	return k;
+}
+
+int t(int a, int b) {
+	int r = 0;
+	if(a == 1 && b == 2) {
+		r = r + 1;
+	}
+	if(a == 1 || b == 2) {
+		r = r + 10;
+	}
+	if(!(a < b)) {
+		r = r + 100;
+	}
+	if((a > 0 && b > 0) || !(a != 5)) {
+		r = r + 1000;
+	}
+	if(a) {
+		r = r + 10000;
+	}
+	if(!b && (a - 2) >= 3) {
+		r = r + 100000;
+	}
+	return r;
+}
+
+void main() {
+	int p = t(1, 2);
+	int q = t(5, 0);
+	int s = t(0, 0);
+	int u = t(3, 7);
+	int i = 0;
+	int n = 0;
+	while(i < 10 && n != 4) {
+		n = n + 1;
+		i = i + 2;
+	}
+	int c = 0;
+	if(c == 1 && side(9) == 9) {
+		c = 5;
+	}
+}
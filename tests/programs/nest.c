@@ -0,0 +1,25 @@
+int f(int n) {
+	int s = 0;
+	int i = 0;
+	while(i != n) {
+		if(i == 3) {
+			s = s + 100;
+		}
+		s = s + 1;
+		i = i + 1;
+		if(i == 7) {
+			break;
+		}
+	}
+	if(s == 5) {
+		return 1;
+	} else {
+		return s;
+	}
+}
+
+void main() {
+	int a = f(5);
+	int b = f(10);
+	int c = f(2);
+}
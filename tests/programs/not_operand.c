@@ -0,0 +1,22 @@
+int t(int a, int b) {
+	int r = 0;
+	if(!a == 1) {
+		r = r + 1;
+	}
+	if(!a != b) {
+		r = r + 10;
+	}
+	if(!(a < b) == 0) {
+		r = r + 100;
+	}
+	if(!a + b > 1) {
+		r = r + 1000;
+	}
+	return r;
+}
+
+void main() {
+	int p = t(0, 0);
+	int q = t(5, 1);
+	int s = t(2, 7);
+}
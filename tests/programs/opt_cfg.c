@@ -0,0 +1,29 @@
+int twice(int n) {
+	return n + n;
+}
+
+void main() {
+	int debug = 0;
+	int level = 2;
+	int out = 0;
+	int k = twice(3);
+	if(debug == 1) {
+		out = 100;
+	} else {
+		out = 5;
+	}
+	if(level > 1) {
+		out += level;
+	}
+	int i = 0;
+	while(i < 3) {
+		if(debug != 0) {
+			out = out + 1000;
+		}
+		out += 1;
+		i += 1;
+	}
+	if(out == 10 && level == 2) {
+		k = k + 1;
+	}
+}
@@ -0,0 +1,12 @@
+void main() {
+	int a = 3;
+	int b = 4;
+	int c = 5;
+	int x = a + b + c;
+	int y = a + b + c;
+	int z = a + b + 1;
+	int w = a + b + 2;
+	a = 10;
+	int v = a + b + c;
+	int u = c + a + b;
+}
@@ -0,0 +1,31 @@
+int g(int n) {
+	int r = n + n;
+	return r;
+}
+
+int rec(int n) {
+	int s = 0;
+	if(n > 0) {
+		int k = n + 1;
+		s = rec(n - 1) + n + 1;
+		s = s + n + 1;
+	}
+	return s;
+}
+
+void main() {
+	int a = 3;
+	int b = 4;
+	int x = a + b;
+	int y = g(a + b) + a + b;
+	int z = a + b + y;
+	a += b;
+	int w = a + b;
+	int q = rec(4);
+	int i = 0;
+	while(i < 3) {
+		x = a + b + i;
+		z = a + b + i + 1;
+		i += 1;
+	}
+}
@@ -0,0 +1,16 @@
+int f(int a, int unused) {
+	int t = a + 1;
+	t = a + 2;
+	int u = f2(a);
+	return t;
+}
+int f2(int z) {
+	return z;
+}
+void main() {
+	int x = 1;
+	x = 2;
+	int y = f(x, 9);
+	y = f(y, x);
+	x = 5;
+}
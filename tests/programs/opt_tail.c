@@ -0,0 +1,24 @@
+int g(int a) {
+	int b = 0;
+	if(a < 3) {
+		b = a + 1;
+		return b + 5;
+	}
+	b = a + 2;
+	return b + 5;
+}
+void main() {
+	int x = 0;
+	int y = 0;
+	int z = 0;
+	if(x < 1) {
+		x = x + 7;
+		y = g(x);
+		z = y + x;
+	} else {
+		x = x + 9;
+		y = g(x);
+		z = y + x;
+	}
+	x = g(1);
+}
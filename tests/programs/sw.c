@@ -0,0 +1,65 @@
+int pick(int a) {
+	int r = 0;
+	switch(a) {
+	case 1:
+		r = 10;
+		break;
+	case 2:
+		r = 20;
+		break;
+	case 3:
+	case 4:
+		r = 34;
+		break;
+	case 5:
+		r = 50;
+		break;
+	case 6:
+		if(a == 6) {
+			r = 60;
+		}
+		r = r + 1;
+		break;
+	default:
+		r = 99;
+	}
+	return r;
+}
+
+int sparse(int a) {
+	int r = 0;
+	switch(a) {
+	case 100:
+		r = 1;
+		break;
+	case 7:
+		r = 2;
+		break;
+	case 50:
+		r = 3;
+		break;
+	case 3000:
+		r = 4;
+		break;
+	case 9:
+		r = 5;
+		break;
+	case 12:
+		r = 6;
+		break;
+	}
+	return r;
+}
+
+void main() {
+	int a = pick(1);
+	int b = pick(4);
+	int c = pick(6);
+	int d = pick(9);
+	int e = pick(0);
+	int f = sparse(3000);
+	int g = sparse(9);
+	int h = sparse(8);
+	int i = sparse(7);
+	int j = sparse(100);
+}
@@ -0,0 +1,115 @@
+int big(int a) {
+	int r = 0;
+	switch(a - 1) {
+	case 0:
+		r = 1;
+		break;
+	case 1:
+		r = 4;
+		break;
+	case 2:
+		r = 7;
+		break;
+	case 3:
+		r = 10;
+		break;
+	case 4:
+		r = 13;
+		break;
+	case 5:
+		r = 16;
+		break;
+	case 6:
+		r = 19;
+		break;
+	case 7:
+		r = 22;
+		break;
+	case 8:
+		r = 25;
+		break;
+	case 9:
+		r = 28;
+		break;
+	case 10:
+		r = 31;
+		break;
+	case 11:
+		r = 34;
+		break;
+	case 12:
+		r = 37;
+		break;
+	case 13:
+		r = 40;
+		break;
+	case 14:
+		r = 43;
+		break;
+	case 15:
+		r = 46;
+		break;
+	}
+	return r;
+}
+
+int tree(int a) {
+	int r = 0;
+	switch(a) {
+	case 1:
+		r = 2;
+		break;
+	case 5:
+		r = 6;
+		break;
+	case 9:
+		r = 10;
+		break;
+	case 30:
+		r = 31;
+		break;
+	case 44:
+		r = 45;
+		break;
+	case 51:
+		r = 52;
+		break;
+	case 60:
+		r = 61;
+		break;
+	case 77:
+		r = 78;
+		break;
+	case 91:
+		r = 92;
+		break;
+	case 105:
+		r = 106;
+		break;
+	case 300:
+		r = 301;
+		break;
+	case 1000:
+		r = 1001;
+		break;
+	default:
+		r = 7;
+	}
+	return r;
+}
+
+void main() {
+	int b0 = big(1);
+	int b1 = big(2);
+	int b2 = big(10);
+	int b3 = big(16);
+	int b4 = big(17);
+	int b5 = big(0);
+	int t0 = tree(1);
+	int t1 = tree(1000);
+	int t2 = tree(60);
+	int t3 = tree(61);
+	int t4 = tree(0);
+	int t5 = tree(91);
+	int t6 = tree(2000);
+}
@@ -0,0 +1,51 @@
+void main() {
+	int c = 1;
+	int r6 = 0;
+	int r8 = 0;
+	int r9 = 0;
+	int v = 6;
+
+	switch(v) {
+		case 6:
+			if(c == 1) {
+				r6 = r6 + 1;
+			} else {
+				r6 = r6 + 5;
+			}
+		case 8:
+			r6 = r6 + 2;
+			break;
+		default:
+			r6 = r6 + 7;
+	}
+
+	v = 8;
+	switch(v) {
+		case 6:
+			if(c == 1) {
+				r8 = r8 + 1;
+			} else {
+				r8 = r8 + 5;
+			}
+		case 8:
+			r8 = r8 + 2;
+			break;
+		default:
+			r8 = r8 + 7;
+	}
+
+	v = 9;
+	switch(v) {
+		case 6:
+			if(c == 1) {
+				r9 = r9 + 1;
+			} else {
+				r9 = r9 + 5;
+			}
+		case 8:
+			r9 = r9 + 2;
+			break;
+		default:
+			r9 = r9 + 7;
+	}
+}
@@ -0,0 +1,77 @@
+#!/bin/sh
+# Compiles each program in tests/programs with each set of options, on the base machine and on one
+# with every optional instruction of jala.machine, and runs it on JALASim. With -O0 the variables
+# listed in the program's .expect file must have the values given there, and with every other set of
+# options the variables of main and the counters of --instrument must come out as they did with -O0.
+# Each program is also compiled with --instrument-all, and the count derived for each block must
+# match its own counter.
+
+cd "$(dirname "$0")"
+compiler=../JALACompiler
+sim=./JALASim
+work=$(mktemp -d)
+failed=0
+
+sed 's/^#inst/inst/' ../jala.machine > "$work/full.machine"
+
+# Checks the count derived for each block against the counter --instrument-all gave it.
+check_derived() {
+	name=$1
+	shift
+	if ! $compiler "$@" --instrument-all "$work/$name.c" > "$work/log" 2>&1; then
+		echo "FAIL $name $*: did not compile with --instrument-all"
+		failed=1
+		return
+	fi
+	eval "$($sim "$work/$name.c.asm" | grep '^count_')"
+
+	while read -r kind func line block count check; do
+		if [ "$kind" = derived ] && [ $(($count)) -ne $(($check)) ]; then
+			echo "FAIL $name $*: $block of $func line $line is $count = $(($count)), but $check = $(($check))"
+			failed=1
+		fi
+	done < "$work/$name.c.counts"
+}
+
+for program in programs/*.c; do
+	name=$(basename "$program" .c)
+
+	for machine in "" "--machine $work/full.machine"; do
+		for options in "-O0" "" "-Os" "--ssa" "--frames" "--frames -Os --ssa"; do
+			cp "$program" "$work/$name.c"
+			if ! $compiler $options $machine --instrument "$work/$name.c" > "$work/log" 2>&1; then
+				echo "FAIL $name $options $machine: did not compile"
+				failed=1
+				continue
+			fi
+			$sim "$work/$name.c.asm" | grep -E '^(main_|count_)' | sort > "$work/$name.out"
+
+			if [ "$options" = "-O0" ]; then
+				cp "$work/$name.out" "$work/$name.base"
+				if grep -v '^#' "programs/$name.expect" | grep -qvxF -f "$work/$name.out"; then
+					echo "FAIL $name $options $machine: expected"
+					grep -v '^#' "programs/$name.expect"
+					echo "got"
+					cat "$work/$name.out"
+					failed=1
+				fi
+			elif ! diff "$work/$name.base" "$work/$name.out" > "$work/diff"; then
+				echo "FAIL $name $options $machine: differs from -O0"
+				cat "$work/diff"
+				failed=1
+			fi
+
+			if [ -z "$machine" ]; then
+				check_derived "$name" $options
+			fi
+		done
+	done
+done
+
+rm -r "$work"
+
+if [ $failed -eq 0 ]; then
+	echo "All tests passed"
+fi
+
+exit $failed